@@ -80,12 +80,12 @@ void BanMapFromJson(const UniValue& bans_json, banmap_t& bans)
 template <typename Stream, typename Data>
 bool SerializeDB(Stream& stream, const Data& data)
 {
-    // Write and commit header, data
+    // Serialize header and data once, into memory, then checksum them and write them out in one go
     try {
-        CHashWriter hasher(stream.GetType(), stream.GetVersion());
-        stream << Params().MessageStart() << data;
-        hasher << Params().MessageStart() << data;
-        stream << hasher.GetHash();
+        CDataStream ss(stream.GetType(), stream.GetVersion());
+        ss << Params().MessageStart() << data;
+        ss << Hash(ss);
+        stream.write((const char*)ss.data(), ss.size());
     } catch (const std::exception& e) {
         return error("%s: Serialize or I/O error - %s", __func__, e.what());
     }
@@ -174,7 +174,16 @@ bool DeserializeFileDB(const fs::path& path, Data& data, int version)
         LogPrintf("Missing or invalid file %s\n", path.string());
         return false;
     }
-    return DeserializeDB(filein, data);
+    // Read the whole file with a single read, and deserialize from memory
+    CDataStream ss(SER_DISK, version);
+    try {
+        ss.resize(fs::file_size(path));
+        filein.read((char*)ss.data(), ss.size());
+    } catch (const std::exception& e) {
+        return error("%s: I/O error - %s", __func__, e.what());
+    }
+    filein.fclose();
+    return DeserializeDB(ss, data);
 }
 } // namespace
 
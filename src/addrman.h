@@ -54,7 +54,7 @@ private:
     //! in tried set? (memory only)
     bool fInTried{false};
 
-    //! position in vRandom
+    //! position in vRandom, -1 if this is an unused slot of the table
     int nRandomPos{-1};
 
     friend class CAddrMan;
@@ -220,7 +220,7 @@ public:
      * as incompatible. This is necessary because it did not check the version number on
      * deserialization.
      *
-     * vvNew, vvTried, mapInfo, mapAddr and vRandom are never encoded explicitly;
+     * vvNew, vvTried, vInfo, mapAddr and vRandom are never encoded explicitly;
      * they are instead reconstructed from the other information.
      *
      * This format is more complex, but significantly smaller (at most 1.5 MiB), and supports
@@ -252,20 +252,20 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::unordered_map<int, int> mapUnkIds;
+        // Index of each new entry in the serialized "all new addresses", by nId.
+        std::vector<int> vUnkIds(vInfo.size(), -1);
         int nIds = 0;
-        for (const auto& entry : mapInfo) {
-            mapUnkIds[entry.first] = nIds;
-            const CAddrInfo &info = entry.second;
+        for (size_t nId = 0; nId < vInfo.size(); ++nId) {
+            const CAddrInfo &info = vInfo[nId];
             if (info.nRefCount) {
                 assert(nIds != nNew); // this means nNew was wrong, oh ow
+                vUnkIds[nId] = nIds;
                 s << info;
                 nIds++;
             }
         }
         nIds = 0;
-        for (const auto& entry : mapInfo) {
-            const CAddrInfo &info = entry.second;
+        for (const CAddrInfo& info : vInfo) {
             if (info.fInTried) {
                 assert(nIds != nTried); // this means nTried was wrong, oh ow
                 s << info;
@@ -281,7 +281,7 @@ public:
             s << nSize;
             for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
                 if (vvNew[bucket][i] != -1) {
-                    int nIndex = mapUnkIds[vvNew[bucket][i]];
+                    int nIndex = vUnkIds[vvNew[bucket][i]];
                     s << nIndex;
                 }
             }
@@ -301,7 +301,9 @@ public:
     {
         LOCK(cs);
 
-        assert(vRandom.empty());
+        // Entries are read back with their position in the file as nId, which only lines up with an
+        // empty table (see Clear()).
+        assert(vRandom.empty() && vInfo.empty() && vFreeIds.empty());
 
         Format format;
         s_ >> Using<CustomUintFormatter<1>>(format);
@@ -348,32 +350,36 @@ public:
                           ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE));
         }
 
+        // Size the tables for all entries at once, entries are then read straight into place.
+        vInfo.reserve(nNew + nTried);
+        vRandom.reserve(nNew + nTried);
+        mapAddr.reserve(nNew + nTried);
+
         // Deserialize entries from the new table.
         for (int n = 0; n < nNew; n++) {
-            CAddrInfo &info = mapInfo[n];
+            CAddrInfo& info = vInfo.emplace_back();
             s >> info;
             mapAddr[info] = n;
             info.nRandomPos = vRandom.size();
             vRandom.push_back(n);
         }
-        nIdCount = nNew;
 
         // Deserialize entries from the tried table.
         int nLost = 0;
         for (int n = 0; n < nTried; n++) {
-            CAddrInfo info;
+            CAddrInfo& info = vInfo.emplace_back();
             s >> info;
             int nKBucket = info.GetTriedBucket(nKey, m_asmap);
             int nKBucketPos = info.GetBucketPosition(nKey, false, nKBucket);
             if (vvTried[nKBucket][nKBucketPos] == -1) {
+                const int nId = vInfo.size() - 1;
                 info.nRandomPos = vRandom.size();
                 info.fInTried = true;
-                vRandom.push_back(nIdCount);
-                mapInfo[nIdCount] = info;
-                mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
-                nIdCount++;
+                vRandom.push_back(nId);
+                mapAddr[info] = nId;
+                vvTried[nKBucket][nKBucketPos] = nId;
             } else {
+                vInfo.pop_back();
                 nLost++;
             }
         }
@@ -417,7 +423,7 @@ public:
         for (auto bucket_entry : bucket_entries) {
             int bucket{bucket_entry.first};
             const int entry_index{bucket_entry.second};
-            CAddrInfo& info = mapInfo[entry_index];
+            CAddrInfo& info = vInfo[entry_index];
 
             // The entry shouldn't appear in more than
             // ADDRMAN_NEW_BUCKETS_PER_ADDRESS. If it has already, just skip
@@ -443,13 +449,11 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (auto it = mapInfo.cbegin(); it != mapInfo.cend(); ) {
-            if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                const auto itCopy = it++;
-                Delete(itCopy->first);
+        const int nNewRead{nNew};
+        for (int nId = 0; nId < nNewRead; ++nId) {
+            if (vInfo[nId].nRefCount == 0) {
+                Delete(nId);
                 ++nLostUnk;
-            } else {
-                ++it;
             }
         }
         if (nLost + nLostUnk > 0) {
@@ -478,12 +482,13 @@ public:
             }
         }
 
-        nIdCount = 0;
         nTried = 0;
         nNew = 0;
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
-        mapInfo.clear();
+        vInfo.clear();
+        vFreeIds.clear();
         mapAddr.clear();
+        m_tried_collisions.clear();
     }
 
     CAddrMan()
@@ -659,11 +664,11 @@ private:
     //! @note Don't increment this. Increment `lowest_compatible` in `Serialize()` instead.
     static constexpr uint8_t INCOMPATIBILITY_BASE = 32;
 
-    //! last used nId
-    int nIdCount GUARDED_BY(cs);
+    //! table with information about all nIds, indexed by nId
+    std::vector<CAddrInfo> vInfo GUARDED_BY(cs);
 
-    //! table with information about all nIds
-    std::unordered_map<int, CAddrInfo> mapInfo GUARDED_BY(cs);
+    //! nIds of the unused slots of vInfo, reused before vInfo grows
+    std::vector<int> vFreeIds GUARDED_BY(cs);
 
     //! find an nId based on its network address
     std::unordered_map<CNetAddr, int, CNetAddrHash> mapAddr GUARDED_BY(cs);
@@ -705,6 +710,9 @@ private:
     //! Delete an entry. It must not be in tried, and have refcount 0.
     void Delete(int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    //! Remove an entry from vRandom and mapAddr, and free its slot in vInfo.
+    void Erase(int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     //! Clear a position in a "new" table. This is the only place where entries are actually deleted.
     void ClearNew(int nUBucket, int nUBucketPos) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -4,7 +4,9 @@
 
 #include <addrman.h>
 #include <bench/bench.h>
+#include <clientversion.h>
 #include <random.h>
+#include <streams.h>
 #include <util/time.h>
 
 #include <optional>
@@ -14,17 +16,19 @@
 
 static constexpr size_t NUM_SOURCES = 64;
 static constexpr size_t NUM_ADDRESSES_PER_SOURCE = 256;
+/* Enough sources for about 100k addresses, more than the tables can hold. */
+static constexpr size_t NUM_SOURCES_LARGE = 400;
 
 static std::vector<CAddress> g_sources;
 static std::vector<std::vector<CAddress>> g_addresses;
 
-static void CreateAddresses()
+static void CreateAddresses(size_t num_sources = NUM_SOURCES)
 {
-    if (g_sources.size() > 0) { // already created
+    if (g_sources.size() >= num_sources) { // already created
         return;
     }
 
-    FastRandomContext rng(uint256(std::vector<unsigned char>(32, 123)));
+    FastRandomContext rng(uint256(std::vector<unsigned char>(32, static_cast<unsigned char>(123 + g_sources.size()))));
 
     auto randAddr = [&rng]() {
         in6_addr addr;
@@ -43,7 +47,7 @@ static void CreateAddresses()
         return ret;
     };
 
-    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+    for (size_t source_i = g_sources.size(); source_i < num_sources; ++source_i) {
         g_sources.emplace_back(randAddr());
         g_addresses.emplace_back();
         for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; ++addr_i) {
@@ -52,9 +56,9 @@ static void CreateAddresses()
     }
 }
 
-static void AddAddressesToAddrMan(CAddrMan& addrman)
+static void AddAddressesToAddrMan(CAddrMan& addrman, size_t num_sources = NUM_SOURCES)
 {
-    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+    for (size_t source_i = 0; source_i < num_sources; ++source_i) {
         addrman.Add(g_addresses[source_i], g_sources[source_i]);
     }
 }
@@ -66,6 +70,19 @@ static void FillAddrMan(CAddrMan& addrman)
     AddAddressesToAddrMan(addrman);
 }
 
+/* Fill both tables, the way a long running node's are. */
+static void FillAddrManLarge(CAddrMan& addrman)
+{
+    CreateAddresses(NUM_SOURCES_LARGE);
+
+    AddAddressesToAddrMan(addrman, NUM_SOURCES_LARGE);
+    for (size_t source_i = 0; source_i < NUM_SOURCES_LARGE; ++source_i) {
+        for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; addr_i += 8) {
+            addrman.Good(g_addresses[source_i][addr_i]);
+        }
+    }
+}
+
 /* Benchmarks */
 
 static void AddrManAdd(benchmark::Bench& bench)
@@ -92,6 +109,61 @@ static void AddrManSelect(benchmark::Bench& bench)
     });
 }
 
+static void AddrManAddLarge(benchmark::Bench& bench)
+{
+    CreateAddresses(NUM_SOURCES_LARGE);
+
+    CAddrMan addrman;
+
+    bench.batch(NUM_SOURCES_LARGE * NUM_ADDRESSES_PER_SOURCE).unit("address").run([&] {
+        AddAddressesToAddrMan(addrman, NUM_SOURCES_LARGE);
+        addrman.Clear();
+    });
+}
+
+static void AddrManSelectLarge(benchmark::Bench& bench)
+{
+    CAddrMan addrman;
+
+    FillAddrManLarge(addrman);
+
+    bench.run([&] {
+        const auto& address = addrman.Select();
+        assert(address.GetPort() > 0);
+    });
+}
+
+/* Loading peers.dat at startup, without the disk access. */
+static void AddrManDeserializeLarge(benchmark::Bench& bench)
+{
+    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    {
+        CAddrMan addrman;
+        FillAddrManLarge(addrman);
+        ssPeers << addrman;
+    }
+
+    bench.run([&] {
+        CDataStream ss{ssPeers};
+        CAddrMan addrman;
+        ss >> addrman;
+        assert(addrman.size() > 0);
+    });
+}
+
+static void AddrManSerializeLarge(benchmark::Bench& bench)
+{
+    CAddrMan addrman;
+
+    FillAddrManLarge(addrman);
+
+    bench.run([&] {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << addrman;
+        assert(!ss.empty());
+    });
+}
+
 static void AddrManGetAddr(benchmark::Bench& bench)
 {
     CAddrMan addrman;
@@ -136,6 +208,10 @@ static void AddrManGood(benchmark::Bench& bench)
 }
 
 BENCHMARK(AddrManAdd);
+BENCHMARK(AddrManAddLarge);
 BENCHMARK(AddrManSelect);
+BENCHMARK(AddrManSelectLarge);
+BENCHMARK(AddrManDeserializeLarge);
+BENCHMARK(AddrManSerializeLarge);
 BENCHMARK(AddrManGetAddr);
 BENCHMARK(AddrManGood);
@@ -4,7 +4,11 @@
 
 #include <bench/bench.h>
 
+#include <crypto/chacha20.h>
+#include <crypto/muhash.h>
+#include <crypto/poly1305.h>
 #include <crypto/sha256.h>
+#include <crypto/siphash.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 
@@ -41,6 +45,10 @@ int main(int argc, char** argv)
     ArgsManager argsman;
     SetupBenchArgs(argsman);
     SHA256AutoDetect();
+    MuHash3072AutoDetect();
+    SipHashAutoDetect();
+    ChaCha20AutoDetect();
+    Poly1305AutoDetect();
     std::string error;
     if (!argsman.ParseParameters(argc, argv, error)) {
         tfm::format(std::cerr, "Error parsing command line arguments: %s\n", error);
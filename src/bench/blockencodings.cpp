@@ -0,0 +1,65 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <chainparams.h>
+#include <random.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+
+#include <cassert>
+#include <vector>
+
+static void AddTx(const CTransactionRef& tx, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    LockPoints lp;
+    pool.addUnchecked(CTxMemPoolEntry(tx, 1000, 0, /* time */ 0, /* entry_height */ 1, /* spends_coinbase */ false, /* sigops_cost */ 4, lp));
+}
+
+/** Reconstruct a compact block of num_block_txs transactions out of a mempool of num_mempool_txs. */
+static void BlockEncodingsInitData(benchmark::Bench& bench, size_t num_mempool_txs, size_t num_block_txs)
+{
+    const auto testing_setup = MakeNoLogFileContext<const BasicTestingSetup>();
+    FastRandomContext det_rand{true};
+    CTxMemPool pool;
+    CBlock block;
+    block.nBits = Params().GenesisBlock().nBits;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    LOCK2(cs_main, pool.cs);
+    for (size_t i = 0; i < num_mempool_txs; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint{det_rand.rand256(), 0};
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 42;
+        const CTransactionRef tx_ref{MakeTransactionRef(tx)};
+        AddTx(tx_ref, pool);
+        // The block is made of transactions spread over the whole mempool.
+        if (i % (num_mempool_txs / num_block_txs) == 0 && block.vtx.size() <= num_block_txs) {
+            block.vtx.push_back(tx_ref);
+        }
+    }
+    const CBlockHeaderAndShortTxIDs cmpctblock{block, /* fUseWTXID */ true};
+    const std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+
+    bench.unit("block").run([&] {
+        PartiallyDownloadedBlock partial_block{&pool};
+        const ReadStatus status{partial_block.InitData(cmpctblock, extra_txn)};
+        assert(status == READ_STATUS_OK);
+        for (size_t i = 0; i < block.vtx.size(); ++i) {
+            assert(partial_block.IsTxAvailable(i));
+        }
+    });
+}
+
+static void BlockEncodingsInitDataSmallMempool(benchmark::Bench& bench) { BlockEncodingsInitData(bench, 5000, 2500); }
+static void BlockEncodingsInitDataLargeMempool(benchmark::Bench& bench) { BlockEncodingsInitData(bench, 100000, 2500); }
+
+BENCHMARK(BlockEncodingsInitDataSmallMempool);
+BENCHMARK(BlockEncodingsInitDataLargeMempool);
@@ -11,8 +11,9 @@ static const uint64_t BUFFER_SIZE_TINY  = 64;
 static const uint64_t BUFFER_SIZE_SMALL = 256;
 static const uint64_t BUFFER_SIZE_LARGE = 1024*1024;
 
-static void CHACHA20(benchmark::Bench& bench, size_t buffersize)
+static void CHACHA20(benchmark::Bench& bench, size_t buffersize, bool use_optimized = true)
 {
+    ChaCha20AutoDetect(use_optimized);
     std::vector<uint8_t> key(32,0);
     ChaCha20 ctx(key.data(), key.size());
     ctx.SetIV(0);
@@ -22,6 +23,7 @@ static void CHACHA20(benchmark::Bench& bench, size_t buffersize)
     bench.batch(in.size()).unit("byte").run([&] {
         ctx.Crypt(in.data(), out.data(), in.size());
     });
+    ChaCha20AutoDetect();
 }
 
 static void CHACHA20_64BYTES(benchmark::Bench& bench)
@@ -39,6 +41,12 @@ static void CHACHA20_1MB(benchmark::Bench& bench)
     CHACHA20(bench, BUFFER_SIZE_LARGE);
 }
 
+static void CHACHA20_1MB_GENERIC(benchmark::Bench& bench)
+{
+    CHACHA20(bench, BUFFER_SIZE_LARGE, /* use_optimized */ false);
+}
+
 BENCHMARK(CHACHA20_64BYTES);
 BENCHMARK(CHACHA20_256BYTES);
 BENCHMARK(CHACHA20_1MB);
+BENCHMARK(CHACHA20_1MB_GENERIC);
@@ -90,6 +90,24 @@ static void SipHash_32b(benchmark::Bench& bench)
     });
 }
 
+static void SipHash_32b_LanesCommon(benchmark::Bench& bench, bool use_optimized)
+{
+    SipHashAutoDetect(use_optimized);
+    uint256 x[SIPHASH_LANES];
+    const uint256* vals[SIPHASH_LANES];
+    for (size_t lane = 0; lane < SIPHASH_LANES; ++lane) vals[lane] = &x[lane];
+    uint64_t out[SIPHASH_LANES];
+    uint64_t k1 = 0;
+    bench.batch(SIPHASH_LANES).unit("hash").run([&] {
+        SipHashUint256Lanes(0, ++k1, vals, out);
+        for (size_t lane = 0; lane < SIPHASH_LANES; ++lane) *((uint64_t*)x[lane].begin()) = out[lane];
+    });
+    SipHashAutoDetect();
+}
+
+static void SipHash_32b_Lanes(benchmark::Bench& bench) { SipHash_32b_LanesCommon(bench, true); }
+static void SipHash_32b_LanesGeneric(benchmark::Bench& bench) { SipHash_32b_LanesCommon(bench, false); }
+
 static void FastRandom_32bit(benchmark::Bench& bench)
 {
     FastRandomContext rng(true);
@@ -128,6 +146,19 @@ static void MuHashMul(benchmark::Bench& bench)
     });
 }
 
+static void MuHashMulGeneric(benchmark::Bench& bench)
+{
+    MuHash3072 acc;
+    FastRandomContext rng(true);
+    MuHash3072 muhash{rng.randbytes(32)};
+
+    MuHash3072AutoDetect(false);
+    bench.run([&] {
+        acc *= muhash;
+    });
+    MuHash3072AutoDetect();
+}
+
 static void MuHashDiv(benchmark::Bench& bench)
 {
     MuHash3072 acc;
@@ -143,6 +174,18 @@ static void MuHashDiv(benchmark::Bench& bench)
     });
 }
 
+static void MuHashFinalize(benchmark::Bench& bench)
+{
+    FastRandomContext rng(true);
+    MuHash3072 acc{rng.randbytes(32)};
+    acc /= MuHash3072{rng.randbytes(32)};
+    uint256 out;
+
+    bench.run([&] {
+        acc.Finalize(out);
+    });
+}
+
 static void MuHashPrecompute(benchmark::Bench& bench)
 {
     MuHash3072 acc;
@@ -162,11 +205,15 @@ BENCHMARK(SHA3_256_1M);
 
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
+BENCHMARK(SipHash_32b_Lanes);
+BENCHMARK(SipHash_32b_LanesGeneric);
 BENCHMARK(SHA256D64_1024);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
 
 BENCHMARK(MuHash);
 BENCHMARK(MuHashMul);
+BENCHMARK(MuHashMulGeneric);
 BENCHMARK(MuHashDiv);
+BENCHMARK(MuHashFinalize);
 BENCHMARK(MuHashPrecompute);
@@ -24,7 +24,7 @@ static void AddTx(const CTransactionRef& tx, const CAmount& nFee, CTxMemPool& po
 // Right now this is only testing eviction performance in an extremely small
 // mempool. Code needs to be written to generate a much wider variety of
 // unique transactions for a more meaningful performance measurement.
-static void MempoolEviction(benchmark::Bench& bench)
+static void RunMempoolEviction(benchmark::Bench& bench, bool use_clusters)
 {
     const auto testing_setup = MakeNoLogFileContext<const TestingSetup>();
 
@@ -109,7 +109,7 @@ static void MempoolEviction(benchmark::Bench& bench)
     tx7.vout[1].scriptPubKey = CScript() << OP_7 << OP_EQUAL;
     tx7.vout[1].nValue = 10 * COIN;
 
-    CTxMemPool pool;
+    CTxMemPool pool(nullptr, 0, use_clusters);
     LOCK2(cs_main, pool.cs);
     // Create transaction references outside the "hot loop"
     const CTransactionRef tx1_r{MakeTransactionRef(tx1)};
@@ -133,4 +133,15 @@ static void MempoolEviction(benchmark::Bench& bench)
     });
 }
 
+static void MempoolEviction(benchmark::Bench& bench)
+{
+    RunMempoolEviction(bench, /* use_clusters */ false);
+}
+
+static void MempoolEvictionClusters(benchmark::Bench& bench)
+{
+    RunMempoolEviction(bench, /* use_clusters */ true);
+}
+
 BENCHMARK(MempoolEviction);
+BENCHMARK(MempoolEvictionClusters);
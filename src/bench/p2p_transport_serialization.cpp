@@ -0,0 +1,121 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/data.h>
+
+#include <chainparams.h>
+#include <net.h>
+#include <netmessagemaker.h>
+#include <protocol.h>
+#include <random.h>
+#include <span.h>
+#include <version.h>
+
+#include <cassert>
+#include <memory>
+#include <optional>
+#include <vector>
+
+/** Keys of a v2 transport connection. They would be set up by the key exchange. */
+static V2CipherKeys BenchV2Keys()
+{
+    V2CipherKeys keys;
+    keys.k1.fill(1);
+    keys.k2.fill(2);
+    return keys;
+}
+
+/** Serialize messages as they would be sent on the wire, one after the other. */
+static std::vector<uint8_t> SerializeMessages(TransportSerializer& serializer, std::vector<CSerializedNetMsg>&& msgs)
+{
+    std::vector<uint8_t> wire;
+    for (CSerializedNetMsg& msg : msgs) {
+        std::vector<unsigned char> header;
+        serializer.prepareForTransport(msg, header);
+        wire.insert(wire.end(), header.begin(), header.end());
+        wire.insert(wire.end(), msg.data.begin(), msg.data.end());
+    }
+    return wire;
+}
+
+/** Deserialize a stream of messages, handed over in chunks the size of the socket receive buffer. */
+static void DeserializeMessages(benchmark::Bench& bench, const std::vector<uint8_t>& wire, size_t num_msgs, bool v2)
+{
+    std::unique_ptr<TransportDeserializer> deserializer;
+    bench.unit("message").batch(num_msgs).run([&] {
+        // The v2 sequence numbers start over with the wire data.
+        if (v2) {
+            deserializer = std::make_unique<V2TransportDeserializer>(BenchV2Keys(), /* node_id */ 0, SER_NETWORK, INIT_PROTO_VERSION);
+        } else {
+            deserializer = std::make_unique<V1TransportDeserializer>(Params(), /* node_id */ 0, SER_NETWORK, INIT_PROTO_VERSION);
+        }
+        size_t received{0};
+        for (size_t pos = 0; pos < wire.size(); pos += 0x10000) {
+            Span<const uint8_t> chunk{Span<const uint8_t>{wire}.subspan(pos, std::min<size_t>(0x10000, wire.size() - pos))};
+            while (!chunk.empty()) {
+                const int handled{deserializer->Read(chunk)};
+                assert(handled >= 0);
+                if (deserializer->Complete()) {
+                    uint32_t out_err_raw_size{0};
+                    std::optional<CNetMessage> msg{deserializer->GetMessage(std::chrono::microseconds{0}, out_err_raw_size)};
+                    assert(msg);
+                    ++received;
+                }
+            }
+        }
+        assert(received == num_msgs);
+    });
+}
+
+static void DeserializeInv(benchmark::Bench& bench, TransportSerializer& serializer, bool v2)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const CNetMsgMaker msg_maker{INIT_PROTO_VERSION};
+    std::vector<CSerializedNetMsg> msgs;
+    for (int i = 0; i < 1000; ++i) {
+        msgs.push_back(msg_maker.Make(NetMsgType::INV, std::vector<CInv>{CInv{MSG_WTX, GetRandHash()}}));
+    }
+    DeserializeMessages(bench, SerializeMessages(serializer, std::move(msgs)), 1000, v2);
+}
+
+static void DeserializeBlock(benchmark::Bench& bench, TransportSerializer& serializer, bool v2)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const CNetMsgMaker msg_maker{INIT_PROTO_VERSION};
+    std::vector<CSerializedNetMsg> msgs;
+    for (int i = 0; i < 4; ++i) {
+        msgs.push_back(msg_maker.Make(NetMsgType::BLOCK, Span<const uint8_t>{benchmark::data::block413567}));
+    }
+    DeserializeMessages(bench, SerializeMessages(serializer, std::move(msgs)), 4, v2);
+}
+
+static void P2PTransportDeserializeInv(benchmark::Bench& bench)
+{
+    V1TransportSerializer serializer;
+    DeserializeInv(bench, serializer, /* v2 */ false);
+}
+
+static void P2PTransportDeserializeBlock(benchmark::Bench& bench)
+{
+    V1TransportSerializer serializer;
+    DeserializeBlock(bench, serializer, /* v2 */ false);
+}
+
+static void P2PTransportDeserializeInvV2(benchmark::Bench& bench)
+{
+    V2TransportSerializer serializer{BenchV2Keys()};
+    DeserializeInv(bench, serializer, /* v2 */ true);
+}
+
+static void P2PTransportDeserializeBlockV2(benchmark::Bench& bench)
+{
+    V2TransportSerializer serializer{BenchV2Keys()};
+    DeserializeBlock(bench, serializer, /* v2 */ true);
+}
+
+BENCHMARK(P2PTransportDeserializeInv);
+BENCHMARK(P2PTransportDeserializeBlock);
+BENCHMARK(P2PTransportDeserializeInvV2);
+BENCHMARK(P2PTransportDeserializeBlockV2);
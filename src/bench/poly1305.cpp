@@ -11,14 +11,16 @@ static constexpr uint64_t BUFFER_SIZE_TINY  = 64;
 static constexpr uint64_t BUFFER_SIZE_SMALL = 256;
 static constexpr uint64_t BUFFER_SIZE_LARGE = 1024*1024;
 
-static void POLY1305(benchmark::Bench& bench, size_t buffersize)
+static void POLY1305(benchmark::Bench& bench, size_t buffersize, bool use_optimized = true)
 {
+    Poly1305AutoDetect(use_optimized);
     std::vector<unsigned char> tag(POLY1305_TAGLEN, 0);
     std::vector<unsigned char> key(POLY1305_KEYLEN, 0);
     std::vector<unsigned char> in(buffersize, 0);
     bench.batch(in.size()).unit("byte").run([&] {
         poly1305_auth(tag.data(), in.data(), in.size(), key.data());
     });
+    Poly1305AutoDetect();
 }
 
 static void POLY1305_64BYTES(benchmark::Bench& bench)
@@ -36,6 +38,12 @@ static void POLY1305_1MB(benchmark::Bench& bench)
     POLY1305(bench, BUFFER_SIZE_LARGE);
 }
 
+static void POLY1305_1MB_GENERIC(benchmark::Bench& bench)
+{
+    POLY1305(bench, BUFFER_SIZE_LARGE, /* use_optimized */ false);
+}
+
 BENCHMARK(POLY1305_64BYTES);
 BENCHMARK(POLY1305_256BYTES);
 BENCHMARK(POLY1305_1MB);
+BENCHMARK(POLY1305_1MB_GENERIC);
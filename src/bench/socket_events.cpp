@@ -0,0 +1,58 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <net.h>
+#include <test/util/net.h>
+#include <test/util/setup_common.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <cassert>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+
+/** One iteration of the socket handler's wait with many idle peers, of which a single one has data to receive. */
+static void SocketEventsCommon(benchmark::Bench& bench, const std::string& mode_name, int num_peers)
+{
+    const auto mode = SocketEventsModeFromString(mode_name);
+    if (!mode) return; // not supported by this build
+    const auto testing_setup = MakeNoLogFileContext<const BasicTestingSetup>();
+    // Every peer uses a socket pair.
+    num_peers = std::min(num_peers, (RaiseFileDescriptorLimit(2 * num_peers + 100) - 100) / 2);
+
+    CAddrMan addrman;
+    ConnmanTestMsg connman{0x1337, 0x1337, addrman};
+    assert(connman.SetSocketEventsMode(*mode));
+    std::vector<int> remote_ends;
+    for (int i = 0; i < num_peers; ++i) {
+        int fds[2];
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        connman.AddTestNode(*new CNode(i, NODE_NETWORK, fds[0], CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::INBOUND, /* inbound_onion */ false));
+        remote_ends.push_back(fds[1]);
+    }
+    // A peer that always has data waiting, so that the wait returns immediately.
+    assert(send(remote_ends[num_peers / 2], "x", 1, 0) == 1);
+
+    bench.run([&] {
+        std::set<SOCKET> recv_set, send_set, error_set;
+        connman.SocketEventsOnce(recv_set, send_set, error_set);
+        assert(recv_set.size() == 1);
+    });
+
+    connman.ClearTestNodes();
+    for (int fd : remote_ends) close(fd);
+}
+
+static void SocketEventsPoll1000Peers(benchmark::Bench& bench) { SocketEventsCommon(bench, "poll", 1000); }
+static void SocketEventsEpoll1000Peers(benchmark::Bench& bench) { SocketEventsCommon(bench, "epoll", 1000); }
+
+BENCHMARK(SocketEventsPoll1000Peers);
+BENCHMARK(SocketEventsEpoll1000Peers);
+#endif
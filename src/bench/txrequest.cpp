@@ -0,0 +1,52 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <random.h>
+#include <txrequest.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <vector>
+
+/** Many peers announce the same transactions, which are then requested, received and forgotten. */
+static void TxRequestCommon(benchmark::Bench& bench, int num_peers, int num_txs)
+{
+    FastRandomContext rng{true};
+    std::vector<uint256> txhashes;
+    for (int i = 0; i < num_txs; ++i) txhashes.push_back(rng.rand256());
+
+    bench.run([&] {
+        TxRequestTracker tracker{/* deterministic */ true};
+        std::chrono::microseconds now{1};
+        for (int peer = 0; peer < num_peers; ++peer) {
+            const bool preferred = peer % 8 == 0;
+            for (const uint256& txhash : txhashes) {
+                tracker.ReceivedInv(peer, GenTxid{true, txhash}, preferred, preferred ? now : now + std::chrono::seconds{2});
+            }
+        }
+        now += std::chrono::seconds{3};
+        for (int peer = 0; peer < num_peers; ++peer) {
+            for (const GenTxid& gtxid : tracker.GetRequestable(peer, now)) {
+                tracker.RequestedTx(peer, gtxid.GetHash(), now + std::chrono::seconds{60});
+            }
+        }
+        for (const uint256& txhash : txhashes) tracker.ForgetTxHash(txhash);
+        for (int peer = 0; peer < num_peers; ++peer) tracker.DisconnectedPeer(peer);
+        assert(tracker.Size() == 0);
+    });
+}
+
+static void TxRequest8Peers(benchmark::Bench& bench)
+{
+    TxRequestCommon(bench, 8 /* num_peers */, 1000 /* num_txs */);
+}
+
+static void TxRequest100Peers(benchmark::Bench& bench)
+{
+    TxRequestCommon(bench, 100 /* num_peers */, 1000 /* num_txs */);
+}
+
+BENCHMARK(TxRequest8Peers);
+BENCHMARK(TxRequest100Peers);
@@ -14,8 +14,13 @@
 #include <validation.h>
 #include <util/system.h>
 
+#include <algorithm>
+#include <bitset>
 #include <unordered_map>
 
+/** Number of bits of the filter of the short IDs of a compact block (8 KiB) */
+static constexpr size_t SHORTTXID_FILTER_SIZE{1 << 16};
+
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
         shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
@@ -44,6 +49,13 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256* const txhashes[SIPHASH_LANES], uint64_t shortids[SIPHASH_LANES]) const {
+    SipHashUint256Lanes(shorttxidk0, shorttxidk1, txhashes, shortids);
+    for (size_t i = 0; i < SIPHASH_LANES; i++) {
+        shortids[i] &= 0xffffffffffffL;
+    }
+}
+
 
 
 ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn) {
@@ -80,11 +92,15 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     // of short IDs, any highly-uneven distribution of elements can be safely treated as a
     // READ_STATUS_FAILED.
     std::unordered_map<uint64_t, uint16_t> shorttxids(cmpctblock.shorttxids.size());
+    // Most mempool transactions are not in the block. Their short IDs are rejected by this
+    // bitmap, which is small enough to stay in the L1 cache, without a lookup in the map.
+    std::bitset<SHORTTXID_FILTER_SIZE> shorttxid_filter;
     uint16_t index_offset = 0;
     for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++) {
         while (txn_available[i + index_offset])
             index_offset++;
         shorttxids[cmpctblock.shorttxids[i]] = i + index_offset;
+        shorttxid_filter.set(cmpctblock.shorttxids[i] % SHORTTXID_FILTER_SIZE);
         // To determine the chance that the number of entries in a bucket exceeds N,
         // we use the fact that the number of elements in a single bucket is
         // binomially distributed (with n = the number of shorttxids S, and p =
@@ -106,29 +122,41 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     std::vector<bool> have_txn(txn_available.size());
     {
     LOCK(pool->cs);
-    for (size_t i = 0; i < pool->vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(pool->vTxHashes[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = pool->vTxHashes[i].second->GetSharedTx();
-                have_txn[idit->second]  = true;
-                mempool_count++;
-            } else {
-                // If we find two mempool txn that match the short id, just request it.
-                // This should be rare enough that the extra bandwidth doesn't matter,
-                // but eating a round-trip due to FillBlock failure would be annoying
-                if (txn_available[idit->second]) {
-                    txn_available[idit->second].reset();
-                    mempool_count--;
+    const auto& tx_hashes = pool->vTxHashes;
+    // Short IDs are computed SIPHASH_LANES at a time. The last batch is padded by repeating
+    // its last transaction, whose extra short IDs are ignored.
+    const uint256* batch_hashes[SIPHASH_LANES];
+    uint64_t batch_shortids[SIPHASH_LANES];
+    for (size_t i = 0; i < tx_hashes.size() && mempool_count != shorttxids.size(); i += SIPHASH_LANES) {
+        const size_t batch_size = std::min(SIPHASH_LANES, tx_hashes.size() - i);
+        for (size_t lane = 0; lane < SIPHASH_LANES; lane++) {
+            batch_hashes[lane] = &tx_hashes[i + std::min(lane, batch_size - 1)].first;
+        }
+        cmpctblock.GetShortIDs(batch_hashes, batch_shortids);
+        for (size_t lane = 0; lane < batch_size; lane++) {
+            if (!shorttxid_filter[batch_shortids[lane] % SHORTTXID_FILTER_SIZE]) continue;
+            std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(batch_shortids[lane]);
+            if (idit != shorttxids.end()) {
+                if (!have_txn[idit->second]) {
+                    txn_available[idit->second] = tx_hashes[i + lane].second->GetSharedTx();
+                    have_txn[idit->second]  = true;
+                    mempool_count++;
+                } else {
+                    // If we find two mempool txn that match the short id, just request it.
+                    // This should be rare enough that the extra bandwidth doesn't matter,
+                    // but eating a round-trip due to FillBlock failure would be annoying
+                    if (txn_available[idit->second]) {
+                        txn_available[idit->second].reset();
+                        mempool_count--;
+                    }
                 }
             }
+            // Though ideally we'd continue scanning for the two-txn-match-shortid case,
+            // the performance win of an early exit here is too good to pass up and worth
+            // the extra risk.
+            if (mempool_count == shorttxids.size())
+                break;
         }
-        // Though ideally we'd continue scanning for the two-txn-match-shortid case,
-        // the performance win of an early exit here is too good to pass up and worth
-        // the extra risk.
-        if (mempool_count == shorttxids.size())
-            break;
     }
     }
 
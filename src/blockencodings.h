@@ -5,6 +5,7 @@
 #ifndef BITCOIN_BLOCKENCODINGS_H
 #define BITCOIN_BLOCKENCODINGS_H
 
+#include <crypto/siphash.h>
 #include <primitives/block.h>
 
 
@@ -107,6 +108,8 @@ public:
     CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
 
     uint64_t GetShortID(const uint256& txhash) const;
+    /** GetShortID of SIPHASH_LANES transactions at once */
+    void GetShortIDs(const uint256* const txhashes[SIPHASH_LANES], uint64_t shortids[SIPHASH_LANES]) const;
 
     size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
 
@@ -0,0 +1,90 @@
+// Copyright (c) 2026 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockmessagecache.h>
+
+#include <hash.h>
+
+#include <algorithm>
+
+BlockMessageCache::BlockMessageCache(size_t max_entries, size_t max_payload_bytes)
+    : m_max_entries{std::max<size_t>(max_entries, 1)}, m_max_payload_bytes{max_payload_bytes} {}
+
+std::optional<BlockMessageCache::Entry> BlockMessageCache::Get(const uint256& block_hash, int flags)
+{
+    LOCK(m_mutex);
+    const auto it = m_index.find(Key{block_hash, flags});
+    if (it == m_index.end()) {
+        ++m_misses;
+        return std::nullopt;
+    }
+    // Mark as most recently used.
+    m_lru.splice(m_lru.end(), m_lru, it->second);
+    const CachedMessage& msg = *it->second;
+    ++m_hits;
+    m_bytes_not_hashed += msg.payload_size;
+    if (msg.payload) m_bytes_not_serialized += msg.payload_size;
+    return Entry{msg.checksum, msg.payload};
+}
+
+BlockMessageCache::Checksum BlockMessageCache::Add(const uint256& block_hash, int flags, Span<const unsigned char> payload, bool keep_payload)
+{
+    // Hash and copy outside of the lock, they are what takes time.
+    Checksum checksum;
+    const uint256 hash{Hash(payload)};
+    std::copy(hash.begin(), hash.begin() + CMessageHeader::CHECKSUM_SIZE, checksum.begin());
+    keep_payload = keep_payload && payload.size() <= m_max_payload_bytes;
+    auto payload_copy{keep_payload ? std::make_shared<const std::vector<unsigned char>>(payload.begin(), payload.end()) : nullptr};
+
+    LOCK(m_mutex);
+    const Key key{block_hash, flags};
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        if (m_lru.size() >= m_max_entries) {
+            const CachedMessage& oldest = m_lru.front();
+            if (oldest.payload) {
+                m_payload_bytes -= oldest.payload_size;
+                --m_payloads;
+            }
+            m_index.erase(oldest.key);
+            m_lru.pop_front();
+        }
+        m_lru.push_back(CachedMessage{key, checksum, payload.size(), nullptr});
+        it = m_index.emplace(key, std::prev(m_lru.end())).first;
+    } else {
+        m_lru.splice(m_lru.end(), m_lru, it->second);
+    }
+    CachedMessage& msg = *it->second;
+    if (payload_copy && !msg.payload) {
+        msg.payload = std::move(payload_copy);
+        m_payload_bytes += msg.payload_size;
+        ++m_payloads;
+        LimitPayloads();
+    }
+    return checksum;
+}
+
+void BlockMessageCache::LimitPayloads()
+{
+    for (auto it = m_lru.begin(); m_payload_bytes > m_max_payload_bytes && it != m_lru.end(); ++it) {
+        if (!it->payload) continue;
+        m_payload_bytes -= it->payload_size;
+        --m_payloads;
+        it->payload.reset();
+    }
+}
+
+BlockMessageCacheStats BlockMessageCache::GetStats() const
+{
+    LOCK(m_mutex);
+    BlockMessageCacheStats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.bytes_not_hashed = m_bytes_not_hashed;
+    stats.bytes_not_serialized = m_bytes_not_serialized;
+    stats.entries = m_lru.size();
+    stats.payloads = m_payloads;
+    stats.payload_bytes = m_payload_bytes;
+    return stats;
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2026 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKMESSAGECACHE_H
+#define BITCOIN_BLOCKMESSAGECACHE_H
+
+#include <protocol.h>
+#include <span.h>
+#include <sync.h>
+#include <uint256.h>
+#include <util/hasher.h>
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** Counters of a BlockMessageCache, for reporting */
+struct BlockMessageCacheStats {
+    /** Lookups that found the block message checksum */
+    uint64_t hits{0};
+    /** Lookups that did not */
+    uint64_t misses{0};
+    /** Payload bytes that did not need to be hashed thanks to the cache */
+    uint64_t bytes_not_hashed{0};
+    /** Payload bytes that did not need to be read or serialized thanks to the cache */
+    uint64_t bytes_not_serialized{0};
+    /** Number of cached checksums */
+    size_t entries{0};
+    /** Number of cached payloads, and their total size */
+    size_t payloads{0};
+    size_t payload_bytes{0};
+};
+
+/**
+ * Cache of the payloads of block messages served to peers: the message checksum for many blocks,
+ * and the serialized payload for a few recent ones. The same blocks are served over and over (to
+ * syncing peers, and right after they are found), so repeated getdata requests can skip hashing
+ * and serializing them.
+ *
+ * Entries are keyed by block hash and serialization flags, as these determine the payload. The
+ * least recently used entries are evicted first. Thread-safe.
+ */
+class BlockMessageCache
+{
+public:
+    using Checksum = std::array<uint8_t, CMessageHeader::CHECKSUM_SIZE>;
+
+    /** A cached block message: its checksum, and its payload if that is cached too */
+    struct Entry {
+        Checksum checksum;
+        std::shared_ptr<const std::vector<unsigned char>> payload;
+    };
+
+    BlockMessageCache(size_t max_entries, size_t max_payload_bytes);
+
+    /** Look up the message for a block, serialized with the given flags. */
+    std::optional<Entry> Get(const uint256& block_hash, int flags) LOCKS_EXCLUDED(m_mutex);
+
+    /**
+     * Compute the checksum of a block message payload and remember it, along with a copy of the
+     * payload itself if keep_payload is set and it fits the payload budget. Returns the checksum.
+     */
+    Checksum Add(const uint256& block_hash, int flags, Span<const unsigned char> payload, bool keep_payload) LOCKS_EXCLUDED(m_mutex);
+
+    BlockMessageCacheStats GetStats() const LOCKS_EXCLUDED(m_mutex);
+
+private:
+    using Key = std::pair<uint256, int>;
+
+    struct KeyHasher {
+        SaltedTxidHasher m_hasher;
+        size_t operator()(const Key& key) const { return m_hasher(key.first) ^ static_cast<size_t>(key.second); }
+    };
+
+    struct CachedMessage {
+        Key key;
+        Checksum checksum;
+        size_t payload_size;
+        std::shared_ptr<const std::vector<unsigned char>> payload;
+    };
+
+    /** Drop the payloads of the least recently used entries until the payload budget is met. */
+    void LimitPayloads() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    const size_t m_max_entries;
+    const size_t m_max_payload_bytes;
+
+    mutable Mutex m_mutex;
+    /** Cached messages, least recently used first */
+    std::list<CachedMessage> m_lru GUARDED_BY(m_mutex);
+    std::unordered_map<Key, std::list<CachedMessage>::iterator, KeyHasher> m_index GUARDED_BY(m_mutex);
+    size_t m_payload_bytes GUARDED_BY(m_mutex){0};
+    size_t m_payloads GUARDED_BY(m_mutex){0};
+    uint64_t m_hits GUARDED_BY(m_mutex){0};
+    uint64_t m_misses GUARDED_BY(m_mutex){0};
+    uint64_t m_bytes_not_hashed GUARDED_BY(m_mutex){0};
+    uint64_t m_bytes_not_serialized GUARDED_BY(m_mutex){0};
+};
+
+#endif // BITCOIN_BLOCKMESSAGECACHE_H
@@ -9,6 +9,9 @@
 #include <random.h>
 #include <version.h>
 
+#include <limits>
+#include <map>
+
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
@@ -39,8 +42,10 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        it->second.access_epoch = m_access_epoch;
         return it;
+    }
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
@@ -50,6 +55,7 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
         // version as fresh.
         ret->second.flags = CCoinsCacheEntry::FRESH;
     }
+    ret->second.access_epoch = m_access_epoch;
     cachedCoinsUsage += ret->second.coin.DynamicMemoryUsage();
     return ret;
 }
@@ -94,15 +100,17 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
     }
     it->second.coin = std::move(coin);
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+    it->second.access_epoch = m_access_epoch;
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
 
 void CCoinsViewCache::EmplaceCoinInternalDANGER(COutPoint&& outpoint, Coin&& coin) {
     cachedCoinsUsage += coin.DynamicMemoryUsage();
-    cacheCoins.emplace(
+    auto [it, inserted] = cacheCoins.emplace(
         std::piecewise_construct,
         std::forward_as_tuple(std::move(outpoint)),
         std::forward_as_tuple(std::move(coin), CCoinsCacheEntry::DIRTY));
+    if (inserted) it->second.access_epoch = m_access_epoch;
 }
 
 void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool check_for_overwrite) {
@@ -161,6 +169,7 @@ uint256 CCoinsViewCache::GetBestBlock() const {
 
 void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     hashBlock = hashBlockIn;
+    ++m_access_epoch;
 }
 
 bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn) {
@@ -180,6 +189,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 entry.coin = std::move(it->second.coin);
                 cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
                 entry.flags = CCoinsCacheEntry::DIRTY;
+                entry.access_epoch = m_access_epoch;
                 // We can mark it FRESH in the parent if it was FRESH in the child
                 // Otherwise it might have just been flushed from the parent's cache
                 // and already exist in the grandparent
@@ -208,6 +218,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 itUs->second.coin = std::move(it->second.coin);
                 cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
                 itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                itUs->second.access_epoch = m_access_epoch;
                 // NOTE: It isn't safe to mark the coin as FRESH in the parent
                 // cache. If it already existed and was spent in the parent
                 // cache then marking it FRESH would prevent that spentness
@@ -216,6 +227,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
         }
     }
     hashBlock = hashBlockIn;
+    ++m_access_epoch;
     return true;
 }
 
@@ -226,6 +238,44 @@ bool CCoinsViewCache::Flush() {
     return fOk;
 }
 
+bool CCoinsViewCache::PartialFlush(size_t max_keep_bytes) {
+    // Tally memory usage of the unspent coins by access epoch, and keep the
+    // most recent epochs that together fit in max_keep_bytes.
+    static const size_t ENTRY_OVERHEAD = memusage::MallocUsage(sizeof(memusage::unordered_node<CCoinsMap::value_type>));
+    std::map<uint32_t, size_t, std::greater<uint32_t>> usage_by_epoch;
+    for (const auto& [outpoint, entry] : cacheCoins) {
+        if (entry.coin.IsSpent()) continue;
+        usage_by_epoch[entry.access_epoch] += ENTRY_OVERHEAD + entry.coin.DynamicMemoryUsage();
+    }
+    uint64_t min_keep_epoch = uint64_t{std::numeric_limits<uint32_t>::max()} + 1;
+    size_t keep_bytes = 0;
+    for (const auto& [epoch, usage] : usage_by_epoch) {
+        if (keep_bytes + usage > max_keep_bytes) break;
+        keep_bytes += usage;
+        min_keep_epoch = epoch;
+    }
+
+    CCoinsMap mapWrite;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        CCoinsCacheEntry& entry = it->second;
+        if (!entry.coin.IsSpent() && entry.access_epoch >= min_keep_epoch) {
+            if (entry.flags & CCoinsCacheEntry::DIRTY) {
+                mapWrite.emplace(std::piecewise_construct, std::forward_as_tuple(it->first), std::forward_as_tuple(Coin{entry.coin}, entry.flags));
+            }
+            // Once written, the base has the same version of the coin.
+            entry.flags = 0;
+            ++it;
+        } else {
+            cachedCoinsUsage -= entry.coin.DynamicMemoryUsage();
+            if (entry.flags & CCoinsCacheEntry::DIRTY) {
+                mapWrite.emplace(std::piecewise_construct, std::forward_as_tuple(it->first), std::forward_as_tuple(std::move(entry.coin), entry.flags));
+            }
+            it = cacheCoins.erase(it);
+        }
+    }
+    return base->BatchWrite(mapWrite, hashBlock);
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -104,6 +104,13 @@ struct CCoinsCacheEntry
 {
     Coin coin; // The actual cached data.
     unsigned char flags;
+    /**
+     * Value of the owning cache's access epoch when this entry was last
+     * created, fetched or modified. Used by CCoinsViewCache::PartialFlush()
+     * to tell recently used coins from stale ones. Fits in padding, so it
+     * does not increase the size of the entry.
+     */
+    uint32_t access_epoch;
 
     enum Flags {
         /**
@@ -126,9 +133,9 @@ struct CCoinsCacheEntry
         FRESH = (1 << 1),
     };
 
-    CCoinsCacheEntry() : flags(0) {}
-    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
-    CCoinsCacheEntry(Coin&& coin_, unsigned char flag) : coin(std::move(coin_)), flags(flag) {}
+    CCoinsCacheEntry() : flags(0), access_epoch(0) {}
+    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0), access_epoch(0) {}
+    CCoinsCacheEntry(Coin&& coin_, unsigned char flag) : coin(std::move(coin_)), flags(flag), access_epoch(0) {}
 };
 
 typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
@@ -223,6 +230,12 @@ protected:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /**
+     * Incremented every time this cache moves to another block; entries are
+     * stamped with it when used (see CCoinsCacheEntry::access_epoch).
+     */
+    uint32_t m_access_epoch{0};
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -289,6 +302,15 @@ public:
      */
     bool Flush();
 
+    /**
+     * Like Flush(), but keep the most recently used unspent coins in the cache,
+     * up to max_keep_bytes of memory, so that validation does not continue on a
+     * cold cache. All modifications are still pushed to the base, and the coins
+     * that are kept are no longer DIRTY or FRESH.
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool PartialFlush(size_t max_keep_bytes);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
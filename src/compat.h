@@ -95,6 +95,8 @@ typedef char* sockopt_arg_type;
 // __APPLE__ poll is broke https://github.com/bitcoin/bitcoin/pull/14336#issuecomment-437384408
 #if defined(__linux__)
 #define USE_POLL
+#define USE_EPOLL
+#define USE_SENDFILE
 #endif
 
 bool static inline IsSelectableSocket(const SOCKET& s) {
@@ -10,6 +10,23 @@
 
 #include <string.h>
 
+#include <compat/cpuid.h>
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace chacha20_avx2
+{
+void Crypt_8way(const uint32_t input[16], const unsigned char* m, unsigned char* c);
+}
+#endif
+
+namespace {
+/** Crypt 8 blocks at the block counter of input into c, or write their keystream if m is nullptr. */
+typedef void (*Crypt8WayFn)(const uint32_t input[16], const unsigned char* m, unsigned char* c);
+
+/** Vector implementation selected by ChaCha20AutoDetect, or nullptr to use the generic code only. */
+Crypt8WayFn Crypt8Way = nullptr;
+} // namespace
+
 constexpr static inline uint32_t rotl32(uint32_t v, int c) { return (v << c) | (v >> (32 - c)); }
 
 #define QUARTERROUND(a,b,c,d) \
@@ -71,6 +88,17 @@ void ChaCha20::Seek(uint64_t pos)
     input[13] = pos >> 32;
 }
 
+void ChaCha20::Crypt8WayBlocks(const unsigned char*& m, unsigned char*& c, size_t& bytes)
+{
+    if (!Crypt8Way) return;
+    for (; bytes >= 512; bytes -= 512) {
+        Crypt8Way(input, m, c);
+        Seek((input[12] | (uint64_t)input[13] << 32) + 8);
+        if (m) m += 512;
+        c += 512;
+    }
+}
+
 void ChaCha20::Keystream(unsigned char* c, size_t bytes)
 {
     uint32_t x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15;
@@ -79,6 +107,8 @@ void ChaCha20::Keystream(unsigned char* c, size_t bytes)
     unsigned char tmp[64];
     unsigned int i;
 
+    const unsigned char* m = nullptr;
+    Crypt8WayBlocks(m, c, bytes);
     if (!bytes) return;
 
     j0 = input[0];
@@ -187,6 +217,7 @@ void ChaCha20::Crypt(const unsigned char* m, unsigned char* c, size_t bytes)
     unsigned char tmp[64];
     unsigned int i;
 
+    Crypt8WayBlocks(m, c, bytes);
     if (!bytes) return;
 
     j0 = input[0];
@@ -308,3 +339,18 @@ void ChaCha20::Crypt(const unsigned char* m, unsigned char* c, size_t bytes)
         m += 64;
     }
 }
+
+std::string ChaCha20AutoDetect(bool use_optimized)
+{
+    Crypt8Way = nullptr;
+    std::string ret = "standard";
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (use_optimized && HaveAVX2()) {
+        Crypt8Way = chacha20_avx2::Crypt_8way;
+        ret = "avx2(8way)";
+    }
+#else
+    (void)use_optimized;
+#endif
+    return ret;
+}
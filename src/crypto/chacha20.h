@@ -8,6 +8,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <string>
+
 /** A class for ChaCha20 256-bit stream cipher developed by Daniel J. Bernstein
     https://cr.yp.to/chacha/chacha-20080128.pdf */
 class ChaCha20
@@ -15,6 +17,9 @@ class ChaCha20
 private:
     uint32_t input[16];
 
+    /** Process whole groups of 8 blocks with the vector implementation, if one was selected. */
+    void Crypt8WayBlocks(const unsigned char*& m, unsigned char*& c, size_t& bytes);
+
 public:
     ChaCha20();
     ChaCha20(const unsigned char* key, size_t keylen);
@@ -31,4 +36,10 @@ public:
     void Crypt(const unsigned char* input, unsigned char* output, size_t bytes);
 };
 
+/** Autodetect the best available ChaCha20 implementation.
+ *  Passing false selects the portable implementation (used for testing).
+ *  Returns the name of the implementation.
+ */
+std::string ChaCha20AutoDetect(bool use_optimized = true);
+
 #endif // BITCOIN_CRYPTO_CHACHA20_H
@@ -0,0 +1,102 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// ChaCha20 of eight consecutive 64-byte blocks, one per 32-bit lane of the
+// AVX2 registers (see ChaCha20::Crypt in chacha20.cpp).
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace chacha20_avx2 {
+namespace {
+
+__m256i inline K(uint32_t x) { return _mm256_set1_epi32(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+template <int c>
+__m256i inline RotL(__m256i x) { return _mm256_or_si256(_mm256_slli_epi32(x, c), _mm256_srli_epi32(x, 32 - c)); }
+/** Rotations by whole bytes are byte shuffles. */
+template <>
+__m256i inline RotL<16>(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, 2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13)); }
+template <>
+__m256i inline RotL<8>(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14, 3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14)); }
+
+void inline QuarterRound(__m256i& a, __m256i& b, __m256i& c, __m256i& d)
+{
+    a = Add(a, b); d = RotL<16>(Xor(d, a));
+    c = Add(c, d); b = RotL<12>(Xor(b, c));
+    a = Add(a, b); d = RotL<8>(Xor(d, a));
+    c = Add(c, d); b = RotL<7>(Xor(b, c));
+}
+
+/** Transpose eight vectors of eight 32-bit words, so that vector i holds word i of each input vector. */
+void inline Transpose(__m256i x[8])
+{
+    const __m256i t0 = _mm256_unpacklo_epi32(x[0], x[1]), t1 = _mm256_unpackhi_epi32(x[0], x[1]);
+    const __m256i t2 = _mm256_unpacklo_epi32(x[2], x[3]), t3 = _mm256_unpackhi_epi32(x[2], x[3]);
+    const __m256i t4 = _mm256_unpacklo_epi32(x[4], x[5]), t5 = _mm256_unpackhi_epi32(x[4], x[5]);
+    const __m256i t6 = _mm256_unpacklo_epi32(x[6], x[7]), t7 = _mm256_unpackhi_epi32(x[6], x[7]);
+    const __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+    const __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+    const __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+    const __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+    x[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    x[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    x[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    x[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    x[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    x[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    x[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    x[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+/** Write 32 bytes of each of the eight blocks, XORed with the message if there is one. */
+void inline Write(__m256i x[8], const unsigned char* m, unsigned char* c)
+{
+    Transpose(x);
+    for (int i = 0; i < 8; ++i) {
+        if (m) x[i] = Xor(x[i], _mm256_loadu_si256((const __m256i*)(m + 64 * i)));
+        _mm256_storeu_si256((__m256i*)(c + 64 * i), x[i]);
+    }
+}
+
+} // namespace
+
+void Crypt_8way(const uint32_t input[16], const unsigned char* m, unsigned char* c)
+{
+    const uint64_t counter = input[12] | (uint64_t)input[13] << 32;
+    __m256i j[16];
+    for (int i = 0; i < 16; ++i) j[i] = K(input[i]);
+    alignas(32) uint32_t counter_lo[8], counter_hi[8];
+    for (int i = 0; i < 8; ++i) {
+        counter_lo[i] = counter + i;
+        counter_hi[i] = (counter + i) >> 32;
+    }
+    j[12] = _mm256_load_si256((const __m256i*)counter_lo);
+    j[13] = _mm256_load_si256((const __m256i*)counter_hi);
+
+    __m256i x[16];
+    for (int i = 0; i < 16; ++i) x[i] = j[i];
+    for (int i = 20; i > 0; i -= 2) {
+        QuarterRound(x[0], x[4], x[8], x[12]);
+        QuarterRound(x[1], x[5], x[9], x[13]);
+        QuarterRound(x[2], x[6], x[10], x[14]);
+        QuarterRound(x[3], x[7], x[11], x[15]);
+        QuarterRound(x[0], x[5], x[10], x[15]);
+        QuarterRound(x[1], x[6], x[11], x[12]);
+        QuarterRound(x[2], x[7], x[8], x[13]);
+        QuarterRound(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; ++i) x[i] = Add(x[i], j[i]);
+
+    Write(x, m, c);
+    Write(x + 8, m ? m + 32 : nullptr, c + 32);
+}
+
+}
+
+#endif
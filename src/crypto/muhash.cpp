@@ -8,10 +8,19 @@
 #include <crypto/common.h>
 #include <hash.h>
 
+#include <compat/cpuid.h>
+
 #include <cassert>
 #include <cstdio>
 #include <limits>
 
+#if defined(ENABLE_MULX) && defined(HAVE___INT128) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace muhash_mulx
+{
+void Mul(uint64_t* out, const uint64_t* a, const uint64_t* b);
+}
+#endif
+
 namespace {
 
 using limb_t = Num3072::limb_t;
@@ -113,6 +122,48 @@ inline void addnextract2(limb_t& c0, limb_t& c1, const limb_t& a, limb_t& n)
     c1 = c2;
 }
 
+/** Full (unreduced) product of two Num3072 values, 2*LIMBS limbs wide. */
+typedef void (*WideMulFn)(limb_t* out, const limb_t* a, const limb_t* b);
+
+/** Optimized product kernel selected by MuHash3072AutoDetect, or nullptr to use the generic code. */
+WideMulFn WideMul = nullptr;
+
+/**
+ * Reduce a 2*LIMBS limb product [lo,hi] = lo + hi*2^3072 modulo 2^3072 - MAX_PRIME_DIFF
+ * into out, producing the same canonical result as the generic Multiply.
+ */
+void ReduceWide(Num3072& out, const limb_t* wide)
+{
+    const limb_t* lo = wide;
+    const limb_t* hi = wide + Num3072::LIMBS;
+
+    /* out = lo + hi * MAX_PRIME_DIFF, with the excess limb in c. */
+    double_limb_t acc = 0;
+    for (int i = 0; i < Num3072::LIMBS; ++i) {
+        acc += (double_limb_t)hi[i] * MAX_PRIME_DIFF + lo[i];
+        out.limbs[i] = acc;
+        acc >>= LIMB_SIZE;
+    }
+
+    /* Fold c back in as c * MAX_PRIME_DIFF, which fits in a double limb. */
+    acc *= MAX_PRIME_DIFF;
+    for (int i = 0; i < Num3072::LIMBS && acc; ++i) {
+        acc += out.limbs[i];
+        out.limbs[i] = acc;
+        acc >>= LIMB_SIZE;
+    }
+
+    /* A final carry leaves a tiny value, so adding MAX_PRIME_DIFF cannot overflow again. */
+    if (acc) {
+        acc = MAX_PRIME_DIFF;
+        for (int i = 0; i < Num3072::LIMBS && acc; ++i) {
+            acc += out.limbs[i];
+            out.limbs[i] = acc;
+            acc >>= LIMB_SIZE;
+        }
+    }
+}
+
 /** in_out = in_out^(2^sq) * mul */
 inline void square_n_mul(Num3072& in_out, const int sq, const Num3072& mul)
 {
@@ -180,6 +231,14 @@ Num3072 Num3072::GetInverse() const
 
 void Num3072::Multiply(const Num3072& a)
 {
+    if (WideMul) {
+        limb_t wide[2 * LIMBS];
+        WideMul(wide, this->limbs, a.limbs);
+        ReduceWide(*this, wide);
+        if (this->IsOverflow()) this->FullReduce();
+        return;
+    }
+
     limb_t c0 = 0, c1 = 0, c2 = 0;
     Num3072 tmp;
 
@@ -217,6 +276,14 @@ void Num3072::Multiply(const Num3072& a)
 
 void Num3072::Square()
 {
+    if (WideMul) {
+        limb_t wide[2 * LIMBS];
+        WideMul(wide, this->limbs, this->limbs);
+        ReduceWide(*this, wide);
+        if (this->IsOverflow()) this->FullReduce();
+        return;
+    }
+
     limb_t c0 = 0, c1 = 0, c2 = 0;
     Num3072 tmp;
 
@@ -252,6 +319,30 @@ void Num3072::Square()
     if (c0) this->FullReduce();
 }
 
+std::string MuHash3072AutoDetect(bool use_optimized)
+{
+    WideMul = nullptr;
+    std::string ret = "standard";
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && defined(ENABLE_MULX) && defined(HAVE___INT128) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (use_optimized) {
+        uint32_t eax, ebx, ecx, edx;
+        GetCPUID(0, 0, eax, ebx, ecx, edx);
+        if (eax >= 7) {
+            GetCPUID(7, 0, eax, ebx, ecx, edx);
+            const bool have_bmi2 = (ebx >> 8) & 1;
+            const bool have_adx = (ebx >> 19) & 1;
+            if (have_bmi2 && have_adx) {
+                WideMul = muhash_mulx::Mul;
+                ret = "mulx";
+            }
+        }
+    }
+#else
+    (void)use_optimized;
+#endif
+    return ret;
+}
+
 void Num3072::SetToOne()
 {
     this->limbs[0] = 1;
@@ -13,6 +13,7 @@
 #include <uint256.h>
 
 #include <stdint.h>
+#include <string>
 
 class Num3072
 {
@@ -128,4 +129,10 @@ public:
     }
 };
 
+/** Autodetect the best available Num3072 multiplication kernel.
+ *  Passing false selects the portable implementation (used for testing).
+ *  Returns the name of the implementation.
+ */
+std::string MuHash3072AutoDetect(bool use_optimized = true);
+
 #endif // BITCOIN_CRYPTO_MUHASH_H
@@ -0,0 +1,69 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Schoolbook 3072x3072-bit multiplication using the BMI2 MULX and ADX
+// ADCX/ADOX instructions, for use by Num3072 (see muhash.cpp).
+//
+// Each row accumulates a[i] * b into the result with two independent carry
+// chains: the low halves of the partial products ride CF (ADCX) and the high
+// halves ride OF (ADOX). Compilers do not keep both chains in the flags when
+// given the equivalent intrinsics, so the row is written in inline assembly.
+
+#ifdef ENABLE_MULX
+
+#include <stdint.h>
+
+namespace muhash_mulx {
+namespace {
+
+constexpr int N = 48;
+
+/** Process limb j of a row. hi receives the high half, prev holds the previous one. */
+#define MULX_STEP(j, hi, prev) \
+    "mulxq " #j "*8(%[b]), %%rax, %%" hi "\n" \
+    "adcxq " #j "*8(%[t]), %%rax\n" \
+    "adoxq %%" prev ", %%rax\n" \
+    "movq %%rax, " #j "*8(%[t])\n"
+
+#define MULX_STEP2(j0, j1) \
+    MULX_STEP(j0, "rbx", "rcx") \
+    MULX_STEP(j1, "rcx", "rbx")
+
+/** t[0..N] += ai * b[0..N-1], where t[N] is zero on entry. */
+inline void AddMulRow(uint64_t* t, const uint64_t* b, uint64_t ai)
+{
+    __asm__ __volatile__(
+        "xorl %%ecx, %%ecx\n" // clears CF and OF as well
+        MULX_STEP2(0, 1) MULX_STEP2(2, 3) MULX_STEP2(4, 5) MULX_STEP2(6, 7)
+        MULX_STEP2(8, 9) MULX_STEP2(10, 11) MULX_STEP2(12, 13) MULX_STEP2(14, 15)
+        MULX_STEP2(16, 17) MULX_STEP2(18, 19) MULX_STEP2(20, 21) MULX_STEP2(22, 23)
+        MULX_STEP2(24, 25) MULX_STEP2(26, 27) MULX_STEP2(28, 29) MULX_STEP2(30, 31)
+        MULX_STEP2(32, 33) MULX_STEP2(34, 35) MULX_STEP2(36, 37) MULX_STEP2(38, 39)
+        MULX_STEP2(40, 41) MULX_STEP2(42, 43) MULX_STEP2(44, 45) MULX_STEP2(46, 47)
+        // The partial product through this row fits in N + 1 limbs, so
+        // folding both carries into the last high half cannot overflow.
+        "movl $0, %%eax\n"
+        "adcxq %%rax, %%rcx\n"
+        "adoxq %%rax, %%rcx\n"
+        "movq %%rcx, 48*8(%[t])\n"
+        :
+        : [t] "r"(t), [b] "r"(b), "d"(ai)
+        : "rax", "rbx", "rcx", "cc", "memory");
+}
+
+#undef MULX_STEP2
+#undef MULX_STEP
+
+} // namespace
+
+/** out[0..2N-1] = a[0..N-1] * b[0..N-1] for N = 48 64-bit limbs. */
+void Mul(uint64_t* out, const uint64_t* a, const uint64_t* b)
+{
+    for (int i = 0; i < 2 * N; ++i) out[i] = 0;
+    for (int i = 0; i < N; ++i) AddMulRow(out + i, b, a[i]);
+}
+
+} // namespace muhash_mulx
+
+#endif // ENABLE_MULX
@@ -10,6 +10,23 @@
 
 #include <string.h>
 
+#include <compat/cpuid.h>
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace poly1305_avx2
+{
+size_t Blocks_4way(uint32_t h[5], const uint32_t r[5], const unsigned char* m, size_t len);
+}
+#endif
+
+namespace {
+/** Absorb whole groups of 4 blocks of m into h, returns the number of bytes processed. */
+typedef size_t (*Blocks4WayFn)(uint32_t h[5], const uint32_t r[5], const unsigned char* m, size_t len);
+
+/** Vector implementation selected by Poly1305AutoDetect, or nullptr to use the generic code only. */
+Blocks4WayFn Blocks4Way = nullptr;
+} // namespace
+
 #define mul32x32_64(a,b) ((uint64_t)(a) * (b))
 
 void poly1305_auth(unsigned char out[POLY1305_TAGLEN], const unsigned char *m, size_t inlen, const unsigned char key[POLY1305_KEYLEN]) {
@@ -50,7 +67,15 @@ void poly1305_auth(unsigned char out[POLY1305_TAGLEN], const unsigned char *m, s
     h3 = 0;
     h4 = 0;
 
-    /* full blocks */
+    /* full blocks, 4 at a time if there is a vector implementation */
+    if (Blocks4Way) {
+        uint32_t h[5] = {h0, h1, h2, h3, h4};
+        const uint32_t r[5] = {r0, r1, r2, r3, r4};
+        const size_t processed = Blocks4Way(h, r, m, inlen);
+        h0 = h[0]; h1 = h[1]; h2 = h[2]; h3 = h[3]; h4 = h[4];
+        m += processed;
+        inlen -= processed;
+    }
     if (inlen < 16) goto poly1305_donna_atmost15bytes;
 poly1305_donna_16bytes:
     m += 16;
@@ -139,3 +164,18 @@ poly1305_donna_finish:
     WriteLE32(&out[ 8], f2); f3 += (f2 >> 32);
     WriteLE32(&out[12], f3);
 }
+
+std::string Poly1305AutoDetect(bool use_optimized)
+{
+    Blocks4Way = nullptr;
+    std::string ret = "standard";
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (use_optimized && HaveAVX2()) {
+        Blocks4Way = poly1305_avx2::Blocks_4way;
+        ret = "avx2(4way)";
+    }
+#else
+    (void)use_optimized;
+#endif
+    return ret;
+}
@@ -8,10 +8,18 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <string>
+
 #define POLY1305_KEYLEN 32
 #define POLY1305_TAGLEN 16
 
 void poly1305_auth(unsigned char out[POLY1305_TAGLEN], const unsigned char *m, size_t inlen,
     const unsigned char key[POLY1305_KEYLEN]);
 
+/** Autodetect the best available Poly1305 implementation.
+ *  Passing false selects the portable implementation (used for testing).
+ *  Returns the name of the implementation.
+ */
+std::string Poly1305AutoDetect(bool use_optimized = true);
+
 #endif // BITCOIN_CRYPTO_POLY1305_H
@@ -0,0 +1,155 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Poly1305 message blocks processed four at a time with AVX2, for use by
+// poly1305_auth (see poly1305.cpp).
+//
+// The accumulator is split in four, one per 64-bit lane: lane i absorbs the
+// blocks i, i + 4, i + 8, ... and is multiplied by r^4 after each of them.
+// Multiplying the lanes by r^4, r^3, r^2 and r at the end and adding them up
+// gives the same result as processing the blocks one by one. Numbers are
+// held in five 26-bit limbs, as in the generic code.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+namespace poly1305_avx2 {
+namespace {
+
+const uint64_t MASK26 = 0x3ffffff;
+
+/** a = a * b mod 2^130 - 5, partially reduced, on 26-bit limbs. */
+void MulMod(uint64_t a[5], const uint64_t b[5])
+{
+    const uint64_t s1 = b[1] * 5, s2 = b[2] * 5, s3 = b[3] * 5, s4 = b[4] * 5;
+    uint64_t t0 = a[0] * b[0] + a[1] * s4 + a[2] * s3 + a[3] * s2 + a[4] * s1;
+    uint64_t t1 = a[0] * b[1] + a[1] * b[0] + a[2] * s4 + a[3] * s3 + a[4] * s2;
+    uint64_t t2 = a[0] * b[2] + a[1] * b[1] + a[2] * b[0] + a[3] * s4 + a[4] * s3;
+    uint64_t t3 = a[0] * b[3] + a[1] * b[2] + a[2] * b[1] + a[3] * b[0] + a[4] * s4;
+    uint64_t t4 = a[0] * b[4] + a[1] * b[3] + a[2] * b[2] + a[3] * b[1] + a[4] * b[0];
+    t1 += t0 >> 26; a[0] = t0 & MASK26;
+    t2 += t1 >> 26; a[1] = t1 & MASK26;
+    t3 += t2 >> 26; a[2] = t2 & MASK26;
+    t4 += t3 >> 26; a[3] = t3 & MASK26;
+    a[0] += (t4 >> 26) * 5; a[4] = t4 & MASK26;
+    a[1] += a[0] >> 26; a[0] &= MASK26;
+}
+
+/** Five 26-bit limbs of four numbers, one per 64-bit lane. */
+struct Limbs {
+    __m256i v[5];
+};
+
+/** Load four 16-byte blocks, adding the 2^128 bit, into limbs. */
+Limbs inline LoadBlocks(const unsigned char* m)
+{
+    const __m256i mask = _mm256_set1_epi64x(MASK26);
+    const __m256i ab = _mm256_loadu_si256((const __m256i*)m);
+    const __m256i cd = _mm256_loadu_si256((const __m256i*)(m + 32));
+    // Low and high 64 bits of the blocks, in order.
+    const __m256i lo = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(ab, cd), 0xD8);
+    const __m256i hi = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(ab, cd), 0xD8);
+    Limbs ret;
+    ret.v[0] = _mm256_and_si256(lo, mask);
+    ret.v[1] = _mm256_and_si256(_mm256_srli_epi64(lo, 26), mask);
+    ret.v[2] = _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(lo, 52), _mm256_slli_epi64(hi, 12)), mask);
+    ret.v[3] = _mm256_and_si256(_mm256_srli_epi64(hi, 14), mask);
+    ret.v[4] = _mm256_or_si256(_mm256_srli_epi64(hi, 40), _mm256_set1_epi64x(1 << 24));
+    return ret;
+}
+
+/** Products of h and r per lane, before carrying. s holds 5 * r. */
+Limbs inline Mul(const Limbs& h, const Limbs& r, const Limbs& s)
+{
+    const auto mul = [](__m256i x, __m256i y) { return _mm256_mul_epu32(x, y); };
+    const auto add = [](__m256i x, __m256i y) { return _mm256_add_epi64(x, y); };
+    Limbs t;
+    t.v[0] = add(add(add(mul(h.v[0], r.v[0]), mul(h.v[1], s.v[4])), add(mul(h.v[2], s.v[3]), mul(h.v[3], s.v[2]))), mul(h.v[4], s.v[1]));
+    t.v[1] = add(add(add(mul(h.v[0], r.v[1]), mul(h.v[1], r.v[0])), add(mul(h.v[2], s.v[4]), mul(h.v[3], s.v[3]))), mul(h.v[4], s.v[2]));
+    t.v[2] = add(add(add(mul(h.v[0], r.v[2]), mul(h.v[1], r.v[1])), add(mul(h.v[2], r.v[0]), mul(h.v[3], s.v[4]))), mul(h.v[4], s.v[3]));
+    t.v[3] = add(add(add(mul(h.v[0], r.v[3]), mul(h.v[1], r.v[2])), add(mul(h.v[2], r.v[1]), mul(h.v[3], r.v[0]))), mul(h.v[4], s.v[4]));
+    t.v[4] = add(add(add(mul(h.v[0], r.v[4]), mul(h.v[1], r.v[3])), add(mul(h.v[2], r.v[2]), mul(h.v[3], r.v[1]))), mul(h.v[4], r.v[0]));
+    return t;
+}
+
+/** Carry the products back into 26-bit limbs, partially reduced. */
+void inline Carry(Limbs& t)
+{
+    const __m256i mask = _mm256_set1_epi64x(MASK26);
+    __m256i c;
+    c = _mm256_srli_epi64(t.v[0], 26); t.v[0] = _mm256_and_si256(t.v[0], mask); t.v[1] = _mm256_add_epi64(t.v[1], c);
+    c = _mm256_srli_epi64(t.v[1], 26); t.v[1] = _mm256_and_si256(t.v[1], mask); t.v[2] = _mm256_add_epi64(t.v[2], c);
+    c = _mm256_srli_epi64(t.v[2], 26); t.v[2] = _mm256_and_si256(t.v[2], mask); t.v[3] = _mm256_add_epi64(t.v[3], c);
+    c = _mm256_srli_epi64(t.v[3], 26); t.v[3] = _mm256_and_si256(t.v[3], mask); t.v[4] = _mm256_add_epi64(t.v[4], c);
+    c = _mm256_srli_epi64(t.v[4], 26); t.v[4] = _mm256_and_si256(t.v[4], mask);
+    t.v[0] = _mm256_add_epi64(t.v[0], _mm256_add_epi64(c, _mm256_slli_epi64(c, 2)));
+    c = _mm256_srli_epi64(t.v[0], 26); t.v[0] = _mm256_and_si256(t.v[0], mask); t.v[1] = _mm256_add_epi64(t.v[1], c);
+}
+
+/** The limbs of a, b, c and d in lanes 0 to 3, and the same multiplied by 5. */
+void inline Broadcast(const uint64_t a[5], const uint64_t b[5], const uint64_t c[5], const uint64_t d[5], Limbs& r, Limbs& s)
+{
+    for (int i = 0; i < 5; ++i) {
+        r.v[i] = _mm256_setr_epi64x(a[i], b[i], c[i], d[i]);
+        s.v[i] = _mm256_add_epi64(r.v[i], _mm256_slli_epi64(r.v[i], 2));
+    }
+}
+
+} // namespace
+
+size_t Blocks_4way(uint32_t h[5], const uint32_t r[5], const unsigned char* m, size_t len)
+{
+    const size_t blocks_len = len & ~(size_t)63;
+    if (blocks_len < 128) return 0;
+
+    // Powers of r.
+    uint64_t r1[5], r2[5], r3[5], r4[5];
+    for (int i = 0; i < 5; ++i) r1[i] = r[i];
+    for (int i = 0; i < 5; ++i) r2[i] = r1[i];
+    MulMod(r2, r1);
+    for (int i = 0; i < 5; ++i) r3[i] = r2[i];
+    MulMod(r3, r1);
+    for (int i = 0; i < 5; ++i) r4[i] = r2[i];
+    MulMod(r4, r2);
+    Limbs r4_lanes, s4_lanes;
+    Broadcast(r4, r4, r4, r4, r4_lanes, s4_lanes);
+
+    // The accumulator goes into lane 0, to be multiplied by the highest power of r.
+    Limbs acc = LoadBlocks(m);
+    for (int i = 0; i < 5; ++i) {
+        acc.v[i] = _mm256_add_epi64(acc.v[i], _mm256_setr_epi64x(h[i], 0, 0, 0));
+    }
+    for (size_t pos = 64; pos < blocks_len; pos += 64) {
+        Limbs t = Mul(acc, r4_lanes, s4_lanes);
+        Carry(t);
+        const Limbs blocks = LoadBlocks(m + pos);
+        for (int i = 0; i < 5; ++i) acc.v[i] = _mm256_add_epi64(t.v[i], blocks.v[i]);
+    }
+
+    // Multiply the lanes by r^4, r^3, r^2 and r, and add them up.
+    Limbs r_lanes, s_lanes;
+    Broadcast(r4, r3, r2, r1, r_lanes, s_lanes);
+    const Limbs t = Mul(acc, r_lanes, s_lanes);
+    uint64_t sum[5];
+    for (int i = 0; i < 5; ++i) {
+        alignas(32) uint64_t lanes[4];
+        _mm256_store_si256((__m256i*)lanes, t.v[i]);
+        sum[i] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    sum[1] += sum[0] >> 26; sum[0] &= MASK26;
+    sum[2] += sum[1] >> 26; sum[1] &= MASK26;
+    sum[3] += sum[2] >> 26; sum[2] &= MASK26;
+    sum[4] += sum[3] >> 26; sum[3] &= MASK26;
+    sum[0] += (sum[4] >> 26) * 5; sum[4] &= MASK26;
+    sum[1] += sum[0] >> 26; sum[0] &= MASK26;
+    for (int i = 0; i < 5; ++i) h[i] = sum[i];
+    return blocks_len;
+}
+
+}
+
+#endif
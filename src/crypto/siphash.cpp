@@ -4,6 +4,17 @@
 
 #include <crypto/siphash.h>
 
+#include <crypto/common.h>
+
+#include <compat/cpuid.h>
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace siphash_avx2
+{
+void Uint256_4way(uint64_t k0, uint64_t k1, const uint256* const vals[4], uint64_t out[4]);
+}
+#endif
+
 #define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
 
 #define SIPROUND do { \
@@ -171,3 +182,37 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+namespace {
+
+typedef void (*Uint256LanesFn)(uint64_t k0, uint64_t k1, const uint256* const vals[SIPHASH_LANES], uint64_t out[SIPHASH_LANES]);
+
+void Uint256LanesGeneric(uint64_t k0, uint64_t k1, const uint256* const vals[SIPHASH_LANES], uint64_t out[SIPHASH_LANES])
+{
+    for (size_t i = 0; i < SIPHASH_LANES; ++i) out[i] = SipHashUint256(k0, k1, *vals[i]);
+}
+
+/** Implementation of SipHashUint256Lanes selected by SipHashAutoDetect. */
+Uint256LanesFn Uint256Lanes = Uint256LanesGeneric;
+
+} // namespace
+
+void SipHashUint256Lanes(uint64_t k0, uint64_t k1, const uint256* const vals[SIPHASH_LANES], uint64_t out[SIPHASH_LANES])
+{
+    Uint256Lanes(k0, k1, vals, out);
+}
+
+std::string SipHashAutoDetect(bool use_optimized)
+{
+    Uint256Lanes = Uint256LanesGeneric;
+    std::string ret = "standard";
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (use_optimized && HaveAVX2()) {
+        Uint256Lanes = siphash_avx2::Uint256_4way;
+        ret = "avx2(4way)";
+    }
+#else
+    (void)use_optimized;
+#endif
+    return ret;
+}
@@ -5,8 +5,11 @@
 #ifndef BITCOIN_CRYPTO_SIPHASH_H
 #define BITCOIN_CRYPTO_SIPHASH_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <string>
+
 #include <uint256.h>
 
 /** SipHash-2-4 */
@@ -44,4 +47,18 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** Number of values SipHashUint256Lanes hashes at once */
+static constexpr size_t SIPHASH_LANES{4};
+
+/** SipHashUint256 of SIPHASH_LANES values at once, with the same key.
+ *  Faster than separate calls when SipHashAutoDetect found a vector implementation.
+ */
+void SipHashUint256Lanes(uint64_t k0, uint64_t k1, const uint256* const vals[SIPHASH_LANES], uint64_t out[SIPHASH_LANES]);
+
+/** Autodetect the best available SipHashUint256Lanes implementation.
+ *  Passing false selects the portable implementation (used for testing).
+ *  Returns the name of the implementation.
+ */
+std::string SipHashAutoDetect(bool use_optimized = true);
+
 #endif // BITCOIN_CRYPTO_SIPHASH_H
@@ -119,15 +119,18 @@ class CDBIterator
 private:
     const CDBWrapper &parent;
     leveldb::Iterator *piter;
+    //! snapshot the iterator reads, if any, kept alive as long as the iterator
+    std::shared_ptr<const leveldb::Snapshot> m_snapshot;
 
 public:
 
     /**
      * @param[in] _parent          Parent CDBWrapper instance.
      * @param[in] _piter           The original leveldb iterator.
+     * @param[in] snapshot         Snapshot _piter was created on, if any.
      */
-    CDBIterator(const CDBWrapper &_parent, leveldb::Iterator *_piter) :
-        parent(_parent), piter(_piter) { };
+    CDBIterator(const CDBWrapper &_parent, leveldb::Iterator *_piter, std::shared_ptr<const leveldb::Snapshot> snapshot = {}) :
+        parent(_parent), piter(_piter), m_snapshot(std::move(snapshot)) { };
     ~CDBIterator();
 
     bool Valid() const;
@@ -227,8 +230,30 @@ public:
     CDBWrapper(const CDBWrapper&) = delete;
     CDBWrapper& operator=(const CDBWrapper&) = delete;
 
+    //! A consistent view of the database, released once no longer referenced
+    using Snapshot = std::shared_ptr<const leveldb::Snapshot>;
+
+    Snapshot GetSnapshot() const
+    {
+        return Snapshot{pdb->GetSnapshot(), [db = pdb](const leveldb::Snapshot* snapshot) { db->ReleaseSnapshot(snapshot); }};
+    }
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
+    {
+        return Read(key, value, readoptions);
+    }
+
+    template <typename K, typename V>
+    bool Read(const K& key, V& value, const Snapshot& snapshot) const
+    {
+        leveldb::ReadOptions options{readoptions};
+        options.snapshot = snapshot.get();
+        return Read(key, value, options);
+    }
+
+    template <typename K, typename V>
+    bool Read(const K& key, V& value, const leveldb::ReadOptions& options) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
@@ -236,7 +261,7 @@ public:
         leveldb::Slice slKey((const char*)ssKey.data(), ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -298,6 +323,13 @@ public:
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
+    CDBIterator *NewIterator(const Snapshot& snapshot)
+    {
+        leveldb::ReadOptions options{iteroptions};
+        options.snapshot = snapshot.get();
+        return new CDBIterator(*this, pdb->NewIterator(options), snapshot);
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
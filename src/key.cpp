@@ -11,6 +11,7 @@
 #include <random.h>
 
 #include <secp256k1.h>
+#include <secp256k1_ecdh.h>
 #include <secp256k1_extrakeys.h>
 #include <secp256k1_recovery.h>
 #include <secp256k1_schnorrsig.h>
@@ -279,6 +280,14 @@ bool CKey::SignSchnorr(const uint256& hash, Span<unsigned char> sig, const uint2
     return ret;
 }
 
+bool CKey::ComputeECDHSecret(const CPubKey& pubkey, uint256& secret) const
+{
+    assert(fValid);
+    secp256k1_pubkey their_pubkey;
+    if (!secp256k1_ec_pubkey_parse(secp256k1_context_sign, &their_pubkey, pubkey.data(), pubkey.size())) return false;
+    return secp256k1_ecdh(secp256k1_context_sign, secret.begin(), &their_pubkey, begin(), nullptr, nullptr);
+}
+
 bool CKey::Load(const CPrivKey &seckey, const CPubKey &vchPubKey, bool fSkipCheck=false) {
     if (!ec_seckey_import_der(secp256k1_context_sign, (unsigned char*)begin(), seckey.data(), seckey.size()))
         return false;
@@ -140,6 +140,12 @@ public:
      */
     bool SignSchnorr(const uint256& hash, Span<unsigned char> sig, const uint256* merkle_root = nullptr, const uint256* aux = nullptr) const;
 
+    /**
+     * Compute the ECDH secret shared with the owner of pubkey: the SHA256 of the compressed
+     * encoding of pubkey multiplied by this key. Returns false if pubkey is invalid.
+     */
+    bool ComputeECDHSecret(const CPubKey& pubkey, uint256& secret) const;
+
     //! Derive BIP32 child key.
     bool Derive(CKey& keyChild, ChainCode &ccChild, unsigned int nChild, const ChainCode& cc) const;
 
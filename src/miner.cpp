@@ -23,6 +23,7 @@
 #include <util/system.h>
 
 #include <algorithm>
+#include <queue>
 #include <utility>
 #include <iostream> 
 #include <sstream>
@@ -103,16 +104,11 @@ void BlockAssembler::resetBlock()
     nFees = 0;
 }
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+CBlockIndex* BlockAssembler::StartBlock()
 {
-    int64_t nTimeStart = GetTimeMicros();
-
     resetBlock();
 
     pblocktemplate.reset(new CBlockTemplate());
-
-    if(!pblocktemplate.get())
-        return nullptr;
     CBlock* const pblock = &pblocktemplate->block; // pointer for convenience
 
     // Add dummy coinbase tx as first transaction
@@ -120,7 +116,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
 
-    LOCK2(cs_main, m_mempool.cs);
     CBlockIndex* pindexPrev = m_chainstate.m_chain.Tip();
     assert(pindexPrev != nullptr);
     nHeight = pindexPrev->nHeight + 1;
@@ -149,11 +144,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = DeploymentActiveAfter(pindexPrev, chainparams.GetConsensus(), Consensus::DEPLOYMENT_SEGWIT);
 
-    int nPackagesSelected = 0;
-    int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    return pindexPrev;
+}
 
-    int64_t nTime1 = GetTimeMicros();
+void BlockAssembler::FinishBlock(const CScript& scriptPubKeyIn, CBlockIndex* pindexPrev)
+{
+    CBlock* const pblock = &pblocktemplate->block; // pointer for convenience
 
     m_last_block_num_txs = nBlockTx;
     m_last_block_weight = nBlockWeight;
@@ -190,13 +186,125 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if (!TestBlockValidity(state, chainparams, m_chainstate, *pblock, pindexPrev, false, false)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, state.ToString()));
     }
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, m_mempool.cs);
+    CBlockIndex* pindexPrev = StartBlock();
+
+    int nPackagesSelected = 0;
+    int nDescendantsUpdated = 0;
+    if (m_mempool.UsesClusters()) {
+        addChunkTxs(nPackagesSelected);
+    } else {
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
+
+    int64_t nTime1 = GetTimeMicros();
+
+    FinishBlock(scriptPubKeyIn, pindexPrev);
+
     int64_t nTime2 = GetTimeMicros();
 
     LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << pblocktemplate->block;
-    std::string strHex = HexStr(ssBlock);
+    return std::move(pblocktemplate);
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::UpdateBlock(const CBlockTemplate& previous, const std::vector<uint256>& candidates, const CScript& scriptPubKeyIn, bool& selection_stale)
+{
+    int64_t nTimeStart = GetTimeMicros();
+    selection_stale = false;
+
+    LOCK2(cs_main, m_mempool.cs);
+    if (m_chainstate.m_chain.Tip() == nullptr || m_chainstate.m_chain.Tip()->GetBlockHash() != previous.block.hashPrevBlock) {
+        return nullptr;
+    }
+    CBlockIndex* pindexPrev = StartBlock();
+
+    // Carry over the previous selection in its original order. A transaction
+    // that has left the mempool takes its in-block descendants with it.
+    for (size_t i = 1; i < previous.block.vtx.size(); ++i) {
+        std::optional<CTxMemPool::txiter> it = m_mempool.GetIter(previous.block.vtx[i]->GetHash());
+        bool parents_in_block = it.has_value();
+        if (parents_in_block) {
+            for (const CTxMemPoolEntry& parent : (*it)->GetMemPoolParentsConst()) {
+                if (!inBlock.count(m_mempool.mapTx.iterator_to(parent))) {
+                    parents_in_block = false;
+                    break;
+                }
+            }
+        }
+        if (!parents_in_block) {
+            selection_stale = true;
+            continue;
+        }
+        AddToBlock(*it);
+    }
+
+    // Append the new arrivals, best ancestor score first.
+    std::vector<CTxMemPool::txiter> new_entries;
+    new_entries.reserve(candidates.size());
+    for (const uint256& txid : candidates) {
+        std::optional<CTxMemPool::txiter> it = m_mempool.GetIter(txid);
+        if (it && !inBlock.count(*it)) new_entries.push_back(*it);
+    }
+    std::sort(new_entries.begin(), new_entries.end(), [](const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) {
+        return CompareTxMemPoolEntryByAncestorBurnFee()(*a, *b);
+    });
+
+    int nPackagesSelected = 0;
+    for (CTxMemPool::txiter iter : new_entries) {
+        // May have been pulled in as the ancestor of an earlier candidate.
+        if (inBlock.count(iter)) continue;
+
+        CTxMemPool::setEntries ancestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        m_mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+
+        onlyUnconfirmed(ancestors);
+        ancestors.insert(iter);
+
+        uint64_t packageSize = 0;
+        CAmount packageFees = 0;
+        int64_t packageSigOpsCost = 0;
+        for (CTxMemPool::txiter it : ancestors) {
+            packageSize += it->GetTxSize();
+            packageFees += it->GetModifiedFee();
+            packageSigOpsCost += it->GetSigOpCost();
+        }
+
+        if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
+            continue;
+        }
+        if (!TestPackage(packageSize, packageSigOpsCost)) {
+            // A full selection could evict cheaper packages to make room.
+            selection_stale = true;
+            continue;
+        }
+        if (!TestPackageTransactions(ancestors)) {
+            continue;
+        }
+
+        std::vector<CTxMemPool::txiter> sortedEntries;
+        SortForBlock(ancestors, sortedEntries);
+        for (CTxMemPool::txiter entry : sortedEntries) {
+            AddToBlock(entry);
+        }
+        ++nPackagesSelected;
+    }
+
+    int64_t nTime1 = GetTimeMicros();
+
+    FinishBlock(scriptPubKeyIn, pindexPrev);
+
+    int64_t nTime2 = GetTimeMicros();
+
+    LogPrint(BCLog::BENCH, "UpdateBlock() packages: %.2fms (%d new packages), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -475,6 +583,67 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+// With a clustered mempool every cluster already comes as a sequence of chunks
+// in mining order, each of which only depends on earlier chunks of the same
+// cluster. Block assembly is then a merge of those sequences: repeatedly take
+// the best next chunk of any cluster. No ancestor state needs updating as
+// chunks are included. If a chunk cannot be included, the rest of its
+// cluster is dropped, since later chunks may depend on it.
+void BlockAssembler::addChunkTxs(int& nPackagesSelected)
+{
+    struct Cursor {
+        const TxCluster* cluster;
+        size_t next;
+        const ClusterChunk& Chunk() const { return cluster->chunks[next]; }
+    };
+    auto worse = [](const Cursor& a, const Cursor& b) { return CompareClusterChunk()(b.Chunk(), a.Chunk()); };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(worse)> queue(worse);
+    for (const auto& [id, cluster] : m_mempool.GetClusters()) {
+        queue.push({&cluster, 0});
+    }
+
+    const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+    int64_t nConsecutiveFailed = 0;
+
+    while (!queue.empty()) {
+        Cursor cursor = queue.top();
+        queue.pop();
+        const ClusterChunk& chunk = cursor.Chunk();
+
+        if (chunk.fee < blockMinFeeRate.GetFee(chunk.size)) {
+            continue;
+        }
+
+        if (!TestPackage(chunk.size, chunk.sigop_cost)) {
+            ++nConsecutiveFailed;
+            if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockWeight >
+                    nBlockMaxWeight - 4000) {
+                // Give up if we're close to full and haven't succeeded in a while
+                break;
+            }
+            continue;
+        }
+
+        CTxMemPool::setEntries package;
+        for (const CTxMemPoolEntry* entry : chunk.txs) {
+            package.insert(m_mempool.mapTx.iterator_to(*entry));
+        }
+        if (!TestPackageTransactions(package)) {
+            continue;
+        }
+
+        nConsecutiveFailed = 0;
+        for (const CTxMemPoolEntry* entry : chunk.txs) {
+            AddToBlock(m_mempool.mapTx.iterator_to(*entry));
+        }
+        ++nPackagesSelected;
+
+        if (++cursor.next < cursor.cluster->chunks.size()) {
+            queue.push(cursor);
+        }
+    }
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -493,3 +662,142 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+BlockTemplateBuilder::BlockTemplateBuilder(ChainstateManager& chainman, const CTxMemPool& mempool, const CChainParams& params, CAmount fee_delta)
+    : m_chainman(chainman),
+      m_mempool(mempool),
+      m_chainparams(params),
+      m_fee_delta(fee_delta)
+{
+}
+
+void BlockTemplateBuilder::TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence)
+{
+    LOCK(m_pending_mutex);
+    if (m_pending_overflow) return;
+    if (m_pending_txids.size() >= MAX_TEMPLATE_PENDING_TXIDS) {
+        std::vector<uint256>().swap(m_pending_txids);
+        m_pending_overflow = true;
+        return;
+    }
+    m_pending_txids.push_back(tx->GetHash());
+}
+
+void BlockTemplateBuilder::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence)
+{
+    // Block removals come with a new tip, which forces a rebuild anyway.
+    if (reason == MemPoolRemovalReason::BLOCK) return;
+    LOCK(m_pending_mutex);
+    m_pending_removals = true;
+}
+
+void BlockTemplateBuilder::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload) return;
+    Refresh();
+}
+
+void BlockTemplateBuilder::UpdateTemplate(const CScript& scriptPubKeyIn)
+{
+    std::vector<uint256> candidates;
+    bool overflow;
+    bool removals;
+    {
+        LOCK(m_pending_mutex);
+        candidates.swap(m_pending_txids);
+        overflow = m_pending_overflow;
+        m_pending_overflow = false;
+        removals = m_pending_removals;
+        m_pending_removals = false;
+    }
+
+    CChainState& chainstate = m_chainman.ActiveChainstate();
+    const uint256 tip_hash = chainstate.m_chain.Tip()->GetBlockHash();
+    const std::chrono::seconds now = GetTime<std::chrono::seconds>();
+
+    m_selection_stale |= removals;
+    const bool rebuild = !m_template ||
+                         m_template->block.hashPrevBlock != tip_hash ||
+                         scriptPubKeyIn != m_script_pub_key ||
+                         overflow ||
+                         (m_selection_stale && now - m_last_full_build >= TEMPLATE_REBUILD_INTERVAL);
+
+    if (rebuild) {
+        m_template = BlockAssembler(chainstate, m_mempool, m_chainparams).CreateNewBlock(scriptPubKeyIn);
+        m_script_pub_key = scriptPubKeyIn;
+        m_last_full_build = now;
+        m_selection_stale = false;
+    } else if (!candidates.empty() || removals) {
+        bool selection_stale{false};
+        std::unique_ptr<CBlockTemplate> updated = BlockAssembler(chainstate, m_mempool, m_chainparams).UpdateBlock(*m_template, candidates, scriptPubKeyIn, selection_stale);
+        // cs_main is held, so the tip cannot have moved under UpdateBlock.
+        assert(updated);
+        m_template = std::move(updated);
+        m_selection_stale |= selection_stale;
+    } else {
+        return;
+    }
+    if (!m_template) return;
+
+    // Decide whether listeners should switch to this template.
+    const CAmount fees = -m_template->vTxFees[0];
+    {
+        LOCK(m_notify_mutex);
+        if (m_notified_prev_block == m_template->block.hashPrevBlock && fees <= m_notified_fees + m_fee_delta) {
+            // Measure the next rise from the lowest point since the last notification.
+            m_notified_fees = std::min(m_notified_fees, fees);
+            return;
+        }
+        m_notified_prev_block = m_template->block.hashPrevBlock;
+        m_notified_fees = fees;
+        ++m_template_sequence;
+    }
+    m_notify_cv.notify_all();
+    if (m_publish_templates) {
+        GetMainSignals().NewBlockTemplate(std::make_shared<const CBlock>(m_template->block));
+    }
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateBuilder::GetTemplate(const CScript& scriptPubKeyIn, uint64_t* sequence)
+{
+    // cs_main is taken first so that callers already holding it (such as
+    // getblocktemplate) agree on the lock order.
+    LOCK2(::cs_main, m_template_mutex);
+    UpdateTemplate(scriptPubKeyIn);
+    if (!m_template) return nullptr;
+
+    if (sequence) *sequence = GetTemplateSequence();
+    return std::make_unique<CBlockTemplate>(*m_template);
+}
+
+void BlockTemplateBuilder::Refresh()
+{
+    if (!m_publish_templates && m_waiters == 0) return;
+
+    LOCK2(::cs_main, m_template_mutex);
+    if (m_chainman.ActiveChainstate().IsInitialBlockDownload()) return;
+    try {
+        UpdateTemplate(CScript() << OP_TRUE);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+}
+
+uint64_t BlockTemplateBuilder::GetTemplateSequence() const
+{
+    LOCK(m_notify_mutex);
+    return m_template_sequence;
+}
+
+uint64_t BlockTemplateBuilder::WaitForTemplate(uint64_t known_sequence, std::chrono::milliseconds timeout)
+{
+    ++m_waiters;
+    uint64_t sequence;
+    {
+        WAIT_LOCK(m_notify_mutex, lock);
+        m_notify_cv.wait_for(lock, timeout, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_notify_mutex) { return m_template_sequence != known_sequence; });
+        sequence = m_template_sequence;
+    }
+    --m_waiters;
+    return sequence;
+}
@@ -8,9 +8,14 @@
 
 #include <deadpool/deadpool.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
 #include <validation.h>
+#include <validationinterface.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
 #include <optional>
 #include <stdint.h>
@@ -165,6 +170,14 @@ public:
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
 
+    /** Construct a new block template on the same tip as previous, keeping the
+      * previous transactions that are still in the mempool and appending the
+      * ancestor packages of candidates. Returns nullptr if the tip has moved.
+      * selection_stale is set when a full CreateNewBlock could do noticeably
+      * better, e.g. a candidate package did not fit. */
+    std::unique_ptr<CBlockTemplate> UpdateBlock(const CBlockTemplate& previous, const std::vector<uint256>& candidates,
+                                                const CScript& scriptPubKeyIn, bool& selection_stale);
+
     inline static std::optional<int64_t> m_last_block_num_txs{};
     inline static std::optional<int64_t> m_last_block_weight{};
 
@@ -172,6 +185,10 @@ private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
+    /** Start a new template on the current tip and fill in the chain context. Returns the tip. */
+    CBlockIndex* StartBlock() EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool.cs);
+    /** Fill in the header and coinbase of the template and check its validity */
+    void FinishBlock(const CScript& scriptPubKeyIn, CBlockIndex* pindexPrev) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
 
@@ -180,6 +197,9 @@ private:
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
     void addPackageTxs(int& nPackagesSelected, int& nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Add transactions chunk by chunk from the mempool's cluster linearizations.
+      * Used instead of addPackageTxs when the mempool tracks clusters. */
+    void addChunkTxs(int& nPackagesSelected) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
@@ -202,6 +222,87 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set& mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 };
 
+/** Minimum time between two full template rebuilds triggered by mempool changes */
+static constexpr std::chrono::seconds TEMPLATE_REBUILD_INTERVAL{5};
+/** How often template listeners are checked for a better template */
+static constexpr std::chrono::seconds TEMPLATE_NOTIFY_INTERVAL{1};
+/** Most mempool additions remembered between two template refreshes. Beyond this the next refresh
+ *  does a full rebuild instead, so nodes that never ask for templates don't keep growing the list. */
+static constexpr size_t MAX_TEMPLATE_PENDING_TXIDS{10000};
+/** Default for -blocktemplatefeedelta */
+static constexpr CAmount DEFAULT_BLOCK_TEMPLATE_FEE_DELTA{10000};
+
+/**
+ * Keeps the most recent block template and refreshes it from mempool
+ * notifications, so that callers polling for templates only pay for the
+ * transactions that arrived since the last call. A full package selection is
+ * run on a new tip, after more than MAX_TEMPLATE_PENDING_TXIDS additions, or
+ * at most every TEMPLATE_REBUILD_INTERVAL when the incremental selection has
+ * fallen behind.
+ *
+ * The template sequence number is bumped whenever the template moves to a new
+ * tip or its fees rise by more than the configured delta. Long-polling
+ * getblocktemplate callers wait on it, and NewBlockTemplate is signalled for
+ * ZMQ if publishing is enabled.
+ */
+class BlockTemplateBuilder final : public CValidationInterface
+{
+public:
+    BlockTemplateBuilder(ChainstateManager& chainman, const CTxMemPool& mempool, const CChainParams& params,
+                         CAmount fee_delta = DEFAULT_BLOCK_TEMPLATE_FEE_DELTA);
+
+    /** Return a copy of the current template with coinbase to scriptPubKeyIn,
+     *  and optionally the template sequence number it corresponds to. */
+    std::unique_ptr<CBlockTemplate> GetTemplate(const CScript& scriptPubKeyIn, uint64_t* sequence = nullptr)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_template_mutex, !m_pending_mutex, !m_notify_mutex);
+
+    /** Bring the template up to date if anybody is listening. Called every TEMPLATE_NOTIFY_INTERVAL. */
+    void Refresh() EXCLUSIVE_LOCKS_REQUIRED(!m_template_mutex, !m_pending_mutex, !m_notify_mutex);
+
+    uint64_t GetTemplateSequence() const EXCLUSIVE_LOCKS_REQUIRED(!m_notify_mutex);
+    /** Wait until the template sequence differs from known_sequence or timeout expires. Returns the current sequence. */
+    uint64_t WaitForTemplate(uint64_t known_sequence, std::chrono::milliseconds timeout) EXCLUSIVE_LOCKS_REQUIRED(!m_notify_mutex);
+
+    /** Whether to signal NewBlockTemplate on every template change */
+    void SetPublishTemplates(bool publish) { m_publish_templates = publish; }
+
+protected:
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override EXCLUSIVE_LOCKS_REQUIRED(!m_pending_mutex);
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) override EXCLUSIVE_LOCKS_REQUIRED(!m_pending_mutex);
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override
+        EXCLUSIVE_LOCKS_REQUIRED(!m_template_mutex, !m_pending_mutex, !m_notify_mutex);
+
+private:
+    void UpdateTemplate(const CScript& scriptPubKeyIn) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_template_mutex, !m_pending_mutex, !m_notify_mutex);
+
+    ChainstateManager& m_chainman;
+    const CTxMemPool& m_mempool;
+    const CChainParams& m_chainparams;
+    const CAmount m_fee_delta;
+
+    Mutex m_template_mutex;
+    std::unique_ptr<CBlockTemplate> m_template GUARDED_BY(m_template_mutex);
+    CScript m_script_pub_key GUARDED_BY(m_template_mutex);
+    std::chrono::seconds m_last_full_build GUARDED_BY(m_template_mutex){0};
+    bool m_selection_stale GUARDED_BY(m_template_mutex){false};
+
+    Mutex m_pending_mutex;
+    //! Transactions added to the mempool since the template was last refreshed
+    std::vector<uint256> m_pending_txids GUARDED_BY(m_pending_mutex);
+    //! More than MAX_TEMPLATE_PENDING_TXIDS transactions were added, m_pending_txids is incomplete
+    bool m_pending_overflow GUARDED_BY(m_pending_mutex){false};
+    bool m_pending_removals GUARDED_BY(m_pending_mutex){false};
+
+    mutable Mutex m_notify_mutex;
+    std::condition_variable m_notify_cv;
+    uint64_t m_template_sequence GUARDED_BY(m_notify_mutex){0};
+    uint256 m_notified_prev_block GUARDED_BY(m_notify_mutex);
+    CAmount m_notified_fees GUARDED_BY(m_notify_mutex){0};
+
+    std::atomic<int> m_waiters{0};
+    std::atomic<bool> m_publish_templates{false};
+};
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
@@ -13,6 +13,7 @@
 #include <clientversion.h>
 #include <compat.h>
 #include <consensus/consensus.h>
+#include <crypto/hkdf_sha256_32.h>
 #include <crypto/sha256.h>
 #include <i2p.h>
 #include <net_permissions.h>
@@ -22,9 +23,11 @@
 #include <protocol.h>
 #include <random.h>
 #include <scheduler.h>
+#include <support/cleanse.h>
 #include <util/sock.h>
 #include <util/strencodings.h>
 #include <util/thread.h>
+#include <util/threadnames.h>
 #include <util/translation.h>
 
 #ifdef WIN32
@@ -41,6 +44,15 @@
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+#ifdef USE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
 #include <algorithm>
 #include <array>
 #include <cstdint>
@@ -59,6 +71,9 @@ const char* const ANCHORS_DATABASE_FILENAME = "anchors.dat";
 // How often to dump addresses to peers.dat
 static constexpr std::chrono::minutes DUMP_PEERS_INTERVAL{15};
 
+/** Maximum number of bytes of a file range handed to the socket at once */
+static constexpr size_t MAX_FILE_SEND_CHUNK = 256 * 1024;
+
 /** Number of DNS seeds to query when the number of connections is low. */
 static constexpr int DNSSEEDS_TO_QUERY_AT_ONCE = 3;
 
@@ -97,6 +112,9 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+/** Maximum number of ready sockets reported by one epoll_wait() call; the rest are reported by the next */
+static const size_t MAX_EPOLL_EVENTS = 256;
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -487,7 +505,9 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
     if (!addr_bind.IsValid()) {
         addr_bind = GetBindAddress(sock->Get());
     }
-    CNode* pnode = new CNode(id, nLocalServices, sock->Release(), addrConnect, CalculateKeyedNetGroup(addrConnect), nonce, addr_bind, pszDest ? pszDest : "", conn_type, /* inbound_onion */ false);
+    // Only peers which announced NODE_P2P_V2 are known to accept the v2 transport.
+    const bool use_v2_transport{m_use_v2_transport && (addrConnect.nServices & NODE_P2P_V2)};
+    CNode* pnode = new CNode(id, nLocalServices, sock->Release(), addrConnect, CalculateKeyedNetGroup(addrConnect), nonce, addr_bind, pszDest ? pszDest : "", conn_type, /* inbound_onion */ false, use_v2_transport);
     pnode->AddRef();
 
     // We're making a new connection, harvest entropy from the time (and our peer count)
@@ -533,6 +553,28 @@ std::string ConnectionTypeAsString(ConnectionType conn_type)
     assert(false);
 }
 
+std::string SendClassAsString(SendClass send_class)
+{
+    switch (send_class) {
+    case SendClass::TIP:
+        return "tip";
+    case SendClass::TX_RELAY:
+        return "tx-relay";
+    case SendClass::BLOCK_SERVING:
+        return "block-serving";
+    } // no default case, so the compiler can warn about missing cases
+
+    assert(false);
+}
+
+/** Priority class of a message that was not given one explicitly. */
+static SendClass DefaultSendClass(const std::string& msg_type)
+{
+    if (msg_type == NetMsgType::BLOCK || msg_type == NetMsgType::MERKLEBLOCK) return SendClass::BLOCK_SERVING;
+    if (msg_type == NetMsgType::TX || msg_type == NetMsgType::INV || msg_type == NetMsgType::NOTFOUND) return SendClass::TX_RELAY;
+    return SendClass::TIP;
+}
+
 std::string CNode::GetAddrName() const {
     LOCK(cs_addrName);
     return addrName;
@@ -598,6 +640,7 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
     {
         LOCK(cs_vSend);
         X(mapSendBytesPerMsgCmd);
+        X(m_send_bytes_per_class);
         X(nSendBytes);
     }
     {
@@ -630,6 +673,10 @@ bool CNode::ReceiveMsgBytes(Span<const uint8_t> msg_bytes, bool& complete)
     LOCK(cs_vRecv);
     nLastRecv = std::chrono::duration_cast<std::chrono::seconds>(time).count();
     nRecvBytes += msg_bytes.size();
+    if (m_v2_handshake && !ReadV2Handshake(msg_bytes)) {
+        // The key exchange failed, disconnect from the peer.
+        return false;
+    }
     while (msg_bytes.size() > 0) {
         // absorb network data
         int handled = m_deserializer->Read(msg_bytes);
@@ -667,6 +714,113 @@ bool CNode::ReceiveMsgBytes(Span<const uint8_t> msg_bytes, bool& complete)
     return true;
 }
 
+bool CNode::ReadV2Handshake(Span<const uint8_t>& msg_bytes)
+{
+    const int handled{m_v2_handshake->Read(msg_bytes)};
+    if (handled < 0) {
+        LogPrint(BCLog::NET, "v2 transport key exchange failed, peer=%d\n", id);
+        return false;
+    }
+    msg_bytes = msg_bytes.subspan(handled);
+    if (!m_v2_handshake->IsV1() && !m_v2_handshake->Complete()) return true;
+
+    LOCK(cs_vSend);
+    if (m_v2_handshake->IsV1()) {
+        LogPrint(BCLog::NET, "peer=%d uses the v1 transport\n", id);
+        m_serializer = std::make_unique<V1TransportSerializer>(V1TransportSerializer());
+        // The network magic read by the key exchange starts the first v1 message.
+        Span<const uint8_t> message_start{m_v2_handshake->GetReceived()};
+        if (m_deserializer->Read(message_start) < 0) return false;
+        assert(message_start.empty() && !m_deserializer->Complete());
+    } else {
+        LogPrint(BCLog::NET, "v2 transport key exchange completed, peer=%d\n", id);
+        if (IsInboundConn()) {
+            const Span<const uint8_t> pubkey{m_v2_handshake->GetOurPubKey()};
+            vSendMsg.push_back(std::vector<unsigned char>(pubkey.begin(), pubkey.end()));
+            nSendSize += pubkey.size();
+        }
+        m_deserializer = std::make_unique<V2TransportDeserializer>(m_v2_handshake->GetRecvKeys(), id, SER_NETWORK, INIT_PROTO_VERSION);
+        m_serializer = std::make_unique<V2TransportSerializer>(m_v2_handshake->GetSendKeys());
+    }
+    m_v2_handshake.reset();
+
+    // Queue what was pushed in the meantime, ahead of any later message.
+    for (CSerializedNetMsg& msg : m_v2_pending_msgs) {
+        if (!QueueMessage(std::move(msg))) return false;
+    }
+    m_v2_pending_msgs.clear();
+    return true;
+}
+
+RecvBufferPool& RecvBufferPool::Instance()
+{
+    // Never destroyed, as messages may still be destroyed during static deinitialization.
+    static RecvBufferPool* const pool{new RecvBufferPool()};
+    return *pool;
+}
+
+CDataStream RecvBufferPool::Acquire(size_t payload_size, int type, int version)
+{
+    const auto size_class{std::lower_bound(CLASS_SIZES.begin(), CLASS_SIZES.end(), payload_size) - CLASS_SIZES.begin()};
+    if (size_class < (ptrdiff_t)CLASS_SIZES.size()) {
+        LOCK(m_mutex);
+        auto& buffers{m_buffers[size_class]};
+        if (!buffers.empty()) {
+            CDataStream stream{std::move(buffers.back())};
+            buffers.pop_back();
+            m_bytes -= stream.capacity();
+            ++m_reused;
+            stream.SetType(type);
+            stream.SetVersion(version);
+            return stream;
+        }
+        ++m_allocated;
+    }
+    // Buffers are allocated with the capacity of their whole class, so that they can be reused for
+    // any message of the class. Don't allocate more than 256 KiB ahead of the data actually received,
+    // though: larger buffers grow as the payload arrives, see Reserve().
+    const size_t class_size{size_class < (ptrdiff_t)CLASS_SIZES.size() ? CLASS_SIZES[size_class] : payload_size};
+    CDataStream stream{type, version};
+    stream.reserve(std::min<size_t>(class_size, 256 * 1024));
+    return stream;
+}
+
+void RecvBufferPool::Release(CDataStream&& stream)
+{
+    CDataStream pooled{std::move(stream)};
+    pooled.clear();
+    const size_t capacity{pooled.capacity()};
+    if (capacity < CLASS_SIZES.front()) return;
+    // The largest class all of whose messages fit into the buffer. A buffer larger than that class
+    // size holds on to more memory than any message of the class needs, so it is freed.
+    const auto size_class{std::upper_bound(CLASS_SIZES.begin(), CLASS_SIZES.end(), capacity) - CLASS_SIZES.begin() - 1};
+    if (capacity > CLASS_SIZES[size_class]) return;
+    LOCK(m_mutex);
+    auto& buffers{m_buffers[size_class]};
+    if (buffers.size() >= CLASS_MAX_BUFFERS[size_class] || m_bytes + capacity > MAX_BYTES) return;
+    m_bytes += capacity;
+    buffers.push_back(std::move(pooled));
+}
+
+void RecvBufferPool::Reserve(CDataStream& stream, size_t size, size_t payload_size)
+{
+    if (stream.capacity() >= size) return;
+    const auto size_class{std::lower_bound(CLASS_SIZES.begin(), CLASS_SIZES.end(), payload_size) - CLASS_SIZES.begin()};
+    const size_t limit{size_class < (ptrdiff_t)CLASS_SIZES.size() ? CLASS_SIZES[size_class] : payload_size};
+    stream.reserve(std::min(limit, std::max(size, 2 * stream.capacity())));
+}
+
+RecvBufferPoolStats RecvBufferPool::GetStats() const
+{
+    LOCK(m_mutex);
+    RecvBufferPoolStats stats;
+    for (const auto& buffers : m_buffers) stats.buffers += buffers.size();
+    stats.bytes = m_bytes;
+    stats.reused = m_reused;
+    stats.allocated = m_allocated;
+    return stats;
+}
+
 int V1TransportDeserializer::readHeader(Span<const uint8_t> msg_bytes)
 {
     // copy data to temporary parsing buffer
@@ -701,6 +855,10 @@ int V1TransportDeserializer::readHeader(Span<const uint8_t> msg_bytes)
         return -1;
     }
 
+    // Receive the payload into a pooled buffer which has room for all of it.
+    RecvBufferPool::Instance().Release(std::move(vRecv));
+    vRecv = RecvBufferPool::Instance().Acquire(hdr.nMessageSize, hdrbuf.GetType(), hdrbuf.GetVersion());
+
     // switch state to reading message data
     in_data = true;
 
@@ -713,8 +871,8 @@ int V1TransportDeserializer::readData(Span<const uint8_t> msg_bytes)
     unsigned int nCopy = std::min<unsigned int>(nRemaining, msg_bytes.size());
 
     if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        RecvBufferPool::Reserve(vRecv, nDataPos + nCopy, hdr.nMessageSize);
+        vRecv.resize(nDataPos + nCopy);
     }
 
     hasher.Write(msg_bytes.first(nCopy));
@@ -770,44 +928,276 @@ std::optional<CNetMessage> V1TransportDeserializer::GetMessage(const std::chrono
 }
 
 void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
-    // create dbl-sha256 checksum
-    uint256 hash = Hash(msg.data);
-
     // create header
-    CMessageHeader hdr(Params().MessageStart(), msg.m_type.c_str(), msg.data.size());
-    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CMessageHeader hdr(Params().MessageStart(), msg.m_type.c_str(), msg.PayloadSize());
+    if (msg.m_checksum) {
+        memcpy(hdr.pchChecksum, msg.m_checksum->data(), CMessageHeader::CHECKSUM_SIZE);
+    } else {
+        // File payloads are never hashed here, their checksum must be known
+        assert(!msg.m_file_payload);
+        // create dbl-sha256 checksum
+        uint256 hash = Hash(msg.Payload());
+        memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    }
 
     // serialize header
     header.reserve(CMessageHeader::HEADER_SIZE);
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, header, 0, hdr};
 }
 
+V2Handshake::V2Handshake(bool initiator, const CChainParams& chain_params)
+    : m_initiator(initiator),
+      m_chain_params(chain_params)
+{
+    // A responder would take a public key starting with the network magic for a v1 message header.
+    do {
+        m_key.MakeNewKey(/* fCompressed */ true);
+        m_our_pubkey = m_key.GetPubKey();
+    } while (memcmp(m_our_pubkey.data(), m_chain_params.MessageStart(), CMessageHeader::MESSAGE_START_SIZE) == 0);
+}
+
+int V2Handshake::Read(Span<const uint8_t> msg_bytes)
+{
+    assert(!m_v1 && !m_complete);
+    if (msg_bytes.empty()) return 0;
+
+    size_t copy{std::min(V2_PUBKEY_SIZE - m_their_pubkey_pos, msg_bytes.size())};
+    if (!m_initiator && m_their_pubkey_pos < CMessageHeader::MESSAGE_START_SIZE) {
+        // As long as what was received matches the network magic, the peer may be sending a v1
+        // message header: read no further until the whole magic is there.
+        const size_t magic_size{std::min(CMessageHeader::MESSAGE_START_SIZE - m_their_pubkey_pos, copy)};
+        if (memcmp(msg_bytes.data(), m_chain_params.MessageStart() + m_their_pubkey_pos, magic_size) == 0) {
+            copy = magic_size;
+            m_v1 = m_their_pubkey_pos + copy == CMessageHeader::MESSAGE_START_SIZE;
+        }
+    }
+    memcpy(m_their_pubkey.data() + m_their_pubkey_pos, msg_bytes.data(), copy);
+    m_their_pubkey_pos += copy;
+    if (m_v1 || m_their_pubkey_pos < V2_PUBKEY_SIZE) return copy;
+
+    uint256 secret;
+    if (!m_key.ComputeECDHSecret(CPubKey{m_their_pubkey}, secret)) return -1;
+
+    // Both sides hash the public keys in the same order, the initiator's first.
+    unsigned char ikm[32 + 2 * V2_PUBKEY_SIZE];
+    memcpy(ikm, secret.begin(), 32);
+    memcpy(ikm + 32, m_initiator ? m_our_pubkey.data() : m_their_pubkey.data(), V2_PUBKEY_SIZE);
+    memcpy(ikm + 32 + V2_PUBKEY_SIZE, m_initiator ? m_their_pubkey.data() : m_our_pubkey.data(), V2_PUBKEY_SIZE);
+    const std::string salt{"bitcoin_v2_shared_secret" + std::string{m_chain_params.MessageStart(), m_chain_params.MessageStart() + CMessageHeader::MESSAGE_START_SIZE}};
+    CHKDF_HMAC_SHA256_L32 hkdf{ikm, sizeof(ikm), salt};
+    memory_cleanse(ikm, sizeof(ikm));
+    memory_cleanse(secret.begin(), secret.size());
+
+    // The initiator sends with the A keys, the responder with the B keys.
+    V2CipherKeys& keys_a{m_initiator ? m_send_keys : m_recv_keys};
+    V2CipherKeys& keys_b{m_initiator ? m_recv_keys : m_send_keys};
+    hkdf.Expand32("BitcoinK1A", keys_a.k1.data());
+    hkdf.Expand32("BitcoinK2A", keys_a.k2.data());
+    hkdf.Expand32("BitcoinK1B", keys_b.k1.data());
+    hkdf.Expand32("BitcoinK2B", keys_b.k2.data());
+    m_complete = true;
+    return copy;
+}
+
+V2TransportDeserializer::V2TransportDeserializer(const V2CipherKeys& keys, const NodeId node_id, int nTypeIn, int nVersionIn)
+    : m_node_id(node_id),
+      m_aead(keys.k1.data(), keys.k1.size(), keys.k2.data(), keys.k2.size()),
+      m_recv(nTypeIn, nVersionIn)
+{
+}
+
+int V2TransportDeserializer::readLength(Span<const uint8_t> msg_bytes)
+{
+    const unsigned int copy = std::min<unsigned int>(CHACHA20_POLY1305_AEAD_AAD_LEN - m_length_pos, msg_bytes.size());
+    memcpy(m_length + m_length_pos, msg_bytes.data(), copy);
+    m_length_pos += copy;
+    if (m_length_pos < CHACHA20_POLY1305_AEAD_AAD_LEN) return copy;
+
+    m_aead.GetLength(&m_payload_size, m_seqnr / AAD_PACKAGES_PER_ROUND, (m_seqnr % AAD_PACKAGES_PER_ROUND) * CHACHA20_POLY1305_AEAD_AAD_LEN, m_length);
+    // The payload starts with the length of the command, and the command.
+    if (m_payload_size > 1 + CMessageHeader::COMMAND_SIZE + std::min<size_t>(MAX_SIZE, MAX_PROTOCOL_MESSAGE_LENGTH)) {
+        LogPrint(BCLog::NET, "Frame error: Size too large (%u bytes), peer=%d\n", m_payload_size, m_node_id);
+        return -1;
+    }
+
+    // Receive the frame into a pooled buffer which has room for all of it.
+    const int type{m_recv.GetType()}, version{m_recv.GetVersion()};
+    RecvBufferPool::Instance().Release(std::move(m_recv));
+    m_recv = RecvBufferPool::Instance().Acquire(FrameSize(), type, version);
+    m_recv.write((const char*)m_length, CHACHA20_POLY1305_AEAD_AAD_LEN);
+    return copy;
+}
+
+int V2TransportDeserializer::readFrame(Span<const uint8_t> msg_bytes)
+{
+    const size_t received{m_recv.size()};
+    const unsigned int copy = std::min<size_t>(FrameSize() - received, msg_bytes.size());
+    RecvBufferPool::Reserve(m_recv, received + copy, FrameSize());
+    m_recv.write((const char*)msg_bytes.data(), copy);
+    if (m_recv.size() < FrameSize()) return copy;
+
+    // Check the MAC, and decrypt the frame in place.
+    const uint64_t seqnr{m_seqnr++};
+    if (!m_aead.Crypt(seqnr, seqnr / AAD_PACKAGES_PER_ROUND, (seqnr % AAD_PACKAGES_PER_ROUND) * CHACHA20_POLY1305_AEAD_AAD_LEN,
+                      m_recv.data(), m_recv.size(), m_recv.data(), m_recv.size(), /* is_encrypt */ false)) {
+        LogPrint(BCLog::NET, "Frame error: Invalid MAC (%u bytes), peer=%d\n", m_payload_size, m_node_id);
+        return -1;
+    }
+    m_recv.resize(CHACHA20_POLY1305_AEAD_AAD_LEN + m_payload_size);
+
+    // Split off the command. A malformed one leaves m_command empty, and the message is dropped.
+    const size_t command_size = m_payload_size > 0 ? m_recv[CHACHA20_POLY1305_AEAD_AAD_LEN] : 0;
+    if (command_size > 0 && command_size <= CMessageHeader::COMMAND_SIZE && 1 + command_size <= m_payload_size) {
+        const char* command{(const char*)m_recv.data() + CHACHA20_POLY1305_AEAD_AAD_LEN + 1};
+        if (std::all_of(command, command + command_size, [](char c) { return c >= ' ' && c <= 0x7E; })) {
+            m_command.assign(command, command_size);
+        }
+    }
+    m_recv.ignore(std::min<size_t>(CHACHA20_POLY1305_AEAD_AAD_LEN + 1 + command_size, m_recv.size()));
+    m_complete = true;
+    return copy;
+}
+
+std::optional<CNetMessage> V2TransportDeserializer::GetMessage(const std::chrono::microseconds time, uint32_t& out_err_raw_size)
+{
+    const uint32_t raw_size = FrameSize();
+    std::optional<CNetMessage> msg(std::move(m_recv));
+    msg->m_command = m_command;
+    msg->m_time = time;
+    msg->m_message_size = msg->m_recv.size();
+    msg->m_raw_message_size = raw_size;
+
+    // We just received a message off the wire, harvest entropy from the time
+    RandAddEvent(m_payload_size);
+
+    if (m_command.empty()) {
+        LogPrint(BCLog::NET, "Frame error: Invalid message type (%u bytes), peer=%d\n", m_payload_size, m_node_id);
+        out_err_raw_size = raw_size;
+        msg.reset();
+    }
+
+    // Always reset the network deserializer (prepare for the next message)
+    Reset();
+    return msg;
+}
+
+V2TransportSerializer::V2TransportSerializer(const V2CipherKeys& keys)
+    : m_aead(keys.k1.data(), keys.k1.size(), keys.k2.data(), keys.k2.size())
+{
+}
+
+void V2TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header)
+{
+    // File payloads must have been read into msg.data, to be encrypted
+    assert(!msg.m_file_payload);
+    assert(!msg.m_type.empty() && msg.m_type.size() <= CMessageHeader::COMMAND_SIZE);
+
+    const Span<const unsigned char> payload{msg.Payload()};
+    const uint32_t payload_size = 1 + msg.m_type.size() + payload.size();
+    std::vector<unsigned char> frame(CHACHA20_POLY1305_AEAD_AAD_LEN + payload_size + POLY1305_TAGLEN);
+    frame[0] = payload_size & 0xff;
+    frame[1] = (payload_size >> 8) & 0xff;
+    frame[2] = (payload_size >> 16) & 0xff;
+    frame[3] = msg.m_type.size();
+    memcpy(frame.data() + 4, msg.m_type.data(), msg.m_type.size());
+    if (!payload.empty()) memcpy(frame.data() + 4 + msg.m_type.size(), payload.data(), payload.size());
+
+    const uint64_t seqnr{m_seqnr++};
+    const bool ret{m_aead.Crypt(seqnr, seqnr / AAD_PACKAGES_PER_ROUND, (seqnr % AAD_PACKAGES_PER_ROUND) * CHACHA20_POLY1305_AEAD_AAD_LEN,
+                                frame.data(), frame.size(), frame.data(), frame.size() - POLY1305_TAGLEN, /* is_encrypt */ true)};
+    assert(ret);
+    msg.data = std::move(frame);
+    msg.m_shared_payload.reset();
+}
+
+static size_t SendBufferSize(const CNode::SendBuffer& buffer)
+{
+    if (const auto* range = std::get_if<FileRange>(&buffer)) return range->size;
+    if (const auto* shared = std::get_if<std::shared_ptr<const std::vector<unsigned char>>>(&buffer)) return (*shared)->size();
+    return std::get<std::vector<unsigned char>>(buffer).size();
+}
+
+/** Read a whole file range into memory. */
+static bool ReadFileRange(const FileRange& range, std::vector<unsigned char>& data)
+{
+    data.resize(range.size);
+    return fseek(range.file.get(), range.offset, SEEK_SET) == 0 &&
+           fread(data.data(), 1, range.size, range.file.get()) == range.size;
+}
+
+/**
+ * Send part of a file range, starting `sent` bytes into it and at most max_size bytes long. Returns
+ * the result of the underlying send call, or nullopt if the file could not be read.
+ */
+static std::optional<int> SendFileRange(SOCKET socket, const FileRange& range, size_t sent, size_t max_size)
+{
+    const size_t chunk = std::min({range.size - sent, MAX_FILE_SEND_CHUNK, max_size});
+#ifdef USE_SENDFILE
+    // The kernel copies straight from the page cache to the socket. sendfile() takes no
+    // flags: sockets are non-blocking, and SIGPIPE is ignored process-wide.
+    off_t offset = range.offset + sent;
+    const ssize_t ret = sendfile(socket, fileno(range.file.get()), &offset, chunk);
+    // Nothing copied for a non-empty range means the file ended early (e.g. it was
+    // truncated), which would otherwise leave the send queue waiting forever.
+    if (ret == 0) return std::nullopt;
+    return ret;
+#else
+    std::vector<unsigned char> data(chunk);
+    if (fseek(range.file.get(), range.offset + sent, SEEK_SET) != 0 ||
+        fread(data.data(), 1, chunk, range.file.get()) != chunk) {
+        return std::nullopt;
+    }
+    return send(socket, reinterpret_cast<const char*>(data.data()), chunk, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+}
+
 size_t CConnman::SocketSendData(CNode& node) const
 {
-    auto it = node.vSendMsg.begin();
     size_t nSentSize = 0;
 
-    while (it != node.vSendMsg.end()) {
-        const auto& data = *it;
-        assert(data.size() > node.nSendOffset);
+    while (!node.vSendMsg.empty()) {
+        const size_t size = SendBufferSize(node.vSendMsg.front());
+        assert(size > node.nSendOffset);
+        // Historical blocks take turns with those of other peers, see SocketHandler().
+        size_t max_size = size - node.nSendOffset;
+        if (node.m_sending_class == SendClass::BLOCK_SERVING) {
+            max_size = std::min(max_size, node.m_block_serving_allowance);
+            if (max_size == 0) break;
+        }
         int nBytes = 0;
+        bool read_error = false;
         {
             LOCK(node.cs_hSocket);
             if (node.hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(node.hSocket, reinterpret_cast<const char*>(data.data()) + node.nSendOffset, data.size() - node.nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (const auto* data = std::get_if<std::vector<unsigned char>>(&node.vSendMsg.front())) {
+                nBytes = send(node.hSocket, reinterpret_cast<const char*>(data->data()) + node.nSendOffset, max_size, MSG_NOSIGNAL | MSG_DONTWAIT);
+            } else if (const auto* shared = std::get_if<std::shared_ptr<const std::vector<unsigned char>>>(&node.vSendMsg.front())) {
+                nBytes = send(node.hSocket, reinterpret_cast<const char*>((*shared)->data()) + node.nSendOffset, max_size, MSG_NOSIGNAL | MSG_DONTWAIT);
+            } else if (const auto sent = SendFileRange(node.hSocket, std::get<FileRange>(node.vSendMsg.front()), node.nSendOffset, max_size)) {
+                nBytes = *sent;
+            } else {
+                read_error = true;
+            }
+        }
+        if (read_error) {
+            LogPrint(BCLog::NET, "block file read error while sending to peer=%d\n", node.GetId());
+            node.CloseSocketDisconnect();
+            break;
         }
         if (nBytes > 0) {
             node.nLastSend = GetTimeSeconds();
             node.nSendBytes += nBytes;
             node.nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (node.nSendOffset == data.size()) {
+            if (node.m_sending_class == SendClass::BLOCK_SERVING) node.m_block_serving_allowance -= nBytes;
+            if (node.nSendOffset == size) {
                 node.nSendOffset = 0;
-                node.nSendSize -= data.size();
+                node.nSendSize -= size;
                 node.fPauseSend = node.nSendSize > nSendBufferMaxSize;
-                it++;
-            } else {
+                node.vSendMsg.pop_front();
+                if (node.vSendMsg.empty()) node.DequeueMessage();
+            } else if ((size_t)nBytes < max_size) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -825,11 +1215,10 @@ size_t CConnman::SocketSendData(CNode& node) const
         }
     }
 
-    if (it == node.vSendMsg.end()) {
+    if (node.vSendMsg.empty()) {
         assert(node.nSendOffset == 0);
         assert(node.nSendSize == 0);
     }
-    node.vSendMsg.erase(node.vSendMsg.begin(), it);
     return nSentSize;
 }
 
@@ -1155,6 +1544,9 @@ void CConnman::CreateNodeFromAcceptedSocket(SOCKET hSocket,
     // According to the internet TCP_NODELAY is not carried into accepted sockets
     // on all platforms.  Set it again here just to be sure.
     SetSocketNoDelay(hSocket);
+    // send() and recv() are always called with MSG_DONTWAIT, but sendfile() has no flags,
+    // so make the socket non-blocking like our outbound ones.
+    SetSocketNonBlocking(hSocket, true);
 
     // Don't accept connections from banned peers.
     bool banned = m_banman && m_banman->IsBanned(addr);
@@ -1193,7 +1585,8 @@ void CConnman::CreateNodeFromAcceptedSocket(SOCKET hSocket,
     }
 
     const bool inbound_onion = std::find(m_onion_binds.begin(), m_onion_binds.end(), addr_bind) != m_onion_binds.end();
-    CNode* pnode = new CNode(id, nodeServices, hSocket, addr, CalculateKeyedNetGroup(addr), nonce, addr_bind, "", ConnectionType::INBOUND, inbound_onion);
+    // Inbound peers using the v1 transport are told apart by their first bytes.
+    CNode* pnode = new CNode(id, nodeServices, hSocket, addr, CalculateKeyedNetGroup(addr), nonce, addr_bind, "", ConnectionType::INBOUND, inbound_onion, m_use_v2_transport);
     pnode->AddRef();
     pnode->m_permissionFlags = permissionFlags;
     pnode->m_prefer_evict = discouraged;
@@ -1268,7 +1661,8 @@ void CConnman::DisconnectNodes()
                 // remove from vNodes
                 vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
-                // release outbound grant (if any)
+                // release outbound grant (if any), unless it is kept to connect again
+                MaybeQueueV1Reconnection(*pnode);
                 pnode->grantOutbound.Release();
 
                 // close socket and cleanup
@@ -1294,6 +1688,36 @@ void CConnman::DisconnectNodes()
     }
 }
 
+void CConnman::MaybeQueueV1Reconnection(CNode& node)
+{
+    if (!fNetworkActive || interruptNet || !node.V2HandshakePending()) return;
+
+    LogPrint(BCLog::NET, "v2 transport key exchange did not complete, connecting to peer=%d again over v1\n", node.GetId());
+    CAddress addr{node.addr};
+    addr.nServices = ServiceFlags(addr.nServices & ~NODE_P2P_V2);
+    addrman.SetServices(addr, addr.nServices);
+
+    LOCK(m_reconnections_mutex);
+    ReconnectionInfo& reconnection{m_reconnections.emplace_back()};
+    reconnection.addr = addr;
+    reconnection.conn_type = node.m_conn_type;
+    node.grantOutbound.MoveTo(reconnection.grant);
+}
+
+void CConnman::PerformReconnections()
+{
+    while (true) {
+        std::list<ReconnectionInfo> reconnection;
+        {
+            LOCK(m_reconnections_mutex);
+            if (m_reconnections.empty()) break;
+            reconnection.splice(reconnection.end(), m_reconnections, m_reconnections.begin());
+        }
+        ReconnectionInfo& item{reconnection.front()};
+        OpenNetworkConnection(item.addr, /* fCountFailure */ false, &item.grant, /* pszDest */ nullptr, item.conn_type);
+    }
+}
+
 void CConnman::NotifyNumConnectionsChanged()
 {
     size_t vNodesSize;
@@ -1392,7 +1816,7 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &s
 }
 
 #ifdef USE_POLL
-void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+void CConnman::SocketEventsPoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
     if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set)) {
@@ -1434,7 +1858,7 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
     }
 }
 #else
-void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+void CConnman::SocketEventsSelect(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
     if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set)) {
@@ -1509,6 +1933,142 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 }
 #endif
 
+#ifdef USE_EPOLL
+void CConnman::SocketEventsEpoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+    // Bring the registrations in line with what each peer wants to wait for, following the same
+    // logic as GenerateSelectSet(). Only peers whose state changed since the last iteration cost
+    // a system call; listening sockets and the wakeup pipe stay registered from InitSocketEvents().
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes) {
+            const bool select_recv = !pnode->fPauseRecv;
+            const bool select_send = WITH_LOCK(pnode->cs_vSend, return !pnode->vSendMsg.empty());
+            const uint32_t events = select_send ? static_cast<uint32_t>(EPOLLOUT) : (select_recv ? static_cast<uint32_t>(EPOLLIN) : uint32_t{0});
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET || pnode->m_epoll_events == events) continue;
+
+            struct epoll_event event{};
+            event.events = events;
+            event.data.fd = pnode->hSocket;
+            const int op = pnode->m_epoll_events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+            if (epoll_ctl(m_epoll_fd, op, pnode->hSocket, &event) != 0) {
+                LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(errno));
+                pnode->fDisconnect = true;
+                continue;
+            }
+            pnode->m_epoll_events = events;
+        }
+    }
+
+    // A closed socket leaves the epoll set by itself, so there is nothing to unregister.
+    std::array<struct epoll_event, MAX_EPOLL_EVENTS> events;
+    const int num_events = epoll_wait(m_epoll_fd, events.data(), events.size(), SELECT_TIMEOUT_MILLISECONDS);
+    if (num_events < 0) {
+        if (errno != EINTR) {
+            LogPrintf("epoll_wait error %s\n", NetworkErrorString(errno));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    if (interruptNet) return;
+
+    for (int i = 0; i < num_events; ++i) {
+        if (events[i].data.fd == m_wakeup_pipe[0]) {
+            char buf[128];
+            while (read(m_wakeup_pipe[0], buf, sizeof(buf)) > 0) {}
+            continue;
+        }
+        const SOCKET socket_id = events[i].data.fd;
+        if (events[i].events & EPOLLIN)              recv_set.insert(socket_id);
+        if (events[i].events & EPOLLOUT)             send_set.insert(socket_id);
+        if (events[i].events & (EPOLLERR|EPOLLHUP))  error_set.insert(socket_id);
+    }
+}
+#endif
+
+void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+#ifdef USE_EPOLL
+    if (m_socket_events_mode == SocketEventsMode::EPOLL) {
+        SocketEventsEpoll(recv_set, send_set, error_set);
+        return;
+    }
+#endif
+#ifdef USE_POLL
+    SocketEventsPoll(recv_set, send_set, error_set);
+#else
+    SocketEventsSelect(recv_set, send_set, error_set);
+#endif
+}
+
+bool CConnman::InitSocketEvents()
+{
+    CloseSocketEvents();
+#ifdef USE_EPOLL
+    if (m_socket_events_mode != SocketEventsMode::EPOLL) return true;
+
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd < 0) {
+        LogPrintf("epoll_create1 failed: %s\n", NetworkErrorString(errno));
+        return false;
+    }
+    if (pipe2(m_wakeup_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        LogPrintf("Creating the socket handler wakeup pipe failed: %s\n", NetworkErrorString(errno));
+        CloseSocketEvents();
+        return false;
+    }
+
+    std::vector<SOCKET> sockets{static_cast<SOCKET>(m_wakeup_pipe[0])};
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        sockets.push_back(hListenSocket.socket);
+    }
+    for (SOCKET socket_id : sockets) {
+        struct epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = socket_id;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, socket_id, &event) != 0) {
+            LogPrintf("epoll_ctl failed: %s\n", NetworkErrorString(errno));
+            CloseSocketEvents();
+            return false;
+        }
+    }
+
+    // Sockets of existing peers are (re)registered on the next iteration.
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodes) {
+        LOCK(pnode->cs_hSocket);
+        pnode->m_epoll_events.reset();
+    }
+#endif
+    return true;
+}
+
+void CConnman::CloseSocketEvents()
+{
+#ifdef USE_EPOLL
+    for (int* fd : {&m_epoll_fd, &m_wakeup_pipe[0], &m_wakeup_pipe[1]}) {
+        if (*fd != -1) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+#endif
+}
+
+void CConnman::WakeSocketHandler()
+{
+#ifdef USE_EPOLL
+    if (m_wakeup_pipe[1] != -1) {
+        // If the pipe is full a wakeup is pending already.
+        const char c = 0;
+        if (write(m_wakeup_pipe[1], &c, 1) < 0) {}
+    }
+#endif
+}
+
 void CConnman::SocketHandler()
 {
     std::set<SOCKET> recv_set, send_set, error_set;
@@ -1587,7 +2147,7 @@ void CConnman::SocketHandler()
                         pnode->nProcessQueueSize += nSizeAdded;
                         pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                     }
-                    WakeMessageHandler();
+                    WakeMessageHandler(*pnode);
                 }
             }
             else if (nBytes == 0)
@@ -1613,8 +2173,15 @@ void CConnman::SocketHandler()
         }
 
         if (sendSet) {
-            // Send data
-            size_t bytes_sent = WITH_LOCK(pnode->cs_vSend, return SocketSendData(*pnode));
+            // Send data. Peers served historical blocks take turns, each sending up to
+            // BLOCK_SERVING_QUANTUM bytes of them per pass, so that one peer with a fast
+            // link does not hold up the others. Other messages are sent without limit.
+            size_t bytes_sent;
+            {
+                LOCK(pnode->cs_vSend);
+                pnode->m_block_serving_allowance = BLOCK_SERVING_QUANTUM;
+                bytes_sent = SocketSendData(*pnode);
+            }
             if (bytes_sent) RecordBytesSent(bytes_sent);
         }
 
@@ -1641,9 +2208,20 @@ void CConnman::WakeMessageHandler()
 {
     {
         LOCK(mutexMsgProc);
-        fMsgProcWake = true;
+        m_msgproc_wake.assign(m_msgproc_wake.size(), true);
+    }
+    condMsgProc.notify_all();
+}
+
+void CConnman::WakeMessageHandler(const CNode& node)
+{
+    {
+        LOCK(mutexMsgProc);
+        if (m_msgproc_wake.empty()) return;
+        m_msgproc_wake[node.GetId() % m_msgproc_wake.size()] = true;
     }
-    condMsgProc.notify_one();
+    // The threads share the condition variable, the ones with nothing to do go back to sleep.
+    condMsgProc.notify_all();
 }
 
 void CConnman::ThreadDNSAddressSeed()
@@ -1868,6 +2446,7 @@ void CConnman::ThreadOpenConnections(const std::vector<std::string> connect)
     while (!interruptNet)
     {
         ProcessAddrFetch();
+        PerformReconnections();
 
         if (!interruptNet.sleep_for(std::chrono::milliseconds(500)))
             return;
@@ -2231,16 +2810,22 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     }
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int worker)
 {
+    if (m_msghand_threads > 1) util::ThreadRename(strprintf("msghand.%i", worker));
+
     FastRandomContext rng;
     while (!flagInterruptMsgProc)
     {
+        // All messages of a peer are processed by the same thread, in the order
+        // they were received. Message processing state shared between peers is
+        // protected by the message processor itself.
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
+            for (CNode* pnode : vNodes) {
+                if (pnode->GetId() % m_msghand_threads != worker) continue;
+                vNodesCopy.push_back(pnode);
                 pnode->AddRef();
             }
         }
@@ -2280,9 +2865,9 @@ void CConnman::ThreadMessageHandler()
 
         WAIT_LOCK(mutexMsgProc, lock);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this]() EXCLUSIVE_LOCKS_REQUIRED(mutexMsgProc) { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this, worker]() EXCLUSIVE_LOCKS_REQUIRED(mutexMsgProc) { return m_msgproc_wake[worker]; });
         }
-        fMsgProcWake = false;
+        m_msgproc_wake[worker] = false;
     }
 }
 
@@ -2520,6 +3105,15 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         return false;
     }
 
+    if (!InitSocketEvents()) {
+        if (clientInterface) {
+            clientInterface->ThreadSafeMessageBox(
+                strprintf(_("Failed to set up %s socket events."), SocketEventsModeToString(m_socket_events_mode)),
+                "", CClientUIInterface::MSG_ERROR);
+        }
+        return false;
+    }
+
     proxyType i2p_sam;
     if (GetProxy(NET_I2P, i2p_sam)) {
         m_i2p_sam_session = std::make_unique<i2p::sam::Session>(gArgs.GetDataDirNet() / "i2p_private_key",
@@ -2578,7 +3172,7 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
 
     {
         LOCK(mutexMsgProc);
-        fMsgProcWake = false;
+        m_msgproc_wake.assign(m_msghand_threads, false);
     }
 
     // Send and receive from sockets, accept connections
@@ -2607,7 +3201,9 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     }
 
     // Process messages
-    threadMessageHandler = std::thread(&util::TraceThread, "msghand", [this] { ThreadMessageHandler(); });
+    for (int worker = 0; worker < m_msghand_threads; ++worker) {
+        m_message_handler_threads.emplace_back(&util::TraceThread, "msghand", [this, worker] { ThreadMessageHandler(worker); });
+    }
 
     if (connOptions.m_i2p_accept_incoming && m_i2p_sam_session.get() != nullptr) {
         threadI2PAcceptIncoming =
@@ -2644,6 +3240,7 @@ void CConnman::Interrupt()
     condMsgProc.notify_all();
 
     interruptNet();
+    WakeSocketHandler();
     InterruptSocks5(true);
 
     if (semOutbound) {
@@ -2664,8 +3261,10 @@ void CConnman::StopThreads()
     if (threadI2PAcceptIncoming.joinable()) {
         threadI2PAcceptIncoming.join();
     }
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : m_message_handler_threads) {
+        thread.join();
+    }
+    m_message_handler_threads.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2714,6 +3313,8 @@ void CConnman::StopNodes()
     }
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+    CloseSocketEvents();
+    WITH_LOCK(m_reconnections_mutex, m_reconnections.clear());
     semOutbound.reset();
     semAddnode.reset();
 }
@@ -2972,7 +3573,7 @@ ServiceFlags CConnman::GetLocalServices() const
 
 unsigned int CConnman::GetReceiveFloodSize() const { return nReceiveFloodSize; }
 
-CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, SOCKET hSocketIn, const CAddress& addrIn, uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn, const CAddress& addrBindIn, const std::string& addrNameIn, ConnectionType conn_type_in, bool inbound_onion)
+CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, SOCKET hSocketIn, const CAddress& addrIn, uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn, const CAddress& addrBindIn, const std::string& addrNameIn, ConnectionType conn_type_in, bool inbound_onion, bool use_v2_transport)
     : nTimeConnected(GetTimeSeconds()),
       addr(addrIn),
       addrBind(addrBindIn),
@@ -3001,7 +3602,18 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, SOCKET hSocketIn, const
     }
 
     m_deserializer = std::make_unique<V1TransportDeserializer>(V1TransportDeserializer(Params(), GetId(), SER_NETWORK, INIT_PROTO_VERSION));
-    m_serializer = std::make_unique<V1TransportSerializer>(V1TransportSerializer());
+    if (use_v2_transport) {
+        // The serializer is set once the key exchange has completed. We send our key first if we
+        // initiated the connection, and otherwise once the peer has sent theirs.
+        m_v2_handshake = std::make_unique<V2Handshake>(/* initiator */ conn_type_in != ConnectionType::INBOUND, Params());
+        if (conn_type_in != ConnectionType::INBOUND) {
+            const Span<const uint8_t> pubkey{m_v2_handshake->GetOurPubKey()};
+            vSendMsg.push_back(std::vector<unsigned char>(pubkey.begin(), pubkey.end()));
+            nSendSize += pubkey.size();
+        }
+    } else {
+        m_serializer = std::make_unique<V1TransportSerializer>(V1TransportSerializer());
+    }
 }
 
 CNode::~CNode()
@@ -3016,34 +3628,101 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    size_t nMessageSize = msg.PayloadSize();
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.m_type), nMessageSize, pnode->GetId());
     if (gArgs.GetBoolArg("-capturemessages", false)) {
-        CaptureMessage(pnode->addr, msg.m_type, msg.data, /* incoming */ false);
+        if (!msg.m_file_payload) {
+            CaptureMessage(pnode->addr, msg.m_type, msg.Payload(), /* incoming */ false);
+        } else if (std::vector<unsigned char> data; ReadFileRange(*msg.m_file_payload, data)) {
+            CaptureMessage(pnode->addr, msg.m_type, data, /* incoming */ false);
+        }
     }
 
-    // make sure we use the appropriate network transport format
-    std::vector<unsigned char> serializedHeader;
-    pnode->m_serializer->prepareForTransport(msg, serializedHeader);
-    size_t nTotalSize = nMessageSize + serializedHeader.size();
-
     size_t nBytesSent = 0;
+    bool wake_socket_handler = false;
     {
         LOCK(pnode->cs_vSend);
+        if (!pnode->m_serializer) {
+            // The v2 key exchange is still going on, the message is queued once it has completed.
+            pnode->m_v2_pending_msgs.push_back(std::move(msg));
+            return;
+        }
         bool optimisticSend(pnode->vSendMsg.empty());
 
-        //log total amount of bytes per message type
-        pnode->mapSendBytesPerMsgCmd[msg.m_type] += nTotalSize;
-        pnode->nSendSize += nTotalSize;
-
+        if (!pnode->QueueMessage(std::move(msg))) {
+            LogPrint(BCLog::NET, "block file read error while sending to peer=%d\n", pnode->GetId());
+            pnode->CloseSocketDisconnect();
+            return;
+        }
         if (pnode->nSendSize > nSendBufferMaxSize) pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize) pnode->vSendMsg.push_back(std::move(msg.data));
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend) nBytesSent = SocketSendData(*pnode);
+        // If that left data queued, let the socket handler wait for the socket to become writable
+        wake_socket_handler = optimisticSend && !pnode->vSendMsg.empty();
     }
     if (nBytesSent) RecordBytesSent(nBytesSent);
+    if (wake_socket_handler) WakeSocketHandler();
+}
+
+bool CNode::QueueMessage(CSerializedNetMsg&& msg)
+{
+    if (msg.m_file_payload && !m_serializer->AllowsFilePayload()) {
+        if (!ReadFileRange(*msg.m_file_payload, msg.data)) return false;
+        msg.m_file_payload.reset();
+    }
+    msg.m_send_class = msg.m_send_class.value_or(DefaultSendClass(msg.m_type));
+
+    // A message is only queued behind one that is being sent, which it cannot overtake. It is
+    // serialized once it is up for sending, as the v2 transport encrypts messages in sending order.
+    if (vSendMsg.empty()) {
+        StartSending(std::move(msg));
+    } else {
+        nSendSize += msg.PayloadSize();
+        m_send_queues[static_cast<size_t>(*msg.m_send_class)].push_back(std::move(msg));
+    }
+    return true;
+}
+
+void CNode::DequeueMessage()
+{
+    for (size_t i = 0; i < NUM_SEND_CLASSES; ++i) {
+        if (m_send_queues[i].empty()) continue;
+        CSerializedNetMsg msg{std::move(m_send_queues[i].front())};
+        m_send_queues[i].pop_front();
+        nSendSize -= msg.PayloadSize();
+        StartSending(std::move(msg));
+        return;
+    }
+}
+
+void CNode::StartSending(CSerializedNetMsg&& msg)
+{
+    // make sure we use the appropriate network transport format
+    std::vector<unsigned char> serializedHeader;
+    m_serializer->prepareForTransport(msg, serializedHeader);
+    const size_t nPayloadSize = msg.PayloadSize();
+    const size_t nTotalSize = nPayloadSize + serializedHeader.size();
+
+    //log total amount of bytes per message type
+    mapSendBytesPerMsgCmd[msg.m_type] += nTotalSize;
+    m_send_bytes_per_class[static_cast<size_t>(*msg.m_send_class)] += nTotalSize;
+    nSendSize += nTotalSize;
+
+    assert(vSendMsg.empty());
+    if (!serializedHeader.empty()) vSendMsg.push_back(std::move(serializedHeader));
+    if (nPayloadSize) {
+        if (msg.m_file_payload) {
+            vSendMsg.push_back(std::move(*msg.m_file_payload));
+        } else if (msg.m_shared_payload) {
+            vSendMsg.push_back(std::move(msg.m_shared_payload));
+        } else {
+            vSendMsg.push_back(std::move(msg.data));
+        }
+    }
+    m_sending_class = *msg.m_send_class;
+    // Nothing to send, move on to the next message.
+    if (vSendMsg.empty()) DequeueMessage();
 }
 
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
@@ -3070,6 +3749,40 @@ std::chrono::microseconds CConnman::PoissonNextSendInbound(std::chrono::microsec
     return m_next_send_inv_to_incoming;
 }
 
+std::optional<SocketEventsMode> SocketEventsModeFromString(const std::string& str)
+{
+#ifdef USE_EPOLL
+    if (str == "epoll") return SocketEventsMode::EPOLL;
+#endif
+#ifdef USE_POLL
+    if (str == "poll") return SocketEventsMode::POLL;
+#else
+    if (str == "select") return SocketEventsMode::SELECT;
+#endif
+    return std::nullopt;
+}
+
+std::string SocketEventsModeToString(SocketEventsMode mode)
+{
+    switch (mode) {
+    case SocketEventsMode::SELECT: return "select";
+    case SocketEventsMode::POLL: return "poll";
+    case SocketEventsMode::EPOLL: return "epoll";
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+#ifdef USE_EPOLL
+    return "epoll, poll";
+#elif defined(USE_POLL)
+    return "poll";
+#else
+    return "select";
+#endif
+}
+
 std::chrono::microseconds PoissonNextSend(std::chrono::microseconds now, std::chrono::seconds average_interval)
 {
     double unscaled = -log1p(GetRand(1ULL << 48) * -0.0000000000000035527136788 /* -1/2^48 */);
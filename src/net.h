@@ -12,14 +12,18 @@
 #include <bloom.h>
 #include <chainparams.h>
 #include <compat.h>
+#include <crypto/chacha_poly_aead.h>
+#include <crypto/poly1305.h>
 #include <crypto/siphash.h>
 #include <hash.h>
 #include <i2p.h>
+#include <key.h>
 #include <net_permissions.h>
 #include <netaddress.h>
 #include <netbase.h>
 #include <policy/feerate.h>
 #include <protocol.h>
+#include <pubkey.h>
 #include <random.h>
 #include <span.h>
 #include <streams.h>
@@ -28,14 +32,18 @@
 #include <uint256.h>
 #include <util/check.h>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <condition_variable>
 #include <cstdint>
+#include <cstdio>
 #include <deque>
 #include <map>
 #include <memory>
 #include <optional>
 #include <thread>
+#include <variant>
 #include <vector>
 
 class CScheduler;
@@ -84,6 +92,33 @@ static const bool DEFAULT_DNSSEED = true;
 static const bool DEFAULT_FIXEDSEEDS = true;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Default for -msghandthreads, the number of threads processing P2P messages */
+static const int DEFAULT_MSGHAND_THREADS = 1;
+/** Maximum for -msghandthreads */
+static const int MAX_MSGHAND_THREADS = 16;
+/** Default for -v2transport */
+static const bool DEFAULT_V2_TRANSPORT = false;
+
+/** How the socket handler thread waits for sockets to become ready (-socketevents). */
+enum class SocketEventsMode {
+    SELECT, //!< select() on all sockets, rebuilt every iteration
+    POLL,   //!< poll() on all sockets, rebuilt every iteration
+    EPOLL,  //!< epoll, with registrations kept across iterations
+};
+
+#if defined(USE_EPOLL)
+static const SocketEventsMode DEFAULT_SOCKET_EVENTS_MODE = SocketEventsMode::EPOLL;
+#elif defined(USE_POLL)
+static const SocketEventsMode DEFAULT_SOCKET_EVENTS_MODE = SocketEventsMode::POLL;
+#else
+static const SocketEventsMode DEFAULT_SOCKET_EVENTS_MODE = SocketEventsMode::SELECT;
+#endif
+
+/** Parse a -socketevents value. Only modes supported by this build are accepted. */
+std::optional<SocketEventsMode> SocketEventsModeFromString(const std::string& str);
+std::string SocketEventsModeToString(SocketEventsMode mode);
+/** Comma-separated list of the -socketevents modes supported by this build. */
+std::string GetSupportedSocketEventsModes();
 
 typedef int64_t NodeId;
 
@@ -98,6 +133,33 @@ struct AddedNodeInfo
 class CNodeStats;
 class CClientUIInterface;
 
+/** A range of bytes in a file, sent to a peer straight from the file instead of being copied into memory first */
+struct FileRange
+{
+    std::shared_ptr<FILE> file;
+    uint64_t offset{0};
+    size_t size{0};
+};
+
+/**
+ * Priority classes of outgoing messages, highest first. A peer's queued messages are sent in
+ * order of class, and in the order they were pushed within a class.
+ */
+enum class SendClass : uint8_t {
+    /** New blocks and everything not listed below: headers, compact blocks, control messages */
+    TIP,
+    /** Transactions, and announcements of and replies about them */
+    TX_RELAY,
+    /** Blocks below the tip, served to peers catching up */
+    BLOCK_SERVING,
+};
+static constexpr size_t NUM_SEND_CLASSES{3};
+
+std::string SendClassAsString(SendClass send_class);
+
+/** Bytes of historical blocks a peer is allowed to send per pass of the socket handler */
+static constexpr size_t BLOCK_SERVING_QUANTUM{256 * 1024};
+
 struct CSerializedNetMsg
 {
     CSerializedNetMsg() = default;
@@ -109,6 +171,18 @@ struct CSerializedNetMsg
 
     std::vector<unsigned char> data;
     std::string m_type;
+    /** If set, the payload is sent from this file range, and data is unused */
+    std::optional<FileRange> m_file_payload;
+    /** If set, the payload is sent from this buffer shared with others (e.g. cached block payloads), and data is unused */
+    std::shared_ptr<const std::vector<unsigned char>> m_shared_payload;
+    /** If set, the payload checksum, which then is not computed again. Required when m_file_payload is set. */
+    std::optional<std::array<uint8_t, CMessageHeader::CHECKSUM_SIZE>> m_checksum;
+    /** If set, the priority class to send the message in, overriding the one of its type */
+    std::optional<SendClass> m_send_class;
+
+    /** The payload in memory, either data or the shared one. Empty for file payloads. */
+    Span<const unsigned char> Payload() const { return m_shared_payload ? Span<const unsigned char>{*m_shared_payload} : Span<const unsigned char>{data}; }
+    size_t PayloadSize() const { return m_file_payload ? m_file_payload->size : Payload().size(); }
 };
 
 /** Different types of connections to a peer. This enum encapsulates the
@@ -259,6 +333,7 @@ public:
     int m_starting_height;
     uint64_t nSendBytes;
     mapMsgCmdSize mapSendBytesPerMsgCmd;
+    std::array<uint64_t, NUM_SEND_CLASSES> m_send_bytes_per_class;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
     NetPermissionFlags m_permissionFlags;
@@ -278,6 +353,55 @@ public:
 };
 
 
+struct RecvBufferPoolStats {
+    /** Number of buffers in the pool, and their total capacity */
+    size_t buffers{0};
+    size_t bytes{0};
+    /** Number of buffers handed out from the pool, and newly allocated */
+    uint64_t reused{0};
+    uint64_t allocated{0};
+};
+
+/**
+ * Pool of buffers to receive message payloads into, shared by all peers.
+ *
+ * Buffers are kept in size classes. A message is received into a buffer of the class of the size
+ * announced in its header, which already has room for the whole payload, so it does not need to be
+ * grown while the payload arrives. Once the message has been processed, its buffer is returned to
+ * the pool for a later message instead of being freed, if it is no larger than its class size and
+ * the pool holds less than MAX_BYTES.
+ */
+class RecvBufferPool
+{
+public:
+    /** The pool used for all peers */
+    static RecvBufferPool& Instance();
+
+    /** Get an empty stream, with room for a payload of the given size if the pool had a buffer for it. */
+    CDataStream Acquire(size_t payload_size, int type, int version) LOCKS_EXCLUDED(m_mutex);
+    /** Return the buffer of a stream to the pool, unless the pool is full. */
+    void Release(CDataStream&& stream) LOCKS_EXCLUDED(m_mutex);
+    /** Grow a stream being received into to hold at least `size` bytes of a payload of `payload_size` bytes.
+     *  It grows geometrically, but not beyond the size class of the payload. */
+    static void Reserve(CDataStream& stream, size_t size, size_t payload_size);
+
+    RecvBufferPoolStats GetStats() const LOCKS_EXCLUDED(m_mutex);
+
+    /** Upper bounds of the size classes */
+    static constexpr std::array<size_t, 4> CLASS_SIZES{1024, 16 * 1024, 256 * 1024, MAX_PROTOCOL_MESSAGE_LENGTH};
+    /** Maximum number of pooled buffers per size class */
+    static constexpr std::array<size_t, 4> CLASS_MAX_BUFFERS{512, 128, 16, 4};
+    /** Maximum total capacity of the pooled buffers */
+    static constexpr size_t MAX_BYTES{8 * 1024 * 1024};
+
+private:
+    mutable Mutex m_mutex;
+    std::array<std::vector<CDataStream>, CLASS_SIZES.size()> m_buffers GUARDED_BY(m_mutex);
+    size_t m_bytes GUARDED_BY(m_mutex){0};
+    uint64_t m_reused GUARDED_BY(m_mutex){0};
+    uint64_t m_allocated GUARDED_BY(m_mutex){0};
+};
+
 /** Transport protocol agnostic message container.
  * Ideally it should only contain receive time, payload,
  * command and size.
@@ -291,6 +415,9 @@ public:
     std::string m_command;
 
     CNetMessage(CDataStream&& recv_in) : m_recv(std::move(recv_in)) {}
+    CNetMessage(CNetMessage&&) = default;
+    CNetMessage& operator=(CNetMessage&&) = default;
+    ~CNetMessage() { RecvBufferPool::Instance().Release(std::move(m_recv)); }
 
     void SetVersion(int nVersionIn)
     {
@@ -384,12 +511,132 @@ class TransportSerializer {
 public:
     // prepare message for transport (header construction, error-correction computation, payload encryption, etc.)
     virtual void prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) = 0;
+    // whether payloads can be sent straight from a file, otherwise they are read into msg.data first
+    virtual bool AllowsFilePayload() const = 0;
     virtual ~TransportSerializer() {}
 };
 
 class V1TransportSerializer  : public TransportSerializer {
 public:
     void prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) override;
+    bool AllowsFilePayload() const override { return true; }
+};
+
+/** Size of the ephemeral public keys exchanged to set up a v2 transport connection */
+static constexpr size_t V2_PUBKEY_SIZE{CPubKey::COMPRESSED_SIZE};
+
+/** Keys of the ChaCha20Poly1305 AEAD encrypting one direction of a v2 transport connection */
+struct V2CipherKeys
+{
+    std::array<unsigned char, CHACHA20_POLY1305_AEAD_KEY_LEN> k1;
+    std::array<unsigned char, CHACHA20_POLY1305_AEAD_KEY_LEN> k2;
+};
+
+/**
+ * Key exchange of a v2 transport connection (-v2transport).
+ *
+ * Both sides send an ephemeral public key, the initiator first. The keys of
+ * both directions are derived from the ECDH secret of the two keys and the
+ * network magic. A responder whose peer starts with the network magic of a
+ * v1 message header instead falls back to the v1 transport.
+ */
+class V2Handshake
+{
+public:
+    V2Handshake(bool initiator, const CChainParams& chain_params);
+
+    /** Our public key, to be sent to the peer */
+    Span<const uint8_t> GetOurPubKey() const { return m_our_pubkey; }
+    /** Read bytes of the peer's public key. Returns the number of bytes used, or -1 if the key exchange failed. */
+    int Read(Span<const uint8_t> msg_bytes);
+    /** Whether the peer turned out to use the v1 transport. Only a responder falls back. */
+    bool IsV1() const { return m_v1; }
+    /** Bytes read from the peer so far. Once IsV1(), the start of its first v1 message. */
+    Span<const uint8_t> GetReceived() const { return Span<const uint8_t>{m_their_pubkey}.first(m_their_pubkey_pos); }
+    /** Whether the keys have been derived */
+    bool Complete() const { return m_complete; }
+
+    /** Keys to encrypt what we send, once complete */
+    const V2CipherKeys& GetSendKeys() const { return m_send_keys; }
+    /** Keys to decrypt what we receive, once complete */
+    const V2CipherKeys& GetRecvKeys() const { return m_recv_keys; }
+
+private:
+    const bool m_initiator;
+    const CChainParams& m_chain_params;
+    CKey m_key;
+    CPubKey m_our_pubkey;
+    std::array<uint8_t, V2_PUBKEY_SIZE> m_their_pubkey;
+    size_t m_their_pubkey_pos{0};
+    bool m_v1{false};
+    bool m_complete{false};
+    V2CipherKeys m_send_keys;
+    V2CipherKeys m_recv_keys;
+};
+
+/**
+ * Deserializer of the v2 transport. Each message is a frame of a 3-byte encrypted
+ * length, the encrypted payload (command length, command and message data) and a
+ * Poly1305 MAC, which replaces the double-SHA256 checksum of the v1 transport.
+ */
+class V2TransportDeserializer final : public TransportDeserializer
+{
+private:
+    const NodeId m_node_id; // Only for logging
+    ChaCha20Poly1305AEAD m_aead;
+    uint64_t m_seqnr{0};            // sequence number of the message being received
+    uint8_t m_length[CHACHA20_POLY1305_AEAD_AAD_LEN]; // encrypted length, as received
+    unsigned int m_length_pos{0};
+    uint32_t m_payload_size{0};     // decrypted length of the payload
+    CDataStream m_recv;             // frame being received, then message data once complete
+    std::string m_command;
+    bool m_complete{false};
+
+    int readLength(Span<const uint8_t> msg_bytes);
+    int readFrame(Span<const uint8_t> msg_bytes);
+    size_t FrameSize() const { return CHACHA20_POLY1305_AEAD_AAD_LEN + m_payload_size + POLY1305_TAGLEN; }
+
+    void Reset()
+    {
+        m_recv.clear();
+        m_length_pos = 0;
+        m_payload_size = 0;
+        m_command.clear();
+        m_complete = false;
+    }
+
+public:
+    V2TransportDeserializer(const V2CipherKeys& keys, const NodeId node_id, int nTypeIn, int nVersionIn);
+
+    bool Complete() const override { return m_complete; }
+    void SetVersion(int nVersionIn) override
+    {
+        m_recv.SetVersion(nVersionIn);
+    }
+    int Read(Span<const uint8_t>& msg_bytes) override
+    {
+        int ret = m_length_pos < CHACHA20_POLY1305_AEAD_AAD_LEN ? readLength(msg_bytes) : readFrame(msg_bytes);
+        if (ret < 0) {
+            Reset();
+        } else {
+            msg_bytes = msg_bytes.subspan(ret);
+        }
+        return ret;
+    }
+    std::optional<CNetMessage> GetMessage(std::chrono::microseconds time, uint32_t& out_err_raw_size) override;
+};
+
+/** Serializer of the v2 transport, which encrypts each message into a frame (see V2TransportDeserializer) */
+class V2TransportSerializer : public TransportSerializer {
+private:
+    ChaCha20Poly1305AEAD m_aead;
+    uint64_t m_seqnr{0}; // sequence number of the next message
+
+public:
+    explicit V2TransportSerializer(const V2CipherKeys& keys);
+    // The whole frame is returned in msg.data, the header is left empty.
+    void prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) override;
+    bool AllowsFilePayload() const override { return false; }
 };
 
 /** Information about a peer */
@@ -400,17 +647,29 @@ class CNode
 
 public:
     std::unique_ptr<TransportDeserializer> m_deserializer;
-    std::unique_ptr<TransportSerializer> m_serializer;
+    /** Null until the v2 key exchange of the connection, if any, has completed */
+    std::unique_ptr<TransportSerializer> m_serializer GUARDED_BY(cs_vSend);
 
     NetPermissionFlags m_permissionFlags{NetPermissionFlags::None};
     std::atomic<ServiceFlags> nServices{NODE_NONE};
     SOCKET hSocket GUARDED_BY(cs_hSocket);
-    /** Total size of all vSendMsg entries */
+    /** Events hSocket is registered for with the epoll socket events backend, nullopt if it is not registered */
+    std::optional<uint32_t> m_epoll_events GUARDED_BY(cs_hSocket);
+    /** Total size of all vSendMsg entries and m_send_queues payloads */
     size_t nSendSize GUARDED_BY(cs_vSend){0};
     /** Offset inside the first vSendMsg already sent */
     size_t nSendOffset GUARDED_BY(cs_vSend){0};
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    /** Data queued for sending: serialized bytes, shared serialized bytes, or a range of a block file */
+    using SendBuffer = std::variant<std::vector<unsigned char>, std::shared_ptr<const std::vector<unsigned char>>, FileRange>;
+    /** The message being sent. Only empty if m_send_queues are empty as well. */
+    std::deque<SendBuffer> vSendMsg GUARDED_BY(cs_vSend);
+    /** Priority class of the message in vSendMsg */
+    SendClass m_sending_class GUARDED_BY(cs_vSend){SendClass::TIP};
+    /** Messages waiting for vSendMsg to drain, per priority class. They are serialized for the transport when dequeued. */
+    std::array<std::deque<CSerializedNetMsg>, NUM_SEND_CLASSES> m_send_queues GUARDED_BY(cs_vSend);
+    /** Bytes of historical blocks that may still be sent in this pass of the socket handler */
+    size_t m_block_serving_allowance GUARDED_BY(cs_vSend){0};
     Mutex cs_vSend;
     Mutex cs_hSocket;
     Mutex cs_vRecv;
@@ -579,7 +838,7 @@ public:
      * criterium in CConnman::AttemptToEvictConnection. */
     std::atomic<std::chrono::microseconds> m_min_ping_time{std::chrono::microseconds::max()};
 
-    CNode(NodeId id, ServiceFlags nLocalServicesIn, SOCKET hSocketIn, const CAddress& addrIn, uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn, const CAddress& addrBindIn, const std::string& addrNameIn, ConnectionType conn_type_in, bool inbound_onion);
+    CNode(NodeId id, ServiceFlags nLocalServicesIn, SOCKET hSocketIn, const CAddress& addrIn, uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn, const CAddress& addrBindIn, const std::string& addrNameIn, ConnectionType conn_type_in, bool inbound_onion, bool use_v2_transport = false);
     ~CNode();
     CNode(const CNode&) = delete;
     CNode& operator=(const CNode&) = delete;
@@ -609,6 +868,27 @@ public:
      */
     bool ReceiveMsgBytes(Span<const uint8_t> msg_bytes, bool& complete);
 
+    /**
+     * Queue a message for sending. It is serialized with the transport of this connection once
+     * it is up for sending, as v2 transport frames must be sent in the order they were encrypted.
+     *
+     * @return  False if a payload to be sent from a file could not be read.
+     */
+    bool QueueMessage(CSerializedNetMsg&& msg) EXCLUSIVE_LOCKS_REQUIRED(cs_vSend);
+
+    /** Move the highest priority queued message into vSendMsg, once the one before it has been sent. */
+    void DequeueMessage() EXCLUSIVE_LOCKS_REQUIRED(cs_vSend);
+
+    /** Serialize a message with the transport of this connection into the empty vSendMsg. */
+    void StartSending(CSerializedNetMsg&& msg) EXCLUSIVE_LOCKS_REQUIRED(cs_vSend);
+
+    /** Whether we initiated a v2 transport connection whose key exchange has not completed */
+    bool V2HandshakePending()
+    {
+        LOCK(cs_vRecv);
+        return !IsInboundConn() && m_v2_handshake;
+    }
+
     void SetCommonVersion(int greatest_common_version)
     {
         Assume(m_greatest_common_version == INIT_PROTO_VERSION);
@@ -697,6 +977,14 @@ private:
 
     std::list<CNetMessage> vRecvMsg;  // Used only by SocketHandler thread
 
+    //! Key exchange of the v2 transport, until it has completed or the peer turned out to use v1
+    std::unique_ptr<V2Handshake> m_v2_handshake GUARDED_BY(cs_vRecv);
+    //! Messages pushed before the v2 key exchange completed, queued once it has
+    std::deque<CSerializedNetMsg> m_v2_pending_msgs GUARDED_BY(cs_vSend);
+
+    /** Read the v2 key exchange off the start of msg_bytes, and switch transports once it is over. */
+    bool ReadV2Handshake(Span<const uint8_t>& msg_bytes) EXCLUSIVE_LOCKS_REQUIRED(cs_vRecv);
+
     mutable RecursiveMutex cs_addrName;
     std::string addrName GUARDED_BY(cs_addrName);
 
@@ -706,6 +994,7 @@ private:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd GUARDED_BY(cs_vSend);
     mapMsgCmdSize mapRecvBytesPerMsgCmd GUARDED_BY(cs_vRecv);
+    std::array<uint64_t, NUM_SEND_CLASSES> m_send_bytes_per_class GUARDED_BY(cs_vSend){};
 };
 
 /**
@@ -778,6 +1067,9 @@ public:
         std::vector<std::string> m_added_nodes;
         std::vector<bool> m_asmap;
         bool m_i2p_accept_incoming;
+        SocketEventsMode m_socket_events_mode = DEFAULT_SOCKET_EVENTS_MODE;
+        int m_msghand_threads = DEFAULT_MSGHAND_THREADS;
+        bool m_use_v2_transport = DEFAULT_V2_TRANSPORT;
     };
 
     void Init(const Options& connOptions) {
@@ -805,6 +1097,9 @@ public:
             vAddedNodes = connOptions.m_added_nodes;
         }
         m_onion_binds = connOptions.onion_binds;
+        m_socket_events_mode = connOptions.m_socket_events_mode;
+        m_msghand_threads = std::clamp(connOptions.m_msghand_threads, 1, MAX_MSGHAND_THREADS);
+        m_use_v2_transport = connOptions.m_use_v2_transport;
     }
 
     CConnman(uint64_t seed0, uint64_t seed1, CAddrMan& addrman, bool network_active = true);
@@ -943,7 +1238,10 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake all message handler threads */
     void WakeMessageHandler();
+    /** Wake the message handler thread that processes the given peer */
+    void WakeMessageHandler(const CNode& node);
 
     /** Attempts to obfuscate tx time through exponentially distributed emitting.
         Works assuming that a single interval is used.
@@ -973,8 +1271,17 @@ private:
     void ThreadOpenAddedConnections();
     void AddAddrFetch(const std::string& strDest);
     void ProcessAddrFetch();
+    /**
+     * If we initiated a v2 transport connection which is being closed before its key exchange
+     * completed, the peer may not support it after all: stop expecting it from its address, and
+     * queue a connection over v1 to it, taking over the outbound grant of the node.
+     */
+    void MaybeQueueV1Reconnection(CNode& node);
+    /** Open the connections queued by MaybeQueueV1Reconnection() */
+    void PerformReconnections();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    /** Process messages of the peers whose id modulo m_msghand_threads equals worker */
+    void ThreadMessageHandler(int worker);
     void ThreadI2PAcceptIncoming();
     void AcceptConnection(const ListenSocket& hListenSocket);
 
@@ -996,7 +1303,20 @@ private:
     /** Return true if the peer is inactive and should be disconnected. */
     bool InactivityCheck(const CNode& node) const;
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+    /** Set up the state the socket events backend keeps across iterations. Listening sockets must be bound. */
+    bool InitSocketEvents();
+    void CloseSocketEvents();
+    /** Interrupt a wait for socket events, so that changed registrations are picked up */
+    void WakeSocketHandler();
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#ifdef USE_POLL
+    void SocketEventsPoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#else
+    void SocketEventsSelect(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#endif
+#ifdef USE_EPOLL
+    void SocketEventsEpoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#endif
     void SocketHandler();
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
@@ -1059,11 +1379,26 @@ private:
     unsigned int nReceiveFloodSize{0};
 
     std::vector<ListenSocket> vhListenSocket;
+    SocketEventsMode m_socket_events_mode{DEFAULT_SOCKET_EVENTS_MODE};
+#ifdef USE_EPOLL
+    /** epoll instance holding the listening sockets, the wakeup pipe and the peer sockets (EPOLL mode only) */
+    int m_epoll_fd{-1};
+    /** Pipe whose read end is in m_epoll_fd, written to by WakeSocketHandler() */
+    int m_wakeup_pipe[2]{-1, -1};
+#endif
     std::atomic<bool> fNetworkActive{true};
     bool fAddressesInitialized{false};
     CAddrMan& addrman;
     std::deque<std::string> m_addr_fetches GUARDED_BY(m_addr_fetches_mutex);
     RecursiveMutex m_addr_fetches_mutex;
+    /** A connection to open again, see MaybeQueueV1Reconnection() */
+    struct ReconnectionInfo {
+        CAddress addr;
+        CSemaphoreGrant grant;
+        ConnectionType conn_type;
+    };
+    std::list<ReconnectionInfo> m_reconnections GUARDED_BY(m_reconnections_mutex);
+    Mutex m_reconnections_mutex;
     std::vector<std::string> vAddedNodes GUARDED_BY(cs_vAddedNodes);
     mutable RecursiveMutex cs_vAddedNodes;
     std::vector<CNode*> vNodes GUARDED_BY(cs_vNodes);
@@ -1142,8 +1477,14 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake GUARDED_BY(mutexMsgProc);
+    /** Number of message handler threads. Each peer is processed by a single one of them, see ThreadMessageHandler(). */
+    int m_msghand_threads{DEFAULT_MSGHAND_THREADS};
+
+    /** Whether to use the v2 transport with peers which support it (-v2transport) */
+    bool m_use_v2_transport{DEFAULT_V2_TRANSPORT};
+
+    /** flags for waking the message processor threads, one per thread. */
+    std::vector<bool> m_msgproc_wake GUARDED_BY(mutexMsgProc);
 
     std::condition_variable condMsgProc;
     Mutex mutexMsgProc;
@@ -1167,7 +1508,7 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> m_message_handler_threads;
     std::thread threadI2PAcceptIncoming;
 
     /** flag for deciding to connect to an extra outbound peer,
@@ -32,6 +32,7 @@
 #include <txorphanage.h>
 #include <txrequest.h>
 #include <util/check.h> // For NDEBUG compile time check
+#include <util/hasher.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 #include <validation.h>
@@ -40,6 +41,7 @@
 #include <memory>
 #include <optional>
 #include <typeinfo>
+#include <unordered_map>
 
 /** How long to cache transactions in mapRelay for normal relay */
 static constexpr auto RELAY_TX_CACHE_TIME = 15min;
@@ -83,6 +85,9 @@ static constexpr int32_t MAX_PEER_TX_REQUEST_IN_FLIGHT = 100;
  *  rate (by our own policy, see INVENTORY_BROADCAST_PER_SECOND) for several minutes, while not receiving
  *  the actual transaction (from any peer) in response to requests for them. */
 static constexpr int32_t MAX_PEER_TX_ANNOUNCEMENTS = 5000;
+/** Maximum number of orphans reconsidered in one ProcessOrphanTx() call, so that a long chain of orphans does not
+ *  hold cs_main for long, and other peers get their messages processed in between. */
+static constexpr size_t MAX_ORPHAN_TX_BATCH{32};
 /** How long to delay requesting transactions via txids, if we have wtxid-relaying peers */
 static constexpr auto TXID_RELAY_DELAY = std::chrono::seconds{2};
 /** How long to delay requesting transactions from non-preferred peers */
@@ -143,6 +148,11 @@ static constexpr unsigned int INVENTORY_MAX_RECENT_RELAY = 3500;
  *  lower bound, and it should be larger to account for higher inv rate to outbound
  *  peers, and random variations in the broadcast mechanism. */
 static_assert(INVENTORY_MAX_RECENT_RELAY >= INVENTORY_BROADCAST_PER_SECOND * UNCONDITIONAL_RELAY_DELAY / std::chrono::seconds{1}, "INVENTORY_RELAY_MAX too low");
+/** Minimum time between rebuilds of the shared transaction announcement order */
+static constexpr auto TX_ANNOUNCEMENT_ORDER_INTERVAL{1s};
+/** How long a relayed transaction stays in the shared announcement order. Peers which have not
+ *  announced it by then look it up in the mempool individually. */
+static constexpr auto TX_ANNOUNCEMENT_MAX_AGE{10min};
 /** Average delay between feefilter broadcasts in seconds. */
 static constexpr auto AVG_FEEFILTER_BROADCAST_INTERVAL = 10min;
 /** Maximum feefilter broadcast delay after significant change. */
@@ -162,9 +172,32 @@ static constexpr double MAX_ADDR_RATE_PER_SECOND{0.1};
  *  based increments won't go above this, but the MAX_ADDR_TO_SEND increment following GETADDR
  *  is exempt from this limit. */
 static constexpr size_t MAX_ADDR_PROCESSING_TOKEN_BUCKET{MAX_ADDR_TO_SEND};
+/** Number of block messages whose checksum is cached */
+static constexpr size_t MAX_BLOCK_MESSAGE_CACHE_ENTRIES{20000};
+/** Memory budget for caching serialized block messages */
+static constexpr size_t MAX_BLOCK_MESSAGE_CACHE_PAYLOAD_BYTES{32 << 20};
+/** Serialized block messages are only cached for blocks this close to the tip, which many peers ask for */
+static constexpr int BLOCK_MESSAGE_CACHE_PAYLOAD_DEPTH{6};
 
 // Internal stuff
 namespace {
+/**
+ * The transactions queued for announcement to peers, in the order they are announced in:
+ * topologically, and by decreasing feerate. It is computed once and shared by all peers, so
+ * that their inventory queues can be ordered and filtered without going through the mempool.
+ */
+struct TxAnnouncementOrder {
+    /** When this was built */
+    std::chrono::microseconds m_time{0};
+    /** CTxMemPool::GetTransactionsUpdated() before this was built. While it is unchanged, all
+     *  transactions in m_txs are still in the mempool with the same fee. */
+    unsigned int m_mempool_updated{0};
+    /** Queued transactions which were in the mempool, in announcement order */
+    std::vector<TxMempoolInfo> m_txs;
+    /** Position in m_txs, by txid and by wtxid */
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> m_positions;
+};
+
 /** Blocks that are in flight, and that are in the queue to be downloaded. */
 struct QueuedBlock {
     /** BlockIndex. We must have this since we only request blocks when we've already validated the header. */
@@ -222,11 +255,13 @@ struct Peer {
     /** Whether a ping has been requested by the user */
     std::atomic<bool> m_ping_queued{false};
 
+    /** Guards the addresses queued for this peer, which other peers' messages add to (see RelayAddress()). */
+    Mutex m_addr_send_mutex;
     /** A vector of addresses to send to the peer, limited to MAX_ADDR_TO_SEND. */
-    std::vector<CAddress> m_addrs_to_send;
+    std::vector<CAddress> m_addrs_to_send GUARDED_BY(m_addr_send_mutex);
     /** Probabilistic filter of addresses that this peer already knows.
      *  Used to avoid relaying addresses to this peer more than once. */
-    const std::unique_ptr<CRollingBloomFilter> m_addr_known;
+    const std::unique_ptr<CRollingBloomFilter> m_addr_known PT_GUARDED_BY(m_addr_send_mutex);
     /** Whether a getaddr request to this peer is outstanding. */
     bool m_getaddr_sent{false};
     /** Guards address sending timers. */
@@ -284,11 +319,12 @@ public:
     void InitializeNode(CNode* pnode) override;
     void FinalizeNode(const CNode& node) override;
     bool ProcessMessages(CNode* pfrom, std::atomic<bool>& interrupt) override;
-    bool SendMessages(CNode* pto) override EXCLUSIVE_LOCKS_REQUIRED(pto->cs_sendProcessing);
+    bool SendMessages(CNode* pto) override EXCLUSIVE_LOCKS_REQUIRED(pto->cs_sendProcessing, !m_msgproc_mutex);
 
     /** Implement PeerManager */
     void CheckForStaleTipAndEvictPeers() override;
     bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats) const override;
+    BlockMessageCacheStats GetBlockMessageCacheStats() const override { return m_block_message_cache.GetStats(); }
     bool IgnoresIncomingTxs() override { return m_ignore_incoming_txs; }
     void SendPings() override;
     void RelayTransaction(const uint256& txid, const uint256& wtxid) override;
@@ -396,6 +432,13 @@ private:
     /** The height of the best chain */
     std::atomic<int> m_best_height{-1};
 
+    /** Serializes the processing of messages that use state shared between peers, as the
+     *  messages of different peers may be processed by different message handler threads
+     *  (-msghandthreads). Messages for which IsConcurrentMessage() is true don't take it.
+     *  SendMessages() always takes it, as it reads and updates the state of other peers
+     *  (sync and download bookkeeping, stale tip and eviction logic). */
+    Mutex m_msgproc_mutex;
+
     int64_t m_stale_tip_check_time; //!< Next time to check for stale tip
 
     /** Whether this node is running in blocks only mode */
@@ -523,6 +566,16 @@ private:
     /** Process a new block. Perform any post-processing housekeeping */
     void ProcessBlock(CNode& node, const std::shared_ptr<const CBlock>& block, bool force_processing);
 
+    /** Get the current transaction announcement order, rebuilding it if it is outdated. */
+    std::shared_ptr<const TxAnnouncementOrder> GetTxAnnouncementOrder(std::chrono::microseconds now) LOCKS_EXCLUDED(m_tx_announcement_mutex);
+
+    Mutex m_tx_announcement_mutex;
+    /** Transactions queued for announcement to peers (txid -> time queued) */
+    std::unordered_map<uint256, std::chrono::microseconds, SaltedTxidHasher> m_txs_to_announce GUARDED_BY(m_tx_announcement_mutex);
+    /** Whether transactions were queued since m_tx_announcement_order was built */
+    bool m_txs_to_announce_added GUARDED_BY(m_tx_announcement_mutex){false};
+    std::shared_ptr<const TxAnnouncementOrder> m_tx_announcement_order GUARDED_BY(m_tx_announcement_mutex){std::make_shared<const TxAnnouncementOrder>()};
+
     /** Relay map (txid or wtxid -> CTransactionRef) */
     typedef std::map<uint256, CTransactionRef> MapRelay;
     MapRelay mapRelay GUARDED_BY(cs_main);
@@ -571,6 +624,12 @@ private:
     bool AlreadyHaveBlock(const uint256& block_hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     void ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv& inv);
 
+    /**
+     * Block messages served to peers. A block whose message checksum is known can be streamed
+     * from its block file as is, and recent blocks are not serialized again for every peer.
+     */
+    BlockMessageCache m_block_message_cache{MAX_BLOCK_MESSAGE_CACHE_ENTRIES, MAX_BLOCK_MESSAGE_CACHE_PAYLOAD_BYTES};
+
     /**
      * Validation logic for compact filters request handling.
      *
@@ -758,10 +817,11 @@ static bool IsAddrCompatible(const Peer& peer, const CAddress& addr)
 static void AddAddressKnown(Peer& peer, const CAddress& addr)
 {
     assert(peer.m_addr_known);
+    LOCK(peer.m_addr_send_mutex);
     peer.m_addr_known->insert(addr.GetKey());
 }
 
-static void PushAddress(Peer& peer, const CAddress& addr, FastRandomContext& insecure_rand)
+static void PushAddress(Peer& peer, const CAddress& addr, FastRandomContext& insecure_rand) EXCLUSIVE_LOCKS_REQUIRED(peer.m_addr_send_mutex)
 {
     // Known checking here is only to save space from duplicates.
     // Before sending, we'll filter it again for known addresses that were
@@ -1680,6 +1740,11 @@ void PeerManagerImpl::RelayTransaction(const uint256& txid, const uint256& wtxid
 
 void PeerManagerImpl::_RelayTransaction(const uint256& txid, const uint256& wtxid)
 {
+    {
+        LOCK(m_tx_announcement_mutex);
+        m_txs_to_announce.emplace(txid, GetTime<std::chrono::microseconds>());
+        m_txs_to_announce_added = true;
+    }
     m_connman.ForEachNode([&txid, &wtxid](CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
         AssertLockHeld(::cs_main);
 
@@ -1734,6 +1799,7 @@ void PeerManagerImpl::RelayAddress(NodeId originator,
     };
 
     for (unsigned int i = 0; i < nRelayNodes && best[i].first != 0; i++) {
+        LOCK(best[i].second->m_addr_send_mutex);
         PushAddress(*best[i].second, addr, insecure_rand);
     }
 }
@@ -1773,64 +1839,136 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
         }
     }
 
-    LOCK(cs_main);
-    const CBlockIndex* pindex = m_chainman.m_blockman.LookupBlockIndex(inv.hash);
-    if (!pindex) {
-        return;
-    }
-    if (!BlockRequestAllowed(pindex)) {
-        LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom.GetId());
-        return;
-    }
     const CNetMsgMaker msgMaker(pfrom.GetCommonVersion());
-    // disconnect node in case we have reached the outbound limit for serving historical blocks
-    if (m_connman.OutboundTargetReached(true) &&
-        (((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.IsMsgFilteredBlk()) &&
-        !pfrom.HasPermission(NetPermissionFlags::Download) // nodes with the download permission may exceed target
-    ) {
-        LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom.GetId());
-        pfrom.fDisconnect = true;
-        return;
-    }
-    // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
-    if (!pfrom.HasPermission(NetPermissionFlags::NoBan) && (
-            (((pfrom.GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom.GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (m_chainman.ActiveChain().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
-       )) {
-        LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold, disconnect peer=%d\n", pfrom.GetId());
-        //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+    const CBlockIndex* pindex;
+    bool fPeerWantsWitness;
+    bool send_compact_block;
+    bool cache_block_payload;
+    SendClass send_class;
+    uint256 tip_hash;
+    {
+        LOCK(cs_main);
+        pindex = m_chainman.m_blockman.LookupBlockIndex(inv.hash);
+        if (!pindex) {
+            return;
+        }
+        if (!BlockRequestAllowed(pindex)) {
+            LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom.GetId());
+            return;
+        }
+        // disconnect node in case we have reached the outbound limit for serving historical blocks
+        if (m_connman.OutboundTargetReached(true) &&
+            (((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.IsMsgFilteredBlk()) &&
+            !pfrom.HasPermission(NetPermissionFlags::Download) // nodes with the download permission may exceed target
+        ) {
+            LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
+        }
+        // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
+        if (!pfrom.HasPermission(NetPermissionFlags::NoBan) && (
+                (((pfrom.GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom.GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (m_chainman.ActiveChain().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
+           )) {
+            LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold, disconnect peer=%d\n", pfrom.GetId());
+            //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+            pfrom.fDisconnect = true;
+            return;
+        }
+        // Pruned nodes may have deleted the block, so check whether
+        // it's available before trying to send.
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            return;
+        }
+        fPeerWantsWitness = State(pfrom.GetId())->fWantsCmpctWitness;
+        send_compact_block = CanDirectFetch() && pindex->nHeight >= m_chainman.ActiveChain().Height() - MAX_CMPCTBLOCK_DEPTH;
+        cache_block_payload = pindex->nHeight >= m_chainman.ActiveChain().Height() - BLOCK_MESSAGE_CACHE_PAYLOAD_DEPTH;
+        // Recent blocks are relayed ahead of transactions, older ones are sent after everything else.
+        send_class = pindex->nHeight >= m_chainman.ActiveChain().Height() - MAX_CMPCTBLOCK_DEPTH ? SendClass::TIP : SendClass::BLOCK_SERVING;
+        tip_hash = m_chainman.ActiveChain().Tip()->GetBlockHash();
+    } // release cs_main before reading the block from disk, so that other peers' requests can be served meanwhile
+
+    // Pruning may delete the block once cs_main is released.
+    auto block_read_failed = [&] {
+        if (WITH_LOCK(cs_main, return !(pindex->nStatus & BLOCK_HAVE_DATA))) {
+            LogPrint(BCLog::NET, "Block was pruned before it could be read, disconnect peer=%d\n", pfrom.GetId());
+        } else {
+            assert(!"cannot load block from disk");
+        }
         pfrom.fDisconnect = true;
-        return;
-    }
-    // Pruned nodes may have deleted the block, so check whether
-    // it's available before trying to send.
-    if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
-        return;
+    };
+    // Whatever is sent for the block, the transactions following a merkleblock included, keeps its order.
+    auto push_message = [&](CSerializedNetMsg&& msg) {
+        msg.m_send_class = send_class;
+        m_connman.PushMessage(&pfrom, std::move(msg));
+    };
+    // Full blocks may be served from the block message cache, skipping their serialization and hashing.
+    const int block_flags{inv.IsMsgWitnessBlk() ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS};
+    std::optional<BlockMessageCache::Entry> cached_block;
+    if (inv.IsMsgBlk() || inv.IsMsgWitnessBlk()) {
+        cached_block = m_block_message_cache.Get(pindex->GetBlockHash(), block_flags);
     }
     std::shared_ptr<const CBlock> pblock;
-    if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
+    if (cached_block && cached_block->payload) {
+        CSerializedNetMsg msg;
+        msg.m_type = NetMsgType::BLOCK;
+        msg.m_shared_payload = cached_block->payload;
+        msg.m_checksum = cached_block->checksum;
+        push_message(std::move(msg));
+        // Don't set pblock as we've sent the block
+    } else if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
         pblock = a_recent_block;
     } else if (inv.IsMsgWitnessBlk()) {
         // Fast-path: in this case it is possible to serve the block directly from disk,
         // as the network format matches the format on disk
-        std::vector<uint8_t> block_data;
-        if (!ReadRawBlockFromDisk(block_data, pindex, m_chainparams.MessageStart())) {
-            assert(!"cannot load block from disk");
+        const FlatFilePos block_pos{WITH_LOCK(cs_main, return pindex->GetBlockPos())};
+        unsigned int block_size;
+        CAutoFile filein(OpenRawBlockFile(block_pos, m_chainparams.MessageStart(), block_size), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            block_read_failed();
+            return;
+        }
+        CSerializedNetMsg msg;
+        msg.m_type = NetMsgType::BLOCK;
+        if (cached_block) msg.m_checksum = cached_block->checksum;
+#ifdef USE_SENDFILE
+        if (msg.m_checksum) {
+            // Nothing needs to be read or hashed: let the kernel send the block from the file.
+            msg.m_file_payload = FileRange{std::shared_ptr<FILE>{filein.release(), fclose}, block_pos.nPos, block_size};
+        }
+#endif
+        if (!msg.m_file_payload) {
+            try {
+                msg.data.resize(block_size);
+                filein.read((char*)msg.data.data(), block_size);
+            } catch (const std::exception& e) {
+                LogPrint(BCLog::NET, "%s: Read from block file failed: %s for %s\n", __func__, e.what(), block_pos.ToString());
+                block_read_failed();
+                return;
+            }
         }
-        m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
+        if (!msg.m_checksum) {
+            msg.m_checksum = m_block_message_cache.Add(pindex->GetBlockHash(), block_flags, msg.data, cache_block_payload);
+        }
+        push_message(std::move(msg));
         // Don't set pblock as we've sent the block
     } else {
         // Send block from disk
         std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
         if (!ReadBlockFromDisk(*pblockRead, pindex, m_chainparams.GetConsensus())) {
-            assert(!"cannot load block from disk");
+            block_read_failed();
+            return;
         }
         pblock = pblockRead;
     }
     if (pblock) {
-        if (inv.IsMsgBlk()) {
-            m_connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-        } else if (inv.IsMsgWitnessBlk()) {
-            m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+        if (inv.IsMsgBlk() || inv.IsMsgWitnessBlk()) {
+            CSerializedNetMsg msg{msgMaker.Make(block_flags, NetMsgType::BLOCK, *pblock)};
+            if (cached_block) {
+                msg.m_checksum = cached_block->checksum;
+            } else {
+                msg.m_checksum = m_block_message_cache.Add(pindex->GetBlockHash(), block_flags, msg.data, cache_block_payload);
+            }
+            push_message(std::move(msg));
         } else if (inv.IsMsgFilteredBlk()) {
             bool sendMerkleBlock = false;
             CMerkleBlock merkleBlock;
@@ -1842,7 +1980,7 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
                 }
             }
             if (sendMerkleBlock) {
-                m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+                push_message(msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
                 // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
                 // This avoids hurting performance by pointlessly requiring a round-trip
                 // Note that there is currently no way for a node to request any single transactions we didn't send here -
@@ -1851,7 +1989,7 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
                 // however we MUST always provide at least what the remote peer needs
                 typedef std::pair<unsigned int, uint256> PairType;
                 for (PairType& pair : merkleBlock.vMatchedTxn)
-                    m_connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
+                    push_message(msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
             }
             // else
             // no response
@@ -1860,17 +1998,16 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
             // they won't have a useful mempool to match against a compact block,
             // and we don't feel like constructing the object for them, so
             // instead we respond with the full, non-compact block.
-            bool fPeerWantsWitness = State(pfrom.GetId())->fWantsCmpctWitness;
             int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-            if (CanDirectFetch() && pindex->nHeight >= m_chainman.ActiveChain().Height() - MAX_CMPCTBLOCK_DEPTH) {
+            if (send_compact_block) {
                 if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
-                    m_connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
+                    push_message(msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
                 } else {
                     CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                    m_connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                    push_message(msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                 }
             } else {
-                m_connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+                push_message(msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
             }
         }
     }
@@ -1883,8 +2020,8 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
             // and we want it right after the last block so they don't
             // wait for other stuff first.
             std::vector<CInv> vInv;
-            vInv.push_back(CInv(MSG_BLOCK, m_chainman.ActiveChain().Tip()->GetBlockHash()));
-            m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+            vInv.push_back(CInv(MSG_BLOCK, tip_hash));
+            push_message(msgMaker.Make(NetMsgType::INV, vInv));
             peer.m_continuation_block.SetNull();
         }
     }
@@ -2223,35 +2360,39 @@ void PeerManagerImpl::ProcessHeadersMessage(CNode& pfrom, const Peer& peer,
 /**
  * Reconsider orphan transactions after a parent has been accepted to the mempool.
  *
- * @param[in,out]  orphan_work_set  The set of orphan transactions to reconsider. Generally only one
- *                                  orphan will be reconsidered on each call of this function. This set
- *                                  may be added to if accepting an orphan causes its children to be
- *                                  reconsidered.
+ * The orphans in the work set are validated together with their descendants in the orphanage, as one batch in
+ * dependency order of at most MAX_ORPHAN_TX_BATCH transactions. Longer chains of orphans are resolved over
+ * several calls.
+ *
+ * @param[in,out]  orphan_work_set  The set of orphan transactions to reconsider. The orphans which did not fit in
+ *                                  the batch are left in it.
  */
 void PeerManagerImpl::ProcessOrphanTx(std::set<uint256>& orphan_work_set)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(g_cs_orphans);
 
-    while (!orphan_work_set.empty()) {
-        const uint256 orphanHash = *orphan_work_set.begin();
-        orphan_work_set.erase(orphan_work_set.begin());
-
-        const auto [porphanTx, from_peer] = m_orphanage.GetTx(orphanHash);
-        if (porphanTx == nullptr) continue;
-
-        const MempoolAcceptResult result = AcceptToMemoryPool(m_chainman.ActiveChainstate(), m_mempool, porphanTx, false /* bypass_limits */);
+    const std::vector<std::pair<CTransactionRef, NodeId>> package = m_orphanage.TakeWorkSetPackage(orphan_work_set, MAX_ORPHAN_TX_BATCH);
+    if (package.empty()) return;
+    std::vector<CTransactionRef> txns;
+    txns.reserve(package.size());
+    for (const auto& [tx, from_peer] : package) txns.push_back(tx);
+    const std::vector<MempoolAcceptResult> results = AcceptToMemoryPoolBatch(m_chainman.ActiveChainstate(), m_mempool, txns);
+
+    for (size_t i = 0; i < package.size(); ++i) {
+        const auto& [porphanTx, from_peer] = package[i];
+        const uint256& orphanHash = porphanTx->GetHash();
+        const MempoolAcceptResult& result = results[i];
         const TxValidationState& state = result.m_state;
 
         if (result.m_result_type == MempoolAcceptResult::ResultType::VALID) {
             LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
             _RelayTransaction(orphanHash, porphanTx->GetWitnessHash());
-            m_orphanage.AddChildrenToWorkSet(*porphanTx, orphan_work_set);
+            // Its children in the orphanage are part of this batch already.
             m_orphanage.EraseTx(orphanHash);
             for (const CTransactionRef& removedTx : result.m_replaced_transactions.value()) {
                 AddToCompactExtraTransactions(removedTx);
             }
-            break;
         } else if (state.GetResult() != TxValidationResult::TX_MISSING_INPUTS) {
             if (state.IsInvalid()) {
                 LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s from peer=%d. %s\n",
@@ -2295,7 +2436,6 @@ void PeerManagerImpl::ProcessOrphanTx(std::set<uint256>& orphan_work_set)
                 }
             }
             m_orphanage.EraseTx(orphanHash);
-            break;
         }
     }
     m_mempool.check(m_chainman.ActiveChainstate());
@@ -2632,6 +2772,7 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
             {
                 CAddress addr = GetLocalAddress(&pfrom.addr, pfrom.GetLocalServices());
                 FastRandomContext insecure_rand;
+                LOCK(peer->m_addr_send_mutex);
                 if (addr.IsRoutable())
                 {
                     LogPrint(BCLog::NET, "ProcessMessages: advertising address %s\n", addr.ToString());
@@ -3330,7 +3471,8 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
 
                 // DoS prevention: do not allow m_orphanage to grow unbounded (see CVE-2012-3789)
                 unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = m_orphanage.LimitOrphans(nMaxOrphanTx);
+                size_t nMaxOrphanUsage = (size_t)std::max((int64_t)0, gArgs.GetArg("-maxorphanpool", DEFAULT_MAX_ORPHAN_POOL_SIZE)) * 1000000;
+                unsigned int nEvicted = m_orphanage.LimitOrphans(nMaxOrphanTx, nMaxOrphanUsage);
                 if (nEvicted > 0) {
                     LogPrint(BCLog::MEMPOOL, "orphanage overflow, removed %u tx\n", nEvicted);
                 }
@@ -3826,7 +3968,6 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
         }
         peer->m_getaddr_recvd = true;
 
-        peer->m_addrs_to_send.clear();
         std::vector<CAddress> vAddr;
         if (pfrom.HasPermission(NetPermissionFlags::Addr)) {
             vAddr = m_connman.GetAddresses(MAX_ADDR_TO_SEND, MAX_PCT_ADDR_TO_SEND, /* network */ std::nullopt);
@@ -3834,6 +3975,8 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
             vAddr = m_connman.GetAddresses(pfrom, MAX_ADDR_TO_SEND, MAX_PCT_ADDR_TO_SEND);
         }
         FastRandomContext insecure_rand;
+        LOCK(peer->m_addr_send_mutex);
+        peer->m_addrs_to_send.clear();
         for (const CAddress &addr : vAddr) {
             PushAddress(*peer, addr, insecure_rand);
         }
@@ -4096,6 +4239,22 @@ bool PeerManagerImpl::MaybeDiscourageAndDisconnect(CNode& pnode, Peer& peer)
     return true;
 }
 
+/**
+ * Whether a message can be processed concurrently with the messages of other peers: its
+ * handling only touches the sending peer's own state, or state behind locks it takes (e.g.
+ * cs_main for inv bookkeeping, or the address relay queues of other peers).
+ */
+static bool IsConcurrentMessage(const std::string& msg_type)
+{
+    return msg_type == NetMsgType::PING ||
+           msg_type == NetMsgType::PONG ||
+           msg_type == NetMsgType::FEEFILTER ||
+           msg_type == NetMsgType::ADDR ||
+           msg_type == NetMsgType::ADDRV2 ||
+           msg_type == NetMsgType::INV ||
+           msg_type == NetMsgType::GETDATA;
+}
+
 bool PeerManagerImpl::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     bool fMoreWork = false;
@@ -4158,7 +4317,12 @@ bool PeerManagerImpl::ProcessMessages(CNode* pfrom, std::atomic<bool>& interrupt
     unsigned int nMessageSize = msg.m_message_size;
 
     try {
-        ProcessMessage(*pfrom, msg_type, msg.m_recv, msg.m_time, interruptMsgProc);
+        if (IsConcurrentMessage(msg_type)) {
+            ProcessMessage(*pfrom, msg_type, msg.m_recv, msg.m_time, interruptMsgProc);
+        } else {
+            LOCK(m_msgproc_mutex);
+            ProcessMessage(*pfrom, msg_type, msg.m_recv, msg.m_time, interruptMsgProc);
+        }
         if (interruptMsgProc) return false;
         {
             LOCK(peer->m_getdata_requests_mutex);
@@ -4398,7 +4562,7 @@ void PeerManagerImpl::MaybeSendAddr(CNode& node, Peer& peer, std::chrono::micros
     // Nothing to do for non-address-relay peers
     if (!RelayAddrsWithPeer(peer)) return;
 
-    LOCK(peer.m_addr_send_times_mutex);
+    LOCK2(peer.m_addr_send_times_mutex, peer.m_addr_send_mutex);
     // Periodically advertise our local address to the peer.
     if (fListen && !m_chainman.ActiveChainstate().IsInitialBlockDownload() &&
         peer.m_next_local_addr_send < current_time) {
@@ -4431,7 +4595,7 @@ void PeerManagerImpl::MaybeSendAddr(CNode& node, Peer& peer, std::chrono::micros
 
     // Remove addr records that the peer already knows about, and add new
     // addrs to the m_addr_known filter on the same pass.
-    auto addr_already_known = [&peer](const CAddress& addr) {
+    auto addr_already_known = [&peer](const CAddress& addr) EXCLUSIVE_LOCKS_REQUIRED(peer.m_addr_send_mutex) {
         bool ret = peer.m_addr_known->contains(addr.GetKey());
         if (!ret) peer.m_addr_known->insert(addr.GetKey());
         return ret;
@@ -4503,25 +4667,48 @@ void PeerManagerImpl::MaybeSendFeefilter(CNode& pto, std::chrono::microseconds c
     }
 }
 
-namespace {
-class CompareInvMempoolOrder
+std::shared_ptr<const TxAnnouncementOrder> PeerManagerImpl::GetTxAnnouncementOrder(std::chrono::microseconds now)
 {
-    CTxMemPool *mp;
-    bool m_wtxid_relay;
-public:
-    explicit CompareInvMempoolOrder(CTxMemPool *_mempool, bool use_wtxid)
+    std::vector<uint256> txids;
     {
-        mp = _mempool;
-        m_wtxid_relay = use_wtxid;
+        LOCK(m_tx_announcement_mutex);
+        if (now < m_tx_announcement_order->m_time + TX_ANNOUNCEMENT_ORDER_INTERVAL ||
+            (!m_txs_to_announce_added && m_tx_announcement_order->m_mempool_updated == m_mempool.GetTransactionsUpdated() &&
+             now < m_tx_announcement_order->m_time + TX_ANNOUNCEMENT_MAX_AGE)) {
+            return m_tx_announcement_order;
+        }
+        m_txs_to_announce_added = false;
+        txids.reserve(m_txs_to_announce.size());
+        for (auto it = m_txs_to_announce.begin(); it != m_txs_to_announce.end();) {
+            if (it->second < now - TX_ANNOUNCEMENT_MAX_AGE) {
+                it = m_txs_to_announce.erase(it);
+            } else {
+                txids.push_back(it->first);
+                ++it;
+            }
+        }
     }
 
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
-    {
-        /* As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a, m_wtxid_relay);
+    // Sort in a single pass over the mempool, without holding m_tx_announcement_mutex.
+    auto order{std::make_shared<TxAnnouncementOrder>()};
+    order->m_time = now;
+    order->m_mempool_updated = m_mempool.GetTransactionsUpdated();
+    order->m_txs = m_mempool.infoForRelay(txids);
+    order->m_positions.reserve(2 * order->m_txs.size());
+    for (size_t i = 0; i < order->m_txs.size(); ++i) {
+        order->m_positions.emplace(order->m_txs[i].tx->GetHash(), i);
+        order->m_positions.emplace(order->m_txs[i].tx->GetWitnessHash(), i);
     }
-};
+
+    LOCK(m_tx_announcement_mutex);
+    // Forget the transactions which left the mempool.
+    if (order->m_txs.size() < txids.size()) {
+        for (const uint256& txid : txids) {
+            if (!order->m_positions.count(txid)) m_txs_to_announce.erase(txid);
+        }
+    }
+    if (order->m_time >= m_tx_announcement_order->m_time) m_tx_announcement_order = order;
+    return order;
 }
 
 bool PeerManagerImpl::SendMessages(CNode* pto)
@@ -4530,6 +4717,8 @@ bool PeerManagerImpl::SendMessages(CNode* pto)
     if (!peer) return false;
     const Consensus::Params& consensusParams = m_chainparams.GetConsensus();
 
+    LOCK(m_msgproc_mutex);
+
     // We must call MaybeDiscourageAndDisconnect first, to ensure that we'll
     // disconnect misbehaving peers even before the version handshake is complete.
     if (MaybeDiscourageAndDisconnect(*pto, *peer)) return true;
@@ -4739,14 +4928,18 @@ bool PeerManagerImpl::SendMessages(CNode* pto)
             LOCK(peer->m_block_inv_mutex);
             vInv.reserve(std::max<size_t>(peer->m_blocks_for_inv_relay.size(), INVENTORY_BROADCAST_MAX));
 
-            // Add blocks
+            // Add blocks. They are announced on their own, ahead of transactions.
+            auto push_block_inv = [&] {
+                CSerializedNetMsg msg{msgMaker.Make(NetMsgType::INV, vInv)};
+                msg.m_send_class = SendClass::TIP;
+                m_connman.PushMessage(pto, std::move(msg));
+                vInv.clear();
+            };
             for (const uint256& hash : peer->m_blocks_for_inv_relay) {
                 vInv.push_back(CInv(MSG_BLOCK, hash));
-                if (vInv.size() == MAX_INV_SZ) {
-                    m_connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
-                    vInv.clear();
-                }
+                if (vInv.size() == MAX_INV_SZ) push_block_inv();
             }
+            if (!vInv.empty()) push_block_inv();
             peer->m_blocks_for_inv_relay.clear();
         }
 
@@ -4801,25 +4994,48 @@ bool PeerManagerImpl::SendMessages(CNode* pto)
 
                 // Determine transactions to relay
                 if (fSendTrickle) {
-                    // Produce a vector with all candidates for sending
-                    std::vector<std::set<uint256>::iterator> vInvTx;
+                    // Topologically and fee-rate sort the inventory we send for privacy and priority reasons,
+                    // using the order shared by all peers. Transactions queued since it was built are
+                    // announced once they are part of it.
+                    const auto order{GetTxAnnouncementOrder(current_time)};
+                    // Transactions may have left the mempool since the order was built.
+                    const bool order_outdated{order->m_mempool_updated != m_mempool.GetTransactionsUpdated()};
+                    // Transactions which left the shared order are looked up individually, and go last.
+                    std::vector<TxMempoolInfo> unordered_txs;
+                    std::vector<std::pair<size_t, std::set<uint256>::iterator>> vInvTx;
                     vInvTx.reserve(pto->m_tx_relay->setInventoryTxToSend.size());
-                    for (std::set<uint256>::iterator it = pto->m_tx_relay->setInventoryTxToSend.begin(); it != pto->m_tx_relay->setInventoryTxToSend.end(); it++) {
-                        vInvTx.push_back(it);
+                    for (auto it = pto->m_tx_relay->setInventoryTxToSend.begin(); it != pto->m_tx_relay->setInventoryTxToSend.end();) {
+                        const auto pos = order->m_positions.find(*it);
+                        if (pos != order->m_positions.end()) {
+                            vInvTx.emplace_back(pos->second, it++);
+                            continue;
+                        }
+                        auto txinfo = m_mempool.info(GenTxid{state.m_wtxid_relay, *it});
+                        if (!txinfo.tx) {
+                            // Not in the mempool anymore? don't bother sending it.
+                            it = pto->m_tx_relay->setInventoryTxToSend.erase(it);
+                        } else if (current_time < txinfo.m_time + TX_ANNOUNCEMENT_MAX_AGE) {
+                            // Relayed since the order was built, wait for the next one.
+                            ++it;
+                        } else {
+                            vInvTx.emplace_back(order->m_txs.size() + unordered_txs.size(), it++);
+                            unordered_txs.push_back(std::move(txinfo));
+                        }
                     }
                     const CFeeRate filterrate{pto->m_tx_relay->minFeeFilter.load()};
-                    // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
                     // A heap is used so that not all items need sorting if only a few are being sent.
-                    CompareInvMempoolOrder compareInvMempoolOrder(&m_mempool, state.m_wtxid_relay);
-                    std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
+                    const auto compare_position = [](const auto& a, const auto& b) { return a.first > b.first; };
+                    std::make_heap(vInvTx.begin(), vInvTx.end(), compare_position);
                     // No reason to drain out at many times the network's capacity,
                     // especially since we have many peers and some will draw much shorter delays.
                     unsigned int nRelayedTransactions = 0;
                     LOCK(pto->m_tx_relay->cs_filter);
                     while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                         // Fetch the top element from the heap
-                        std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                        std::set<uint256>::iterator it = vInvTx.back();
+                        std::pop_heap(vInvTx.begin(), vInvTx.end(), compare_position);
+                        const size_t pos{vInvTx.back().first};
+                        const TxMempoolInfo& txinfo = pos < order->m_txs.size() ? order->m_txs[pos] : unordered_txs[pos - order->m_txs.size()];
+                        std::set<uint256>::iterator it = vInvTx.back().second;
                         vInvTx.pop_back();
                         uint256 hash = *it;
                         CInv inv(state.m_wtxid_relay ? MSG_WTX : MSG_TX, hash);
@@ -4830,8 +5046,7 @@ bool PeerManagerImpl::SendMessages(CNode* pto)
                             continue;
                         }
                         // Not in the mempool anymore? don't bother sending it.
-                        auto txinfo = m_mempool.info(ToGenTxid(inv));
-                        if (!txinfo.tx) {
+                        if (order_outdated && pos < order->m_txs.size() && !m_mempool.exists(GenTxid{state.m_wtxid_relay, hash})) {
                             continue;
                         }
                         auto txid = txinfo.tx->GetHash();
@@ -4853,7 +5068,7 @@ bool PeerManagerImpl::SendMessages(CNode* pto)
                                 g_relay_expiration.pop_front();
                             }
 
-                            auto ret = mapRelay.emplace(txid, std::move(txinfo.tx));
+                            auto ret = mapRelay.emplace(txid, txinfo.tx);
                             if (ret.second) {
                                 g_relay_expiration.emplace_back(current_time + RELAY_TX_CACHE_TIME, ret.first);
                             }
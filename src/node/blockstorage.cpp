@@ -410,13 +410,14 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
-bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
+FILE* OpenRawBlockFile(const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start, unsigned int& block_size)
 {
     FlatFilePos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
     CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull()) {
-        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+        error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+        return nullptr;
     }
 
     try {
@@ -426,16 +427,35 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, c
         filein >> blk_start >> blk_size;
 
         if (memcmp(blk_start, message_start, CMessageHeader::MESSAGE_START_SIZE)) {
-            return error("%s: Block magic mismatch for %s: %s versus expected %s", __func__, pos.ToString(),
-                         HexStr(blk_start),
-                         HexStr(message_start));
+            error("%s: Block magic mismatch for %s: %s versus expected %s", __func__, pos.ToString(),
+                  HexStr(blk_start),
+                  HexStr(message_start));
+            return nullptr;
         }
 
         if (blk_size > MAX_SIZE) {
-            return error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s", __func__, pos.ToString(),
-                         blk_size, MAX_SIZE);
+            error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s", __func__, pos.ToString(),
+                  blk_size, MAX_SIZE);
+            return nullptr;
         }
+        block_size = blk_size;
+    } catch (const std::exception& e) {
+        error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
+        return nullptr;
+    }
+
+    return filein.release();
+}
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
+{
+    unsigned int blk_size;
+    CAutoFile filein(OpenRawBlockFile(pos, message_start, blk_size), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return false;
+    }
 
+    try {
         block.resize(blk_size); // Zeroing of memory is intentional here
         filein.read((char*)block.data(), blk_size);
     } catch (const std::exception& e) {
@@ -10,11 +10,18 @@
 #include <hash.h>
 #include <index/coinstatsindex.h>
 #include <serialize.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <util/system.h>
+#include <util/thread.h>
 #include <validation.h>
 
+#include <algorithm>
+#include <exception>
 #include <map>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 // Database-independent metric indicating the UTXO set size
 uint64_t GetBogoSize(const CScript& script_pub_key)
@@ -87,37 +94,19 @@ static void ApplyStats(CCoinsStats& stats, const uint256& hash, const std::map<u
     }
 }
 
-//! Calculate statistics about the unspent transaction output set
+//! Apply the coins from cursor to stats and hash_obj, stopping before the
+//! first txid whose leading key byte is end_prefix or higher.
 template <typename T>
-static bool GetUTXOStats(CCoinsView* view, BlockManager& blockman, CCoinsStats& stats, T hash_obj, const std::function<void()>& interruption_point, const CBlockIndex* pindex)
+static bool ApplyCoins(CCoinsViewCursor& cursor, CCoinsStats& stats, T& hash_obj, const std::function<void()>& interruption_point, unsigned int end_prefix = 256)
 {
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
-    if (!pindex) {
-        {
-            LOCK(cs_main);
-            pindex = blockman.LookupBlockIndex(view->GetBestBlock());
-        }
-    }
-    stats.nHeight = Assert(pindex)->nHeight;
-    stats.hashBlock = pindex->GetBlockHash();
-
-    // Use CoinStatsIndex if it is requested and available and a hash_type of Muhash or None was requested
-    if ((stats.m_hash_type == CoinStatsHashType::MUHASH || stats.m_hash_type == CoinStatsHashType::NONE) && g_coin_stats_index && stats.index_requested) {
-        stats.index_used = true;
-        return g_coin_stats_index->LookUpStats(pindex, stats);
-    }
-
-    PrepareHash(hash_obj, stats);
-
     uint256 prevkey;
     std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
+    while (cursor.Valid()) {
         interruption_point();
         COutPoint key;
         Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+        if (cursor.GetKey(key) && cursor.GetValue(coin)) {
+            if (*key.hash.begin() >= end_prefix) break;
             if (!outputs.empty() && key.hash != prevkey) {
                 ApplyStats(stats, prevkey, outputs);
                 ApplyHash(hash_obj, prevkey, outputs);
@@ -129,12 +118,117 @@ static bool GetUTXOStats(CCoinsView* view, BlockManager& blockman, CCoinsStats&
         } else {
             return error("%s: unable to read value", __func__);
         }
-        pcursor->Next();
+        cursor.Next();
     }
     if (!outputs.empty()) {
         ApplyStats(stats, prevkey, outputs);
         ApplyHash(hash_obj, prevkey, outputs);
     }
+    return true;
+}
+
+static void CombineHash(MuHash3072& muhash, const MuHash3072& part)
+{
+    muhash *= part;
+}
+static void CombineHash(std::nullptr_t, std::nullptr_t) {}
+
+//! Walk the coins database in disjoint key ranges at once, one per cursor.
+//! Ranges split on the first byte of the txid, so all outputs of a
+//! transaction are seen by the same thread.
+template <typename T>
+static bool ApplyCoinsParallel(std::vector<std::unique_ptr<CCoinsViewCursor>>& cursors, CCoinsStats& stats, T& hash_obj, const std::function<void()>& interruption_point)
+{
+    const unsigned int num_ranges = cursors.size();
+
+    struct Range {
+        std::unique_ptr<CCoinsViewCursor> cursor;
+        unsigned int end_prefix;
+        CCoinsStats stats{CoinStatsHashType::NONE};
+        T hash_obj{};
+        bool ok{false};
+        std::exception_ptr error;
+    };
+    std::vector<Range> ranges(num_ranges);
+    for (unsigned int i = 0; i < num_ranges; ++i) {
+        ranges[i].cursor = std::move(cursors[i]);
+        ranges[i].end_prefix = 256 * (i + 1) / num_ranges;
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < num_ranges; ++i) {
+        threads.emplace_back(&util::TraceThread, "utxostats", [&range = ranges[i], &interruption_point] {
+            try {
+                range.ok = ApplyCoins(*range.cursor, range.stats, range.hash_obj, interruption_point, range.end_prefix);
+            } catch (...) {
+                range.error = std::current_exception();
+            }
+        });
+    }
+    // The first range is done on this thread.
+    try {
+        ranges[0].ok = ApplyCoins(*ranges[0].cursor, ranges[0].stats, ranges[0].hash_obj, interruption_point, ranges[0].end_prefix);
+    } catch (...) {
+        ranges[0].error = std::current_exception();
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    for (Range& range : ranges) {
+        if (range.error) std::rethrow_exception(range.error);
+        if (!range.ok) return false;
+        stats.nTransactions += range.stats.nTransactions;
+        stats.nTransactionOutputs += range.stats.nTransactionOutputs;
+        stats.nBogoSize += range.stats.nBogoSize;
+        stats.nTotalAmount += range.stats.nTotalAmount;
+        stats.coins_count += range.stats.coins_count;
+        CombineHash(hash_obj, range.hash_obj);
+    }
+    return true;
+}
+
+//! Calculate statistics about the unspent transaction output set
+template <typename T>
+static bool GetUTXOStats(CCoinsView* view, BlockManager& blockman, CCoinsStats& stats, T hash_obj, const std::function<void()>& interruption_point, const CBlockIndex* pindex)
+{
+    // The serialized hash depends on the order of the coins, so it is always
+    // computed on a single cursor.
+    const CCoinsViewDB* db = dynamic_cast<const CCoinsViewDB*>(view);
+    const bool parallel = !std::is_same_v<T, CHashWriter> && db && stats.m_threads > 1;
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    std::vector<std::unique_ptr<CCoinsViewCursor>> range_cursors;
+    if (parallel) {
+        // The cursors read one snapshot of the database, which may be written to
+        // meanwhile by a background flush, without cs_main.
+        const unsigned int num_ranges = std::clamp(stats.m_threads, 1, MAX_UTXO_STATS_THREADS);
+        std::vector<uint256> starts(num_ranges);
+        for (unsigned int i = 0; i < num_ranges; ++i) *starts[i].begin() = 256 * i / num_ranges;
+        range_cursors = db->Cursors(starts);
+    } else {
+        pcursor = view->Cursor();
+        assert(pcursor);
+    }
+
+    if (!pindex) {
+        {
+            LOCK(cs_main);
+            pindex = blockman.LookupBlockIndex(parallel ? range_cursors.front()->GetBestBlock() : view->GetBestBlock());
+        }
+    }
+    stats.nHeight = Assert(pindex)->nHeight;
+    stats.hashBlock = pindex->GetBlockHash();
+
+    // Use CoinStatsIndex if it is requested and available and a hash_type of Muhash or None was requested
+    if ((stats.m_hash_type == CoinStatsHashType::MUHASH || stats.m_hash_type == CoinStatsHashType::NONE) && g_coin_stats_index && stats.index_requested) {
+        stats.index_used = true;
+        return g_coin_stats_index->LookUpStats(pindex, stats);
+    }
+
+    PrepareHash(hash_obj, stats);
+
+    if constexpr (!std::is_same_v<T, CHashWriter>) {
+        if (parallel && !ApplyCoinsParallel(range_cursors, stats, hash_obj, interruption_point)) return false;
+    }
+    if (!parallel && !ApplyCoins(*pcursor, stats, hash_obj, interruption_point)) return false;
 
     FinalizeHash(hash_obj, stats);
 
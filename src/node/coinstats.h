@@ -18,6 +18,9 @@
 class BlockManager;
 class CCoinsView;
 
+//! Maximum number of threads GetUTXOStats will hash the UTXO set with
+static constexpr int MAX_UTXO_STATS_THREADS{16};
+
 enum class CoinStatsHashType {
     HASH_SERIALIZED,
     MUHASH,
@@ -43,6 +46,10 @@ struct CCoinsStats
     bool index_requested{true};
     //! Signals if the coinstatsindex was used to retrieve the statistics.
     bool index_used{false};
+    //! Number of threads to walk the UTXO set with. Only used for MuHash and
+    //! no hash, whose results do not depend on the order coins are seen in,
+    //! and only when reading from a CCoinsViewDB.
+    int m_threads{1};
 
     // Following values are only available from coinstats index
     CAmount total_subsidy{0};
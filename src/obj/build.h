@@ -0,0 +1 @@
+#define BUILD_GIT_COMMIT "48c86836091a-dirty"
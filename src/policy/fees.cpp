@@ -648,6 +648,8 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
     trackedTxs = 0;
     untrackedTxs = 0;
+
+    RefreshSmartFeeCache();
 }
 
 CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
@@ -805,8 +807,67 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  */
 CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
 {
+    if (confTarget > 0) {
+        LOCK(m_cs_smart_fee_cache);
+        const std::vector<CachedSmartFee>& cache = m_smart_fee_cache[conservative];
+        if ((unsigned int)confTarget < cache.size() && cache[confTarget].valid) {
+            if (feeCalc) *feeCalc = cache[confTarget].calc;
+            return cache[confTarget].feerate;
+        }
+    }
+
     LOCK(m_cs_fee_estimator);
+    FeeCalculation calc;
+    const CFeeRate feerate = ComputeSmartFee(confTarget, &calc, conservative);
+    if (feeCalc) *feeCalc = calc;
+
+    // Still holding m_cs_fee_estimator, so the stats cannot have changed since.
+    const unsigned int max_target = longStats->GetMaxConfirms();
+    if (confTarget > 0 && (unsigned int)confTarget <= max_target) {
+        LOCK(m_cs_smart_fee_cache);
+        std::vector<CachedSmartFee>& cache = m_smart_fee_cache[conservative];
+        if (cache.size() <= max_target) cache.resize(max_target + 1);
+        cache[confTarget] = {true, feerate, calc};
+    }
+    return feerate;
+}
+
+void CBlockPolicyEstimator::InvalidateSmartFeeCache()
+{
+    AssertLockHeld(m_cs_fee_estimator);
+    LOCK(m_cs_smart_fee_cache);
+    for (std::vector<CachedSmartFee>& cache : m_smart_fee_cache) {
+        cache.clear();
+    }
+}
 
+void CBlockPolicyEstimator::RefreshSmartFeeCache()
+{
+    AssertLockHeld(m_cs_fee_estimator);
+    // Recompute the targets that were asked for since the last block, without blocking readers of
+    // the old results meanwhile.
+    std::vector<CachedSmartFee> refreshed[2];
+    {
+        LOCK(m_cs_smart_fee_cache);
+        for (int conservative = 0; conservative < 2; ++conservative) {
+            refreshed[conservative] = m_smart_fee_cache[conservative];
+        }
+    }
+    for (int conservative = 0; conservative < 2; ++conservative) {
+        for (size_t target = 1; target < refreshed[conservative].size(); ++target) {
+            CachedSmartFee& cached = refreshed[conservative][target];
+            if (!cached.valid) continue;
+            cached.feerate = ComputeSmartFee(target, &cached.calc, conservative);
+        }
+    }
+    LOCK(m_cs_smart_fee_cache);
+    for (int conservative = 0; conservative < 2; ++conservative) {
+        m_smart_fee_cache[conservative].swap(refreshed[conservative]);
+    }
+}
+
+CFeeRate CBlockPolicyEstimator::ComputeSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+{
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
         feeCalc->returnedTarget = confTarget;
@@ -969,6 +1030,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+            InvalidateSmartFeeCache();
         }
     }
     catch (const std::exception& e) {
@@ -987,6 +1049,7 @@ void CBlockPolicyEstimator::FlushUnconfirmed() {
         auto mi = mapMemPoolTxs.begin();
         removeTx(mi->first, false); // this calls erase() on mapMemPoolTxs
     }
+    InvalidateSmartFeeCache();
     int64_t endclear = GetTimeMicros();
     LogPrint(BCLog::ESTIMATEFEE, "Recorded %u unconfirmed txs from mempool in %gs\n", num_entries, (endclear - startclear)*0.000001);
 }
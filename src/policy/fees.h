@@ -201,6 +201,9 @@ public:
      *  blocks. If no answer can be given at confTarget, return an estimate at
      *  the closest target where one can be given.  'conservative' estimates are
      *  valid over longer time horizons also.
+     *  Results are cached, and the targets asked for are recomputed whenever a
+     *  block is processed, so repeated calls are answered without taking the
+     *  main estimator lock.
      */
     CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
 
@@ -254,6 +257,25 @@ private:
     std::vector<double> buckets GUARDED_BY(m_cs_fee_estimator); // The upper-bound of the range for the bucket (inclusive)
     std::map<double, unsigned int> bucketMap GUARDED_BY(m_cs_fee_estimator); // Map of bucket upper-bound to index into all vectors by bucket
 
+    struct CachedSmartFee
+    {
+        bool valid{false};
+        CFeeRate feerate;
+        FeeCalculation calc;
+    };
+
+    /** Protects the estimateSmartFee() cache. May be taken while holding m_cs_fee_estimator, not the other way around. */
+    mutable Mutex m_cs_smart_fee_cache;
+    /** estimateSmartFee() results indexed by [conservative][confTarget], refreshed after each block */
+    mutable std::vector<CachedSmartFee> m_smart_fee_cache[2] GUARDED_BY(m_cs_smart_fee_cache);
+
+    /** Drop cached estimateSmartFee() results */
+    void InvalidateSmartFeeCache() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** Recompute the cached estimateSmartFee() results against the current stats */
+    void RefreshSmartFeeCache() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** Uncached implementation of estimateSmartFee */
+    CFeeRate ComputeSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
 
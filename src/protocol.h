@@ -297,6 +297,11 @@ enum ServiceFlags : uint64_t {
     // collisions and other cases where nodes may be advertising a service they
     // do not actually support. Other service bits should be allocated via the
     // BIP process.
+
+    // NODE_P2P_V2 means the node accepts connections using the encrypted v2 transport
+    // (ChaCha20-Poly1305 AEAD framing set up by an ECDH key exchange, see -v2transport).
+    // This transport is not BIP324's, whose bit 11 it must not be confused with.
+    NODE_P2P_V2 = (1 << 24),
 };
 
 /**
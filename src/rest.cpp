@@ -24,6 +24,7 @@
 #include <version.h>
 
 #include <any>
+#include <functional>
 
 #include <boost/algorithm/string.hpp>
 
@@ -386,6 +387,76 @@ static bool rest_mempool_info(const std::any& context, HTTPRequest* req, const s
     }
 }
 
+static bool rest_mempool_stats(const std::any& context, HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    const CTxMemPool* mempool = GetMemPool(context, req);
+    if (!mempool) return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    switch (rf) {
+    case RetFormat::JSON: {
+        UniValue mempoolStatsObject = MempoolStatsToJSON(*mempool);
+
+        std::string strJSON = mempoolStatsObject.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+}
+
+/** Serve the mempool statistics in the Prometheus text exposition format */
+static bool rest_mempool_metrics(const std::any& context, HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    const CTxMemPool* mempool = GetMemPool(context, req);
+    if (!mempool) return false;
+
+    MempoolStats stats;
+    uint64_t size, bytes, usage;
+    {
+        LOCK(mempool->cs);
+        stats = mempool->GetStats();
+        size = mempool->size();
+        bytes = mempool->GetTotalTxSize();
+        usage = mempool->DynamicMemoryUsage();
+    }
+
+    std::string out;
+    out += "# TYPE mempool_size gauge\n";
+    out += strprintf("mempool_size %u\n", size);
+    out += "# TYPE mempool_bytes gauge\n";
+    out += strprintf("mempool_bytes %u\n", bytes);
+    out += "# TYPE mempool_usage_bytes gauge\n";
+    out += strprintf("mempool_usage_bytes %u\n", usage);
+    const auto write_buckets = [&](const std::string& metric, const std::function<int64_t(const MempoolStats::FeeBucket&)>& value) {
+        out += strprintf("# TYPE mempool_feerate_bucket_%s gauge\n", metric);
+        for (size_t i = 0; i < stats.fee_histogram.size(); ++i) {
+            out += strprintf("mempool_feerate_bucket_%s{min_sat_per_kvb=\"%d\"} %d\n", metric, MEMPOOL_HISTOGRAM_FEERATES[i], value(stats.fee_histogram[i]));
+        }
+    };
+    write_buckets("count", [](const MempoolStats::FeeBucket& b) { return int64_t(b.count); });
+    write_buckets("vsize", [](const MempoolStats::FeeBucket& b) { return int64_t(b.vsize); });
+    write_buckets("fees", [](const MempoolStats::FeeBucket& b) { return int64_t(b.fees); });
+    out += "# TYPE mempool_removed_total counter\n";
+    for (size_t i = 0; i < stats.removed.size(); ++i) {
+        out += strprintf("mempool_removed_total{reason=\"%s\"} %u\n", RemovalReasonToString(static_cast<MemPoolRemovalReason>(i)), stats.removed[i]);
+    }
+    out += "# TYPE mempool_rejected_chain_limit_total counter\n";
+    out += strprintf("mempool_rejected_chain_limit_total %u\n", stats.rejected_chain_limit);
+
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, out);
+    return true;
+}
+
 static bool rest_mempool_contents(const std::any& context, HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req)) return false;
@@ -718,6 +789,8 @@ static const struct {
       {"/rest/chaininfo", rest_chaininfo},
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
+      {"/rest/mempool/stats", rest_mempool_stats},
+      {"/rest/mempool/metrics", rest_mempool_metrics},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
       {"/rest/blockhashbyheight/", rest_blockhash_by_height},
@@ -161,6 +161,12 @@ static RPCHelpMan getpeerinfo()
                                                               "When a message type is not listed in this json object, the bytes sent are 0.\n"
                                                               "Only known message types can appear as keys in the object."}
                             }},
+                            {RPCResult::Type::OBJ, "bytessent_per_class", "The total bytes sent aggregated by priority class of the messages",
+                            {
+                                {RPCResult::Type::NUM, "tip", "New blocks, headers and control messages, sent first"},
+                                {RPCResult::Type::NUM, "tx-relay", "Transactions and their announcements"},
+                                {RPCResult::Type::NUM, "block-serving", "Historical blocks, sent last and in turns with other peers"},
+                            }},
                             {RPCResult::Type::OBJ_DYN, "bytesrecv_per_msg", "",
                             {
                                 {RPCResult::Type::NUM, "msg", "The total bytes received aggregated by message type\n"
@@ -259,6 +265,12 @@ static RPCHelpMan getpeerinfo()
         }
         obj.pushKV("bytessent_per_msg", sendPerMsgCmd);
 
+        UniValue sendPerClass(UniValue::VOBJ);
+        for (size_t i = 0; i < NUM_SEND_CLASSES; ++i) {
+            sendPerClass.pushKV(SendClassAsString(static_cast<SendClass>(i)), stats.m_send_bytes_per_class[i]);
+        }
+        obj.pushKV("bytessent_per_class", sendPerClass);
+
         UniValue recvPerMsgCmd(UniValue::VOBJ);
         for (const auto& i : stats.mapRecvBytesPerMsgCmd) {
             if (i.second > 0)
@@ -528,6 +540,16 @@ static RPCHelpMan getnettotals()
                            {RPCResult::Type::NUM, "bytes_left_in_cycle", "Bytes left in current time cycle"},
                            {RPCResult::Type::NUM, "time_left_in_cycle", "Seconds left in current time cycle"},
                         }},
+                       {RPCResult::Type::OBJ, "blockmessagecache", /* optional */ true, "Cache of block messages served to peers",
+                       {
+                           {RPCResult::Type::NUM, "hits", "Number of block requests whose message checksum was cached"},
+                           {RPCResult::Type::NUM, "misses", "Number of block requests whose message checksum was not cached"},
+                           {RPCResult::Type::NUM, "bytes_not_hashed", "Bytes of block messages sent without computing their checksum"},
+                           {RPCResult::Type::NUM, "bytes_not_serialized", "Bytes of block messages sent from the cache, without reading or serializing the block"},
+                           {RPCResult::Type::NUM, "entries", "Number of cached message checksums"},
+                           {RPCResult::Type::NUM, "payloads", "Number of cached serialized messages"},
+                           {RPCResult::Type::NUM, "payload_bytes", "Size of the cached serialized messages"},
+                        }},
                     }
                 },
                 RPCExamples{
@@ -552,6 +574,19 @@ static RPCHelpMan getnettotals()
     outboundLimit.pushKV("bytes_left_in_cycle", connman.GetOutboundTargetBytesLeft());
     outboundLimit.pushKV("time_left_in_cycle", count_seconds(connman.GetMaxOutboundTimeLeftInCycle()));
     obj.pushKV("uploadtarget", outboundLimit);
+
+    if (node.peerman) {
+        const BlockMessageCacheStats stats{node.peerman->GetBlockMessageCacheStats()};
+        UniValue block_cache(UniValue::VOBJ);
+        block_cache.pushKV("hits", stats.hits);
+        block_cache.pushKV("misses", stats.misses);
+        block_cache.pushKV("bytes_not_hashed", stats.bytes_not_hashed);
+        block_cache.pushKV("bytes_not_serialized", stats.bytes_not_serialized);
+        block_cache.pushKV("entries", (uint64_t)stats.entries);
+        block_cache.pushKV("payloads", (uint64_t)stats.payloads);
+        block_cache.pushKV("payload_bytes", (uint64_t)stats.payload_bytes);
+        obj.pushKV("blockmessagecache", block_cache);
+    }
     return obj;
 },
     };
@@ -620,6 +655,13 @@ static RPCHelpMan getnetworkinfo()
                                 {RPCResult::Type::NUM, "score", "relative score"},
                             }},
                         }},
+                        {RPCResult::Type::OBJ, "recvbufferpool", "pool of buffers that received messages are read into",
+                        {
+                            {RPCResult::Type::NUM, "buffers", "the number of pooled buffers"},
+                            {RPCResult::Type::NUM, "bytes", "the memory held by pooled buffers"},
+                            {RPCResult::Type::NUM, "reused", "the number of messages received into a pooled buffer"},
+                            {RPCResult::Type::NUM, "allocated", "the number of messages for which a new buffer was allocated"},
+                        }},
                         {RPCResult::Type::STR, "warnings", "any network and blockchain warnings"},
                     }
                 },
@@ -666,6 +708,13 @@ static RPCHelpMan getnetworkinfo()
         }
     }
     obj.pushKV("localaddresses", localAddresses);
+    const RecvBufferPoolStats pool_stats{RecvBufferPool::Instance().GetStats()};
+    UniValue recv_buffer_pool(UniValue::VOBJ);
+    recv_buffer_pool.pushKV("buffers", (uint64_t)pool_stats.buffers);
+    recv_buffer_pool.pushKV("bytes", (uint64_t)pool_stats.bytes);
+    recv_buffer_pool.pushKV("reused", pool_stats.reused);
+    recv_buffer_pool.pushKV("allocated", pool_stats.allocated);
+    obj.pushKV("recvbufferpool", recv_buffer_pool);
     obj.pushKV("warnings",       GetWarnings(false).original);
     return obj;
 },
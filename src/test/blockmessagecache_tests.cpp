@@ -0,0 +1,84 @@
+// Copyright (c) 2026 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockmessagecache.h>
+#include <hash.h>
+#include <serialize.h>
+#include <test/util/setup_common.h>
+#include <uint256.h>
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockmessagecache_tests, BasicTestingSetup)
+
+static BlockMessageCache::Checksum ExpectedChecksum(const std::vector<unsigned char>& payload)
+{
+    const uint256 hash{Hash(payload)};
+    BlockMessageCache::Checksum checksum;
+    std::copy(hash.begin(), hash.begin() + checksum.size(), checksum.begin());
+    return checksum;
+}
+
+BOOST_AUTO_TEST_CASE(checksums_and_payloads)
+{
+    BlockMessageCache cache{/* max_entries */ 3, /* max_payload_bytes */ 250};
+    const uint256 block{InsecureRand256()};
+    const std::vector<unsigned char> payload(100, 0x42);
+    const std::vector<unsigned char> payload_no_witness(90, 0x43);
+
+    BOOST_CHECK(!cache.Get(block, 0));
+    BOOST_CHECK(cache.Add(block, 0, payload, /* keep_payload */ false) == ExpectedChecksum(payload));
+    auto entry{cache.Get(block, 0)};
+    BOOST_REQUIRE(entry);
+    BOOST_CHECK(entry->checksum == ExpectedChecksum(payload));
+    BOOST_CHECK(!entry->payload);
+
+    // Serialization flags are part of the key.
+    BOOST_CHECK(!cache.Get(block, SERIALIZE_TRANSACTION_NO_WITNESS));
+    cache.Add(block, SERIALIZE_TRANSACTION_NO_WITNESS, payload_no_witness, /* keep_payload */ true);
+    entry = cache.Get(block, SERIALIZE_TRANSACTION_NO_WITNESS);
+    BOOST_REQUIRE(entry && entry->payload);
+    BOOST_CHECK(*entry->payload == payload_no_witness);
+    BOOST_CHECK(entry->checksum == ExpectedChecksum(payload_no_witness));
+
+    // Adding the payload of an entry that only had its checksum cached.
+    cache.Add(block, 0, payload, /* keep_payload */ true);
+    BOOST_CHECK(cache.Get(block, 0)->payload);
+
+    BlockMessageCacheStats stats{cache.GetStats()};
+    BOOST_CHECK_EQUAL(stats.hits, 3U);
+    BOOST_CHECK_EQUAL(stats.misses, 2U);
+    BOOST_CHECK_EQUAL(stats.bytes_not_hashed, 290U);
+    BOOST_CHECK_EQUAL(stats.bytes_not_serialized, 190U);
+    BOOST_CHECK_EQUAL(stats.entries, 2U);
+    BOOST_CHECK_EQUAL(stats.payloads, 2U);
+    BOOST_CHECK_EQUAL(stats.payload_bytes, 190U);
+
+    // Going over the payload budget drops the payload of the least recently used entry,
+    // which is the one without witnesses.
+    const uint256 block2{InsecureRand256()};
+    cache.Add(block2, 0, payload, /* keep_payload */ true);
+    BOOST_CHECK(!cache.Get(block, SERIALIZE_TRANSACTION_NO_WITNESS)->payload);
+    BOOST_CHECK(cache.Get(block, 0)->payload);
+    BOOST_CHECK(cache.Get(block2, 0)->payload);
+    stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.payloads, 2U);
+    BOOST_CHECK_EQUAL(stats.payload_bytes, 200U);
+
+    // Payloads larger than the whole budget are never kept.
+    const uint256 block3{InsecureRand256()};
+    cache.Add(block3, 0, std::vector<unsigned char>(251), /* keep_payload */ true);
+    BOOST_CHECK(!cache.Get(block3, 0)->payload);
+
+    // Going over the entry limit evicts the least recently used entry.
+    BOOST_CHECK(!cache.Get(block, SERIALIZE_TRANSACTION_NO_WITNESS));
+    BOOST_CHECK(cache.Get(block, 0));
+    stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.entries, 3U);
+    BOOST_CHECK_EQUAL(stats.payloads, 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,7 +4,9 @@
 
 #include <attributes.h>
 #include <clientversion.h>
+#include <chain.h>
 #include <coins.h>
+#include <node/coinstats.h>
 #include <script/standard.h>
 #include <streams.h>
 #include <test/util/setup_common.h>
@@ -12,6 +14,7 @@
 #include <uint256.h>
 #include <undo.h>
 #include <util/strencodings.h>
+#include <validation.h>
 
 #include <map>
 #include <vector>
@@ -878,4 +881,117 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_partial_flush)
+{
+    CCoinsView root;
+    CCoinsViewCacheTest base{&root};
+    CCoinsViewCacheTest cache{&base};
+
+    auto add_coins = [](CCoinsViewCache& view, int count) {
+        std::vector<COutPoint> outpoints;
+        for (int i = 0; i < count; ++i) {
+            Coin coin;
+            coin.nHeight = 1;
+            coin.out.nValue = 1 + InsecureRandRange(1000);
+            coin.out.scriptPubKey.assign(uint32_t{56}, 1);
+            outpoints.emplace_back(InsecureRand256(), 0);
+            view.AddCoin(outpoints.back(), std::move(coin), false);
+        }
+        return outpoints;
+    };
+
+    // A coin which exists in the base and is spent in the cache.
+    const COutPoint spent = add_coins(base, 1).front();
+    const std::vector<COutPoint> old_coins = add_coins(cache, 10);
+    BOOST_CHECK(cache.SpendCoin(spent));
+    cache.SetBestBlock(InsecureRand256());
+    const std::vector<COutPoint> new_coins = add_coins(cache, 10);
+    cache.SetBestBlock(InsecureRand256());
+
+    // Keep exactly the coins created after the first block.
+    size_t keep_bytes = 0;
+    for (const COutPoint& outpoint : new_coins) {
+        keep_bytes += memusage::MallocUsage(sizeof(memusage::unordered_node<CCoinsMap::value_type>)) +
+                      cache.AccessCoin(outpoint).DynamicMemoryUsage();
+    }
+    BOOST_CHECK(cache.PartialFlush(keep_bytes));
+    cache.SelfTest();
+
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), new_coins.size());
+    for (const COutPoint& outpoint : new_coins) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+        BOOST_CHECK_EQUAL(cache.map().at(outpoint).flags, 0);
+        BOOST_CHECK(base.HaveCoinInCache(outpoint));
+    }
+    for (const COutPoint& outpoint : old_coins) {
+        BOOST_CHECK(!cache.HaveCoinInCache(outpoint));
+        BOOST_CHECK(base.HaveCoinInCache(outpoint));
+    }
+    BOOST_CHECK(!base.HaveCoin(spent));
+
+    // Spending a kept coin must still reach the base, since it is no longer FRESH.
+    BOOST_CHECK(cache.SpendCoin(new_coins.front()));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!base.HaveCoin(new_coins.front()));
+    base.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(utxo_stats_parallel)
+{
+    CCoinsViewDB db{m_args.GetDataDirBase() / "utxo_stats", /*nCacheSize*/ 1 << 20, /*fMemory*/ true, /*fWipe*/ false};
+    CCoinsViewCache cache{&db};
+    for (int i = 0; i < 500; ++i) {
+        const uint256 txid{InsecureRand256()};
+        for (uint32_t n = 0; n < 1 + InsecureRandRange(3); ++n) {
+            Coin coin;
+            coin.nHeight = 1 + InsecureRandRange(100);
+            coin.fCoinBase = InsecureRandBool();
+            coin.out.nValue = 1 + InsecureRandRange(1000);
+            coin.out.scriptPubKey.assign(static_cast<uint32_t>(1 + InsecureRandRange(50)), 1);
+            cache.AddCoin(COutPoint{txid, n}, std::move(coin), false);
+        }
+    }
+    const uint256 best_block{InsecureRand256()};
+    cache.SetBestBlock(best_block);
+    BOOST_CHECK(cache.Flush());
+
+    BlockManager blockman{};
+    CBlockIndex index;
+    index.phashBlock = &best_block;
+    for (const CoinStatsHashType hash_type : {CoinStatsHashType::MUHASH, CoinStatsHashType::NONE}) {
+        CCoinsStats serial{hash_type};
+        BOOST_CHECK(GetUTXOStats(&db, blockman, serial, [] {}, &index));
+        for (const int threads : {2, 3, 7}) {
+            CCoinsStats parallel{hash_type};
+            parallel.m_threads = threads;
+            BOOST_CHECK(GetUTXOStats(&db, blockman, parallel, [] {}, &index));
+            BOOST_CHECK(parallel.hashSerialized == serial.hashSerialized);
+            BOOST_CHECK_EQUAL(parallel.nTransactions, serial.nTransactions);
+            BOOST_CHECK_EQUAL(parallel.nTransactionOutputs, serial.nTransactionOutputs);
+            BOOST_CHECK_EQUAL(parallel.nBogoSize, serial.nBogoSize);
+            BOOST_CHECK_EQUAL(parallel.nTotalAmount, serial.nTotalAmount);
+            BOOST_CHECK_EQUAL(parallel.coins_count, serial.coins_count);
+        }
+    }
+
+    // The range cursors read the database as it was when they were opened,
+    // whatever is flushed to it meanwhile.
+    CCoinsStats before{CoinStatsHashType::NONE};
+    BOOST_CHECK(GetUTXOStats(&db, blockman, before, [] {}, &index));
+    auto cursors{db.Cursors({uint256{}, uint256{}})};
+    Coin coin;
+    coin.out.nValue = 1;
+    cache.AddCoin(COutPoint{InsecureRand256(), 0}, std::move(coin), false);
+    const uint256 new_best_block{InsecureRand256()};
+    cache.SetBestBlock(new_best_block);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(db.GetBestBlock() == new_best_block);
+    for (const auto& cursor : cursors) {
+        BOOST_CHECK(cursor->GetBestBlock() == best_block);
+        uint64_t num_coins{0};
+        for (; cursor->Valid(); cursor->Next()) ++num_coins;
+        BOOST_CHECK_EQUAL(num_coins, before.coins_count);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -20,6 +20,8 @@
 #include <test/util/setup_common.h>
 #include <util/strencodings.h>
 
+#include <algorithm>
+#include <limits>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -947,4 +949,95 @@ BOOST_AUTO_TEST_CASE(muhash_tests)
     BOOST_CHECK_EQUAL(HexStr(out4), "3a31e6903aff0de9f62f9a9f7f8b861de76ce2cda09822b90014319ae5dc2271");
 }
 
+BOOST_AUTO_TEST_CASE(muhash_kernel_tests)
+{
+    // Compare the autodetected Num3072 kernel against the portable one.
+    std::vector<Num3072> nums;
+    for (int i = 0; i < 4; ++i) {
+        Num3072 n;
+        for (auto& limb : n.limbs) limb = std::numeric_limits<Num3072::limb_t>::max();
+        nums.push_back(n);
+    }
+    nums[1].limbs[0] -= 1103717; // the modulus
+    nums[2].limbs[0] -= 1103718; // the modulus minus one
+    nums[3].limbs[0] = 0;        // only the upper limbs set
+    nums.emplace_back();         // one
+    for (int i = 0; i < 32; ++i) {
+        Num3072 n;
+        for (auto& limb : n.limbs) limb = InsecureRand32() | (uint64_t{InsecureRand32()} << 31);
+        if (i & 1) n.limbs[Num3072::LIMBS - 1] = std::numeric_limits<Num3072::limb_t>::max();
+        nums.push_back(n);
+    }
+
+    const auto product = [](Num3072 a, const Num3072& b) { a.Multiply(b); return a; };
+    const auto square = [](Num3072 a) { a.Square(); return a; };
+    std::vector<Num3072> generic;
+    MuHash3072AutoDetect(false);
+    for (const auto& a : nums) {
+        generic.push_back(square(a));
+        for (const auto& b : nums) generic.push_back(product(a, b));
+    }
+
+    BOOST_TEST_MESSAGE("Using the '" << MuHash3072AutoDetect() << "' MuHash3072 implementation");
+    size_t i = 0;
+    for (const auto& a : nums) {
+        const Num3072 sq = square(a);
+        BOOST_CHECK(std::equal(std::begin(sq.limbs), std::end(sq.limbs), std::begin(generic[i++].limbs)));
+        for (const auto& b : nums) {
+            const Num3072 prod = product(a, b);
+            BOOST_CHECK(std::equal(std::begin(prod.limbs), std::end(prod.limbs), std::begin(generic[i++].limbs)));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(chacha20_poly1305_kernel_tests)
+{
+    // Messages of all lengths around the sizes processed by the vector kernels, with random and
+    // all-ones contents and keys (the largest limbs), and ChaCha20 block counters that carry.
+    struct Case {
+        std::vector<unsigned char> key;
+        std::vector<unsigned char> message;
+        uint64_t seek;
+    };
+    std::vector<Case> cases;
+    for (size_t len = 0; len < 1200; len += 1 + len / 64) {
+        Case c{g_insecure_rand_ctx.randbytes(32), g_insecure_rand_ctx.randbytes(len), InsecureRandBool() ? 0xfffffffcULL : g_insecure_rand_ctx.rand64()};
+        if (len % 3 == 0) {
+            std::fill(c.key.begin(), c.key.end(), 0xff);
+            std::fill(c.message.begin(), c.message.end(), 0xff);
+        }
+        cases.push_back(std::move(c));
+    }
+
+    const auto results = [&] {
+        std::vector<std::vector<unsigned char>> ret;
+        for (const Case& c : cases) {
+            ChaCha20 chacha{c.key.data(), c.key.size()};
+            chacha.SetIV(c.seek ^ 0x5555);
+            chacha.Seek(c.seek);
+            std::vector<unsigned char> out(c.message.size());
+            chacha.Crypt(c.message.data(), out.data(), out.size());
+            ret.push_back(out);
+            // In place, and the keystream.
+            chacha.Seek(c.seek);
+            chacha.Crypt(out.data(), out.data(), out.size());
+            BOOST_CHECK(out == c.message);
+            chacha.Seek(c.seek);
+            chacha.Keystream(out.data(), out.size());
+            ret.push_back(out);
+            std::vector<unsigned char> tag(POLY1305_TAGLEN);
+            poly1305_auth(tag.data(), c.message.data(), c.message.size(), c.key.data());
+            ret.push_back(tag);
+        }
+        return ret;
+    };
+
+    ChaCha20AutoDetect(false);
+    Poly1305AutoDetect(false);
+    const auto generic = results();
+    BOOST_TEST_MESSAGE("Using the '" << ChaCha20AutoDetect() << "' ChaCha20 implementation");
+    BOOST_TEST_MESSAGE("Using the '" << Poly1305AutoDetect() << "' Poly1305 implementation");
+    BOOST_CHECK(results() == generic);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,8 +7,10 @@
 #include <arith_uint256.h>
 #include <banman.h>
 #include <chainparams.h>
+#include <core_memusage.h>
 #include <net.h>
 #include <net_processing.h>
+#include <netmessagemaker.h>
 #include <pubkey.h>
 #include <script/sign.h>
 #include <script/signingprovider.h>
@@ -16,6 +18,7 @@
 #include <serialize.h>
 #include <test/util/net.h>
 #include <test/util/setup_common.h>
+#include <txmempool.h>
 #include <txorphanage.h>
 #include <util/string.h>
 #include <util/system.h>
@@ -23,6 +26,8 @@
 #include <validation.h>
 
 #include <array>
+#include <chrono>
+#include <memory>
 #include <stdint.h>
 
 #include <boost/test/unit_test.hpp>
@@ -282,6 +287,183 @@ BOOST_AUTO_TEST_CASE(peer_discouragement)
     connman->ClearTestNodes();
 }
 
+// Process the messages of several peers on several message handler threads at once,
+// and check that each peer gets its replies in the order of its requests.
+BOOST_AUTO_TEST_CASE(message_handler_threads)
+{
+    const CChainParams& chainparams = Params();
+    auto connman = std::make_unique<ConnmanTestMsg>(0x1337, 0x1337, *m_node.addrman);
+    auto peerLogic = PeerManager::make(chainparams, *connman, *m_node.addrman, nullptr,
+                                       *m_node.scheduler, *m_node.chainman, *m_node.mempool, false);
+    CConnman::Options options;
+    options.m_msgproc = peerLogic.get();
+    options.m_msghand_threads = 4;
+    options.nSendBufferMaxSize = 1000 * DEFAULT_MAXSENDBUFFER;
+    connman->Init(options);
+
+    constexpr int num_peers{8};
+    constexpr uint64_t num_requests{50};
+    const CNetMsgMaker msg_maker{PROTOCOL_VERSION};
+    const CBlockLocator locator{std::vector<uint256>{chainparams.GenesisBlock().GetHash()}};
+    std::vector<CNode*> nodes;
+    std::vector<std::unique_ptr<CNode>> receivers;
+    for (int i = 0; i < num_peers; ++i) {
+        CNode* node = new CNode{id++, NODE_NETWORK, INVALID_SOCKET, CAddress{ip(0xa0b0c001 + i), NODE_NONE}, /* nKeyedNetGroupIn */ 0,
+                                /* nLocalHostNonceIn */ 0, CAddress(), /* pszDest */ "",
+                                ConnectionType::INBOUND, /* inbound_onion */ false};
+        node->nVersion = PROTOCOL_VERSION;
+        node->SetCommonVersion(PROTOCOL_VERSION);
+        // Answer getheaders despite the initial block download.
+        node->m_permissionFlags = NetPermissionFlags::Download;
+        peerLogic->InitializeNode(node);
+        node->fSuccessfullyConnected = true;
+        connman->AddTestNode(*node);
+        nodes.push_back(node);
+        receivers.push_back(std::make_unique<CNode>(id++, NODE_NETWORK, INVALID_SOCKET, CAddress{}, /* nKeyedNetGroupIn */ 0,
+                                                    /* nLocalHostNonceIn */ 0, CAddress(), /* pszDest */ "",
+                                                    ConnectionType::OUTBOUND_FULL_RELAY, /* inbound_onion */ false));
+
+        // Pings are processed without m_msgproc_mutex, getheaders under it.
+        for (uint64_t nonce = 0; nonce < num_requests; ++nonce) {
+            CSerializedNetMsg ping{msg_maker.Make(NetMsgType::PING, (uint64_t(i) << 32) | nonce)};
+            connman->ReceiveMsgFrom(*node, ping);
+            CSerializedNetMsg getheaders{msg_maker.Make(NetMsgType::GETHEADERS, locator, uint256{})};
+            connman->ReceiveMsgFrom(*node, getheaders);
+        }
+    }
+
+    const auto replies = [](CNode& receiver) {
+        std::vector<CNetMessage> msgs;
+        LOCK(receiver.cs_vProcessMsg);
+        for (CNetMessage& msg : receiver.vProcessMsg) {
+            if (msg.m_command == NetMsgType::PONG || msg.m_command == NetMsgType::HEADERS) msgs.push_back(std::move(msg));
+        }
+        return msgs;
+    };
+    connman->StartMessageHandlers();
+    const auto deadline = std::chrono::steady_clock::now() + 60s;
+    bool done{false};
+    while (!done && std::chrono::steady_clock::now() < deadline) {
+        done = true;
+        for (int i = 0; i < num_peers; ++i) {
+            bool complete;
+            const std::vector<uint8_t> bytes{TakeSendQueue(*nodes[i])};
+            if (!bytes.empty()) connman->NodeReceiveMsgBytes(*receivers[i], bytes, complete);
+            size_t count{0};
+            {
+                LOCK(receivers[i]->cs_vProcessMsg);
+                for (const CNetMessage& msg : receivers[i]->vProcessMsg) {
+                    count += msg.m_command == NetMsgType::PONG || msg.m_command == NetMsgType::HEADERS;
+                }
+            }
+            done &= count == 2 * num_requests;
+        }
+        if (!done) UninterruptibleSleep(1ms);
+    }
+    connman->StopMessageHandlers();
+    BOOST_CHECK(done);
+
+    for (int i = 0; i < num_peers; ++i) {
+        BOOST_CHECK(!nodes[i]->fDisconnect);
+        BOOST_CHECK(WITH_LOCK(nodes[i]->cs_vProcessMsg, return nodes[i]->vProcessMsg.empty()));
+        CNodeStateStats stats;
+        BOOST_CHECK(peerLogic->GetNodeStateStats(nodes[i]->GetId(), stats));
+
+        std::vector<CNetMessage> msgs{replies(*receivers[i])};
+        BOOST_CHECK_EQUAL(msgs.size(), 2 * num_requests);
+        for (uint64_t nonce = 0; 2 * nonce + 1 < msgs.size(); ++nonce) {
+            CNetMessage& pong{msgs[2 * nonce]};
+            CNetMessage& headers{msgs[2 * nonce + 1]};
+            BOOST_CHECK_EQUAL(pong.m_command, NetMsgType::PONG);
+            BOOST_CHECK_EQUAL(headers.m_command, NetMsgType::HEADERS);
+            if (pong.m_command != NetMsgType::PONG || headers.m_command != NetMsgType::HEADERS) break;
+            uint64_t received_nonce;
+            pong.m_recv >> received_nonce;
+            BOOST_CHECK_EQUAL(received_nonce, (uint64_t(i) << 32) | nonce);
+            std::vector<CBlock> received_headers;
+            headers.m_recv >> received_headers;
+            BOOST_CHECK(received_headers.empty());
+        }
+    }
+
+    for (const CNode* node : nodes) {
+        peerLogic->FinalizeNode(*node);
+    }
+    connman->ClearTestNodes();
+}
+
+BOOST_AUTO_TEST_CASE(tx_announcement_mempool_removal)
+{
+    const CChainParams& chainparams = Params();
+    auto connman = std::make_unique<ConnmanTestMsg>(0x1337, 0x1337, *m_node.addrman);
+    auto peerLogic = PeerManager::make(chainparams, *connman, *m_node.addrman, nullptr,
+                                       *m_node.scheduler, *m_node.chainman, *m_node.mempool, false);
+    CConnman::Options options;
+    options.nSendBufferMaxSize = 1000 * DEFAULT_MAXSENDBUFFER;
+    connman->Init(options);
+    SetMockTime(GetTime());
+
+    std::vector<CNode*> nodes;
+    for (int i = 0; i < 2; ++i) {
+        CNode* node = new CNode{id++, NODE_NETWORK, INVALID_SOCKET, CAddress{ip(0xa0b0c001 + i), NODE_NONE}, /* nKeyedNetGroupIn */ 0,
+                                /* nLocalHostNonceIn */ 0, CAddress(), /* pszDest */ "",
+                                ConnectionType::OUTBOUND_FULL_RELAY, /* inbound_onion */ false};
+        node->nVersion = PROTOCOL_VERSION;
+        node->SetCommonVersion(PROTOCOL_VERSION);
+        // Trickle on every SendMessages call.
+        node->m_permissionFlags = NetPermissionFlags::NoBan;
+        peerLogic->InitializeNode(node);
+        node->fSuccessfullyConnected = true;
+        WITH_LOCK(node->m_tx_relay->cs_filter, node->m_tx_relay->fRelayTxes = true);
+        connman->AddTestNode(*node);
+        nodes.push_back(node);
+    }
+
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < 2; ++i) {
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(COutPoint{InsecureRand256(), 0});
+        mtx.vout.emplace_back(COIN, CScript() << OP_TRUE);
+        txs.push_back(MakeTransactionRef(mtx));
+        {
+            LOCK2(cs_main, m_node.mempool->cs);
+            m_node.mempool->addUnchecked(TestMemPoolEntryHelper{}.Fee(10000 * (i + 1)).FromTx(txs.back()));
+        }
+        peerLogic->RelayTransaction(txs.back()->GetHash(), txs.back()->GetWitnessHash());
+    }
+
+    const auto announced = [&](CNode& node) {
+        WITH_LOCK(node.cs_sendProcessing, peerLogic->SendMessages(&node));
+        CNode receiver{id++, NODE_NETWORK, INVALID_SOCKET, CAddress{}, /* nKeyedNetGroupIn */ 0,
+                       /* nLocalHostNonceIn */ 0, CAddress(), /* pszDest */ "",
+                       ConnectionType::OUTBOUND_FULL_RELAY, /* inbound_onion */ false};
+        bool complete;
+        connman->NodeReceiveMsgBytes(receiver, TakeSendQueue(node), complete);
+        std::vector<uint256> hashes;
+        LOCK(receiver.cs_vProcessMsg);
+        for (CNetMessage& msg : receiver.vProcessMsg) {
+            if (msg.m_command != NetMsgType::INV) continue;
+            std::vector<CInv> invs;
+            msg.m_recv >> invs;
+            for (const CInv& inv : invs) hashes.push_back(inv.hash);
+        }
+        return hashes;
+    };
+
+    // The first peer builds the shared order, highest feerate first.
+    BOOST_CHECK(announced(*nodes[0]) == std::vector<uint256>({txs[1]->GetHash(), txs[0]->GetHash()}));
+
+    // A transaction which left the mempool since is no longer announced from that order.
+    WITH_LOCK(m_node.mempool->cs, m_node.mempool->removeRecursive(*txs[1], MemPoolRemovalReason::CONFLICT));
+    BOOST_CHECK(announced(*nodes[1]) == std::vector<uint256>({txs[0]->GetHash()}));
+
+    SetMockTime(0);
+    for (const CNode* node : nodes) {
+        peerLogic->FinalizeNode(*node);
+    }
+    connman->ClearTestNodes();
+}
+
 BOOST_AUTO_TEST_CASE(DoS_bantime)
 {
     const CChainParams& chainparams = Params();
@@ -419,12 +601,75 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     }
 
     // Test LimitOrphanTxSize() function:
+    const size_t usage_before = orphanage.DynamicMemoryUsage();
+    BOOST_CHECK(usage_before > 0);
+    orphanage.LimitOrphans(1000, usage_before / 2);
+    BOOST_CHECK(orphanage.DynamicMemoryUsage() <= usage_before / 2);
     orphanage.LimitOrphans(40);
     BOOST_CHECK(orphanage.CountOrphans() <= 40);
     orphanage.LimitOrphans(10);
     BOOST_CHECK(orphanage.CountOrphans() <= 10);
     orphanage.LimitOrphans(0);
     BOOST_CHECK(orphanage.CountOrphans() == 0);
+    BOOST_CHECK_EQUAL(orphanage.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphanPackage)
+{
+    TxOrphanageTest orphanage;
+    LOCK(g_cs_orphans);
+
+    // A chain of orphans a <- b <- c, where c also spends a, and an unrelated orphan d.
+    auto make_tx = [](const std::vector<uint256>& parents) {
+        CMutableTransaction tx;
+        for (const uint256& parent : parents) tx.vin.emplace_back(COutPoint(parent, 0));
+        if (parents.empty()) tx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        return MakeTransactionRef(tx);
+    };
+    const CTransactionRef a = make_tx({});
+    const CTransactionRef b = make_tx({a->GetHash()});
+    const CTransactionRef c = make_tx({b->GetHash(), a->GetHash()});
+    const CTransactionRef d = make_tx({});
+    // Add them children first so that insertion order does not match dependency order.
+    BOOST_CHECK(orphanage.AddTx(c, 3));
+    BOOST_CHECK(orphanage.AddTx(b, 2));
+    BOOST_CHECK(orphanage.AddTx(a, 1));
+    BOOST_CHECK(orphanage.AddTx(d, 4));
+    // The orphanage's indexes are counted in its memory usage too.
+    BOOST_CHECK(orphanage.DynamicMemoryUsage() > RecursiveDynamicUsage(a) + RecursiveDynamicUsage(b) +
+                                                 RecursiveDynamicUsage(c) + RecursiveDynamicUsage(d));
+
+    std::set<uint256> work_set{a->GetHash()};
+    const auto package = orphanage.TakeWorkSetPackage(work_set);
+    BOOST_CHECK(work_set.empty());
+    BOOST_REQUIRE_EQUAL(package.size(), 3U);
+    BOOST_CHECK(package[0].first == a && package[0].second == 1);
+    BOOST_CHECK(package[1].first == b && package[1].second == 2);
+    BOOST_CHECK(package[2].first == c && package[2].second == 3);
+
+    // Taking the package leaves the orphans in place.
+    BOOST_CHECK_EQUAL(orphanage.CountOrphans(), 4U);
+    work_set = {b->GetHash(), GetRandHash()};
+    const auto sub_package = orphanage.TakeWorkSetPackage(work_set);
+    BOOST_REQUIRE_EQUAL(sub_package.size(), 2U);
+    BOOST_CHECK(sub_package[0].first == b);
+    BOOST_CHECK(sub_package[1].first == c);
+
+    // A capped package is a prefix in dependency order, and the rest stays in the work set.
+    work_set = {a->GetHash(), d->GetHash()};
+    const auto capped_package = orphanage.TakeWorkSetPackage(work_set, 2);
+    BOOST_REQUIRE_EQUAL(capped_package.size(), 2U);
+    std::set<uint256> taken;
+    for (const auto& [tx, from_peer] : capped_package) taken.insert(tx->GetHash());
+    BOOST_CHECK(!taken.count(c->GetHash()) && (!taken.count(b->GetHash()) || taken.count(a->GetHash())));
+    BOOST_CHECK_EQUAL(work_set.size(), 2U);
+    for (const uint256& txid : work_set) BOOST_CHECK(!taken.count(txid));
+    const auto rest = orphanage.TakeWorkSetPackage(work_set);
+    BOOST_CHECK(work_set.empty());
+    BOOST_CHECK_EQUAL(rest.size(), 2U);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
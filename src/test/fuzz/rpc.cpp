@@ -123,6 +123,7 @@ const std::vector<std::string> RPC_COMMANDS_SAFE_FOR_FUZZING{
     "getmempooldescendants",
     "getmempoolentry",
     "getmempoolinfo",
+    "getmempoolstats",
     "getmininginfo",
     "getnettotals",
     "getnetworkhashps",
@@ -145,6 +145,26 @@ BOOST_AUTO_TEST_CASE(siphash)
         BOOST_CHECK_EQUAL(SipHashUint256(k1, k2, x), sip256.Finalize());
         BOOST_CHECK_EQUAL(SipHashUint256Extra(k1, k2, x, n), sip288.Finalize());
     }
+
+    // Check consistency between SipHashUint256 and both implementations of SipHashUint256Lanes.
+    for (const bool use_optimized : {false, true}) {
+        BOOST_TEST_MESSAGE("Using the '" << SipHashAutoDetect(use_optimized) << "' SipHash implementation");
+        for (int i = 0; i < 16; ++i) {
+            uint64_t k1 = ctx.rand64();
+            uint64_t k2 = ctx.rand64();
+            uint256 vals[SIPHASH_LANES];
+            const uint256* val_ptrs[SIPHASH_LANES];
+            for (size_t lane = 0; lane < SIPHASH_LANES; ++lane) {
+                vals[lane] = InsecureRand256();
+                val_ptrs[lane] = &vals[lane];
+            }
+            uint64_t out[SIPHASH_LANES];
+            SipHashUint256Lanes(k1, k2, val_ptrs, out);
+            for (size_t lane = 0; lane < SIPHASH_LANES; ++lane) {
+                BOOST_CHECK_EQUAL(out[lane], SipHashUint256(k1, k2, vals[lane]));
+            }
+        }
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -786,4 +786,254 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_FIXTURE_TEST_CASE(MempoolSnapshotTest, BasicTestingSetup)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    const auto empty = pool.GetSnapshot();
+    BOOST_CHECK(empty->entries.empty());
+    // Nothing changed, so readers share the same snapshot.
+    BOOST_CHECK_EQUAL(pool.GetSnapshot().get(), empty.get());
+
+    CMutableTransaction parent;
+    parent.vin.resize(1);
+    parent.vin[0].scriptSig = CScript() << OP_11;
+    parent.vin[0].nSequence = 0; // signals BIP125
+    parent.vout.resize(1);
+    parent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    parent.vout[0].nValue = 10 * COIN;
+
+    CMutableTransaction child;
+    child.vin.resize(1);
+    child.vin[0].prevout = COutPoint(parent.GetHash(), 0);
+    child.vout.resize(1);
+    child.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    child.vout[0].nValue = 9 * COIN;
+
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.Fee(1000).FromTx(parent));
+        pool.addUnchecked(entry.Fee(2000).FromTx(child));
+    }
+
+    const auto full = pool.GetSnapshot();
+    BOOST_CHECK(full.get() != empty.get());
+    BOOST_CHECK(empty->entries.empty());
+    BOOST_REQUIRE_EQUAL(full->entries.size(), 2U);
+    // Parents sort before their children.
+    BOOST_CHECK(full->entries[0].tx->GetHash() == parent.GetHash());
+    BOOST_CHECK(full->entries[1].tx->GetHash() == child.GetHash());
+
+    const MempoolSnapshotEntry* child_entry = full->Find(child.GetHash());
+    BOOST_REQUIRE(child_entry);
+    BOOST_CHECK_EQUAL(child_entry->count_with_ancestors, 2U);
+    BOOST_CHECK_EQUAL(child_entry->mod_fees_with_ancestors, 3000);
+    BOOST_CHECK(child_entry->parents == std::vector<uint256>{parent.GetHash()});
+    BOOST_CHECK(child_entry->bip125_replaceable); // inherited from the parent
+    BOOST_CHECK(full->Find(parent.GetHash())->children == std::vector<uint256>{child.GetHash()});
+    BOOST_CHECK_EQUAL(full->Find(parent.GetHash())->mod_fees_with_descendants, 3000);
+
+    {
+        // A single-entry copy agrees with the snapshot without building one.
+        LOCK(pool.cs);
+        const MempoolSnapshotEntry copy{pool.CopyEntry(pool.mapTx.find(child.GetHash()))};
+        BOOST_CHECK(copy.tx->GetHash() == child.GetHash());
+        BOOST_CHECK_EQUAL(copy.count_with_ancestors, child_entry->count_with_ancestors);
+        BOOST_CHECK_EQUAL(copy.mod_fees_with_ancestors, child_entry->mod_fees_with_ancestors);
+        BOOST_CHECK(copy.parents == child_entry->parents);
+        BOOST_CHECK(copy.bip125_replaceable);
+    }
+
+    pool.PrioritiseTransaction(child.GetHash(), 500);
+    const auto prioritised = pool.GetSnapshot();
+    BOOST_CHECK(prioritised.get() != full.get());
+    BOOST_CHECK_EQUAL(prioritised->Find(child.GetHash())->modified_fee, 2500);
+    BOOST_CHECK_EQUAL(full->Find(child.GetHash())->modified_fee, 2000);
+
+    {
+        LOCK(pool.cs);
+        pool.removeForBlock({MakeTransactionRef(parent)}, 1);
+    }
+    const auto confirmed = pool.GetSnapshot();
+    BOOST_REQUIRE_EQUAL(confirmed->entries.size(), 1U);
+    BOOST_CHECK(confirmed->Find(parent.GetHash()) == nullptr);
+    BOOST_CHECK_EQUAL(confirmed->entries[0].count_with_ancestors, 1U);
+    BOOST_CHECK(confirmed->entries[0].parents.empty());
+    BOOST_CHECK(!confirmed->entries[0].bip125_replaceable);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolClusterTest)
+{
+    CTxMemPool pool(nullptr, 0, /* use_clusters */ true);
+    TestMemPoolEntryHelper entry;
+    BOOST_CHECK(pool.UsesClusters());
+
+    auto make_tx = [](std::vector<COutPoint> prevouts, int tag) {
+        CMutableTransaction tx;
+        tx.vin.resize(prevouts.size());
+        for (size_t i = 0; i < prevouts.size(); ++i) {
+            tx.vin[i].prevout = prevouts[i];
+            tx.vin[i].scriptSig = CScript() << tag;
+        }
+        tx.vout.resize(2);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        tx.vout[1].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[1].nValue = COIN;
+        return tx;
+    };
+
+    // A low fee parent with two high fee children, plus an unrelated transaction.
+    const CMutableTransaction parent = make_tx({COutPoint()}, 1);
+    const CMutableTransaction child1 = make_tx({COutPoint(parent.GetHash(), 0)}, 2);
+    const CMutableTransaction child2 = make_tx({COutPoint(parent.GetHash(), 1)}, 3);
+    const CMutableTransaction single = make_tx({COutPoint()}, 4);
+
+    LOCK2(cs_main, pool.cs);
+    pool.addUnchecked(entry.Fee(1000).FromTx(parent));
+    pool.addUnchecked(entry.Fee(2000).FromTx(single));
+    BOOST_CHECK_EQUAL(pool.GetClusters().size(), 2U);
+    pool.addUnchecked(entry.Fee(20000).FromTx(child1));
+    pool.addUnchecked(entry.Fee(10000).FromTx(child2));
+
+    const auto& clusters = pool.GetClusters();
+    BOOST_REQUIRE_EQUAL(clusters.size(), 2U);
+    const TxCluster* family = nullptr;
+    for (const auto& [id, cluster] : clusters) {
+        if (cluster.txs.size() == 3) family = &cluster;
+    }
+    BOOST_REQUIRE(family);
+    // The parent is paid for by its best child, so they share the first
+    // chunk; the other child follows on its own.
+    BOOST_REQUIRE_EQUAL(family->chunks.size(), 2U);
+    BOOST_REQUIRE_EQUAL(family->chunks[0].txs.size(), 2U);
+    BOOST_CHECK(family->chunks[0].txs[0]->GetTx().GetHash() == parent.GetHash());
+    BOOST_CHECK(family->chunks[0].txs[1]->GetTx().GetHash() == child1.GetHash());
+    BOOST_CHECK_EQUAL(family->chunks[0].fee, 21000);
+    BOOST_REQUIRE_EQUAL(family->chunks[1].txs.size(), 1U);
+    BOOST_CHECK(family->chunks[1].txs[0]->GetTx().GetHash() == child2.GetHash());
+    BOOST_CHECK(!CompareClusterChunk()(family->chunks[1], family->chunks[0]));
+
+    // Prioritising the second child moves it ahead.
+    pool.PrioritiseTransaction(child2.GetHash(), 50000);
+    for (const auto& [id, cluster] : pool.GetClusters()) {
+        if (cluster.txs.size() != 3) continue;
+        BOOST_REQUIRE_EQUAL(cluster.chunks.size(), 2U);
+        BOOST_CHECK(cluster.chunks[0].txs[1]->GetTx().GetHash() == child2.GetHash());
+    }
+
+    // Confirming the parent splits its cluster in two.
+    pool.removeForBlock({MakeTransactionRef(parent)}, 1);
+    BOOST_REQUIRE_EQUAL(pool.GetClusters().size(), 3U);
+    for (const auto& [id, cluster] : pool.GetClusters()) {
+        BOOST_REQUIRE_EQUAL(cluster.txs.size(), 1U);
+        BOOST_REQUIRE_EQUAL(cluster.chunks.size(), 1U);
+        BOOST_CHECK_EQUAL(cluster.txs[0]->m_cluster_id, id);
+    }
+
+    // A transaction spending both children joins them again.
+    const CMutableTransaction joiner = make_tx({COutPoint(child1.GetHash(), 0), COutPoint(child2.GetHash(), 0)}, 5);
+    pool.addUnchecked(entry.Fee(1000).FromTx(joiner));
+    BOOST_REQUIRE_EQUAL(pool.GetClusters().size(), 2U);
+    for (const auto& [id, cluster] : pool.GetClusters()) {
+        BOOST_CHECK_EQUAL(cluster.txs.size(), cluster.txs[0]->GetTx().GetHash() == single.GetHash() ? 1U : 3U);
+    }
+
+    // Trimming evicts the chunk that would be mined last, one at a time.
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!pool.exists(joiner.GetHash()));
+    BOOST_CHECK_EQUAL(pool.size(), 3U);
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!pool.exists(single.GetHash()));
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+    pool.TrimToSize(0);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK(pool.GetClusters().empty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolStatsTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    auto make_tx = [](int tag) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << tag;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        return tx;
+    };
+    const CMutableTransaction tx1 = make_tx(1);
+    const CMutableTransaction tx2 = make_tx(2);
+    const CMutableTransaction tx3 = make_tx(3);
+    const size_t vsize = GetVirtualTransactionSize(CTransaction(tx1));
+    const CAmount high_fee = MEMPOOL_HISTOGRAM_FEERATES[NUM_MEMPOOL_HISTOGRAM_BUCKETS - 1] * vsize / 1000 + 1000;
+
+    LOCK2(cs_main, pool.cs);
+    pool.addUnchecked(entry.Fee(0).FromTx(tx1));
+    pool.addUnchecked(entry.Fee(0).FromTx(tx2));
+    pool.addUnchecked(entry.Fee(high_fee).FromTx(tx3));
+    // Modified fees are not reflected in the histogram.
+    pool.PrioritiseTransaction(tx1.GetHash(), high_fee);
+
+    MempoolStats stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.fee_histogram[0].count, 2U);
+    BOOST_CHECK_EQUAL(stats.fee_histogram[0].vsize, 2 * vsize);
+    BOOST_CHECK_EQUAL(stats.fee_histogram.back().count, 1U);
+    BOOST_CHECK_EQUAL(stats.fee_histogram.back().fees, high_fee);
+
+    pool.removeRecursive(CTransaction(tx2), MemPoolRemovalReason::EXPIRY);
+    pool.removeForBlock({MakeTransactionRef(tx3)}, 1);
+    stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.fee_histogram[0].count, 1U);
+    BOOST_CHECK_EQUAL(stats.fee_histogram.back().count, 0U);
+    BOOST_CHECK_EQUAL(stats.fee_histogram.back().vsize, 0U);
+    BOOST_CHECK_EQUAL(stats.removed[static_cast<size_t>(MemPoolRemovalReason::EXPIRY)], 1U);
+    BOOST_CHECK_EQUAL(stats.removed[static_cast<size_t>(MemPoolRemovalReason::BLOCK)], 1U);
+
+    // Clearing empties the histogram but keeps the cumulative counters.
+    pool._clear();
+    stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.fee_histogram[0].count, 0U);
+    BOOST_CHECK_EQUAL(stats.removed[static_cast<size_t>(MemPoolRemovalReason::EXPIRY)], 1U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolInfoForRelayTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    auto make_tx = [](const std::vector<COutPoint>& inputs, int tag) {
+        CMutableTransaction tx;
+        for (const COutPoint& prevout : inputs) {
+            tx.vin.emplace_back(prevout, CScript() << tag);
+        }
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        return tx;
+    };
+    const CMutableTransaction parent = make_tx({COutPoint(InsecureRand256(), 0)}, 1);
+    const CMutableTransaction child = make_tx({COutPoint(parent.GetHash(), 0)}, 2);
+    const CMutableTransaction high_fee = make_tx({COutPoint(InsecureRand256(), 0)}, 3);
+    const CMutableTransaction missing = make_tx({COutPoint(InsecureRand256(), 0)}, 4);
+
+    LOCK2(cs_main, pool.cs);
+    pool.addUnchecked(entry.Fee(1000).FromTx(parent));
+    // A child pays more than its parent, but is still relayed after it.
+    pool.addUnchecked(entry.Fee(50000).FromTx(child));
+    pool.addUnchecked(entry.Fee(10000).FromTx(high_fee));
+
+    const std::vector<TxMempoolInfo> infos{pool.infoForRelay({child.GetHash(), missing.GetHash(), parent.GetHash(), high_fee.GetHash()})};
+    BOOST_REQUIRE_EQUAL(infos.size(), 3U);
+    BOOST_CHECK(infos[0].tx->GetHash() == high_fee.GetHash());
+    BOOST_CHECK(infos[1].tx->GetHash() == parent.GetHash());
+    BOOST_CHECK(infos[2].tx->GetHash() == child.GetHash());
+    BOOST_CHECK_EQUAL(infos[2].fee, 50000);
+    BOOST_CHECK(pool.infoForRelay({missing.GetHash()}).empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
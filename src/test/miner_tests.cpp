@@ -16,6 +16,7 @@
 #include <util/system.h>
 #include <util/time.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <test/util/setup_common.h>
 
@@ -527,4 +528,126 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_FIXTURE_TEST_CASE(UpdateBlock_incremental, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    CChainState& chainstate = m_node.chainman->ActiveChainstate();
+    const CScript coinbase_script{m_coinbase_txns[0]->vout[0].scriptPubKey};
+    const CScript script_pub_key{CScript() << OP_TRUE};
+    const CAmount fee{10000};
+    // Let the second coinbase mature too.
+    CreateAndProcessBlock({}, script_pub_key);
+
+    std::unique_ptr<CBlockTemplate> previous;
+    {
+        LOCK2(cs_main, m_node.mempool->cs);
+        previous = BlockAssembler(chainstate, *m_node.mempool, chainparams).CreateNewBlock(script_pub_key);
+    }
+    BOOST_REQUIRE(previous);
+    BOOST_CHECK_EQUAL(previous->block.vtx.size(), 1U);
+
+    const CMutableTransaction parent{CreateValidMempoolTransaction(m_coinbase_txns[0], 0, 1, coinbaseKey, coinbase_script, m_coinbase_txns[0]->vout[0].nValue - fee)};
+    const CMutableTransaction child{CreateValidMempoolTransaction(MakeTransactionRef(parent), 0, 102, coinbaseKey, coinbase_script, parent.vout[0].nValue - fee)};
+    const CMutableTransaction other{CreateValidMempoolTransaction(m_coinbase_txns[1], 0, 2, coinbaseKey, coinbase_script, m_coinbase_txns[1]->vout[0].nValue - fee)};
+
+    LOCK2(cs_main, m_node.mempool->cs);
+    BlockAssembler assembler{chainstate, *m_node.mempool, chainparams};
+
+    // A candidate is appended along with its ancestors that are not in the template yet.
+    bool selection_stale{false};
+    const std::unique_ptr<CBlockTemplate> updated{assembler.UpdateBlock(*previous, {child.GetHash()}, script_pub_key, selection_stale)};
+    BOOST_REQUIRE(updated);
+    BOOST_CHECK(!selection_stale);
+    BOOST_REQUIRE_EQUAL(updated->block.vtx.size(), 3U);
+    BOOST_CHECK(updated->block.vtx[1]->GetHash() == parent.GetHash());
+    BOOST_CHECK(updated->block.vtx[2]->GetHash() == child.GetHash());
+    BOOST_CHECK_EQUAL(updated->vTxFees[0], -2 * fee);
+
+    // Transactions already in the template are kept, and the result matches a full rebuild.
+    const std::unique_ptr<CBlockTemplate> updated_again{assembler.UpdateBlock(*updated, {other.GetHash()}, script_pub_key, selection_stale)};
+    BOOST_REQUIRE(updated_again);
+    const std::unique_ptr<CBlockTemplate> full{assembler.CreateNewBlock(script_pub_key)};
+    BOOST_REQUIRE(full);
+    BOOST_REQUIRE_EQUAL(updated_again->block.vtx.size(), 4U);
+    BOOST_CHECK_EQUAL(full->block.vtx.size(), updated_again->block.vtx.size());
+    BOOST_CHECK_EQUAL(full->vTxFees[0], updated_again->vTxFees[0]);
+    BOOST_CHECK(updated_again->block.vtx[3]->GetHash() == other.GetHash());
+    for (size_t i = 1; i < updated->block.vtx.size(); ++i) {
+        BOOST_CHECK(updated_again->block.vtx[i]->GetHash() == updated->block.vtx[i]->GetHash());
+    }
+
+    // Once the tip has moved, the template cannot be updated any more.
+    CreateAndProcessBlock({}, script_pub_key);
+    BOOST_CHECK(!assembler.UpdateBlock(*updated_again, {}, script_pub_key, selection_stale));
+}
+
+BOOST_FIXTURE_TEST_CASE(BlockTemplateBuilder_refresh, TestChain100Setup)
+{
+    const CScript coinbase_script{m_coinbase_txns[0]->vout[0].scriptPubKey};
+    const CScript script_pub_key{CScript() << OP_TRUE};
+    BlockTemplateBuilder builder{*m_node.chainman, *m_node.mempool, Params(), /* fee_delta */ 0};
+    RegisterValidationInterface(&builder);
+
+    uint64_t sequence{0};
+    std::unique_ptr<CBlockTemplate> block_template{builder.GetTemplate(script_pub_key, &sequence)};
+    BOOST_REQUIRE(block_template);
+    BOOST_CHECK_EQUAL(block_template->block.vtx.size(), 1U);
+
+    // Nothing changed, so the template and its sequence stay the same.
+    uint64_t unchanged_sequence{0};
+    BOOST_REQUIRE(builder.GetTemplate(script_pub_key, &unchanged_sequence));
+    BOOST_CHECK_EQUAL(unchanged_sequence, sequence);
+
+    // A new mempool transaction is added to the template, and its fees bump the sequence.
+    const CMutableTransaction tx{CreateValidMempoolTransaction(m_coinbase_txns[0], 0, 1, coinbaseKey, coinbase_script, m_coinbase_txns[0]->vout[0].nValue - 10000)};
+    SyncWithValidationInterfaceQueue();
+    uint64_t added_sequence{0};
+    block_template = builder.GetTemplate(script_pub_key, &added_sequence);
+    BOOST_REQUIRE(block_template);
+    BOOST_REQUIRE_EQUAL(block_template->block.vtx.size(), 2U);
+    BOOST_CHECK(block_template->block.vtx[1]->GetHash() == tx.GetHash());
+    BOOST_CHECK_GT(added_sequence, sequence);
+
+    // A new tip rebuilds the template from scratch.
+    const CBlock block{CreateAndProcessBlock({tx}, script_pub_key)};
+    SyncWithValidationInterfaceQueue();
+    uint64_t tip_sequence{0};
+    block_template = builder.GetTemplate(script_pub_key, &tip_sequence);
+    BOOST_REQUIRE(block_template);
+    BOOST_CHECK(block_template->block.hashPrevBlock == block.GetHash());
+    BOOST_CHECK_EQUAL(block_template->block.vtx.size(), 1U);
+    BOOST_CHECK_GT(tip_sequence, added_sequence);
+
+    UnregisterValidationInterface(&builder);
+}
+
+BOOST_FIXTURE_TEST_CASE(BlockTemplateBuilder_pending_overflow, TestChain100Setup)
+{
+    const CScript coinbase_script{m_coinbase_txns[0]->vout[0].scriptPubKey};
+    const CScript script_pub_key{CScript() << OP_TRUE};
+    BlockTemplateBuilder builder{*m_node.chainman, *m_node.mempool, Params(), /* fee_delta */ 0};
+    RegisterValidationInterface(&builder);
+    BOOST_REQUIRE(builder.GetTemplate(script_pub_key));
+
+    // Nobody asks for a template while the mempool keeps changing: the pending transactions are
+    // dropped once there are too many, including the one that is really in the mempool...
+    const CMutableTransaction tx{CreateValidMempoolTransaction(m_coinbase_txns[0], 0, 1, coinbaseKey, coinbase_script, m_coinbase_txns[0]->vout[0].nValue - 10000)};
+    CMutableTransaction unrelated;
+    unrelated.vin.resize(1);
+    unrelated.vout.resize(1);
+    for (size_t i = 0; i < MAX_TEMPLATE_PENDING_TXIDS; ++i) {
+        unrelated.vin[0].prevout.n = i;
+        GetMainSignals().TransactionAddedToMempool(MakeTransactionRef(unrelated), /* mempool_sequence */ 0);
+    }
+    SyncWithValidationInterfaceQueue();
+
+    // ...and the next template is built from scratch, so it still includes it.
+    const std::unique_ptr<CBlockTemplate> block_template{builder.GetTemplate(script_pub_key)};
+    BOOST_REQUIRE(block_template);
+    BOOST_REQUIRE_EQUAL(block_template->block.vtx.size(), 2U);
+    BOOST_CHECK(block_template->block.vtx[1]->GetHash() == tx.GetHash());
+
+    UnregisterValidationInterface(&builder);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
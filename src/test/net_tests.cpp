@@ -6,14 +6,18 @@
 #include <addrman.h>
 #include <chainparams.h>
 #include <clientversion.h>
+#include <fs.h>
 #include <cstdint>
 #include <net.h>
 #include <netaddress.h>
 #include <netbase.h>
+#include <netmessagemaker.h>
 #include <serialize.h>
 #include <span.h>
 #include <streams.h>
+#include <test/util/net.h>
 #include <test/util/setup_common.h>
+#include <timedata.h>
 #include <util/strencodings.h>
 #include <util/string.h>
 #include <util/system.h>
@@ -26,6 +30,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <variant>
 
 using namespace std::literals;
 
@@ -835,4 +840,541 @@ BOOST_AUTO_TEST_CASE(LocalAddress_BasicLifecycle)
     BOOST_CHECK_EQUAL(IsLocal(addr), false);
 }
 
+BOOST_AUTO_TEST_CASE(recv_buffer_pool)
+{
+    RecvBufferPool pool;
+    const auto& class_sizes{RecvBufferPool::CLASS_SIZES};
+
+    // New buffers have room for any message of their size class.
+    CDataStream small{pool.Acquire(100, SER_NETWORK, INIT_PROTO_VERSION)};
+    BOOST_CHECK(small.empty());
+    BOOST_CHECK_GE(small.capacity(), class_sizes[0]);
+    CDataStream medium{pool.Acquire(class_sizes[0] + 1, SER_NETWORK, INIT_PROTO_VERSION)};
+    BOOST_CHECK_GE(medium.capacity(), class_sizes[1]);
+    small.resize(100);
+    pool.Release(std::move(small));
+    RecvBufferPoolStats stats{pool.GetStats()};
+    BOOST_CHECK_EQUAL(stats.buffers, 1U);
+    BOOST_CHECK_GE(stats.bytes, class_sizes[0]);
+    BOOST_CHECK_EQUAL(stats.allocated, 2U);
+    BOOST_CHECK_EQUAL(stats.reused, 0U);
+
+    // A pooled buffer is handed out again, empty, for a message of its class only.
+    CDataStream reused{pool.Acquire(1, SER_DISK, PROTOCOL_VERSION)};
+    BOOST_CHECK(reused.empty());
+    BOOST_CHECK_EQUAL(reused.GetType(), SER_DISK);
+    BOOST_CHECK_EQUAL(reused.GetVersion(), PROTOCOL_VERSION);
+    stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.buffers, 0U);
+    BOOST_CHECK_EQUAL(stats.bytes, 0U);
+    BOOST_CHECK_EQUAL(stats.reused, 1U);
+
+    // A buffer that grew up to the size of a larger class is pooled in that class.
+    reused.reserve(class_sizes[2]);
+    pool.Release(std::move(reused));
+    pool.Release(std::move(medium));
+    BOOST_CHECK_GE(pool.Acquire(class_sizes[1] + 1, SER_NETWORK, INIT_PROTO_VERSION).capacity(), class_sizes[2]);
+    BOOST_CHECK_GE(pool.Acquire(class_sizes[0] + 1, SER_NETWORK, INIT_PROTO_VERSION).capacity(), class_sizes[1]);
+    stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.buffers, 0U);
+    BOOST_CHECK_EQUAL(stats.reused, 3U);
+
+    // Receiving grows a buffer geometrically, up to the size class of the payload.
+    const size_t payload_size{class_sizes[2] + 1};
+    CDataStream large{pool.Acquire(payload_size, SER_NETWORK, INIT_PROTO_VERSION)};
+    const size_t initial_capacity{large.capacity()};
+    RecvBufferPool::Reserve(large, initial_capacity + 1, payload_size);
+    BOOST_CHECK_EQUAL(large.capacity(), 2 * initial_capacity);
+    RecvBufferPool::Reserve(large, class_sizes[3] - 1, payload_size);
+    BOOST_CHECK_EQUAL(large.capacity(), class_sizes[3] - 1);
+    RecvBufferPool::Reserve(large, class_sizes[3], payload_size);
+    BOOST_CHECK_EQUAL(large.capacity(), class_sizes[3]);
+
+    // Buffers larger than their class size are freed.
+    CDataStream oversized{SER_NETWORK, INIT_PROTO_VERSION};
+    oversized.reserve(class_sizes[1] + 1);
+    pool.Release(std::move(oversized));
+    BOOST_CHECK_EQUAL(pool.GetStats().buffers, 0U);
+
+    // The pool holds at most MAX_BYTES.
+    for (size_t i = 0; i < RecvBufferPool::CLASS_MAX_BUFFERS[3]; ++i) {
+        CDataStream stream{SER_NETWORK, INIT_PROTO_VERSION};
+        stream.reserve(class_sizes[3]);
+        pool.Release(std::move(stream));
+    }
+    stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.buffers, RecvBufferPool::MAX_BYTES / class_sizes[3]);
+    BOOST_CHECK_LE(stats.bytes, RecvBufferPool::MAX_BYTES);
+    while (pool.GetStats().buffers > 0) pool.Acquire(class_sizes[3], SER_NETWORK, INIT_PROTO_VERSION);
+
+    // Buffers too small for any class, or beyond the limit of their class, are freed.
+    pool.Release(CDataStream{SER_NETWORK, INIT_PROTO_VERSION});
+    for (size_t i = 0; i <= RecvBufferPool::CLASS_MAX_BUFFERS[0]; ++i) {
+        CDataStream stream{SER_NETWORK, INIT_PROTO_VERSION};
+        stream.reserve(class_sizes[0]);
+        pool.Release(std::move(stream));
+    }
+    BOOST_CHECK_EQUAL(pool.GetStats().buffers, RecvBufferPool::CLASS_MAX_BUFFERS[0]);
+}
+
+BOOST_AUTO_TEST_CASE(send_priority)
+{
+    CAddrMan addrman;
+    ConnmanTestMsg connman{0x1337, 0x1337, addrman};
+    CNode* sender = new CNode(0, NODE_NETWORK, INVALID_SOCKET, CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::INBOUND, /* inbound_onion */ false);
+    CNode* receiver = new CNode(1, NODE_NETWORK, INVALID_SOCKET, CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::OUTBOUND_FULL_RELAY, /* inbound_onion */ false);
+    connman.AddTestNode(*sender);
+    connman.AddTestNode(*receiver);
+    const CNetMsgMaker msg_maker{INIT_PROTO_VERSION};
+    const std::vector<unsigned char> block(1000);
+    std::array<uint64_t, NUM_SEND_CLASSES> bytes_per_class{};
+    const auto push = [&](CSerializedNetMsg&& msg, SendClass send_class) {
+        bytes_per_class[static_cast<size_t>(send_class)] += CMessageHeader::HEADER_SIZE + msg.data.size();
+        connman.PushMessage(sender, std::move(msg));
+    };
+
+    // The socket is invalid, so nothing is sent: the first message stays the one being sent,
+    // and those pushed after it are queued by class.
+    push(msg_maker.Make(NetMsgType::BLOCK, block), SendClass::BLOCK_SERVING);
+    push(msg_maker.Make(NetMsgType::BLOCK, block), SendClass::BLOCK_SERVING);
+    push(msg_maker.Make(NetMsgType::TX, block), SendClass::TX_RELAY);
+    push(msg_maker.Make(NetMsgType::INV, std::vector<CInv>{CInv{MSG_WTX, uint256::ONE}}), SendClass::TX_RELAY);
+    push(msg_maker.Make(NetMsgType::HEADERS, std::vector<CBlock>{}), SendClass::TIP);
+    CSerializedNetMsg tip_block{msg_maker.Make(NetMsgType::BLOCK, block)};
+    tip_block.m_send_class = SendClass::TIP;
+    push(std::move(tip_block), SendClass::TIP);
+    push(msg_maker.Make(NetMsgType::PING, uint64_t{42}), SendClass::TIP);
+
+    bool complete;
+    connman.NodeReceiveMsgBytes(*receiver, TakeSendQueue(*sender), complete);
+    BOOST_CHECK(complete);
+    CNodeStats stats;
+    sender->copyStats(stats, /* m_asmap */ {});
+    BOOST_CHECK(stats.m_send_bytes_per_class == bytes_per_class);
+    std::vector<std::string> commands;
+    {
+        LOCK(receiver->cs_vProcessMsg);
+        for (const CNetMessage& msg : receiver->vProcessMsg) commands.push_back(msg.m_command);
+    }
+    const std::vector<std::string> expected{NetMsgType::BLOCK, NetMsgType::HEADERS, NetMsgType::BLOCK, NetMsgType::PING, NetMsgType::TX, NetMsgType::INV, NetMsgType::BLOCK};
+    BOOST_CHECK_EQUAL_COLLECTIONS(commands.begin(), commands.end(), expected.begin(), expected.end());
+
+    connman.ClearTestNodes();
+}
+
+BOOST_AUTO_TEST_CASE(send_shared_payload)
+{
+    CAddrMan addrman;
+    ConnmanTestMsg connman{0x1337, 0x1337, addrman};
+    CNode* sender = new CNode(0, NODE_NETWORK, INVALID_SOCKET, CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::INBOUND, /* inbound_onion */ false);
+    CNode* receiver = new CNode(1, NODE_NETWORK, INVALID_SOCKET, CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::OUTBOUND_FULL_RELAY, /* inbound_onion */ false);
+    connman.AddTestNode(*sender);
+    connman.AddTestNode(*receiver);
+    const auto payload{std::make_shared<const std::vector<unsigned char>>(g_insecure_rand_ctx.randbytes(1000))};
+
+    // The payload is queued without being copied, however many messages it is sent in.
+    for (int i = 0; i < 2; ++i) {
+        CSerializedNetMsg msg;
+        msg.m_type = NetMsgType::BLOCK;
+        msg.m_shared_payload = payload;
+        BOOST_CHECK_EQUAL(msg.PayloadSize(), payload->size());
+        connman.PushMessage(sender, std::move(msg));
+    }
+    BOOST_CHECK_EQUAL(payload.use_count(), 3);
+
+    bool complete;
+    connman.NodeReceiveMsgBytes(*receiver, TakeSendQueue(*sender), complete);
+    BOOST_CHECK(complete);
+    BOOST_CHECK_EQUAL(payload.use_count(), 1);
+    {
+        LOCK(receiver->cs_vProcessMsg);
+        BOOST_CHECK_EQUAL(receiver->vProcessMsg.size(), 2U);
+        for (const CNetMessage& msg : receiver->vProcessMsg) {
+            BOOST_CHECK_EQUAL(msg.m_command, NetMsgType::BLOCK);
+            BOOST_CHECK(std::equal(msg.m_recv.begin(), msg.m_recv.end(), payload->begin(), payload->end()));
+        }
+    }
+
+    connman.ClearTestNodes();
+}
+
+BOOST_AUTO_TEST_CASE(v2_transport)
+{
+    V2Handshake initiator{/* initiator */ true, Params()};
+    V2Handshake responder{/* initiator */ false, Params()};
+    const Span<const uint8_t> initiator_pubkey{initiator.GetOurPubKey()};
+    const Span<const uint8_t> responder_pubkey{responder.GetOurPubKey()};
+    BOOST_REQUIRE_EQUAL(initiator_pubkey.size(), V2_PUBKEY_SIZE);
+
+    // Public keys may arrive in pieces.
+    BOOST_CHECK_EQUAL(responder.Read(initiator_pubkey.first(1)), 1);
+    BOOST_CHECK(!responder.Complete() && !responder.IsV1());
+    BOOST_CHECK_EQUAL(responder.Read(initiator_pubkey.subspan(1)), (int)V2_PUBKEY_SIZE - 1);
+    BOOST_CHECK_EQUAL(initiator.Read(responder_pubkey), (int)V2_PUBKEY_SIZE);
+    BOOST_REQUIRE(initiator.Complete() && responder.Complete());
+    BOOST_CHECK(initiator.GetSendKeys().k1 == responder.GetRecvKeys().k1);
+    BOOST_CHECK(initiator.GetSendKeys().k2 == responder.GetRecvKeys().k2);
+    BOOST_CHECK(initiator.GetRecvKeys().k1 == responder.GetSendKeys().k1);
+    BOOST_CHECK(initiator.GetSendKeys().k1 != initiator.GetRecvKeys().k1);
+
+    // Messages of all sizes go through, whatever the chunks they are received in.
+    V2TransportSerializer serializer{initiator.GetSendKeys()};
+    V2TransportDeserializer deserializer{responder.GetRecvKeys(), /* node_id */ 0, SER_NETWORK, INIT_PROTO_VERSION};
+    for (const size_t size : {0, 1, 63, 64, 511, 512, 1000, 100000}) {
+        CSerializedNetMsg msg;
+        msg.m_type = NetMsgType::BLOCK;
+        msg.data = g_insecure_rand_ctx.randbytes(size);
+        const std::vector<unsigned char> data{msg.data};
+        std::vector<unsigned char> header;
+        serializer.prepareForTransport(msg, header);
+        BOOST_CHECK(header.empty());
+        BOOST_CHECK_EQUAL(msg.data.size(), CHACHA20_POLY1305_AEAD_AAD_LEN + 1 + msg.m_type.size() + size + POLY1305_TAGLEN);
+
+        Span<const uint8_t> frame{msg.data};
+        while (!frame.empty()) {
+            BOOST_REQUIRE(!deserializer.Complete());
+            Span<const uint8_t> chunk{frame.first(std::min<size_t>(frame.size(), 1 + InsecureRandRange(1000)))};
+            frame = frame.subspan(chunk.size());
+            while (!chunk.empty()) BOOST_REQUIRE_GT(deserializer.Read(chunk), 0);
+        }
+        BOOST_REQUIRE(deserializer.Complete());
+        uint32_t out_err_raw_size{0};
+        std::optional<CNetMessage> received{deserializer.GetMessage(std::chrono::microseconds{0}, out_err_raw_size)};
+        BOOST_REQUIRE(received);
+        BOOST_CHECK_EQUAL(received->m_command, NetMsgType::BLOCK);
+        BOOST_CHECK_EQUAL(received->m_message_size, size);
+        BOOST_CHECK(std::equal(received->m_recv.begin(), received->m_recv.end(), data.begin(), data.end()));
+    }
+
+    // Shared payloads are encrypted like the others.
+    {
+        CSerializedNetMsg msg;
+        msg.m_type = NetMsgType::BLOCK;
+        msg.m_shared_payload = std::make_shared<const std::vector<unsigned char>>(g_insecure_rand_ctx.randbytes(100));
+        const auto payload{msg.m_shared_payload};
+        std::vector<unsigned char> header;
+        serializer.prepareForTransport(msg, header);
+        BOOST_CHECK(!msg.m_shared_payload);
+        Span<const uint8_t> frame{msg.data};
+        while (!frame.empty()) BOOST_REQUIRE_GT(deserializer.Read(frame), 0);
+        BOOST_REQUIRE(deserializer.Complete());
+        uint32_t out_err_raw_size{0};
+        std::optional<CNetMessage> received{deserializer.GetMessage(std::chrono::microseconds{0}, out_err_raw_size)};
+        BOOST_REQUIRE(received);
+        BOOST_CHECK(std::equal(received->m_recv.begin(), received->m_recv.end(), payload->begin(), payload->end()));
+    }
+
+    // A frame which was tampered with is rejected.
+    CSerializedNetMsg msg;
+    msg.m_type = NetMsgType::PING;
+    msg.data.resize(8);
+    std::vector<unsigned char> header;
+    serializer.prepareForTransport(msg, header);
+    msg.data.back() ^= 1;
+    Span<const uint8_t> frame{msg.data};
+    BOOST_CHECK_EQUAL(deserializer.Read(frame), CHACHA20_POLY1305_AEAD_AAD_LEN);
+    BOOST_CHECK_EQUAL(deserializer.Read(frame), -1);
+
+    // A responder receiving a v1 message header falls back to v1 once it has read the network magic,
+    // whatever the chunks it arrives in, and reads nothing beyond it.
+    const Span<const uint8_t> magic{MakeUCharSpan(Params().MessageStart())};
+    std::vector<uint8_t> v1_header{magic.begin(), magic.end()};
+    v1_header.resize(CMessageHeader::HEADER_SIZE);
+    V2Handshake v1_responder{/* initiator */ false, Params()};
+    BOOST_CHECK_EQUAL(v1_responder.Read(Span<const uint8_t>{v1_header}.first(1)), 1);
+    BOOST_CHECK(!v1_responder.IsV1() && !v1_responder.Complete());
+    BOOST_CHECK_EQUAL(v1_responder.Read(Span<const uint8_t>{v1_header}.subspan(1)), (int)CMessageHeader::MESSAGE_START_SIZE - 1);
+    BOOST_CHECK(v1_responder.IsV1() && !v1_responder.Complete());
+    BOOST_CHECK(v1_responder.GetReceived() == magic);
+
+    // Bytes which only share their start with the network magic are read as a public key.
+    V2Handshake v2_responder{/* initiator */ false, Params()};
+    std::vector<uint8_t> pubkey{magic.begin(), magic.end()};
+    pubkey.back() ^= 1;
+    BOOST_CHECK_EQUAL(v2_responder.Read(Span<const uint8_t>{pubkey}.first(2)), 2);
+    BOOST_CHECK_EQUAL(v2_responder.Read(Span<const uint8_t>{pubkey}.subspan(2)), 2);
+    BOOST_CHECK(!v2_responder.IsV1());
+    BOOST_CHECK_EQUAL(v2_responder.GetReceived().size(), CMessageHeader::MESSAGE_START_SIZE);
+
+    // Our own public keys never start with the network magic.
+    for (int i = 0; i < 10; ++i) {
+        const V2Handshake handshake{/* initiator */ true, Params()};
+        BOOST_CHECK(handshake.GetOurPubKey().first(CMessageHeader::MESSAGE_START_SIZE) != magic);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(v2_transport_connection)
+{
+    CAddrMan addrman;
+    ConnmanTestMsg connman{0x1337, 0x1337, addrman};
+    CNode* initiator = new CNode(0, NODE_NETWORK, INVALID_SOCKET, CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::OUTBOUND_FULL_RELAY, /* inbound_onion */ false, /* use_v2_transport */ true);
+    CNode* responder = new CNode(1, NODE_NETWORK, INVALID_SOCKET, CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::INBOUND, /* inbound_onion */ false, /* use_v2_transport */ true);
+    CNode* v1_responder = new CNode(2, NODE_NETWORK, INVALID_SOCKET, CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::INBOUND, /* inbound_onion */ false, /* use_v2_transport */ true);
+    connman.AddTestNode(*initiator);
+    connman.AddTestNode(*responder);
+    connman.AddTestNode(*v1_responder);
+    const CNetMsgMaker msg_maker{INIT_PROTO_VERSION};
+    const auto received_command = [](CNode& node) {
+        LOCK(node.cs_vProcessMsg);
+        BOOST_REQUIRE_EQUAL(node.vProcessMsg.size(), 1U);
+        const std::string command{node.vProcessMsg.front().m_command};
+        node.vProcessMsg.clear();
+        return command;
+    };
+
+    // The initiator sends its key first. What is pushed meanwhile waits for the key exchange.
+    connman.PushMessage(initiator, msg_maker.Make(NetMsgType::PING, uint64_t{42}));
+    std::vector<unsigned char> bytes{TakeSendQueue(*initiator)};
+    BOOST_CHECK_EQUAL(bytes.size(), V2_PUBKEY_SIZE);
+    bool complete;
+    connman.NodeReceiveMsgBytes(*responder, bytes, complete);
+    BOOST_CHECK(!complete);
+    bytes = TakeSendQueue(*responder);
+    BOOST_CHECK_EQUAL(bytes.size(), V2_PUBKEY_SIZE);
+    connman.NodeReceiveMsgBytes(*initiator, bytes, complete);
+    BOOST_CHECK(!complete);
+
+    bytes = TakeSendQueue(*initiator);
+    BOOST_CHECK_GT(bytes.size(), 0U);
+    connman.NodeReceiveMsgBytes(*responder, bytes, complete);
+    BOOST_CHECK(complete);
+    BOOST_CHECK_EQUAL(received_command(*responder), NetMsgType::PING);
+
+    // Both directions are encrypted from then on.
+    connman.PushMessage(responder, msg_maker.Make(NetMsgType::PONG, uint64_t{42}));
+    bytes = TakeSendQueue(*responder);
+    BOOST_CHECK(std::search(bytes.begin(), bytes.end(), NetMsgType::PONG, NetMsgType::PONG + 4) == bytes.end());
+    connman.NodeReceiveMsgBytes(*initiator, bytes, complete);
+    BOOST_CHECK(complete);
+    BOOST_CHECK_EQUAL(received_command(*initiator), NetMsgType::PONG);
+
+    // A peer using the v1 transport gets v1 messages back.
+    CSerializedNetMsg ping{msg_maker.Make(NetMsgType::PING, uint64_t{42})};
+    bytes.clear();
+    V1TransportSerializer{}.prepareForTransport(ping, bytes);
+    bytes.insert(bytes.end(), ping.data.begin(), ping.data.end());
+    connman.NodeReceiveMsgBytes(*v1_responder, bytes, complete);
+    BOOST_CHECK(complete);
+    BOOST_CHECK_EQUAL(received_command(*v1_responder), NetMsgType::PING);
+    BOOST_CHECK(TakeSendQueue(*v1_responder).empty());
+    connman.PushMessage(v1_responder, msg_maker.Make(NetMsgType::PONG, uint64_t{42}));
+    bytes = TakeSendQueue(*v1_responder);
+    BOOST_REQUIRE_GE(bytes.size(), CMessageHeader::HEADER_SIZE);
+    BOOST_CHECK(std::equal(bytes.begin(), bytes.begin() + CMessageHeader::MESSAGE_START_SIZE, Params().MessageStart()));
+
+    connman.ClearTestNodes();
+}
+
+BOOST_AUTO_TEST_CASE(v2_transport_send_priority)
+{
+    CAddrMan addrman;
+    ConnmanTestMsg connman{0x1337, 0x1337, addrman};
+    CNode* sender = new CNode(0, NODE_NETWORK, INVALID_SOCKET, CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::OUTBOUND_FULL_RELAY, /* inbound_onion */ false, /* use_v2_transport */ true);
+    CNode* receiver = new CNode(1, NODE_NETWORK, INVALID_SOCKET, CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::INBOUND, /* inbound_onion */ false, /* use_v2_transport */ true);
+    connman.AddTestNode(*sender);
+    connman.AddTestNode(*receiver);
+    bool complete;
+    connman.NodeReceiveMsgBytes(*receiver, TakeSendQueue(*sender), complete);
+    connman.NodeReceiveMsgBytes(*sender, TakeSendQueue(*receiver), complete);
+
+    // Messages sent in another order than they were pushed in are encrypted in the order they are
+    // sent, which the receiver decrypts them in.
+    const CNetMsgMaker msg_maker{INIT_PROTO_VERSION};
+    const std::vector<unsigned char> block(1000);
+    const auto push = [&](CSerializedNetMsg&& msg, SendClass send_class) {
+        msg.m_send_class = send_class;
+        connman.PushMessage(sender, std::move(msg));
+    };
+    push(msg_maker.Make(NetMsgType::BLOCK, block), SendClass::BLOCK_SERVING);
+    push(msg_maker.Make(NetMsgType::BLOCK, block), SendClass::BLOCK_SERVING);
+    push(msg_maker.Make(NetMsgType::TX, block), SendClass::TX_RELAY);
+    push(msg_maker.Make(NetMsgType::HEADERS, std::vector<CBlock>{}), SendClass::TIP);
+    push(msg_maker.Make(NetMsgType::PING, uint64_t{42}), SendClass::TIP);
+    connman.NodeReceiveMsgBytes(*receiver, TakeSendQueue(*sender), complete);
+    BOOST_CHECK(complete);
+    std::vector<std::string> commands;
+    {
+        LOCK(receiver->cs_vProcessMsg);
+        for (const CNetMessage& msg : receiver->vProcessMsg) commands.push_back(msg.m_command);
+    }
+    const std::vector<std::string> expected{NetMsgType::BLOCK, NetMsgType::HEADERS, NetMsgType::PING, NetMsgType::TX, NetMsgType::BLOCK};
+    BOOST_CHECK_EQUAL_COLLECTIONS(commands.begin(), commands.end(), expected.begin(), expected.end());
+
+    connman.ClearTestNodes();
+}
+
+BOOST_AUTO_TEST_CASE(v2_transport_v1_reconnection)
+{
+    CAddrMan addrman;
+    ConnmanTestMsg connman{0x1337, 0x1337, addrman};
+    CService service;
+    BOOST_REQUIRE(Lookup("250.1.1.1", service, 8333, false));
+    CAddress addr{service, ServiceFlags(NODE_NETWORK | NODE_P2P_V2)};
+    addr.nTime = GetAdjustedTime();
+    BOOST_REQUIRE(addrman.Add(addr, CNetAddr{}));
+    const auto addrman_services = [&] {
+        const std::vector<CAddress> addrs{addrman.GetAddr(/* max_addresses */ 0, /* max_pct */ 0, /* network */ std::nullopt)};
+        BOOST_REQUIRE_EQUAL(addrs.size(), 1U);
+        return addrs[0].nServices;
+    };
+    CNode* initiator = new CNode(0, NODE_NETWORK, INVALID_SOCKET, addr, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::OUTBOUND_FULL_RELAY, /* inbound_onion */ false, /* use_v2_transport */ true);
+    CNode* responder = new CNode(1, NODE_NETWORK, INVALID_SOCKET, CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::INBOUND, /* inbound_onion */ false, /* use_v2_transport */ true);
+    CNode* v1_initiator = new CNode(2, NODE_NETWORK, INVALID_SOCKET, addr, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::OUTBOUND_FULL_RELAY, /* inbound_onion */ false);
+    CNode* failed_initiator = new CNode(3, NODE_NETWORK, INVALID_SOCKET, addr, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::OUTBOUND_FULL_RELAY, /* inbound_onion */ false, /* use_v2_transport */ true);
+    for (CNode* node : {initiator, responder, v1_initiator, failed_initiator}) connman.AddTestNode(*node);
+
+    // Connections without a key exchange of ours going on are not opened again.
+    bool complete;
+    connman.NodeReceiveMsgBytes(*responder, TakeSendQueue(*initiator), complete);
+    connman.NodeReceiveMsgBytes(*initiator, TakeSendQueue(*responder), complete);
+    for (CNode* node : {initiator, responder, v1_initiator}) connman.MaybeQueueV1ReconnectionOnce(*node);
+    BOOST_CHECK_EQUAL(connman.NumReconnections(), 0U);
+    BOOST_CHECK(addrman_services() == addr.nServices);
+
+    // One closed before its key exchange completed is opened again over v1, and the address
+    // of the peer is no longer taken to support v2.
+    connman.MaybeQueueV1ReconnectionOnce(*failed_initiator);
+    BOOST_CHECK_EQUAL(connman.NumReconnections(), 1U);
+    BOOST_CHECK(addrman_services() == NODE_NETWORK);
+
+    connman.ClearTestNodes();
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(socket_events)
+{
+    std::vector<SocketEventsMode> modes;
+    for (const std::string name : {"select", "poll", "epoll"}) {
+        if (const auto mode = SocketEventsModeFromString(name)) modes.push_back(*mode);
+    }
+    BOOST_REQUIRE(!modes.empty());
+    BOOST_CHECK(SocketEventsModeFromString("kqueue") == std::nullopt);
+
+    for (const SocketEventsMode mode : modes) {
+        BOOST_TEST_MESSAGE("socket events mode " << SocketEventsModeToString(mode));
+        CAddrMan addrman;
+        ConnmanTestMsg connman{0x1337, 0x1337, addrman};
+        BOOST_REQUIRE(connman.SetSocketEventsMode(mode));
+
+        int fds[2];
+        BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        CNode* node = new CNode(0, NODE_NETWORK, fds[0], CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::OUTBOUND_FULL_RELAY, /* inbound_onion */ false);
+        connman.AddTestNode(*node);
+        const SOCKET socket_id = fds[0];
+
+        // Nothing to receive, nothing to send.
+        std::set<SOCKET> recv_set, send_set, error_set;
+        connman.SocketEventsOnce(recv_set, send_set, error_set);
+        BOOST_CHECK(recv_set.empty() && send_set.empty() && error_set.empty());
+
+        // Incoming data is reported, and keeps being reported until it is read.
+        BOOST_REQUIRE_EQUAL(send(fds[1], "x", 1, 0), 1);
+        for (int i = 0; i < 2; ++i) {
+            recv_set.clear();
+            connman.SocketEventsOnce(recv_set, send_set, error_set);
+            BOOST_CHECK(recv_set.count(socket_id));
+            BOOST_CHECK(send_set.empty());
+        }
+
+        // With data queued, only writability is waited for.
+        WITH_LOCK(node->cs_vSend, node->vSendMsg.emplace_back(std::vector<unsigned char>(1, 0)));
+        recv_set.clear();
+        connman.SocketEventsOnce(recv_set, send_set, error_set);
+        BOOST_CHECK(recv_set.empty());
+        BOOST_CHECK(send_set.count(socket_id));
+
+        connman.ClearTestNodes();
+        close(fds[1]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(send_file_payload)
+{
+    // Larger than the socket buffers, so that it takes several sends.
+    std::vector<unsigned char> payload(1000000);
+    for (size_t i = 0; i < payload.size(); ++i) payload[i] = i % 251;
+    const std::string prefix{"prefix"};
+    FILE* file = fsbridge::fopen(m_path_root / "payload.dat", "wb+");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(prefix.data(), 1, prefix.size(), file), prefix.size());
+    BOOST_REQUIRE_EQUAL(fwrite(payload.data(), 1, payload.size(), file), payload.size());
+    BOOST_REQUIRE_EQUAL(fflush(file), 0);
+
+    // What is sent for the same message held in memory.
+    std::vector<unsigned char> expected;
+    {
+        CSerializedNetMsg msg;
+        msg.m_type = NetMsgType::BLOCK;
+        msg.data = payload;
+        V1TransportSerializer{}.prepareForTransport(msg, expected);
+        expected.insert(expected.end(), payload.begin(), payload.end());
+    }
+
+    CAddrMan addrman;
+    ConnmanTestMsg connman{0x1337, 0x1337, addrman};
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    BOOST_REQUIRE(SetSocketNonBlocking(fds[0], true));
+    CNode* node = new CNode(0, NODE_NETWORK, fds[0], CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::INBOUND, /* inbound_onion */ false);
+    connman.AddTestNode(*node);
+
+    CSerializedNetMsg msg;
+    msg.m_type = NetMsgType::BLOCK;
+    msg.m_file_payload = FileRange{std::shared_ptr<FILE>{file, fclose}, prefix.size(), payload.size()};
+    const uint256 hash{Hash(payload)};
+    msg.m_checksum.emplace();
+    std::copy(hash.begin(), hash.begin() + CMessageHeader::CHECKSUM_SIZE, msg.m_checksum->begin());
+    connman.PushMessage(node, std::move(msg));
+    BOOST_CHECK(WITH_LOCK(node->cs_vSend, return !node->vSendMsg.empty()));
+
+    std::vector<unsigned char> received;
+    for (int i = 0; i < 10000 && received.size() < expected.size(); ++i) {
+        connman.SocketSendDataOnce(*node);
+        unsigned char buf[65536];
+        const ssize_t n = recv(fds[1], buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0) received.insert(received.end(), buf, buf + n);
+    }
+    BOOST_CHECK(received == expected);
+    BOOST_CHECK(WITH_LOCK(node->cs_vSend, return node->vSendMsg.empty() && node->nSendSize == 0));
+
+    connman.ClearTestNodes();
+    close(fds[1]);
+}
+
+BOOST_AUTO_TEST_CASE(send_file_payload_truncated)
+{
+    const std::vector<unsigned char> payload(1000, 0x42);
+    FILE* file = fsbridge::fopen(m_path_root / "truncated.dat", "wb+");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(payload.data(), 1, payload.size(), file), payload.size());
+    BOOST_REQUIRE_EQUAL(fflush(file), 0);
+
+    CAddrMan addrman;
+    ConnmanTestMsg connman{0x1337, 0x1337, addrman};
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    BOOST_REQUIRE(SetSocketNonBlocking(fds[0], true));
+    CNode* node = new CNode(0, NODE_NETWORK, fds[0], CAddress{}, /* nKeyedNetGroupIn */ 0, /* nLocalHostNonceIn */ 0, CAddress{}, /* pszDest */ std::string{}, ConnectionType::INBOUND, /* inbound_onion */ false);
+    connman.AddTestNode(*node);
+
+    // The range runs past the end of the file, as if the block file had been truncated.
+    CSerializedNetMsg msg;
+    msg.m_type = NetMsgType::BLOCK;
+    msg.m_file_payload = FileRange{std::shared_ptr<FILE>{file, fclose}, 0, 2 * payload.size()};
+    msg.m_checksum.emplace();
+    connman.PushMessage(node, std::move(msg));
+
+    for (int i = 0; i < 100 && !node->fDisconnect; ++i) {
+        connman.SocketSendDataOnce(*node);
+        unsigned char buf[65536];
+        while (recv(fds[1], buf, sizeof(buf), MSG_DONTWAIT) > 0) {}
+    }
+    // Instead of stalling the send queue forever, the peer is disconnected.
+    BOOST_CHECK(node->fDisconnect);
+
+    connman.ClearTestNodes();
+    close(fds[1]);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
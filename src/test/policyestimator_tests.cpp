@@ -180,4 +180,68 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(SmartFeeCacheFollowsBlocks)
+{
+    // Both estimators see the same transactions and blocks, but only the first one is asked for
+    // estimates along the way, so that its answers come from the cache.
+    CBlockPolicyEstimator queried_est;
+    CBlockPolicyEstimator fresh_est;
+    CTxMemPool queried_pool(&queried_est);
+    CTxMemPool fresh_pool(&fresh_est);
+    LOCK(cs_main);
+    LOCK2(queried_pool.cs, fresh_pool.cs);
+    TestMemPoolEntryHelper entry;
+    const int targets[] = {2, 6, 12};
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(128, 'X');
+    tx.vout.resize(1);
+    const CAmount low_fee{2000};
+    const CAmount high_fee{20000};
+
+    unsigned int blocknum{0};
+    // Each block, add transactions paying each of the fees, and confirm those paying confirmed_fee.
+    const auto mine_blocks = [&](int num_blocks, const std::vector<CAmount>& fees, CAmount confirmed_fee) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, queried_pool.cs, fresh_pool.cs) {
+        for (int b = 0; b < num_blocks; ++b) {
+            std::vector<CTransactionRef> block;
+            for (size_t j = 0; j < fees.size(); ++j) {
+                for (int k = 0; k < 4; ++k) {
+                    tx.vin[0].prevout.n = 10000 * blocknum + 100 * j + k;
+                    queried_pool.addUnchecked(entry.Fee(fees[j]).Time(GetTime()).Height(blocknum).FromTx(tx));
+                    fresh_pool.addUnchecked(entry.Fee(fees[j]).Time(GetTime()).Height(blocknum).FromTx(tx));
+                    if (fees[j] == confirmed_fee) block.push_back(MakeTransactionRef(tx));
+                }
+            }
+            ++blocknum;
+            queried_pool.removeForBlock(block, blocknum);
+            fresh_pool.removeForBlock(block, blocknum);
+            for (const int target : targets) {
+                queried_est.estimateSmartFee(target, nullptr, /* conservative */ false);
+                queried_est.estimateSmartFee(target, nullptr, /* conservative */ true);
+            }
+        }
+    };
+
+    mine_blocks(60, {low_fee}, low_fee);
+    const CFeeRate before{queried_est.estimateSmartFee(2, nullptr, /* conservative */ false)};
+    BOOST_CHECK(before != CFeeRate(0));
+
+    // Low fee transactions stop confirming, which raises the estimates.
+    mine_blocks(60, {low_fee, high_fee}, high_fee);
+    BOOST_CHECK(queried_est.estimateSmartFee(2, nullptr, /* conservative */ false) > before);
+
+    // The cached answers match those computed from scratch.
+    for (const int target : targets) {
+        for (const bool conservative : {false, true}) {
+            FeeCalculation queried_calc;
+            FeeCalculation fresh_calc;
+            BOOST_CHECK(queried_est.estimateSmartFee(target, &queried_calc, conservative) ==
+                        fresh_est.estimateSmartFee(target, &fresh_calc, conservative));
+            BOOST_CHECK_EQUAL(queried_calc.returnedTarget, fresh_calc.returnedTarget);
+            BOOST_CHECK(queried_calc.reason == fresh_calc.reason);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
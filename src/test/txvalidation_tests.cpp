@@ -145,4 +145,67 @@ BOOST_FIXTURE_TEST_CASE(package_tests, TestChain100Setup)
     // Check that mempool size hasn't changed.
     BOOST_CHECK_EQUAL(m_node.mempool->size(), initialPoolSize);
 }
+
+BOOST_FIXTURE_TEST_CASE(reorg_reaccepts_transactions, TestChain100Setup)
+{
+    const CScript& coinbase_script{m_coinbase_txns[0]->vout[0].scriptPubKey};
+    const CScript op_true{CScript() << OP_TRUE};
+    const CAmount fee{10000};
+    // Let two more coinbase outputs mature.
+    CreateAndProcessBlock({}, op_true);
+    CreateAndProcessBlock({}, op_true);
+
+    const CMutableTransaction parent{CreateValidMempoolTransaction(m_coinbase_txns[0], 0, 1, coinbaseKey, coinbase_script,
+                                                                   m_coinbase_txns[0]->vout[0].nValue - fee, /* submit */ false)};
+    const CMutableTransaction child{CreateValidMempoolTransaction(MakeTransactionRef(parent), 0, 103, coinbaseKey, coinbase_script,
+                                                                  parent.vout[0].nValue - fee, /* submit */ false)};
+    const CMutableTransaction other{CreateValidMempoolTransaction(m_coinbase_txns[1], 0, 2, coinbaseKey, coinbase_script,
+                                                                  m_coinbase_txns[1]->vout[0].nValue - fee, /* submit */ false)};
+    // Valid in a block, but not standard.
+    const CMutableTransaction nonstandard{CreateValidMempoolTransaction(m_coinbase_txns[2], 0, 3, coinbaseKey, CScript() << OP_1 << OP_DROP,
+                                                                        m_coinbase_txns[2]->vout[0].nValue - fee, /* submit */ false)};
+    const CBlock block{CreateAndProcessBlock({parent, child, other, nonstandard}, op_true)};
+
+    LOCK(cs_main);
+    CChainState& chainstate = m_node.chainman->ActiveChainstate();
+    BOOST_REQUIRE(chainstate.m_chain.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+
+    // Disconnecting the block re-admits its transactions as one batch, parents before children.
+    BlockValidationState state;
+    BOOST_REQUIRE(chainstate.InvalidateBlock(state, chainstate.m_chain.Tip()));
+    BOOST_CHECK(chainstate.m_chain.Tip()->GetBlockHash() == block.hashPrevBlock);
+
+    LOCK(m_node.mempool->cs);
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 3U);
+    BOOST_CHECK(m_node.mempool->exists(parent.GetHash()));
+    BOOST_CHECK(m_node.mempool->exists(other.GetHash()));
+    const auto child_it = m_node.mempool->mapTx.find(child.GetHash());
+    BOOST_REQUIRE(child_it != m_node.mempool->mapTx.end());
+    BOOST_CHECK_EQUAL(child_it->GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(child_it->GetModFeesWithAncestors(), 2 * fee);
+    // Policy still applies, so the non-standard transaction is left out.
+    BOOST_CHECK(!m_node.mempool->exists(nonstandard.GetHash()));
+}
+
+BOOST_FIXTURE_TEST_CASE(batch_uncaches_rejected_inputs, TestChain100Setup)
+{
+    // Valid in a block, but not standard.
+    const CMutableTransaction nonstandard{CreateValidMempoolTransaction(m_coinbase_txns[0], 0, 1, coinbaseKey, CScript() << OP_1 << OP_DROP,
+                                                                        m_coinbase_txns[0]->vout[0].nValue - 10000, /* submit */ false)};
+    const COutPoint prevout{m_coinbase_txns[0]->GetHash(), 0};
+
+    LOCK(cs_main);
+    CChainState& chainstate = m_node.chainman->ActiveChainstate();
+    chainstate.ForceFlushStateToDisk();
+    BOOST_REQUIRE(!chainstate.CoinsTip().HaveCoinInCache(prevout));
+
+    // Transactions from peers, such as orphans, must not leave their inputs in the coins cache
+    // when they are rejected.
+    const std::vector<MempoolAcceptResult> results{AcceptToMemoryPoolBatch(chainstate, *m_node.mempool, {MakeTransactionRef(nonstandard)})};
+    BOOST_REQUIRE_EQUAL(results.size(), 1U);
+    BOOST_CHECK(results[0].m_result_type == MempoolAcceptResult::ResultType::INVALID);
+    BOOST_CHECK(!chainstate.CoinsTip().HaveCoinInCache(prevout));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include <consensus/validation.h>
 #include <key.h>
+#include <policy/policy.h>
 #include <script/sign.h>
 #include <script/signingprovider.h>
 #include <script/standard.h>
@@ -374,4 +375,85 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(mempool_parallel_script_checks, TestChain100Setup)
+{
+    // Transactions with this many inputs have them verified on the script check threads.
+    BOOST_REQUIRE(g_parallel_script_checks);
+    const size_t num_inputs{MEMPOOL_PARALLEL_SCRIPT_CHECK_INPUTS};
+    for (size_t i = 1; i < num_inputs; ++i) {
+        CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    }
+
+    const CScript& coinbase_script{m_coinbase_txns[0]->vout[0].scriptPubKey};
+    CMutableTransaction tx;
+    CAmount input_value{0};
+    std::map<COutPoint, Coin> coins;
+    for (size_t i = 0; i < num_inputs; ++i) {
+        tx.vin.emplace_back(COutPoint{m_coinbase_txns[i]->GetHash(), 0});
+        input_value += m_coinbase_txns[i]->vout[0].nValue;
+        coins.emplace(tx.vin.back().prevout, Coin{m_coinbase_txns[i]->vout[0], static_cast<int>(i) + 1, /* fCoinBaseIn */ true});
+    }
+    tx.vout.emplace_back(input_value - 100000, coinbase_script);
+    FillableSigningProvider keystore;
+    keystore.AddKey(coinbaseKey);
+    std::map<int, std::string> input_errors;
+    BOOST_REQUIRE(SignTransaction(tx, &keystore, coins, SIGHASH_ALL, input_errors));
+
+    LOCK(cs_main);
+    CChainState& chainstate = m_node.chainman->ActiveChainstate();
+
+    // A bad signature breaks consensus rules, and is reported as such after the parallel pass.
+    CMutableTransaction bad_tx{tx};
+    bad_tx.vin.back().scriptSig = bad_tx.vin.front().scriptSig;
+    const MempoolAcceptResult bad_result{AcceptToMemoryPool(chainstate, *m_node.mempool, MakeTransactionRef(bad_tx), /* bypass_limits */ false)};
+    BOOST_CHECK(bad_result.m_result_type == MempoolAcceptResult::ResultType::INVALID);
+    BOOST_CHECK(bad_result.m_state.GetResult() == TxValidationResult::TX_CONSENSUS);
+    BOOST_CHECK_EQUAL(bad_result.m_state.GetRejectReason(), "mandatory-script-verify-flag-failed (Signature must be zero for failed CHECK(MULTI)SIG operation)");
+    BOOST_CHECK(!m_node.mempool->exists(bad_tx.GetHash()));
+
+    // A non-minimal push of a valid signature only breaks policy.
+    CMutableTransaction nonstandard_tx{tx};
+    {
+        CScript& script_sig{nonstandard_tx.vin.back().scriptSig};
+        CScript::const_iterator pc{script_sig.begin()};
+        opcodetype opcode;
+        std::vector<unsigned char> sig;
+        BOOST_REQUIRE(script_sig.GetOp(pc, opcode, sig) && pc == script_sig.end());
+        script_sig.clear();
+        script_sig.push_back(OP_PUSHDATA1);
+        script_sig.push_back(static_cast<unsigned char>(sig.size()));
+        script_sig.insert(script_sig.end(), sig.begin(), sig.end());
+    }
+    const MempoolAcceptResult nonstandard_result{AcceptToMemoryPool(chainstate, *m_node.mempool, MakeTransactionRef(nonstandard_tx), /* bypass_limits */ false)};
+    BOOST_CHECK(nonstandard_result.m_result_type == MempoolAcceptResult::ResultType::INVALID);
+    BOOST_CHECK(nonstandard_result.m_state.GetResult() == TxValidationResult::TX_NOT_STANDARD);
+    BOOST_CHECK_EQUAL(nonstandard_result.m_state.GetRejectReason(), "non-mandatory-script-verify-flag (Data push larger than necessary)");
+    BOOST_CHECK(!m_node.mempool->exists(nonstandard_tx.GetHash()));
+
+    const MempoolAcceptResult result{AcceptToMemoryPool(chainstate, *m_node.mempool, MakeTransactionRef(tx), /* bypass_limits */ false)};
+    BOOST_REQUIRE(result.m_result_type == MempoolAcceptResult::ResultType::VALID);
+
+    // The parallel pass stored the scripts' validity against the tip's flags, so a block including
+    // the transaction has nothing left to verify.
+    const unsigned int block_flags{SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_DERSIG |
+                                   SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY | SCRIPT_VERIFY_CHECKSEQUENCEVERIFY |
+                                   SCRIPT_VERIFY_TAPROOT | SCRIPT_VERIFY_NULLDUMMY};
+    const CTransaction tx_const{tx};
+    {
+        TxValidationState state;
+        PrecomputedTransactionData txdata;
+        std::vector<CScriptCheck> scriptchecks;
+        BOOST_CHECK(CheckInputScripts(tx_const, state, chainstate.CoinsTip(), block_flags, true, false, txdata, &scriptchecks));
+        BOOST_CHECK(scriptchecks.empty());
+    }
+    // Policy checks do not add to that cache.
+    {
+        TxValidationState state;
+        PrecomputedTransactionData txdata;
+        std::vector<CScriptCheck> scriptchecks;
+        BOOST_CHECK(CheckInputScripts(tx_const, state, chainstate.CoinsTip(), STANDARD_SCRIPT_VERIFY_FLAGS, true, false, txdata, &scriptchecks));
+        BOOST_CHECK_EQUAL(scriptchecks.size(), num_inputs);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
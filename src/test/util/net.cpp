@@ -8,6 +8,7 @@
 #include <net.h>
 #include <span.h>
 
+#include <variant>
 #include <vector>
 
 void ConnmanTestMsg::NodeReceiveMsgBytes(CNode& node, Span<const uint8_t> msg_bytes, bool& complete) const
@@ -33,14 +34,32 @@ void ConnmanTestMsg::NodeReceiveMsgBytes(CNode& node, Span<const uint8_t> msg_by
 bool ConnmanTestMsg::ReceiveMsgFrom(CNode& node, CSerializedNetMsg& ser_msg) const
 {
     std::vector<uint8_t> ser_msg_header;
-    node.m_serializer->prepareForTransport(ser_msg, ser_msg_header);
+    WITH_LOCK(node.cs_vSend, node.m_serializer->prepareForTransport(ser_msg, ser_msg_header));
 
     bool complete;
     NodeReceiveMsgBytes(node, ser_msg_header, complete);
-    NodeReceiveMsgBytes(node, ser_msg.data, complete);
+    NodeReceiveMsgBytes(node, ser_msg.Payload(), complete);
     return complete;
 }
 
+std::vector<uint8_t> TakeSendQueue(CNode& node)
+{
+    LOCK(node.cs_vSend);
+    std::vector<uint8_t> bytes;
+    while (!node.vSendMsg.empty()) {
+        for (const CNode::SendBuffer& buffer : node.vSendMsg) {
+            const auto* shared{std::get_if<std::shared_ptr<const std::vector<unsigned char>>>(&buffer)};
+            const auto& data{shared ? **shared : std::get<std::vector<unsigned char>>(buffer)};
+            bytes.insert(bytes.end(), data.begin(), data.end());
+        }
+        node.vSendMsg.clear();
+        node.DequeueMessage();
+    }
+    node.nSendSize = 0;
+    node.fPauseSend = false;
+    return bytes;
+}
+
 std::vector<NodeEvictionCandidate> GetRandomNodeEvictionCandidates(int n_candidates, FastRandomContext& random_context)
 {
     std::vector<NodeEvictionCandidate> candidates;
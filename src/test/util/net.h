@@ -13,7 +13,10 @@
 #include <array>
 #include <cassert>
 #include <cstring>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 struct ConnmanTestMsg : public CConnman {
     using CConnman::CConnman;
@@ -33,11 +36,50 @@ struct ConnmanTestMsg : public CConnman {
 
     void ProcessMessagesOnce(CNode& node) { m_msgproc->ProcessMessages(&node, flagInterruptMsgProc); }
 
+    bool SetSocketEventsMode(SocketEventsMode mode)
+    {
+        m_socket_events_mode = mode;
+        return InitSocketEvents();
+    }
+    void SocketEventsOnce(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+    {
+        SocketEvents(recv_set, send_set, error_set);
+    }
+    size_t SocketSendDataOnce(CNode& node) const
+    {
+        LOCK(node.cs_vSend);
+        node.m_block_serving_allowance = BLOCK_SERVING_QUANTUM;
+        return SocketSendData(node);
+    }
+
     void NodeReceiveMsgBytes(CNode& node, Span<const uint8_t> msg_bytes, bool& complete) const;
 
     bool ReceiveMsgFrom(CNode& node, CSerializedNetMsg& ser_msg) const;
+
+    void MaybeQueueV1ReconnectionOnce(CNode& node) { MaybeQueueV1Reconnection(node); }
+    size_t NumReconnections() { return WITH_LOCK(m_reconnections_mutex, return m_reconnections.size()); }
+
+    /** Run the message handler threads, as many as set by the -msghandthreads option given to Init(). */
+    void StartMessageHandlers()
+    {
+        flagInterruptMsgProc = false;
+        WITH_LOCK(mutexMsgProc, m_msgproc_wake.assign(m_msghand_threads, false));
+        for (int worker = 0; worker < m_msghand_threads; ++worker) {
+            m_message_handler_threads.emplace_back([this, worker] { ThreadMessageHandler(worker); });
+        }
+    }
+    void StopMessageHandlers()
+    {
+        WITH_LOCK(mutexMsgProc, flagInterruptMsgProc = true);
+        condMsgProc.notify_all();
+        for (std::thread& thread : m_message_handler_threads) thread.join();
+        m_message_handler_threads.clear();
+    }
 };
 
+/** Move the bytes queued for sending to a peer out of its send queue. */
+std::vector<uint8_t> TakeSendQueue(CNode& node);
+
 constexpr ServiceFlags ALL_SERVICE_FLAGS[]{
     NODE_NONE,
     NODE_NETWORK,
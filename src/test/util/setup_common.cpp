@@ -10,7 +10,11 @@
 #include <consensus/consensus.h>
 #include <consensus/params.h>
 #include <consensus/validation.h>
+#include <crypto/chacha20.h>
+#include <crypto/muhash.h>
+#include <crypto/poly1305.h>
 #include <crypto/sha256.h>
+#include <crypto/siphash.h>
 #include <init.h>
 #include <interfaces/chain.h>
 #include <miner.h>
@@ -108,6 +112,10 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName, const std::ve
     AppInitParameterInteraction(*m_node.args);
     LogInstance().StartLogging();
     SHA256AutoDetect();
+    MuHash3072AutoDetect();
+    SipHashAutoDetect();
+    ChaCha20AutoDetect();
+    Poly1305AutoDetect();
     ECC_Start();
     SetupEnvironment();
     SetupNetworking();
@@ -159,7 +167,9 @@ ChainTestingSetup::~ChainTestingSetup()
     if (m_node.scheduler) m_node.scheduler->stop();
     StopScriptCheckWorkerThreads();
     GetMainSignals().FlushBackgroundCallbacks();
+    if (m_node.block_template_builder) UnregisterValidationInterface(m_node.block_template_builder.get());
     GetMainSignals().UnregisterBackgroundSignalScheduler();
+    m_node.block_template_builder.reset();
     m_node.connman.reset();
     m_node.banman.reset();
     m_node.addrman.reset();
@@ -201,6 +211,8 @@ TestingSetup::TestingSetup(const std::string& chainName, const std::vector<const
     m_node.peerman = PeerManager::make(chainparams, *m_node.connman, *m_node.addrman,
                                        m_node.banman.get(), *m_node.scheduler, *m_node.chainman,
                                        *m_node.mempool, false);
+    m_node.block_template_builder = std::make_unique<BlockTemplateBuilder>(*m_node.chainman, *m_node.mempool, chainparams);
+    RegisterValidationInterface(m_node.block_template_builder.get());
     {
         CConnman::Options options;
         options.m_msgproc = m_node.peerman.get();
@@ -163,4 +163,50 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
         CoinsCacheSizeState::CRITICAL);
 }
 
+//! Test that coins handed to a background write stay visible until they are
+//! on disk, and that the database ends up consistent with the flushed cache.
+BOOST_AUTO_TEST_CASE(background_coins_write)
+{
+    CCoinsViewDB db{m_args.GetDataDirBase() / "background_write", /*nCacheSize*/ 1 << 20, /*fMemory*/ true, /*fWipe*/ false};
+    CCoinsViewBackgroundWriter writer{&db, db, /*async*/ true};
+    CCoinsViewCache view{&writer};
+
+    std::vector<COutPoint> outpoints;
+    for (int i{0}; i < 1000; ++i) {
+        Coin newcoin;
+        newcoin.nHeight = 1;
+        newcoin.out.nValue = 1 + InsecureRandRange(1000);
+        newcoin.out.scriptPubKey.assign((uint32_t)56, 1);
+        outpoints.emplace_back(InsecureRand256(), 0);
+        view.AddCoin(outpoints.back(), std::move(newcoin), false);
+    }
+    const uint256 first_block{InsecureRand256()};
+    view.SetBestBlock(first_block);
+    BOOST_CHECK(view.Flush());
+    BOOST_CHECK_EQUAL(view.GetCacheSize(), 0U);
+
+    // Whether or not the write has completed, every coin is still readable.
+    for (const COutPoint& outpoint : outpoints) {
+        BOOST_CHECK(view.HaveCoin(outpoint));
+    }
+    BOOST_CHECK(writer.GetBestBlock() == first_block);
+
+    // Spend a coin and flush again; this waits for the first write.
+    BOOST_CHECK(view.SpendCoin(outpoints.front()));
+    const uint256 second_block{InsecureRand256()};
+    view.SetBestBlock(second_block);
+    BOOST_CHECK(view.Flush());
+    BOOST_CHECK(!view.HaveCoin(outpoints.front()));
+
+    BOOST_CHECK(writer.Sync());
+    BOOST_CHECK(!writer.IsWriting());
+    BOOST_CHECK_EQUAL(writer.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK(db.GetBestBlock() == second_block);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    BOOST_CHECK(!db.HaveCoin(outpoints.front()));
+    for (size_t i{1}; i < outpoints.size(); ++i) {
+        BOOST_CHECK(db.HaveCoin(outpoints[i]));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
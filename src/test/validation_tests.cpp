@@ -3,13 +3,19 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <crypto/common.h>
+#include <fs.h>
 #include <net.h>
 #include <signet.h>
+#include <txmempool.h>
 #include <uint256.h>
 #include <validation.h>
 
+#include <test/util/logging.h>
 #include <test/util/setup_common.h>
 
+#include <iterator>
+
 #include <boost/test/unit_test.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(validation_tests, TestingSetup)
@@ -98,4 +104,48 @@ BOOST_AUTO_TEST_CASE(test_assumeutxo)
     BOOST_CHECK_EQUAL(out210.nChainTx, 200U);
 }
 
+BOOST_FIXTURE_TEST_CASE(mempool_dump_load, TestChain100Setup)
+{
+    CChainState& chainstate{m_node.chainman->ActiveChainstate()};
+    CTxMemPool& pool{*m_node.mempool};
+    const CScript& coinbase_script{m_coinbase_txns[0]->vout[0].scriptPubKey};
+    const CTransaction tx{CreateValidMempoolTransaction(m_coinbase_txns[0], 0, 1, coinbaseKey, coinbase_script,
+                                                        m_coinbase_txns[0]->vout[0].nValue - 10000)};
+    BOOST_REQUIRE(pool.exists(tx.GetHash()));
+    BOOST_REQUIRE(DumpMempool(pool, chainstate));
+
+    const fs::path path{gArgs.GetDataDirNet() / "mempool.dat"};
+    std::vector<unsigned char> dump;
+    {
+        fsbridge::ifstream file{path, std::ios::binary};
+        dump.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+    }
+    // Still readable by older versions, which ignore the tip hash at the end.
+    BOOST_REQUIRE(dump.size() > 8 + uint256::size());
+    BOOST_CHECK_EQUAL(ReadLE64(dump.data()), 1U);
+    const uint256 dump_tip{std::vector<unsigned char>(dump.end() - uint256::size(), dump.end())};
+    BOOST_CHECK_EQUAL(dump_tip, WITH_LOCK(cs_main, return chainstate.m_chain.Tip()->GetBlockHash()));
+
+    const auto load = [&](const std::vector<unsigned char>& bytes) {
+        pool.clear();
+        {
+            fsbridge::ofstream file{path, std::ios::binary | std::ios::trunc};
+            file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        }
+        BOOST_CHECK(LoadMempool(pool, chainstate));
+        BOOST_CHECK(pool.exists(tx.GetHash()));
+    };
+
+    // Dumped at the current tip: the signatures are verified in parallel first.
+    {
+        ASSERT_DEBUG_LOG("dumped at the current tip");
+        load(dump);
+    }
+    // Dumped by an older version, without the tip.
+    load(std::vector<unsigned char>(dump.begin(), dump.end() - uint256::size()));
+    // Dumped at an earlier tip.
+    CreateAndProcessBlock({}, coinbase_script);
+    load(dump);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
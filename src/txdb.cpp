@@ -11,6 +11,7 @@
 #include <shutdown.h>
 #include <uint256.h>
 #include <util/system.h>
+#include <util/thread.h>
 #include <util/translation.h>
 #include <util/vector.h>
 
@@ -81,6 +82,15 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, /* erase */ true);
+}
+
+bool CCoinsViewDB::WriteCoinsSnapshot(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, /* erase */ false);
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) {
+    LOCK(m_write_mutex);
     CDBBatch batch(*m_db);
     size_t count = 0;
     size_t changed = 0;
@@ -115,8 +125,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (erase) {
+            it = mapCoins.erase(it);
+        } else {
+            ++it;
+        }
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             m_db->WriteBatch(batch);
@@ -146,6 +159,124 @@ size_t CCoinsViewDB::EstimateSize() const
     return m_db->EstimateSize(DB_COIN, uint8_t(DB_COIN + 1));
 }
 
+CCoinsViewBackgroundWriter::CCoinsViewBackgroundWriter(CCoinsView* view, CCoinsViewDB& db, bool async) :
+    CCoinsViewBacked(view), m_db(db), m_async(async) { }
+
+CCoinsViewBackgroundWriter::~CCoinsViewBackgroundWriter()
+{
+    if (!Sync()) {
+        LogPrintf("%s: background coins write failed\n", __func__);
+    }
+}
+
+bool CCoinsViewBackgroundWriter::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        LOCK(m_mutex);
+        CCoinsMap::const_iterator it;
+        if (m_writing && (it = m_writing->find(outpoint)) != m_writing->end()) {
+            // A spent entry is either about to be erased from the database or
+            // was never written to it.
+            coin = it->second.coin;
+            return !coin.IsSpent();
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewBackgroundWriter::HaveCoin(const COutPoint &outpoint) const {
+    {
+        LOCK(m_mutex);
+        CCoinsMap::const_iterator it;
+        if (m_writing && (it = m_writing->find(outpoint)) != m_writing->end()) return !it->second.coin.IsSpent();
+    }
+    return base->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewBackgroundWriter::GetBestBlock() const {
+    {
+        LOCK(m_mutex);
+        if (m_in_flight || m_write_failed) return m_writing_block;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewBackgroundWriter::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (!Sync()) return false;
+    if (!m_async) return m_db.BatchWrite(mapCoins, hashBlock);
+
+    {
+        LOCK(m_mutex);
+        m_writing = std::make_unique<CCoinsMap>(std::move(mapCoins));
+        m_writing_block = hashBlock;
+        m_writing_usage = memusage::DynamicUsage(*m_writing);
+        m_in_flight = true;
+    }
+    mapCoins.clear();
+    m_thread = std::thread(&util::TraceThread, "coinsflush", [this] { ThreadWrite(); });
+    return true;
+}
+
+std::unique_ptr<CCoinsViewCursor> CCoinsViewBackgroundWriter::Cursor() const {
+    // The database is only consistent again once the write has completed.
+    WaitForWrite();
+    return base->Cursor();
+}
+
+void CCoinsViewBackgroundWriter::ThreadWrite()
+{
+    CCoinsMap* coins;
+    uint256 hash_block;
+    {
+        LOCK(m_mutex);
+        coins = m_writing.get();
+        hash_block = m_writing_block;
+    }
+    // m_writing is not modified while m_in_flight is set, so it is safe to
+    // read it here without holding m_mutex, concurrently with lookups.
+    bool ok;
+    try {
+        ok = m_db.WriteCoinsSnapshot(*coins, hash_block);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        ok = false;
+    }
+
+    LOCK(m_mutex);
+    if (ok) {
+        m_writing.reset();
+        m_writing_usage = 0;
+    } else {
+        // Keep serving the unwritten coins; the failure is reported by Sync().
+        m_write_failed = true;
+    }
+    m_in_flight = false;
+    m_write_done.notify_all();
+}
+
+void CCoinsViewBackgroundWriter::WaitForWrite() const
+{
+    WAIT_LOCK(m_mutex, lock);
+    m_write_done.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return !m_in_flight; });
+}
+
+bool CCoinsViewBackgroundWriter::Sync()
+{
+    if (m_thread.joinable()) m_thread.join();
+    return !WITH_LOCK(m_mutex, return m_write_failed);
+}
+
+bool CCoinsViewBackgroundWriter::IsWriting() const
+{
+    LOCK(m_mutex);
+    return m_in_flight;
+}
+
+size_t CCoinsViewBackgroundWriter::DynamicMemoryUsage() const
+{
+    LOCK(m_mutex);
+    return m_writing_usage;
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.GetDataDirNet() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
 }
 
@@ -186,6 +317,9 @@ public:
     void Next() override;
 
 private:
+    //! Cache the key of the record pcursor was positioned at.
+    void CacheFirstKey();
+
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
 
@@ -200,15 +334,42 @@ std::unique_ptr<CCoinsViewCursor> CCoinsViewDB::Cursor() const
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     i->pcursor->Seek(DB_COIN);
-    // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
+    i->CacheFirstKey();
+    return i;
+}
+
+std::vector<std::unique_ptr<CCoinsViewCursor>> CCoinsViewDB::Cursors(const std::vector<uint256>& start_txids) const
+{
+    CDBWrapper::Snapshot snapshot;
+    {
+        // Between flushes, the coins are those of the best block.
+        LOCK(m_write_mutex);
+        snapshot = m_db->GetSnapshot();
+    }
+    uint256 best_block;
+    if (!m_db->Read(DB_BEST_BLOCK, best_block, snapshot)) best_block.SetNull();
+
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    for (const uint256& start_txid : start_txids) {
+        auto i = std::make_unique<CCoinsViewDBCursor>(
+            const_cast<CDBWrapper&>(*m_db).NewIterator(snapshot), best_block);
+        const COutPoint start(start_txid, 0);
+        i->pcursor->Seek(CoinEntry(&start));
+        i->CacheFirstKey();
+        cursors.push_back(std::move(i));
+    }
+    return cursors;
+}
+
+void CCoinsViewDBCursor::CacheFirstKey()
+{
+    if (pcursor->Valid()) {
+        CoinEntry entry(&keyTmp.second);
+        pcursor->GetKey(entry);
+        keyTmp.first = entry.key;
     } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+        keyTmp.first = 0; // Make sure Valid() and GetKey() return false
     }
-    return i;
 }
 
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
@@ -10,9 +10,12 @@
 #include <dbwrapper.h>
 #include <chain.h>
 #include <primitives/block.h>
+#include <sync.h>
 
+#include <condition_variable>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -42,6 +45,8 @@ static const int64_t nMaxDeadpoolIndexCache = 64;
 static const int64_t nMaxCoinsDBCache = 8;
 //!Default rate of checking pow on index load
 static const int nDefaultCheckPoWRate = 100;
+//! -asynccoinsflush default
+static const bool DEFAULT_ASYNC_COINS_FLUSH = false;
 
 // Actually declared in validation.cpp; can't include because of circular dependency.
 extern RecursiveMutex cs_main;
@@ -66,12 +71,90 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     std::unique_ptr<CCoinsViewCursor> Cursor() const override;
 
+    //! Get cursors positioned at the first coin whose txid is not less than
+    //! each of start_txids in database key order. They all read the same
+    //! snapshot of the database, taken between two flushes.
+    std::vector<std::unique_ptr<CCoinsViewCursor>> Cursors(const std::vector<uint256>& start_txids) const;
+
+    //! Like BatchWrite, but leaves mapCoins untouched so that it can keep
+    //! serving reads while the write is in progress.
+    bool WriteCoinsSnapshot(CCoinsMap &mapCoins, const uint256 &hashBlock);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
 
     //! Dynamically alter the underlying leveldb cache size.
     void ResizeCache(size_t new_cache_size) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+private:
+    bool WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase);
+
+    //! Held for the whole of a flush, which may span several batches, and
+    //! possibly without cs_main (see CCoinsViewBackgroundWriter).
+    mutable Mutex m_write_mutex;
+};
+
+/**
+ * CCoinsView that sits between the in-memory coins cache and the coins
+ * database, and can move the database write of a cache flush onto a
+ * background thread.
+ *
+ * In asynchronous mode, BatchWrite() takes ownership of the flushed coins and
+ * returns immediately. A worker thread writes them to the database while this
+ * view keeps serving them to readers, so validation continues against the
+ * emptied cache above it. At most one write is in flight at a time: the next
+ * BatchWrite() or Sync() waits for it to finish. Crash consistency is provided
+ * by the head-blocks marker written by CCoinsViewDB, exactly as for a
+ * synchronous flush.
+ *
+ * In synchronous mode this is a plain pass-through.
+ */
+class CCoinsViewBackgroundWriter final : public CCoinsViewBacked
+{
+public:
+    /**
+     * @param[in] view    View to read from, which must be backed by db.
+     * @param[in] db      Database the flushed coins are written to.
+     * @param[in] async   Whether to write on a background thread.
+     */
+    CCoinsViewBackgroundWriter(CCoinsView* view, CCoinsViewDB& db, bool async);
+    ~CCoinsViewBackgroundWriter();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    std::unique_ptr<CCoinsViewCursor> Cursor() const override;
+
+    //! Wait for the in-flight write, if any. Returns false if it failed.
+    bool Sync();
+
+    //! Whether a background write is currently in progress.
+    bool IsWriting() const;
+
+    //! Memory held by coins which are still being written.
+    size_t DynamicMemoryUsage() const;
+
+private:
+    void ThreadWrite();
+    void WaitForWrite() const;
+
+    CCoinsViewDB& m_db;
+    const bool m_async;
+
+    mutable Mutex m_mutex;
+    mutable std::condition_variable m_write_done;
+
+    //! Coins handed over by the last BatchWrite(), if still unwritten. They are
+    //! read, but never modified, by the worker thread until the write completes.
+    std::unique_ptr<CCoinsMap> m_writing GUARDED_BY(m_mutex);
+    uint256 m_writing_block GUARDED_BY(m_mutex);
+    size_t m_writing_usage GUARDED_BY(m_mutex){0};
+    bool m_in_flight GUARDED_BY(m_mutex){false};
+    bool m_write_failed GUARDED_BY(m_mutex){false};
+
+    std::thread m_thread;
 };
 
 /** Access to the block database (blocks/index/) */
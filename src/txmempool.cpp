@@ -13,13 +13,17 @@
 #include <policy/settings.h>
 #include <reverse_iterator.h>
 #include <util/moneystr.h>
+#include <util/rbf.h>
 #include <util/system.h>
 #include <util/time.h>
 #include <validation.h>
 #include <validationinterface.h>
 
+#include <algorithm>
 #include <cmath>
 #include <optional>
+#include <unordered_map>
+#include <unordered_set>
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  const CAmount& _nBurnAmount, int64_t _nTime,
@@ -119,6 +123,7 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
 void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate)
 {
     AssertLockHeld(cs);
+    ++m_mutation_count;
     // For each entry in vHashesToUpdate, store the set of in-mempool, but not
     // in-vHashesToUpdate transactions, so that we don't have to recalculate
     // descendants when we come across a previously seen entry.
@@ -154,6 +159,7 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
                 if (!visited(childIter) && !setAlreadyIncluded.count(childHash)) {
                     UpdateChild(it, childIter, true);
                     UpdateParent(childIter, it, true);
+                    if (m_use_clusters) JoinClusters(it->m_cluster_id, childIter->m_cluster_id);
                 }
             }
         } // release epoch guard for UpdateForDescendants
@@ -359,8 +365,8 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
     assert(nBurnAmountWithAncestors >= 0);
 }
 
-CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator, int check_ratio)
-    : m_check_ratio(check_ratio), minerPolicyEstimator(estimator)
+CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator, int check_ratio, bool use_clusters)
+    : m_check_ratio(check_ratio), minerPolicyEstimator(estimator), m_use_clusters(use_clusters)
 {
     _clear(); //lock free clear
 }
@@ -381,6 +387,26 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+size_t MempoolStats::BucketIndex(CAmount fee, size_t vsize)
+{
+    const CAmount feerate{CFeeRate(fee, vsize).GetFeePerK()};
+    const auto it{std::upper_bound(std::begin(MEMPOOL_HISTOGRAM_FEERATES), std::end(MEMPOOL_HISTOGRAM_FEERATES), feerate)};
+    return it == std::begin(MEMPOOL_HISTOGRAM_FEERATES) ? 0 : std::distance(std::begin(MEMPOOL_HISTOGRAM_FEERATES), it) - 1;
+}
+
+std::string RemovalReasonToString(MemPoolRemovalReason r) noexcept
+{
+    switch (r) {
+        case MemPoolRemovalReason::EXPIRY: return "expiry";
+        case MemPoolRemovalReason::SIZELIMIT: return "sizelimit";
+        case MemPoolRemovalReason::REORG: return "reorg";
+        case MemPoolRemovalReason::BLOCK: return "block";
+        case MemPoolRemovalReason::CONFLICT: return "conflict";
+        case MemPoolRemovalReason::REPLACED: return "replaced";
+    }
+    assert(false);
+}
+
 void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate)
 {
     // Add to memory pool without checking anything.
@@ -421,10 +447,16 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     }
     UpdateAncestorsOf(true, newit, setAncestors);
     UpdateEntryForAncestors(newit, setAncestors);
+    if (m_use_clusters) ClusterAdd(newit);
 
     nTransactionsUpdated++;
+    ++m_mutation_count;
     totalTxSize += entry.GetTxSize();
     m_total_fee += entry.GetFee();
+    MempoolStats::FeeBucket& bucket = m_stats.fee_histogram[MempoolStats::BucketIndex(entry.GetFee(), entry.GetTxSize())];
+    ++bucket.count;
+    bucket.vsize += entry.GetTxSize();
+    bucket.fees += entry.GetFee();
     if (minerPolicyEstimator) {
         minerPolicyEstimator->processTransaction(entry, validFeeEstimate);
     }
@@ -464,10 +496,17 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 
     totalTxSize -= it->GetTxSize();
     m_total_fee -= it->GetFee();
+    MempoolStats::FeeBucket& bucket = m_stats.fee_histogram[MempoolStats::BucketIndex(it->GetFee(), it->GetTxSize())];
+    --bucket.count;
+    bucket.vsize -= it->GetTxSize();
+    bucket.fees -= it->GetFee();
+    ++m_stats.removed[static_cast<size_t>(reason)];
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(it->GetMemPoolParentsConst()) + memusage::DynamicUsage(it->GetMemPoolChildrenConst());
+    if (m_use_clusters) ClusterRemove(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
+    ++m_mutation_count;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
 }
 
@@ -624,13 +663,18 @@ void CTxMemPool::_clear()
 {
     mapTx.clear();
     mapNextTx.clear();
+    m_clusters.clear();
+    m_dirty_clusters.clear();
+    m_cluster_tails.clear();
     totalTxSize = 0;
     m_total_fee = 0;
     cachedInnerUsage = 0;
+    m_stats.fee_histogram.fill({});
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    ++m_mutation_count;
 }
 
 void CTxMemPool::clear()
@@ -766,7 +810,37 @@ void CTxMemPool::check(CChainState& active_chainstate) const
 
     assert(totalTxSize == checkTotal);
     assert(m_total_fee == check_total_fee);
+    uint64_t histogram_count{0}, histogram_vsize{0};
+    CAmount histogram_fees{0};
+    for (const MempoolStats::FeeBucket& bucket : m_stats.fee_histogram) {
+        histogram_count += bucket.count;
+        histogram_vsize += bucket.vsize;
+        histogram_fees += bucket.fees;
+    }
+    assert(histogram_count == mapTx.size());
+    assert(histogram_vsize == totalTxSize);
+    assert(histogram_fees == m_total_fee);
     assert(innerUsage == cachedInnerUsage);
+
+    if (m_use_clusters) {
+        // Every entry is in exactly one cluster, shared with its parents.
+        size_t clustered = 0;
+        for (const auto& [id, cluster] : m_clusters) {
+            assert(!cluster.txs.empty());
+            for (const CTxMemPoolEntry* entry : cluster.txs) {
+                assert(entry->m_cluster_id == id);
+            }
+            clustered += cluster.txs.size();
+            if (!m_dirty_clusters.count(id)) assert(m_cluster_tails.count({&cluster.chunks.back(), id}));
+        }
+        assert(clustered == mapTx.size());
+        assert(m_cluster_tails.size() + m_dirty_clusters.size() == m_clusters.size());
+        for (const CTxMemPoolEntry& entry : mapTx) {
+            for (const CTxMemPoolEntry& parent : entry.GetMemPoolParentsConst()) {
+                assert(parent.m_cluster_id == entry.m_cluster_id);
+            }
+        }
+    }
 }
 
 bool CTxMemPool::CompareDepthAndScore(const uint256& hasha, const uint256& hashb, bool wtxid)
@@ -850,6 +924,25 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+std::vector<TxMempoolInfo> CTxMemPool::infoForRelay(const std::vector<uint256>& txids) const
+{
+    LOCK(cs);
+    std::vector<indexed_transaction_set::const_iterator> iters;
+    iters.reserve(txids.size());
+    for (const uint256& txid : txids) {
+        const auto it = mapTx.find(txid);
+        if (it != mapTx.end()) iters.push_back(it);
+    }
+    std::sort(iters.begin(), iters.end(), DepthAndScoreComparator());
+
+    std::vector<TxMempoolInfo> ret;
+    ret.reserve(iters.size());
+    for (auto it : iters) {
+        ret.push_back(GetInfo(it));
+    }
+    return ret;
+}
+
 CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -870,6 +963,89 @@ TxMempoolInfo CTxMemPool::info(const GenTxid& gtxid) const
 
 TxMempoolInfo CTxMemPool::info(const uint256& txid) const { return info(GenTxid{false, txid}); }
 
+std::shared_ptr<const MempoolSnapshot> CTxMemPool::GetSnapshot() const
+{
+    {
+        LOCK(m_snapshot_mutex);
+        if (m_snapshot && m_snapshot->mutation_count == m_mutation_count) return m_snapshot;
+    }
+
+    auto snapshot = std::make_shared<MempoolSnapshot>();
+    {
+        LOCK(cs);
+        snapshot->mutation_count = m_mutation_count;
+        snapshot->sequence = GetSequence();
+
+        // Parents sort before their children here, so BIP125 signalling can
+        // be inherited from the already copied parent entries.
+        const auto iters = GetSortedDepthAndScore();
+        snapshot->entries.reserve(iters.size());
+        snapshot->index.reserve(iters.size());
+        for (const auto& it : iters) {
+            MempoolSnapshotEntry& e = snapshot->entries.emplace_back(CopyEntryState(*it));
+            for (const uint256& parent : e.parents) {
+                const MempoolSnapshotEntry* parent_entry = snapshot->Find(parent);
+                if (parent_entry && parent_entry->bip125_replaceable) e.bip125_replaceable = true;
+            }
+            snapshot->index.emplace(e.tx->GetHash(), snapshot->entries.size() - 1);
+        }
+    }
+
+    LOCK(m_snapshot_mutex);
+    if (!m_snapshot || m_snapshot->mutation_count < snapshot->mutation_count) m_snapshot = snapshot;
+    return snapshot;
+}
+
+MempoolSnapshotEntry CTxMemPool::CopyEntryState(const CTxMemPoolEntry& entry) const
+{
+    MempoolSnapshotEntry e;
+    e.tx = entry.GetSharedTx();
+    e.wtxid = vTxHashes[entry.vTxHashesIdx].first;
+    e.fee = entry.GetFee();
+    e.modified_fee = entry.GetModifiedFee();
+    e.burned = entry.GetBurnAmount();
+    e.vsize = entry.GetTxSize();
+    e.weight = entry.GetTxWeight();
+    e.time = entry.GetTime();
+    e.height = entry.GetHeight();
+    e.count_with_descendants = entry.GetCountWithDescendants();
+    e.size_with_descendants = entry.GetSizeWithDescendants();
+    e.mod_fees_with_descendants = entry.GetModFeesWithDescendants();
+    e.burned_with_descendants = entry.GetBurnAmountWithDescendants();
+    e.count_with_ancestors = entry.GetCountWithAncestors();
+    e.size_with_ancestors = entry.GetSizeWithAncestors();
+    e.mod_fees_with_ancestors = entry.GetModFeesWithAncestors();
+    e.burned_with_ancestors = entry.GetBurnAmountWithAncestors();
+    e.unbroadcast = m_unbroadcast_txids.count(e.tx->GetHash()) != 0;
+    e.bip125_replaceable = SignalsOptInRBF(*e.tx);
+    for (const CTxMemPoolEntry& parent : entry.GetMemPoolParentsConst()) {
+        e.parents.push_back(parent.GetTx().GetHash());
+    }
+    for (const CTxMemPoolEntry& child : entry.GetMemPoolChildrenConst()) {
+        e.children.push_back(child.GetTx().GetHash());
+    }
+    return e;
+}
+
+MempoolSnapshotEntry CTxMemPool::CopyEntry(txiter it) const
+{
+    AssertLockHeld(cs);
+    MempoolSnapshotEntry e{CopyEntryState(*it)};
+    if (!e.bip125_replaceable) {
+        setEntries ancestors;
+        uint64_t no_limit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        CalculateMemPoolAncestors(*it, ancestors, no_limit, no_limit, no_limit, no_limit, dummy, false);
+        for (txiter ancestor : ancestors) {
+            if (SignalsOptInRBF(ancestor->GetTx())) {
+                e.bip125_replaceable = true;
+                break;
+            }
+        }
+    }
+    return e;
+}
+
 void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeDelta)
 {
     {
@@ -894,7 +1070,9 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
             for (txiter descendantIt : setDescendants) {
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0, 0));
             }
+            if (m_use_clusters) MarkClusterDirty(it->m_cluster_id);
             ++nTransactionsUpdated;
+            ++m_mutation_count;
         }
     }
     LogPrintf("PrioritiseTransaction: %s feerate += %s\n", hash.ToString(), FormatMoney(nFeeDelta));
@@ -982,7 +1160,9 @@ void CCoinsViewMemPool::PackageAddTransaction(const CTransactionRef& tx)
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    // Clusters hold each entry twice: as a member and inside one chunk.
+    const size_t cluster_usage = m_use_clusters ? memusage::DynamicUsage(m_clusters) + memusage::DynamicUsage(m_cluster_tails) + 2 * sizeof(void*) * mapTx.size() : 0;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage + cluster_usage;
 }
 
 void CTxMemPool::RemoveUnbroadcastTx(const uint256& txid, const bool unchecked) {
@@ -990,6 +1170,7 @@ void CTxMemPool::RemoveUnbroadcastTx(const uint256& txid, const bool unchecked)
 
     if (m_unbroadcast_txids.erase(txid))
     {
+        ++m_mutation_count;
         LogPrint(BCLog::MEMPOOL, "Removed %i from set of unbroadcast txns%s\n", txid.GetHex(), (unchecked ? " before confirmation that txn was sent out" : ""));
     }
 }
@@ -1088,19 +1269,31 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
     while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+        CFeeRate removed;
+        setEntries stage;
+        if (m_use_clusters) {
+            // Evict the chunk that would be mined last. As the tail of its
+            // cluster's linearization it includes all of its descendants.
+            GetClusters();
+            const ClusterChunk* worst = m_cluster_tails.rbegin()->first;
+            removed = CFeeRate(worst->fee, worst->size);
+            for (const CTxMemPoolEntry* entry : worst->txs) {
+                stage.insert(mapTx.iterator_to(*entry));
+            }
+        } else {
+            indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+            removed = CFeeRate(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+            CalculateDescendants(mapTx.project<0>(it), stage);
+        }
 
         // We set the new mempool min fee to the feerate of the removed set, plus the
         // "minimum reasonable fee rate" (ie some value under which we consider txn
         // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
         // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
         removed += incrementalRelayFee;
         trackPackageRemoved(removed);
         maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
 
-        setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
@@ -1125,6 +1318,181 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
     }
 }
 
+namespace {
+
+/** Clusters up to this size get a greedy ancestor-set linearization. Larger
+ *  ones keep ancestor-count order, which is cheap and still topological. */
+constexpr size_t MAX_GREEDY_LINEARIZATION{64};
+
+/** Order the transactions of a connected component for mining. */
+std::vector<const CTxMemPoolEntry*> LinearizeComponent(std::vector<const CTxMemPoolEntry*> txs)
+{
+    std::sort(txs.begin(), txs.end(), [](const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors()) {
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        }
+        return a->GetTx().GetHash() < b->GetTx().GetHash();
+    });
+    const size_t n = txs.size();
+    if (n == 1 || n > MAX_GREEDY_LINEARIZATION) return txs;
+
+    // In-cluster ancestor sets as bitmasks over positions in txs. Parents
+    // come first in ancestor-count order, so one pass suffices.
+    std::unordered_map<const CTxMemPoolEntry*, size_t> pos;
+    for (size_t i = 0; i < n; ++i) pos.emplace(txs[i], i);
+    std::vector<uint64_t> ancestors(n);
+    for (size_t i = 0; i < n; ++i) {
+        ancestors[i] = uint64_t{1} << i;
+        for (const CTxMemPoolEntry& parent : txs[i]->GetMemPoolParentsConst()) {
+            ancestors[i] |= ancestors[pos.at(&parent)];
+        }
+    }
+
+    // Repeatedly emit the best remaining ancestor set.
+    std::vector<const CTxMemPoolEntry*> order;
+    order.reserve(n);
+    uint64_t remaining = n == 64 ? ~uint64_t{0} : (uint64_t{1} << n) - 1;
+    while (remaining) {
+        uint64_t best_set{0};
+        ClusterChunk best;
+        for (size_t i = 0; i < n; ++i) {
+            if (!((remaining >> i) & 1)) continue;
+            const uint64_t set = ancestors[i] & remaining;
+            ClusterChunk candidate;
+            for (size_t j = 0; j < n; ++j) {
+                if (!((set >> j) & 1)) continue;
+                candidate.fee += txs[j]->GetModifiedFee();
+                candidate.burned += txs[j]->GetBurnAmount();
+                candidate.size += txs[j]->GetTxSize();
+            }
+            if (best_set == 0 || CompareClusterChunk()(candidate, best)) {
+                best_set = set;
+                best = candidate;
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if ((best_set >> i) & 1) order.push_back(txs[i]);
+        }
+        remaining &= ~best_set;
+    }
+    return order;
+}
+
+/** Split a linearization into chunks of non-increasing mining score. */
+std::vector<ClusterChunk> ChunkLinearization(const std::vector<const CTxMemPoolEntry*>& order)
+{
+    std::vector<ClusterChunk> chunks;
+    for (const CTxMemPoolEntry* entry : order) {
+        chunks.emplace_back();
+        chunks.back().Add(*entry);
+        // A chunk that would be mined before its predecessor is merged into it.
+        while (chunks.size() > 1 && CompareClusterChunk()(chunks.back(), chunks[chunks.size() - 2])) {
+            ClusterChunk last = std::move(chunks.back());
+            chunks.pop_back();
+            chunks.back().Merge(std::move(last));
+        }
+    }
+    return chunks;
+}
+
+} // namespace
+
+void CTxMemPool::ClusterAdd(txiter it)
+{
+    uint64_t id = m_next_cluster_id++;
+    m_clusters[id].txs.push_back(&*it);
+    it->m_cluster_id = id;
+    m_dirty_clusters.insert(id);
+    for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+        id = JoinClusters(id, parent.m_cluster_id);
+    }
+}
+
+void CTxMemPool::ClusterRemove(txiter it)
+{
+    auto cluster_it = m_clusters.find(it->m_cluster_id);
+    assert(cluster_it != m_clusters.end());
+    std::vector<const CTxMemPoolEntry*>& txs = cluster_it->second.txs;
+    txs.erase(std::find(txs.begin(), txs.end(), &*it));
+    // The cluster may have split; LinearizeCluster sorts that out.
+    MarkClusterDirty(cluster_it->first);
+    if (txs.empty()) {
+        m_dirty_clusters.erase(cluster_it->first);
+        m_clusters.erase(cluster_it);
+    }
+}
+
+uint64_t CTxMemPool::JoinClusters(uint64_t a, uint64_t b)
+{
+    if (a == b) return a;
+    TxCluster* into = &m_clusters.at(a);
+    TxCluster* from = &m_clusters.at(b);
+    if (into->txs.size() < from->txs.size()) {
+        std::swap(a, b);
+        std::swap(into, from);
+    }
+    // Move the smaller cluster into the larger one.
+    for (const CTxMemPoolEntry* entry : from->txs) {
+        entry->m_cluster_id = a;
+    }
+    into->txs.insert(into->txs.end(), from->txs.begin(), from->txs.end());
+    MarkClusterDirty(a);
+    MarkClusterDirty(b);
+    m_clusters.erase(b);
+    m_dirty_clusters.erase(b);
+    return a;
+}
+
+void CTxMemPool::MarkClusterDirty(uint64_t id) const
+{
+    if (!m_dirty_clusters.insert(id).second) return;
+    // Clusters which are not dirty have been linearized, and are in m_cluster_tails.
+    m_cluster_tails.erase({&m_clusters.at(id).chunks.back(), id});
+}
+
+void CTxMemPool::LinearizeCluster(uint64_t id) const
+{
+    std::vector<const CTxMemPoolEntry*> members = std::move(m_clusters.at(id).txs);
+    m_clusters.erase(id);
+
+    std::unordered_set<const CTxMemPoolEntry*> unassigned(members.begin(), members.end());
+    bool reuse_id = true;
+    for (const CTxMemPoolEntry* start : members) {
+        if (!unassigned.erase(start)) continue;
+        std::vector<const CTxMemPoolEntry*> component{start};
+        for (size_t i = 0; i < component.size(); ++i) {
+            for (const CTxMemPoolEntry& parent : component[i]->GetMemPoolParentsConst()) {
+                if (unassigned.erase(&parent)) component.push_back(&parent);
+            }
+            for (const CTxMemPoolEntry& child : component[i]->GetMemPoolChildrenConst()) {
+                if (unassigned.erase(&child)) component.push_back(&child);
+            }
+        }
+
+        const uint64_t component_id = reuse_id ? id : m_next_cluster_id++;
+        reuse_id = false;
+        for (const CTxMemPoolEntry* entry : component) {
+            entry->m_cluster_id = component_id;
+        }
+        TxCluster& cluster = m_clusters[component_id];
+        cluster.txs = LinearizeComponent(std::move(component));
+        cluster.chunks = ChunkLinearization(cluster.txs);
+        m_cluster_tails.emplace(&cluster.chunks.back(), component_id);
+    }
+}
+
+const std::map<uint64_t, TxCluster>& CTxMemPool::GetClusters() const
+{
+    AssertLockHeld(cs);
+    assert(m_use_clusters);
+    while (!m_dirty_clusters.empty()) {
+        const uint64_t id = *m_dirty_clusters.begin();
+        m_dirty_clusters.erase(m_dirty_clusters.begin());
+        LinearizeCluster(id);
+    }
+    return m_clusters;
+}
+
 uint64_t CTxMemPool::CalculateDescendantMaximum(txiter entry) const {
     // find parent with highest descendant count
     std::vector<txiter> candidates;
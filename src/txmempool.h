@@ -6,11 +6,14 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <array>
 #include <atomic>
 #include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -194,6 +197,7 @@ public:
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
     mutable Epoch::Marker m_epoch_marker; //!< epoch when last touched, useful for graph algorithms
+    mutable uint64_t m_cluster_id{0}; //!< Mempool cluster this entry belongs to, if clusters are tracked
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -454,6 +458,140 @@ struct TxMempoolInfo
     CAmount burned;
 };
 
+/**
+ * Copy of a mempool entry's state, including its ancestor and descendant
+ * statistics, that holds no references back into the mempool.
+ */
+struct MempoolSnapshotEntry
+{
+    CTransactionRef tx;
+    uint256 wtxid;
+    CAmount fee;
+    CAmount modified_fee;
+    CAmount burned;
+    size_t vsize;
+    size_t weight;
+    std::chrono::seconds time;
+    unsigned int height;
+
+    uint64_t count_with_descendants;
+    uint64_t size_with_descendants;
+    CAmount mod_fees_with_descendants;
+    CAmount burned_with_descendants;
+
+    uint64_t count_with_ancestors;
+    uint64_t size_with_ancestors;
+    CAmount mod_fees_with_ancestors;
+    CAmount burned_with_ancestors;
+
+    /** Txids of the in-mempool parents and children, ordered by txid. */
+    std::vector<uint256> parents;
+    std::vector<uint256> children;
+
+    /** Whether the transaction or one of its in-mempool ancestors signals BIP125. */
+    bool bip125_replaceable;
+    /** Whether the transaction is still in the unbroadcast set. */
+    bool unbroadcast;
+};
+
+/**
+ * Immutable view of the whole mempool at one point in time.
+ *
+ * Snapshots are built by CTxMemPool::GetSnapshot() and shared between all
+ * readers until the mempool is next modified, so that RPC and REST queries
+ * can be answered without holding mempool.cs (or cs_main) while formatting
+ * their results.
+ */
+struct MempoolSnapshot
+{
+    /** CTxMemPool mutation count this snapshot reflects. */
+    uint64_t mutation_count{0};
+    /** Mempool sequence number (see CTxMemPool::GetSequence()) at the time of the snapshot. */
+    uint64_t sequence{0};
+    /** All entries, sorted by depth and score like CTxMemPool::queryHashes(). */
+    std::vector<MempoolSnapshotEntry> entries;
+    /** Position of each txid in entries. */
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> index;
+
+    /** Returns the entry for txid, or nullptr if it was not in the mempool. */
+    const MempoolSnapshotEntry* Find(const uint256& txid) const
+    {
+        auto it = index.find(txid);
+        return it == index.end() ? nullptr : &entries[it->second];
+    }
+};
+
+/** Default for -mempoolclusters */
+static const bool DEFAULT_MEMPOOL_CLUSTERS = false;
+
+/**
+ * A group of consecutive transactions from a cluster's linearization that is
+ * mined (or evicted) as a unit. The chunks of a cluster are in decreasing
+ * CompareClusterChunk order, and every chunk only depends on earlier ones.
+ */
+struct ClusterChunk
+{
+    /** Transactions in an order that is valid within a block. */
+    std::vector<const CTxMemPoolEntry*> txs;
+    CAmount fee{0};        //!< Sum of modified fees
+    CAmount burned{0};     //!< Sum of burn amounts
+    int64_t size{0};       //!< Sum of virtual sizes
+    int64_t sigop_cost{0}; //!< Sum of sigop costs
+
+    void Add(const CTxMemPoolEntry& entry)
+    {
+        txs.push_back(&entry);
+        fee += entry.GetModifiedFee();
+        burned += entry.GetBurnAmount();
+        size += entry.GetTxSize();
+        sigop_cost += entry.GetSigOpCost();
+    }
+
+    void Merge(ClusterChunk&& other)
+    {
+        txs.insert(txs.end(), other.txs.begin(), other.txs.end());
+        fee += other.fee;
+        burned += other.burned;
+        size += other.size;
+        sigop_cost += other.sigop_cost;
+    }
+};
+
+/** Mining order of chunks: burn amount first, as in
+ *  CompareTxMemPoolEntryByAncestorBurnFee, then feerate. */
+struct CompareClusterChunk
+{
+    bool operator()(const ClusterChunk& a, const ClusterChunk& b) const
+    {
+        if (a.burned != b.burned) {
+            return a.burned > b.burned;
+        }
+        // Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
+        return (double)a.fee * b.size > (double)b.fee * a.size;
+    }
+};
+
+/** Eviction order of clusters, given as (last chunk, cluster id): the cluster whose last chunk would
+ *  be mined last comes last. Of clusters with equal last chunks, the one with the lowest id does. */
+struct CompareClusterTail
+{
+    bool operator()(const std::pair<const ClusterChunk*, uint64_t>& a, const std::pair<const ClusterChunk*, uint64_t>& b) const
+    {
+        if (CompareClusterChunk()(*a.first, *b.first)) return true;
+        if (CompareClusterChunk()(*b.first, *a.first)) return false;
+        return a.second > b.second;
+    }
+};
+
+/** A connected component of the mempool's parent/child graph. */
+struct TxCluster
+{
+    /** Members of the cluster; in linearization order while chunks are up to date. */
+    std::vector<const CTxMemPoolEntry*> txs;
+    /** The linearization split into chunks. */
+    std::vector<ClusterChunk> chunks;
+};
+
 /** Reason why a transaction was removed from the mempool,
  * this is passed to the notification signal.
  */
@@ -463,8 +601,42 @@ enum class MemPoolRemovalReason {
     REORG,       //!< Removed for reorganization
     BLOCK,       //!< Removed for block
     CONFLICT,    //!< Removed for conflict with in-block transaction
-    REPLACED,    //!< Removed for replacement
+    REPLACED,    //!< Removed for replacement. Keep last, see NUM_MEMPOOL_REMOVAL_REASONS.
+};
+
+static constexpr size_t NUM_MEMPOOL_REMOVAL_REASONS{6};
+static_assert(NUM_MEMPOOL_REMOVAL_REASONS == static_cast<size_t>(MemPoolRemovalReason::REPLACED) + 1,
+              "NUM_MEMPOOL_REMOVAL_REASONS must cover every MemPoolRemovalReason");
+
+/** Lower bounds (inclusive, in sat/kvB) of the fee rate buckets kept by MempoolStats */
+static constexpr CAmount MEMPOOL_HISTOGRAM_FEERATES[] = {
+    0, 1000, 2000, 3000, 4000, 5000, 6000, 8000, 10000, 12000, 15000, 20000, 25000, 30000,
+    40000, 50000, 60000, 80000, 100000, 150000, 200000, 300000, 500000, 1000000,
 };
+static constexpr size_t NUM_MEMPOOL_HISTOGRAM_BUCKETS{std::size(MEMPOOL_HISTOGRAM_FEERATES)};
+
+/**
+ * Mempool telemetry, maintained as transactions are added and removed so that
+ * reading it does not require walking mapTx.
+ */
+struct MempoolStats
+{
+    struct FeeBucket {
+        uint64_t count{0}; //!< number of transactions in the bucket
+        uint64_t vsize{0}; //!< sum of their virtual sizes
+        CAmount fees{0};   //!< sum of their fees (NOT modified fee)
+    };
+    //! Current contents by fee rate, indexed like MEMPOOL_HISTOGRAM_FEERATES
+    std::array<FeeBucket, NUM_MEMPOOL_HISTOGRAM_BUCKETS> fee_histogram{};
+    //! Transactions removed since startup, indexed by MemPoolRemovalReason
+    std::array<uint64_t, NUM_MEMPOOL_REMOVAL_REASONS> removed{};
+    //! Transactions rejected for exceeding the ancestor or descendant limits
+    uint64_t rejected_chain_limit{0};
+
+    static size_t BucketIndex(CAmount fee, size_t vsize);
+};
+
+std::string RemovalReasonToString(MemPoolRemovalReason r) noexcept;
 
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions
@@ -549,6 +721,7 @@ protected:
     uint64_t totalTxSize GUARDED_BY(cs);      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     CAmount m_total_fee GUARDED_BY(cs);       //!< sum of all mempool tx's fees (NOT modified fee)
     uint64_t cachedInnerUsage GUARDED_BY(cs); //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+    MempoolStats m_stats GUARDED_BY(cs);
 
     mutable int64_t lastRollingFeeUpdate GUARDED_BY(cs);
     mutable bool blockSinceLastRollingFeeBump GUARDED_BY(cs);
@@ -560,10 +733,28 @@ protected:
     // is added or removed from the mempool for any reason.
     mutable uint64_t m_sequence_number GUARDED_BY(cs){1};
 
+    //! Incremented under cs whenever state visible through a MempoolSnapshot changes.
+    std::atomic<uint64_t> m_mutation_count{0};
+    //! Most recently built snapshot, shared by readers until it becomes stale.
+    mutable Mutex m_snapshot_mutex;
+    mutable std::shared_ptr<const MempoolSnapshot> m_snapshot GUARDED_BY(m_snapshot_mutex);
+
     void trackPackageRemoved(const CFeeRate& rate) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    //! Copy of an entry for a snapshot. BIP125 signalling is only that of the entry itself.
+    MempoolSnapshotEntry CopyEntryState(const CTxMemPoolEntry& entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     bool m_is_loaded GUARDED_BY(cs){false};
 
+    const bool m_use_clusters; //!< Whether TrimToSize and block assembly work on cluster chunks
+    //! Connected components of the transaction graph by id. Linearizations
+    //! are cached and recomputed on demand for the ids in m_dirty_clusters.
+    mutable std::map<uint64_t, TxCluster> m_clusters GUARDED_BY(cs);
+    mutable std::set<uint64_t> m_dirty_clusters GUARDED_BY(cs);
+    //! The last chunk of every cluster that is not in m_dirty_clusters, for TrimToSize.
+    mutable std::set<std::pair<const ClusterChunk*, uint64_t>, CompareClusterTail> m_cluster_tails GUARDED_BY(cs);
+    mutable uint64_t m_next_cluster_id GUARDED_BY(cs){1};
+
 public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
@@ -645,6 +836,17 @@ private:
 
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /** Put a newly added entry into the cluster of its in-mempool parents. */
+    void ClusterAdd(txiter it) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Drop an entry that is about to be removed from its cluster. */
+    void ClusterRemove(txiter it) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Mark a cluster's linearization as outdated, and take it out of m_cluster_tails. */
+    void MarkClusterDirty(uint64_t id) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Merge two clusters, returning the id of the result. */
+    uint64_t JoinClusters(uint64_t a, uint64_t b) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Split a dirty cluster into its connected components and linearize each of them. */
+    void LinearizeCluster(uint64_t id) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     /**
      * Track locally submitted transactions to periodically retry initial broadcast.
      */
@@ -661,8 +863,9 @@ public:
      *
      * @param[in] estimator is used to estimate appropriate transaction fees.
      * @param[in] check_ratio is the ratio used to determine how often sanity checks will run.
+     * @param[in] use_clusters makes eviction and block assembly operate on cluster chunks.
      */
-    explicit CTxMemPool(CBlockPolicyEstimator* estimator = nullptr, int check_ratio = 0);
+    explicit CTxMemPool(CBlockPolicyEstimator* estimator = nullptr, int check_ratio = 0, bool use_clusters = DEFAULT_MEMPOOL_CLUSTERS);
 
     /**
      * If sanity-checking is turned on, check makes sure the pool is
@@ -798,6 +1001,19 @@ public:
         return m_total_fee;
     }
 
+    MempoolStats GetStats() const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        AssertLockHeld(cs);
+        return m_stats;
+    }
+
+    /** Count a transaction rejected by CalculateMemPoolAncestors() limits */
+    void RecordChainLimitRejection() EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        AssertLockHeld(cs);
+        ++m_stats.rejected_chain_limit;
+    }
+
     bool exists(const GenTxid& gtxid) const
     {
         LOCK(cs);
@@ -817,6 +1033,27 @@ public:
     TxMempoolInfo info(const uint256& hash) const;
     TxMempoolInfo info(const GenTxid& gtxid) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** Info of those of the given transactions that are in the mempool, in the order they are relayed in (see CompareDepthAndScore). */
+    std::vector<TxMempoolInfo> infoForRelay(const std::vector<uint256>& txids) const;
+
+    /**
+     * Return a read-only snapshot of the mempool. If nothing changed since the
+     * last snapshot was taken it is returned without locking cs; otherwise a
+     * new one is built under cs and published for subsequent readers.
+     */
+    std::shared_ptr<const MempoolSnapshot> GetSnapshot() const LOCKS_EXCLUDED(m_snapshot_mutex);
+
+    /**
+     * Copy of a single entry, as it appears in a snapshot. Lookups of a few
+     * entries use this instead of GetSnapshot(), which copies the whole
+     * mempool after any change.
+     */
+    MempoolSnapshotEntry CopyEntry(txiter it) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** Whether the mempool groups its transactions into clusters. */
+    bool UsesClusters() const { return m_use_clusters; }
+    /** Return all clusters with up-to-date chunks. Requires UsesClusters(). */
+    const std::map<uint64_t, TxCluster>& GetClusters() const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     size_t DynamicMemoryUsage() const;
 
@@ -826,7 +1063,7 @@ public:
         LOCK(cs);
         // Sanity check the transaction is in the mempool & insert into
         // unbroadcast set.
-        if (exists(txid)) m_unbroadcast_txids.insert(txid);
+        if (exists(txid) && m_unbroadcast_txids.insert(txid).second) ++m_mutation_count;
     };
 
     /** Removes a transaction from the unbroadcast set */
@@ -5,9 +5,12 @@
 #include <txorphanage.h>
 
 #include <consensus/validation.h>
+#include <core_memusage.h>
 #include <logging.h>
+#include <memusage.h>
 #include <policy/policy.h>
 
+#include <algorithm>
 #include <cassert>
 
 /** Expiration time for orphan transactions in seconds */
@@ -30,8 +33,7 @@ bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
     // large transaction with a missing parent then we assume
     // it will rebroadcast it later, after the parent transaction(s)
     // have been mined or received.
-    // 100 orphans, each of which is at most 100,000 bytes big is
-    // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
+    // The total size of the orphans is bounded by LimitOrphans().
     unsigned int sz = GetTransactionWeight(*tx);
     if (sz > MAX_STANDARD_TX_WEIGHT)
     {
@@ -39,8 +41,17 @@ bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
         return false;
     }
 
-    auto ret = m_orphans.emplace(hash, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, m_orphan_list.size()});
+    // Count the orphan's entries in the indexes too, or orphans with many small inputs would
+    // take up much more memory than is accounted for.
+    const size_t usage = RecursiveDynamicUsage(tx) +
+        memusage::MallocUsage(sizeof(memusage::stl_tree_node<OrphanMap::value_type>)) +
+        memusage::MallocUsage(sizeof(memusage::stl_tree_node<decltype(m_wtxid_to_orphan_it)::value_type>)) +
+        sizeof(OrphanMap::iterator) +
+        tx->vin.size() * (memusage::MallocUsage(sizeof(memusage::stl_tree_node<decltype(m_outpoint_to_orphan_it)::value_type>)) +
+                          memusage::MallocUsage(sizeof(memusage::stl_tree_node<OrphanMap::iterator>)));
+    auto ret = m_orphans.emplace(hash, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, m_orphan_list.size(), usage});
     assert(ret.second);
+    m_total_usage += usage;
     m_orphan_list.push_back(ret.first);
     // Allow for lookups in the orphan pool by wtxid, as well as txid
     m_wtxid_to_orphan_it.emplace(tx->GetWitnessHash(), ret.first);
@@ -48,8 +59,8 @@ bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
         m_outpoint_to_orphan_it[txin.prevout].insert(ret.first);
     }
 
-    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
-             m_orphans.size(), m_outpoint_to_orphan_it.size());
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u usage %u)\n", hash.ToString(),
+             m_orphans.size(), m_outpoint_to_orphan_it.size(), m_total_usage);
     return true;
 }
 
@@ -80,6 +91,7 @@ int TxOrphanage::EraseTx(const uint256& txid)
     }
     m_orphan_list.pop_back();
     m_wtxid_to_orphan_it.erase(it->second.tx->GetWitnessHash());
+    m_total_usage -= it->second.usage;
 
     m_orphans.erase(it);
     return 1;
@@ -102,7 +114,7 @@ void TxOrphanage::EraseForPeer(NodeId peer)
     if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased, peer);
 }
 
-unsigned int TxOrphanage::LimitOrphans(unsigned int max_orphans)
+unsigned int TxOrphanage::LimitOrphans(unsigned int max_orphans, size_t max_usage)
 {
     AssertLockHeld(g_cs_orphans);
 
@@ -128,7 +140,7 @@ unsigned int TxOrphanage::LimitOrphans(unsigned int max_orphans)
         if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
     }
     FastRandomContext rng;
-    while (m_orphans.size() > max_orphans)
+    while (m_orphans.size() > max_orphans || m_total_usage > max_usage)
     {
         // Evict a random orphan:
         size_t randompos = rng.randrange(m_orphan_list.size());
@@ -151,6 +163,65 @@ void TxOrphanage::AddChildrenToWorkSet(const CTransaction& tx, std::set<uint256>
     }
 }
 
+std::vector<std::pair<CTransactionRef, NodeId>> TxOrphanage::TakeWorkSetPackage(std::set<uint256>& orphan_work_set, size_t max_count) const
+{
+    AssertLockHeld(g_cs_orphans);
+
+    // Collect the orphans in the work set and, transitively, their children in the orphanage.
+    std::vector<OrphanMap::const_iterator> found;
+    std::set<uint256> seen;
+    std::vector<uint256> todo(orphan_work_set.begin(), orphan_work_set.end());
+    orphan_work_set.clear();
+    while (!todo.empty()) {
+        const uint256 txid = todo.back();
+        todo.pop_back();
+        if (!seen.insert(txid).second) continue;
+        const auto it = m_orphans.find(txid);
+        if (it == m_orphans.end()) continue;
+        found.push_back(it);
+        std::set<uint256> children;
+        AddChildrenToWorkSet(*it->second.tx, children);
+        todo.insert(todo.end(), children.begin(), children.end());
+    }
+
+    // Sort them so that parents come before their children.
+    std::map<uint256, size_t> missing_parents;
+    std::map<uint256, std::vector<OrphanMap::const_iterator>> waiting_children;
+    std::vector<OrphanMap::const_iterator> ready;
+    for (const auto& it : found) {
+        std::set<uint256> parents;
+        for (const CTxIn& txin : it->second.tx->vin) {
+            const uint256& parent = txin.prevout.hash;
+            if (m_orphans.count(parent) && seen.count(parent) && parents.insert(parent).second) {
+                waiting_children[parent].push_back(it);
+            }
+        }
+        if (parents.empty()) {
+            ready.push_back(it);
+        } else {
+            missing_parents[it->first] = parents.size();
+        }
+    }
+    std::vector<std::pair<CTransactionRef, NodeId>> package;
+    package.reserve(std::min(found.size(), max_count));
+    for (size_t i = 0; i < ready.size(); ++i) {
+        if (package.size() == max_count) {
+            // Any prefix keeps parents before children. The rest is for a later call.
+            for (; i < ready.size(); ++i) orphan_work_set.insert(ready[i]->first);
+            for (const auto& [txid, count] : missing_parents) {
+                if (count > 0) orphan_work_set.insert(txid);
+            }
+            return package;
+        }
+        package.emplace_back(ready[i]->second.tx, ready[i]->second.fromPeer);
+        for (const auto& child : waiting_children[ready[i]->first]) {
+            if (--missing_parents[child->first] == 0) ready.push_back(child);
+        }
+    }
+    assert(package.size() == found.size());
+    return package;
+}
+
 bool TxOrphanage::HaveTx(const GenTxid& gtxid) const
 {
     LOCK(g_cs_orphans);
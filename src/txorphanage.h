@@ -10,6 +10,12 @@
 #include <primitives/transaction.h>
 #include <sync.h>
 
+#include <limits>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
 /** Guards orphan transactions and extra txs for compact blocks */
 extern RecursiveMutex g_cs_orphans;
 
@@ -40,25 +46,42 @@ public:
     /** Erase all orphans included in or invalidated by a new block */
     void EraseForBlock(const CBlock& block) LOCKS_EXCLUDED(::g_cs_orphans);
 
-    /** Limit the orphanage to the given maximum */
-    unsigned int LimitOrphans(unsigned int max_orphans) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+    /** Limit the orphanage to the given maximum number of transactions and memory usage in bytes */
+    unsigned int LimitOrphans(unsigned int max_orphans, size_t max_usage = std::numeric_limits<size_t>::max()) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 
     /** Add any orphans that list a particular tx as a parent into a peer's work set
      * (ie orphans that may have found their final missing parent, and so should be reconsidered for the mempool) */
     void AddChildrenToWorkSet(const CTransaction& tx, std::set<uint256>& orphan_work_set) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 
+    /** Take the orphans in a work set, along with all their descendants in the orphanage, for validation as one
+     * package. They are returned with their originating peers, parents before children. At most max_count orphans
+     * are returned, and the ones left out are put back in the work set. */
+    std::vector<std::pair<CTransactionRef, NodeId>> TakeWorkSetPackage(std::set<uint256>& orphan_work_set, size_t max_count = std::numeric_limits<size_t>::max()) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Memory usage of the orphan transactions and their index entries in bytes */
+    size_t DynamicMemoryUsage() const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
+    {
+        AssertLockHeld(g_cs_orphans);
+        return m_total_usage;
+    }
+
 protected:
     struct OrphanTx {
         CTransactionRef tx;
         NodeId fromPeer;
         int64_t nTimeExpire;
         size_t list_pos;
+        size_t usage; //!< memory usage of tx and its index entries, counted in m_total_usage
     };
 
     /** Map from txid to orphan transaction record. Limited by
-     *  -maxorphantx/DEFAULT_MAX_ORPHAN_TRANSACTIONS */
+     *  -maxorphantx/DEFAULT_MAX_ORPHAN_TRANSACTIONS and
+     *  -maxorphanpool/DEFAULT_MAX_ORPHAN_POOL_SIZE */
     std::map<uint256, OrphanTx> m_orphans GUARDED_BY(g_cs_orphans);
 
+    /** Sum of the memory usage of all orphans */
+    size_t m_total_usage GUARDED_BY(g_cs_orphans){0};
+
     using OrphanMap = decltype(m_orphans);
 
     struct IteratorComparator
@@ -10,10 +10,13 @@
 #include <random.h>
 #include <uint256.h>
 
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
+#include <util/hasher.h>
 
+#include <algorithm>
 #include <chrono>
+#include <limits>
+#include <map>
+#include <set>
 #include <unordered_map>
 #include <utility>
 
@@ -24,7 +27,6 @@ namespace {
 /** The various states a (txhash,peer) pair can be in.
  *
  * Note that CANDIDATE is split up into 3 substates (DELAYED, BEST, READY), allowing more efficient implementation.
- * Also note that the sorting order of ByTxHashView relies on the specific order of values in this enum.
  *
  * Expected behaviour is:
  *   - When first announced by a peer, the state is CANDIDATE_DELAYED until reqtime is reached.
@@ -53,32 +55,71 @@ enum class State : uint8_t {
 //! Type alias for sequence numbers.
 using SequenceNumber = uint64_t;
 
+//! Type alias for priorities.
+using Priority = uint64_t;
+
+//! Type alias for announcement handles: positions in TxRequestTracker::Impl::m_announcements.
+using AnnId = uint32_t;
+
+//! Handle value that does not refer to any announcement.
+constexpr AnnId NO_ANNOUNCEMENT = std::numeric_limits<AnnId>::max();
+
+/** Per-txhash data. There is exactly one for every txhash with announcements, and it is also the only place the
+ *  txhash itself is stored: announcements refer to it instead of carrying a copy. */
+struct TxHashEntry {
+    //! The (peer, announcement) pairs for this txhash, in no particular order.
+    std::vector<std::pair<NodeId, AnnId>> m_announcements;
+    //! The CANDIDATE_BEST or REQUESTED announcement for this txhash, if any.
+    AnnId m_selected = NO_ANNOUNCEMENT;
+    //! Number of announcements for this txhash that are not COMPLETED.
+    size_t m_non_completed = 0;
+};
+
+/** Map of interned txhashes. Its elements have stable addresses, so announcements can point into it. */
+using TxHashMap = std::unordered_map<uint256, TxHashEntry, SaltedTxidHasher>;
+
 /** An announcement. This is the data we track for each txid or wtxid that is announced to us by each peer. */
 struct Announcement {
-    /** Txid or wtxid that was announced. */
-    const uint256 m_txhash;
+    /** Txid or wtxid that was announced, and its per-txhash data. nullptr for unused slots. */
+    TxHashMap::value_type* m_txhash;
     /** For CANDIDATE_{DELAYED,BEST,READY} the reqtime; for REQUESTED the expiry. */
     std::chrono::microseconds m_time;
     /** What peer the request was from. */
-    const NodeId m_peer;
+    NodeId m_peer;
+    /** The priority of this announcement, computed once when it is created. */
+    Priority m_priority;
     /** What sequence number this announcement has. */
-    const SequenceNumber m_sequence : 59;
+    SequenceNumber m_sequence : 59;
     /** Whether the request is preferred. */
-    const bool m_preferred : 1;
+    bool m_preferred : 1;
     /** Whether this is a wtxid request. */
-    const bool m_is_wtxid : 1;
+    bool m_is_wtxid : 1;
 
     /** What state this announcement is in.
      *  This is a uint8_t instead of a State to silence a GCC warning in versions prior to 8.4 and 9.3.
      *  See https://gcc.gnu.org/bugzilla/show_bug.cgi?id=61414 */
     uint8_t m_state : 3;
 
+    /** Position of this announcement in its peer's PeerInfo::m_announcements. */
+    uint32_t m_peer_pos;
+    /** Position of this announcement in its txhash's TxHashEntry::m_announcements. */
+    uint32_t m_txhash_pos;
+
     /** Convert m_state to a State enum. */
     State GetState() const { return static_cast<State>(m_state); }
 
     /** Convert a State enum to a uint8_t and store it in m_state. */
     void SetState(State state) { m_state = static_cast<uint8_t>(state); }
 
+    /** Whether this slot holds an announcement. */
+    bool IsUsed() const { return m_txhash != nullptr; }
+
+    /** The announced txid or wtxid. */
+    const uint256& GetTxHash() const { return m_txhash->first; }
+
+    /** The data shared by all announcements of this txhash. */
+    TxHashEntry& GetEntry() const { return m_txhash->second; }
+
     /** Whether this announcement is selected. There can be at most 1 selected peer per txhash. */
     bool IsSelected() const
     {
@@ -98,15 +139,13 @@ struct Announcement {
     }
 
     /** Construct a new announcement from scratch, initially in CANDIDATE_DELAYED state. */
-    Announcement(const GenTxid& gtxid, NodeId peer, bool preferred, std::chrono::microseconds reqtime,
-        SequenceNumber sequence) :
-        m_txhash(gtxid.GetHash()), m_time(reqtime), m_peer(peer), m_sequence(sequence), m_preferred(preferred),
-        m_is_wtxid(gtxid.IsWtxid()), m_state(static_cast<uint8_t>(State::CANDIDATE_DELAYED)) {}
+    Announcement(TxHashMap::value_type* txhash, const GenTxid& gtxid, NodeId peer, bool preferred,
+        std::chrono::microseconds reqtime, SequenceNumber sequence, Priority priority) :
+        m_txhash(txhash), m_time(reqtime), m_peer(peer), m_priority(priority), m_sequence(sequence),
+        m_preferred(preferred), m_is_wtxid(gtxid.IsWtxid()), m_state(static_cast<uint8_t>(State::CANDIDATE_DELAYED)),
+        m_peer_pos(0), m_txhash_pos(0) {}
 };
 
-//! Type alias for priorities.
-using Priority = uint64_t;
-
 /** A functor with embedded salt that computes priority of an announcement.
  *
  * Higher priorities are selected first.
@@ -123,114 +162,27 @@ public:
         uint64_t low_bits = CSipHasher(m_k0, m_k1).Write(txhash.begin(), txhash.size()).Write(peer).Finalize() >> 1;
         return low_bits | uint64_t{preferred} << 63;
     }
-
-    Priority operator()(const Announcement& ann) const
-    {
-        return operator()(ann.m_txhash, ann.m_peer, ann.m_preferred);
-    }
-};
-
-// Definitions for the 3 indexes used in the main data structure.
-//
-// Each index has a By* type to identify it, a By*View data type to represent the view of announcement it is sorted
-// by, and an By*ViewExtractor type to convert an announcement into the By*View type.
-// See https://www.boost.org/doc/libs/1_58_0/libs/multi_index/doc/reference/key_extraction.html#key_extractors
-// for more information about the key extraction concept.
-
-// The ByPeer index is sorted by (peer, state == CANDIDATE_BEST, txhash)
-//
-// Uses:
-// * Looking up existing announcements by peer/txhash, by checking both (peer, false, txhash) and
-//   (peer, true, txhash).
-// * Finding all CANDIDATE_BEST announcements for a given peer in GetRequestable.
-struct ByPeer {};
-using ByPeerView = std::tuple<NodeId, bool, const uint256&>;
-struct ByPeerViewExtractor
-{
-    using result_type = ByPeerView;
-    result_type operator()(const Announcement& ann) const
-    {
-        return ByPeerView{ann.m_peer, ann.GetState() == State::CANDIDATE_BEST, ann.m_txhash};
-    }
-};
-
-// The ByTxHash index is sorted by (txhash, state, priority).
-//
-// Note: priority == 0 whenever state != CANDIDATE_READY.
-//
-// Uses:
-// * Deleting all announcements with a given txhash in ForgetTxHash.
-// * Finding the best CANDIDATE_READY to convert to CANDIDATE_BEST, when no other CANDIDATE_READY or REQUESTED
-//   announcement exists for that txhash.
-// * Determining when no more non-COMPLETED announcements for a given txhash exist, so the COMPLETED ones can be
-//   deleted.
-struct ByTxHash {};
-using ByTxHashView = std::tuple<const uint256&, State, Priority>;
-class ByTxHashViewExtractor {
-    const PriorityComputer& m_computer;
-public:
-    explicit ByTxHashViewExtractor(const PriorityComputer& computer) : m_computer(computer) {}
-    using result_type = ByTxHashView;
-    result_type operator()(const Announcement& ann) const
-    {
-        const Priority prio = (ann.GetState() == State::CANDIDATE_READY) ? m_computer(ann) : 0;
-        return ByTxHashView{ann.m_txhash, ann.GetState(), prio};
-    }
-};
-
-enum class WaitState {
-    //! Used for announcements that need efficient testing of "is their timestamp in the future?".
-    FUTURE_EVENT,
-    //! Used for announcements whose timestamp is not relevant.
-    NO_EVENT,
-    //! Used for announcements that need efficient testing of "is their timestamp in the past?".
-    PAST_EVENT,
 };
 
-WaitState GetWaitState(const Announcement& ann)
-{
-    if (ann.IsWaiting()) return WaitState::FUTURE_EVENT;
-    if (ann.IsSelectable()) return WaitState::PAST_EVENT;
-    return WaitState::NO_EVENT;
-}
+/** A point in time at which a waiting (CANDIDATE_DELAYED or REQUESTED) announcement needs attention.
+ *
+ * Events are not removed when their announcement changes; instead they are skipped if the announcement they were
+ * created for (identified by its sequence number) no longer waits for that time.
+ */
+struct TimeEvent {
+    std::chrono::microseconds m_time;
+    SequenceNumber m_sequence;
+    AnnId m_id;
 
-// The ByTime index is sorted by (wait_state, time).
-//
-// All announcements with a timestamp in the future can be found by iterating the index forward from the beginning.
-// All announcements with a timestamp in the past can be found by iterating the index backwards from the end.
-//
-// Uses:
-// * Finding CANDIDATE_DELAYED announcements whose reqtime has passed, and REQUESTED announcements whose expiry has
-//   passed.
-// * Finding CANDIDATE_READY/BEST announcements whose reqtime is in the future (when the clock time went backwards).
-struct ByTime {};
-using ByTimeView = std::pair<WaitState, std::chrono::microseconds>;
-struct ByTimeViewExtractor
-{
-    using result_type = ByTimeView;
-    result_type operator()(const Announcement& ann) const
-    {
-        return ByTimeView{GetWaitState(ann), ann.m_time};
-    }
+    //! Ordering for a min-heap on time.
+    bool operator<(const TimeEvent& other) const { return m_time > other.m_time; }
 };
 
-/** Data type for the main data structure (Announcement objects with ByPeer/ByTxHash/ByTime indexes). */
-using Index = boost::multi_index_container<
-    Announcement,
-    boost::multi_index::indexed_by<
-        boost::multi_index::ordered_unique<boost::multi_index::tag<ByPeer>, ByPeerViewExtractor>,
-        boost::multi_index::ordered_non_unique<boost::multi_index::tag<ByTxHash>, ByTxHashViewExtractor>,
-        boost::multi_index::ordered_non_unique<boost::multi_index::tag<ByTime>, ByTimeViewExtractor>
-    >
->;
-
-/** Helper type to simplify syntax of iterator types. */
-template<typename Tag>
-using Iter = typename Index::index<Tag>::type::iterator;
-
-/** Per-peer statistics object. */
+/** Per-peer data. */
 struct PeerInfo {
-    size_t m_total = 0; //!< Total number of announcements for this peer.
+    //! All announcements for this peer. The first m_best of them are the CANDIDATE_BEST ones.
+    std::vector<AnnId> m_announcements;
+    size_t m_best = 0; //!< Number of CANDIDATE_BEST announcements for this peer.
     size_t m_completed = 0; //!< Number of COMPLETED announcements for this peer.
     size_t m_requested = 0; //!< Number of REQUESTED announcements for this peer.
 };
@@ -254,32 +206,16 @@ struct TxHashInfo
     std::vector<NodeId> m_peers;
 };
 
-/** Compare two PeerInfo objects. Only used for sanity checking. */
-bool operator==(const PeerInfo& a, const PeerInfo& b)
-{
-    return std::tie(a.m_total, a.m_completed, a.m_requested) ==
-           std::tie(b.m_total, b.m_completed, b.m_requested);
-};
-
-/** (Re)compute the PeerInfo map from the index. Only used for sanity checking. */
-std::unordered_map<NodeId, PeerInfo> RecomputePeerInfo(const Index& index)
-{
-    std::unordered_map<NodeId, PeerInfo> ret;
-    for (const Announcement& ann : index) {
-        PeerInfo& info = ret[ann.m_peer];
-        ++info.m_total;
-        info.m_requested += (ann.GetState() == State::REQUESTED);
-        info.m_completed += (ann.GetState() == State::COMPLETED);
-    }
-    return ret;
-}
-
 /** Compute the TxHashInfo map. Only used for sanity checking. */
-std::map<uint256, TxHashInfo> ComputeTxHashInfo(const Index& index, const PriorityComputer& computer)
+std::map<uint256, TxHashInfo> ComputeTxHashInfo(const std::vector<Announcement>& announcements,
+    const PriorityComputer& computer)
 {
     std::map<uint256, TxHashInfo> ret;
-    for (const Announcement& ann : index) {
-        TxHashInfo& info = ret[ann.m_txhash];
+    for (const Announcement& ann : announcements) {
+        if (!ann.IsUsed()) continue;
+        // The cached priority must match a fresh computation.
+        assert(ann.m_priority == computer(ann.GetTxHash(), ann.m_peer, ann.m_preferred));
+        TxHashInfo& info = ret[ann.GetTxHash()];
         // Classify how many announcements of each state we have for this txhash.
         info.m_candidate_delayed += (ann.GetState() == State::CANDIDATE_DELAYED);
         info.m_candidate_ready += (ann.GetState() == State::CANDIDATE_READY);
@@ -287,10 +223,10 @@ std::map<uint256, TxHashInfo> ComputeTxHashInfo(const Index& index, const Priori
         info.m_requested += (ann.GetState() == State::REQUESTED);
         // And track the priority of the best CANDIDATE_READY/CANDIDATE_BEST announcements.
         if (ann.GetState() == State::CANDIDATE_BEST) {
-            info.m_priority_candidate_best = computer(ann);
+            info.m_priority_candidate_best = ann.m_priority;
         }
         if (ann.GetState() == State::CANDIDATE_READY) {
-            info.m_priority_best_candidate_ready = std::max(info.m_priority_best_candidate_ready, computer(ann));
+            info.m_priority_best_candidate_ready = std::max(info.m_priority_best_candidate_ready, ann.m_priority);
         }
         // Also keep track of which peers this txhash has an announcement for (so we can detect duplicates).
         info.m_peers.push_back(ann.m_peer);
@@ -300,12 +236,18 @@ std::map<uint256, TxHashInfo> ComputeTxHashInfo(const Index& index, const Priori
 
 GenTxid ToGenTxid(const Announcement& ann)
 {
-    return {ann.m_is_wtxid, ann.m_txhash};
+    return {ann.m_is_wtxid, ann.GetTxHash()};
 }
 
 }  // namespace
 
-/** Actual implementation for TxRequestTracker's data structure. */
+/** Actual implementation for TxRequestTracker's data structure.
+ *
+ * Announcements live in a flat array (m_announcements) whose unused slots are recycled. Each txhash is stored once,
+ * as the key of m_txhashes, together with the handles of its announcements. Each peer has an array with the handles
+ * of its announcements, with the CANDIDATE_BEST ones kept at the front. Announcements that wait for a point in time
+ * are found through a heap of TimeEvents.
+ */
 class TxRequestTracker::Impl {
     //! The current sequence number. Increases for every announcement. This is used to sort txhashes returned by
     //! GetRequestable in announcement order.
@@ -314,21 +256,68 @@ class TxRequestTracker::Impl {
     //! This tracker's priority computer.
     const PriorityComputer m_computer;
 
-    //! This tracker's main data structure. See SanityCheck() for the invariants that apply to it.
-    Index m_index;
+    //! All announcements, indexed by AnnId. See SanityCheck() for the invariants that apply to them.
+    std::vector<Announcement> m_announcements;
+
+    //! Unused slots in m_announcements.
+    std::vector<AnnId> m_free_slots;
+
+    //! Interned txhashes with their per-txhash data.
+    TxHashMap m_txhashes;
 
-    //! Map with this tracker's per-peer statistics.
+    //! Map with this tracker's per-peer data.
     std::unordered_map<NodeId, PeerInfo> m_peerinfo;
 
+    //! Heap of the times at which waiting announcements need to be looked at again.
+    std::vector<TimeEvent> m_events;
+
+    //! No CANDIDATE_READY or CANDIDATE_BEST announcement has a time after this.
+    std::chrono::microseconds m_selectable_time_bound{std::chrono::microseconds::min()};
+
 public:
     void SanityCheck() const
     {
-        // Recompute m_peerdata from m_index. This verifies the data in it as it should just be caching statistics
-        // on m_index. It also verifies the invariant that no PeerInfo announcements with m_total==0 exist.
-        assert(m_peerinfo == RecomputePeerInfo(m_index));
+        // Verify the per-peer data. This also verifies the invariant that no PeerInfo objects without
+        // announcements exist.
+        size_t peer_announcements = 0;
+        for (const auto& [peer, info] : m_peerinfo) {
+            assert(!info.m_announcements.empty());
+            size_t best = 0, completed = 0, requested = 0;
+            for (size_t pos = 0; pos < info.m_announcements.size(); ++pos) {
+                const Announcement& ann = m_announcements[info.m_announcements[pos]];
+                assert(ann.IsUsed() && ann.m_peer == peer && ann.m_peer_pos == pos);
+                // CANDIDATE_BEST announcements come first.
+                assert((ann.GetState() == State::CANDIDATE_BEST) == (pos < info.m_best));
+                best += ann.GetState() == State::CANDIDATE_BEST;
+                completed += ann.GetState() == State::COMPLETED;
+                requested += ann.GetState() == State::REQUESTED;
+            }
+            assert(best == info.m_best && completed == info.m_completed && requested == info.m_requested);
+            peer_announcements += info.m_announcements.size();
+        }
+        assert(peer_announcements == Size());
+
+        // Verify the per-txhash data.
+        size_t txhash_announcements = 0;
+        for (const auto& [txhash, entry] : m_txhashes) {
+            assert(!entry.m_announcements.empty());
+            size_t non_completed = 0;
+            AnnId selected = NO_ANNOUNCEMENT;
+            for (size_t pos = 0; pos < entry.m_announcements.size(); ++pos) {
+                const auto& [peer, id] = entry.m_announcements[pos];
+                const Announcement& ann = m_announcements[id];
+                assert(ann.IsUsed() && ann.GetTxHash() == txhash && ann.m_peer == peer && ann.m_txhash_pos == pos);
+                non_completed += ann.GetState() != State::COMPLETED;
+                if (ann.IsSelected()) selected = id;
+            }
+            assert(non_completed == entry.m_non_completed);
+            assert(selected == entry.m_selected);
+            txhash_announcements += entry.m_announcements.size();
+        }
+        assert(txhash_announcements == Size());
 
-        // Calculate per-txhash statistics from m_index, and validate invariants.
-        for (auto& item : ComputeTxHashInfo(m_index, m_computer)) {
+        // Calculate per-txhash statistics from m_announcements, and validate invariants.
+        for (auto& item : ComputeTxHashInfo(m_announcements, m_computer)) {
             TxHashInfo& info = item.second;
 
             // Cannot have only COMPLETED peer (txhash should have been forgotten already)
@@ -353,11 +342,22 @@ public:
             std::sort(info.m_peers.begin(), info.m_peers.end());
             assert(std::adjacent_find(info.m_peers.begin(), info.m_peers.end()) == info.m_peers.end());
         }
+
+        // Every waiting announcement has an event for its time.
+        std::set<AnnId> scheduled;
+        for (const TimeEvent& ev : m_events) {
+            if (IsCurrent(ev)) scheduled.insert(ev.m_id);
+        }
+        for (AnnId id = 0; id < m_announcements.size(); ++id) {
+            const Announcement& ann = m_announcements[id];
+            if (ann.IsUsed() && ann.IsWaiting()) assert(scheduled.count(id));
+        }
     }
 
     void PostGetRequestableSanityCheck(std::chrono::microseconds now) const
     {
-        for (const Announcement& ann : m_index) {
+        for (const Announcement& ann : m_announcements) {
+            if (!ann.IsUsed()) continue;
             if (ann.IsWaiting()) {
                 // REQUESTED and CANDIDATE_DELAYED must have a time in the future (they should have been converted
                 // to COMPLETED/CANDIDATE_READY respectively).
@@ -371,116 +371,186 @@ public:
     }
 
 private:
-    //! Wrapper around Index::...::erase that keeps m_peerinfo up to date.
-    template<typename Tag>
-    Iter<Tag> Erase(Iter<Tag> it)
+    //! Whether an event still refers to the time its announcement is waiting for.
+    bool IsCurrent(const TimeEvent& ev) const
+    {
+        if (ev.m_id >= m_announcements.size()) return false;
+        const Announcement& ann = m_announcements[ev.m_id];
+        return ann.IsUsed() && ann.m_sequence == ev.m_sequence && ann.IsWaiting() && ann.m_time == ev.m_time;
+    }
+
+    //! Schedule a waiting announcement to be looked at again once its time has passed.
+    void AddEvent(AnnId id)
+    {
+        // Drop outdated events once they make up the majority of the heap.
+        if (m_events.size() >= 2 * (Size() + 32)) {
+            m_events.erase(std::remove_if(m_events.begin(), m_events.end(),
+                [this](const TimeEvent& ev) { return !IsCurrent(ev); }), m_events.end());
+            std::make_heap(m_events.begin(), m_events.end());
+        }
+        const Announcement& ann = m_announcements[id];
+        m_events.push_back({ann.m_time, ann.m_sequence, id});
+        std::push_heap(m_events.begin(), m_events.end());
+    }
+
+    //! Swap two entries of a peer's announcement array.
+    void SwapPeerPositions(PeerInfo& info, size_t a, size_t b)
+    {
+        if (a == b) return;
+        std::swap(info.m_announcements[a], info.m_announcements[b]);
+        m_announcements[info.m_announcements[a]].m_peer_pos = a;
+        m_announcements[info.m_announcements[b]].m_peer_pos = b;
+    }
+
+    //! Change the state of an announcement, keeping the per-peer and per-txhash data up to date.
+    void SetState(AnnId id, State new_state)
+    {
+        Announcement& ann = m_announcements[id];
+        const State old_state = ann.GetState();
+        PeerInfo& info = m_peerinfo.find(ann.m_peer)->second;
+        TxHashEntry& entry = ann.GetEntry();
+
+        info.m_completed -= old_state == State::COMPLETED;
+        info.m_requested -= old_state == State::REQUESTED;
+        entry.m_non_completed -= old_state != State::COMPLETED;
+        if (old_state == State::CANDIDATE_BEST && new_state != State::CANDIDATE_BEST) {
+            SwapPeerPositions(info, ann.m_peer_pos, --info.m_best);
+        } else if (old_state != State::CANDIDATE_BEST && new_state == State::CANDIDATE_BEST) {
+            SwapPeerPositions(info, ann.m_peer_pos, info.m_best++);
+        }
+        if (ann.IsSelected()) entry.m_selected = NO_ANNOUNCEMENT;
+
+        ann.SetState(new_state);
+
+        info.m_completed += new_state == State::COMPLETED;
+        info.m_requested += new_state == State::REQUESTED;
+        entry.m_non_completed += new_state != State::COMPLETED;
+        if (ann.IsSelected()) entry.m_selected = id;
+        if (ann.IsWaiting()) AddEvent(id);
+    }
+
+    //! Delete an announcement, along with its txhash's entry if it was the last one for that txhash.
+    void Erase(AnnId id)
+    {
+        Announcement& ann = m_announcements[id];
+
+        auto peerit = m_peerinfo.find(ann.m_peer);
+        PeerInfo& info = peerit->second;
+        if (ann.GetState() == State::CANDIDATE_BEST) SwapPeerPositions(info, ann.m_peer_pos, --info.m_best);
+        info.m_completed -= ann.GetState() == State::COMPLETED;
+        info.m_requested -= ann.GetState() == State::REQUESTED;
+        SwapPeerPositions(info, ann.m_peer_pos, info.m_announcements.size() - 1);
+        info.m_announcements.pop_back();
+        if (info.m_announcements.empty()) m_peerinfo.erase(peerit);
+
+        TxHashEntry& entry = ann.GetEntry();
+        entry.m_non_completed -= ann.GetState() != State::COMPLETED;
+        if (entry.m_selected == id) entry.m_selected = NO_ANNOUNCEMENT;
+        if (ann.m_txhash_pos != entry.m_announcements.size() - 1) {
+            entry.m_announcements[ann.m_txhash_pos] = entry.m_announcements.back();
+            m_announcements[entry.m_announcements[ann.m_txhash_pos].second].m_txhash_pos = ann.m_txhash_pos;
+        }
+        entry.m_announcements.pop_back();
+        if (entry.m_announcements.empty()) {
+            const uint256 txhash = ann.GetTxHash();
+            m_txhashes.erase(txhash);
+        }
+
+        ann.m_txhash = nullptr;
+        m_free_slots.push_back(id);
+        if (m_free_slots.size() == m_announcements.size()) {
+            // Nothing is tracked anymore; release the slots and any outdated events.
+            m_announcements.clear();
+            m_free_slots.clear();
+            m_events.clear();
+        }
+    }
+
+    //! Delete all announcements for a txhash.
+    void EraseTxHash(TxHashMap::iterator it)
     {
-        auto peerit = m_peerinfo.find(it->m_peer);
-        peerit->second.m_completed -= it->GetState() == State::COMPLETED;
-        peerit->second.m_requested -= it->GetState() == State::REQUESTED;
-        if (--peerit->second.m_total == 0) m_peerinfo.erase(peerit);
-        return m_index.get<Tag>().erase(it);
+        // Erase() modifies (and finally deletes) the entry, so iterate over a copy.
+        const auto announcements = it->second.m_announcements;
+        for (const auto& [peer, id] : announcements) Erase(id);
     }
 
-    //! Wrapper around Index::...::modify that keeps m_peerinfo up to date.
-    template<typename Tag, typename Modifier>
-    void Modify(Iter<Tag> it, Modifier modifier)
+    //! Find the announcement for a (peer, txhash) combination.
+    AnnId Find(NodeId peer, const uint256& txhash) const
     {
-        auto peerit = m_peerinfo.find(it->m_peer);
-        peerit->second.m_completed -= it->GetState() == State::COMPLETED;
-        peerit->second.m_requested -= it->GetState() == State::REQUESTED;
-        m_index.get<Tag>().modify(it, std::move(modifier));
-        peerit->second.m_completed += it->GetState() == State::COMPLETED;
-        peerit->second.m_requested += it->GetState() == State::REQUESTED;
+        auto it = m_txhashes.find(txhash);
+        if (it == m_txhashes.end()) return NO_ANNOUNCEMENT;
+        for (const auto& [ann_peer, id] : it->second.m_announcements) {
+            if (ann_peer == peer) return id;
+        }
+        return NO_ANNOUNCEMENT;
+    }
+
+    //! Make the highest-priority CANDIDATE_READY announcement of a txhash (if any) its CANDIDATE_BEST. Must only be
+    //! called when the txhash has no IsSelected() announcement.
+    void Reselect(const TxHashEntry& entry)
+    {
+        assert(entry.m_selected == NO_ANNOUNCEMENT);
+        AnnId best = NO_ANNOUNCEMENT;
+        for (const auto& [peer, id] : entry.m_announcements) {
+            const Announcement& ann = m_announcements[id];
+            if (ann.GetState() != State::CANDIDATE_READY) continue;
+            if (best == NO_ANNOUNCEMENT || ann.m_priority > m_announcements[best].m_priority) best = id;
+        }
+        if (best != NO_ANNOUNCEMENT) SetState(best, State::CANDIDATE_BEST);
     }
 
     //! Convert a CANDIDATE_DELAYED announcement into a CANDIDATE_READY. If this makes it the new best
     //! CANDIDATE_READY (and no REQUESTED exists) and better than the CANDIDATE_BEST (if any), it becomes the new
     //! CANDIDATE_BEST.
-    void PromoteCandidateReady(Iter<ByTxHash> it)
+    void PromoteCandidateReady(AnnId id)
     {
-        assert(it != m_index.get<ByTxHash>().end());
-        assert(it->GetState() == State::CANDIDATE_DELAYED);
-        // Convert CANDIDATE_DELAYED to CANDIDATE_READY first.
-        Modify<ByTxHash>(it, [](Announcement& ann){ ann.SetState(State::CANDIDATE_READY); });
-        // The following code relies on the fact that the ByTxHash is sorted by txhash, and then by state (first
-        // _DELAYED, then _READY, then _BEST/REQUESTED). Within the _READY announcements, the best one (highest
-        // priority) comes last. Thus, if an existing _BEST exists for the same txhash that this announcement may
-        // be preferred over, it must immediately follow the newly created _READY.
-        auto it_next = std::next(it);
-        if (it_next == m_index.get<ByTxHash>().end() || it_next->m_txhash != it->m_txhash ||
-            it_next->GetState() == State::COMPLETED) {
-            // This is the new best CANDIDATE_READY, and there is no IsSelected() announcement for this txhash
-            // already.
-            Modify<ByTxHash>(it, [](Announcement& ann){ ann.SetState(State::CANDIDATE_BEST); });
-        } else if (it_next->GetState() == State::CANDIDATE_BEST) {
-            Priority priority_old = m_computer(*it_next);
-            Priority priority_new = m_computer(*it);
-            if (priority_new > priority_old) {
+        assert(m_announcements[id].GetState() == State::CANDIDATE_DELAYED);
+        SetState(id, State::CANDIDATE_READY);
+        const TxHashEntry& entry = m_announcements[id].GetEntry();
+        if (entry.m_selected == NO_ANNOUNCEMENT) {
+            // There is no IsSelected() announcement for this txhash already, so the invariants guarantee there are
+            // no other CANDIDATE_READY ones either.
+            SetState(id, State::CANDIDATE_BEST);
+        } else {
+            const AnnId old_best = entry.m_selected;
+            if (m_announcements[old_best].GetState() == State::CANDIDATE_BEST &&
+                m_announcements[id].m_priority > m_announcements[old_best].m_priority) {
                 // There is a CANDIDATE_BEST announcement already, but this one is better.
-                Modify<ByTxHash>(it_next, [](Announcement& ann){ ann.SetState(State::CANDIDATE_READY); });
-                Modify<ByTxHash>(it, [](Announcement& ann){ ann.SetState(State::CANDIDATE_BEST); });
+                SetState(old_best, State::CANDIDATE_READY);
+                SetState(id, State::CANDIDATE_BEST);
             }
         }
     }
 
     //! Change the state of an announcement to something non-IsSelected(). If it was IsSelected(), the next best
     //! announcement will be marked CANDIDATE_BEST.
-    void ChangeAndReselect(Iter<ByTxHash> it, State new_state)
+    void ChangeAndReselect(AnnId id, State new_state)
     {
         assert(new_state == State::COMPLETED || new_state == State::CANDIDATE_DELAYED);
-        assert(it != m_index.get<ByTxHash>().end());
-        if (it->IsSelected() && it != m_index.get<ByTxHash>().begin()) {
-            auto it_prev = std::prev(it);
-            // The next best CANDIDATE_READY, if any, immediately precedes the REQUESTED or CANDIDATE_BEST
-            // announcement in the ByTxHash index.
-            if (it_prev->m_txhash == it->m_txhash && it_prev->GetState() == State::CANDIDATE_READY) {
-                // If one such CANDIDATE_READY exists (for this txhash), convert it to CANDIDATE_BEST.
-                Modify<ByTxHash>(it_prev, [](Announcement& ann){ ann.SetState(State::CANDIDATE_BEST); });
-            }
-        }
-        Modify<ByTxHash>(it, [new_state](Announcement& ann){ ann.SetState(new_state); });
-    }
-
-    //! Check if 'it' is the only announcement for a given txhash that isn't COMPLETED.
-    bool IsOnlyNonCompleted(Iter<ByTxHash> it)
-    {
-        assert(it != m_index.get<ByTxHash>().end());
-        assert(it->GetState() != State::COMPLETED); // Not allowed to call this on COMPLETED announcements.
-
-        // This announcement has a predecessor that belongs to the same txhash. Due to ordering, and the
-        // fact that 'it' is not COMPLETED, its predecessor cannot be COMPLETED here.
-        if (it != m_index.get<ByTxHash>().begin() && std::prev(it)->m_txhash == it->m_txhash) return false;
-
-        // This announcement has a successor that belongs to the same txhash, and is not COMPLETED.
-        if (std::next(it) != m_index.get<ByTxHash>().end() && std::next(it)->m_txhash == it->m_txhash &&
-            std::next(it)->GetState() != State::COMPLETED) return false;
-
-        return true;
+        const bool was_selected = m_announcements[id].IsSelected();
+        SetState(id, new_state);
+        if (was_selected) Reselect(m_announcements[id].GetEntry());
     }
 
     /** Convert any announcement to a COMPLETED one. If there are no non-COMPLETED announcements left for this
      *  txhash, they are deleted. If this was a REQUESTED announcement, and there are other CANDIDATEs left, the
      *  best one is made CANDIDATE_BEST. Returns whether the announcement still exists. */
-    bool MakeCompleted(Iter<ByTxHash> it)
+    bool MakeCompleted(AnnId id)
     {
-        assert(it != m_index.get<ByTxHash>().end());
+        const Announcement& ann = m_announcements[id];
 
         // Nothing to be done if it's already COMPLETED.
-        if (it->GetState() == State::COMPLETED) return true;
+        if (ann.GetState() == State::COMPLETED) return true;
 
-        if (IsOnlyNonCompleted(it)) {
+        if (ann.GetEntry().m_non_completed == 1) {
             // This is the last non-COMPLETED announcement for this txhash. Delete all.
-            uint256 txhash = it->m_txhash;
-            do {
-                it = Erase<ByTxHash>(it);
-            } while (it != m_index.get<ByTxHash>().end() && it->m_txhash == txhash);
+            EraseTxHash(m_txhashes.find(ann.GetTxHash()));
             return false;
         }
 
-        // Mark the announcement COMPLETED, and select the next best announcement (the first CANDIDATE_READY) if
+        // Mark the announcement COMPLETED, and select the next best announcement (the best CANDIDATE_READY) if
         // needed.
-        ChangeAndReselect(it, State::COMPLETED);
+        ChangeAndReselect(id, State::COMPLETED);
 
         return true;
     }
@@ -493,102 +563,103 @@ private:
     {
         if (expired) expired->clear();
 
-        // Iterate over all CANDIDATE_DELAYED and REQUESTED from old to new, as long as they're in the past,
-        // and convert them to CANDIDATE_READY and COMPLETED respectively.
-        while (!m_index.empty()) {
-            auto it = m_index.get<ByTime>().begin();
-            if (it->GetState() == State::CANDIDATE_DELAYED && it->m_time <= now) {
-                PromoteCandidateReady(m_index.project<ByTxHash>(it));
-            } else if (it->GetState() == State::REQUESTED && it->m_time <= now) {
-                if (expired) expired->emplace_back(it->m_peer, ToGenTxid(*it));
-                MakeCompleted(m_index.project<ByTxHash>(it));
+        // Go over all events that are in the past, and convert their CANDIDATE_DELAYED and REQUESTED announcements
+        // to CANDIDATE_READY and COMPLETED respectively.
+        while (!m_events.empty() && m_events.front().m_time <= now) {
+            std::pop_heap(m_events.begin(), m_events.end());
+            const TimeEvent ev = m_events.back();
+            m_events.pop_back();
+            if (!IsCurrent(ev)) continue;
+            const Announcement& ann = m_announcements[ev.m_id];
+            if (ann.GetState() == State::CANDIDATE_DELAYED) {
+                PromoteCandidateReady(ev.m_id);
             } else {
-                break;
+                if (expired) expired->emplace_back(ann.m_peer, ToGenTxid(ann));
+                MakeCompleted(ev.m_id);
             }
         }
 
-        while (!m_index.empty()) {
-            // If time went backwards, we may need to demote CANDIDATE_BEST and CANDIDATE_READY announcements back
-            // to CANDIDATE_DELAYED. This is an unusual edge case, and unlikely to matter in production. However,
-            // it makes it much easier to specify and test TxRequestTracker::Impl's behaviour.
-            auto it = std::prev(m_index.get<ByTime>().end());
-            if (it->IsSelectable() && it->m_time > now) {
-                ChangeAndReselect(m_index.project<ByTxHash>(it), State::CANDIDATE_DELAYED);
-            } else {
-                break;
+        // If time went backwards, we may need to demote CANDIDATE_BEST and CANDIDATE_READY announcements back
+        // to CANDIDATE_DELAYED. This is an unusual edge case, and unlikely to matter in production. However,
+        // it makes it much easier to specify and test TxRequestTracker::Impl's behaviour. Announcements only become
+        // selectable at times up to the 'now' they were promoted at, so a scan is only needed if 'now' went back.
+        if (now < m_selectable_time_bound) {
+            for (AnnId id = 0; id < m_announcements.size(); ++id) {
+                const Announcement& ann = m_announcements[id];
+                if (ann.IsUsed() && ann.IsSelectable() && ann.m_time > now) {
+                    ChangeAndReselect(id, State::CANDIDATE_DELAYED);
+                }
             }
         }
+        m_selectable_time_bound = now;
     }
 
 public:
     explicit Impl(bool deterministic) :
-        m_computer(deterministic),
-        // Explicitly initialize m_index as we need to pass a reference to m_computer to ByTxHashViewExtractor.
-        m_index(boost::make_tuple(
-            boost::make_tuple(ByPeerViewExtractor(), std::less<ByPeerView>()),
-            boost::make_tuple(ByTxHashViewExtractor(m_computer), std::less<ByTxHashView>()),
-            boost::make_tuple(ByTimeViewExtractor(), std::less<ByTimeView>())
-        )) {}
-
-    // Disable copying and assigning (a default copy won't work due the stateful ByTxHashViewExtractor).
+        m_computer(deterministic) {}
+
+    // Disable copying and assigning (announcements point into m_txhashes).
     Impl(const Impl&) = delete;
     Impl& operator=(const Impl&) = delete;
 
     void DisconnectedPeer(NodeId peer)
     {
-        auto& index = m_index.get<ByPeer>();
-        auto it = index.lower_bound(ByPeerView{peer, false, uint256::ZERO});
-        while (it != index.end() && it->m_peer == peer) {
-            // Check what to continue with after this iteration. 'it' will be deleted in what follows, so we need to
-            // decide what to continue with afterwards. There are a number of cases to consider:
-            // - std::next(it) is end() or belongs to a different peer. In that case, this is the last iteration
-            //   of the loop (denote this by setting it_next to end()).
-            // - 'it' is not the only non-COMPLETED announcement for its txhash. This means it will be deleted, but
-            //   no other Announcement objects will be modified. Continue with std::next(it) if it belongs to the
-            //   same peer, but decide this ahead of time (as 'it' may change position in what follows).
-            // - 'it' is the only non-COMPLETED announcement for its txhash. This means it will be deleted along
-            //   with all other announcements for the same txhash - which may include std::next(it). However, other
-            //   than 'it', no announcements for the same peer can be affected (due to (peer, txhash) uniqueness).
-            //   In other words, the situation where std::next(it) is deleted can only occur if std::next(it)
-            //   belongs to a different peer but the same txhash as 'it'. This is covered by the first bulletpoint
-            //   already, and we'll have set it_next to end().
-            auto it_next = (std::next(it) == index.end() || std::next(it)->m_peer != peer) ? index.end() :
-                std::next(it);
+        auto it = m_peerinfo.find(peer);
+        if (it == m_peerinfo.end()) return;
+        // Iterate over a copy, as the peer's array is modified (and finally deleted) below. Making one of this
+        // peer's announcements COMPLETED may delete all announcements for its txhash, but due to (peer, txhash)
+        // uniqueness that never includes another announcement of this peer.
+        const std::vector<AnnId> announcements = it->second.m_announcements;
+        for (AnnId id : announcements) {
             // If the announcement isn't already COMPLETED, first make it COMPLETED (which will mark other
             // CANDIDATEs as CANDIDATE_BEST, or delete all of a txhash's announcements if no non-COMPLETED ones are
             // left).
-            if (MakeCompleted(m_index.project<ByTxHash>(it))) {
+            if (MakeCompleted(id)) {
                 // Then actually delete the announcement (unless it was already deleted by MakeCompleted).
-                Erase<ByPeer>(it);
+                Erase(id);
             }
-            it = it_next;
         }
     }
 
     void ForgetTxHash(const uint256& txhash)
     {
-        auto it = m_index.get<ByTxHash>().lower_bound(ByTxHashView{txhash, State::CANDIDATE_DELAYED, 0});
-        while (it != m_index.get<ByTxHash>().end() && it->m_txhash == txhash) {
-            it = Erase<ByTxHash>(it);
-        }
+        auto it = m_txhashes.find(txhash);
+        if (it != m_txhashes.end()) EraseTxHash(it);
     }
 
     void ReceivedInv(NodeId peer, const GenTxid& gtxid, bool preferred,
         std::chrono::microseconds reqtime)
     {
-        // Bail out if we already have a CANDIDATE_BEST announcement for this (txhash, peer) combination. The case
-        // where there is a non-CANDIDATE_BEST announcement already will be caught by the uniqueness property of the
-        // ByPeer index when we try to emplace the new object below.
-        if (m_index.get<ByPeer>().count(ByPeerView{peer, true, gtxid.GetHash()})) return;
+        // Bail out if we already have an announcement for this (txhash, peer) combination.
+        auto [it, inserted] = m_txhashes.try_emplace(gtxid.GetHash());
+        if (!inserted) {
+            for (const auto& [ann_peer, id] : it->second.m_announcements) {
+                if (ann_peer == peer) return;
+            }
+        }
 
-        // Try creating the announcement with CANDIDATE_DELAYED state (which will fail due to the uniqueness
-        // of the ByPeer index if a non-CANDIDATE_BEST announcement already exists with the same txhash and peer).
-        // Bail out in that case.
-        auto ret = m_index.get<ByPeer>().emplace(gtxid, peer, preferred, reqtime, m_current_sequence);
-        if (!ret.second) return;
+        // Create the announcement with CANDIDATE_DELAYED state.
+        AnnId id;
+        Announcement ann{&*it, gtxid, peer, preferred, reqtime, m_current_sequence,
+            m_computer(gtxid.GetHash(), peer, preferred)};
+        if (m_free_slots.empty()) {
+            id = m_announcements.size();
+            m_announcements.push_back(ann);
+        } else {
+            id = m_free_slots.back();
+            m_free_slots.pop_back();
+            m_announcements[id] = ann;
+        }
 
         // Update accounting metadata.
-        ++m_peerinfo[peer].m_total;
+        PeerInfo& info = m_peerinfo[peer];
+        m_announcements[id].m_peer_pos = info.m_announcements.size();
+        info.m_announcements.push_back(id);
+        TxHashEntry& entry = it->second;
+        m_announcements[id].m_txhash_pos = entry.m_announcements.size();
+        entry.m_announcements.emplace_back(peer, id);
+        ++entry.m_non_completed;
+        AddEvent(id);
         ++m_current_sequence;
     }
 
@@ -601,11 +672,12 @@ public:
 
         // Find all CANDIDATE_BEST announcements for this peer.
         std::vector<const Announcement*> selected;
-        auto it_peer = m_index.get<ByPeer>().lower_bound(ByPeerView{peer, true, uint256::ZERO});
-        while (it_peer != m_index.get<ByPeer>().end() && it_peer->m_peer == peer &&
-            it_peer->GetState() == State::CANDIDATE_BEST) {
-            selected.emplace_back(&*it_peer);
-            ++it_peer;
+        auto it = m_peerinfo.find(peer);
+        if (it != m_peerinfo.end()) {
+            selected.reserve(it->second.m_best);
+            for (size_t pos = 0; pos < it->second.m_best; ++pos) {
+                selected.emplace_back(&m_announcements[it->second.m_announcements[pos]]);
+            }
         }
 
         // Sort by sequence number.
@@ -624,16 +696,16 @@ public:
 
     void RequestedTx(NodeId peer, const uint256& txhash, std::chrono::microseconds expiry)
     {
-        auto it = m_index.get<ByPeer>().find(ByPeerView{peer, true, txhash});
-        if (it == m_index.get<ByPeer>().end()) {
+        const AnnId id = Find(peer, txhash);
+        if (id == NO_ANNOUNCEMENT) return;
+
+        if (m_announcements[id].GetState() != State::CANDIDATE_BEST) {
             // There is no CANDIDATE_BEST announcement, look for a _READY or _DELAYED instead. If the caller only
             // ever invokes RequestedTx with the values returned by GetRequestable, and no other non-const functions
             // other than ForgetTxHash and GetRequestable in between, this branch will never execute (as txhashes
             // returned by GetRequestable always correspond to CANDIDATE_BEST announcements).
-
-            it = m_index.get<ByPeer>().find(ByPeerView{peer, false, txhash});
-            if (it == m_index.get<ByPeer>().end() || (it->GetState() != State::CANDIDATE_DELAYED &&
-                                                      it->GetState() != State::CANDIDATE_READY)) {
+            if (m_announcements[id].GetState() != State::CANDIDATE_DELAYED &&
+                m_announcements[id].GetState() != State::CANDIDATE_READY) {
                 // There is no CANDIDATE announcement tracked for this peer, so we have nothing to do. Either this
                 // txhash wasn't tracked at all (and the caller should have called ReceivedInv), or it was already
                 // requested and/or completed for other reasons and this is just a superfluous RequestedTx call.
@@ -643,38 +715,32 @@ public:
             // Look for an existing CANDIDATE_BEST or REQUESTED with the same txhash. We only need to do this if the
             // found announcement had a different state than CANDIDATE_BEST. If it did, invariants guarantee that no
             // other CANDIDATE_BEST or REQUESTED can exist.
-            auto it_old = m_index.get<ByTxHash>().lower_bound(ByTxHashView{txhash, State::CANDIDATE_BEST, 0});
-            if (it_old != m_index.get<ByTxHash>().end() && it_old->m_txhash == txhash) {
-                if (it_old->GetState() == State::CANDIDATE_BEST) {
+            const AnnId id_old = m_announcements[id].GetEntry().m_selected;
+            if (id_old != NO_ANNOUNCEMENT) {
+                if (m_announcements[id_old].GetState() == State::CANDIDATE_BEST) {
                     // The data structure's invariants require that there can be at most one CANDIDATE_BEST or one
                     // REQUESTED announcement per txhash (but not both simultaneously), so we have to convert any
                     // existing CANDIDATE_BEST to another CANDIDATE_* when constructing another REQUESTED.
                     // It doesn't matter whether we pick CANDIDATE_READY or _DELAYED here, as SetTimePoint()
                     // will correct it at GetRequestable() time. If time only goes forward, it will always be
                     // _READY, so pick that to avoid extra work in SetTimePoint().
-                    Modify<ByTxHash>(it_old, [](Announcement& ann) { ann.SetState(State::CANDIDATE_READY); });
-                } else if (it_old->GetState() == State::REQUESTED) {
+                    SetState(id_old, State::CANDIDATE_READY);
+                } else {
                     // As we're no longer waiting for a response to the previous REQUESTED announcement, convert it
                     // to COMPLETED. This also helps guaranteeing progress.
-                    Modify<ByTxHash>(it_old, [](Announcement& ann) { ann.SetState(State::COMPLETED); });
+                    SetState(id_old, State::COMPLETED);
                 }
             }
         }
 
-        Modify<ByPeer>(it, [expiry](Announcement& ann) {
-            ann.SetState(State::REQUESTED);
-            ann.m_time = expiry;
-        });
+        m_announcements[id].m_time = expiry;
+        SetState(id, State::REQUESTED);
     }
 
     void ReceivedResponse(NodeId peer, const uint256& txhash)
     {
-        // We need to search the ByPeer index for both (peer, false, txhash) and (peer, true, txhash).
-        auto it = m_index.get<ByPeer>().find(ByPeerView{peer, false, txhash});
-        if (it == m_index.get<ByPeer>().end()) {
-            it = m_index.get<ByPeer>().find(ByPeerView{peer, true, txhash});
-        }
-        if (it != m_index.get<ByPeer>().end()) MakeCompleted(m_index.project<ByTxHash>(it));
+        const AnnId id = Find(peer, txhash);
+        if (id != NO_ANNOUNCEMENT) MakeCompleted(id);
     }
 
     size_t CountInFlight(NodeId peer) const
@@ -687,19 +753,21 @@ public:
     size_t CountCandidates(NodeId peer) const
     {
         auto it = m_peerinfo.find(peer);
-        if (it != m_peerinfo.end()) return it->second.m_total - it->second.m_requested - it->second.m_completed;
+        if (it != m_peerinfo.end()) {
+            return it->second.m_announcements.size() - it->second.m_requested - it->second.m_completed;
+        }
         return 0;
     }
 
     size_t Count(NodeId peer) const
     {
         auto it = m_peerinfo.find(peer);
-        if (it != m_peerinfo.end()) return it->second.m_total;
+        if (it != m_peerinfo.end()) return it->second.m_announcements.size();
         return 0;
     }
 
     //! Count how many announcements are being tracked in total across all peers and transactions.
-    size_t Size() const { return m_index.size(); }
+    size_t Size() const { return m_announcements.size() - m_free_slots.size(); }
 
     uint64_t ComputePriority(const uint256& txhash, NodeId peer, bool preferred) const
     {
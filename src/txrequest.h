@@ -88,10 +88,13 @@
  *   P-1+NP/NPh.
  *
  * Complexity:
- * - Memory usage is proportional to the total number of tracked announcements (Size()) plus the number of
- *   peers with a nonzero number of tracked announcements.
- * - CPU usage is generally logarithmic in the total number of tracked announcements, plus the number of
- *   announcements affected by an operation (amortized O(1) per announcement).
+ * - Memory usage is proportional to the largest total number of tracked announcements (Size()) since the tracker
+ *   was last empty, plus the number of peers and txhashes with a nonzero number of tracked announcements. Each
+ *   txhash is stored once, however many peers announced it.
+ * - CPU usage is generally constant for operations on a single announcement, plus linear in the number of
+ *   announcements for the same txhash when a new one has to be selected, plus logarithmic in the total number of
+ *   tracked announcements for the ones waiting for a reqtime or expiry. When the clock goes backwards,
+ *   GetRequestable is linear in the total number of tracked announcements.
  */
 class TxRequestTracker {
     // Avoid littering this header file with implementation details.
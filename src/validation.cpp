@@ -184,6 +184,13 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState& state,
                        std::vector<CScriptCheck>* pvChecks = nullptr)
                        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+static bool CheckInputScriptsMempool(const CTransaction& tx, TxValidationState& state,
+                                     const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore,
+                                     bool cacheFullScriptStore, PrecomputedTransactionData& txdata)
+                                     EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
 bool CheckFinalTx(const CBlockIndex* active_chain_tip, const CTransaction &tx, int flags)
 {
     AssertLockHeld(cs_main);
@@ -379,6 +386,10 @@ static bool IsCurrentForFeeEstimation(CChainState& active_chainstate) EXCLUSIVE_
     return true;
 }
 
+static std::vector<MempoolAcceptResult> AcceptReorgTransactions(CChainState& active_chainstate, CTxMemPool& pool,
+                                                                const std::vector<CTransactionRef>& txns)
+                                                                EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs);
+
 void CChainState::MaybeUpdateMempoolForReorg(
     DisconnectedBlockTransactions& disconnectpool,
     bool fAddToMempool)
@@ -394,20 +405,30 @@ void CChainState::MaybeUpdateMempoolForReorg(
     // Iterate disconnectpool in reverse, so that we add transactions
     // back to the mempool starting with the earliest transaction that had
     // been previously seen in a block.
-    auto it = disconnectpool.queuedTx.get<insertion_order>().rbegin();
-    while (it != disconnectpool.queuedTx.get<insertion_order>().rend()) {
-        // ignore validation errors in resurrected transactions
-        if (!fAddToMempool || (*it)->IsCoinBase() ||
-            AcceptToMemoryPool(
-                *this, *m_mempool, *it, true /* bypass_limits */).m_result_type !=
-                    MempoolAcceptResult::ResultType::VALID) {
+    std::vector<CTransactionRef> txns(disconnectpool.queuedTx.get<insertion_order>().rbegin(),
+                                      disconnectpool.queuedTx.get<insertion_order>().rend());
+    std::vector<CTransactionRef> resurrect;
+    if (fAddToMempool) {
+        std::copy_if(txns.begin(), txns.end(), std::back_inserter(resurrect),
+                     [](const CTransactionRef& tx) { return !tx->IsCoinBase(); });
+    }
+    // Parents precede their children in this order, so the whole set can be
+    // re-admitted as one batch.
+    const std::vector<MempoolAcceptResult> results = AcceptReorgTransactions(*this, *m_mempool, resurrect);
+    auto result = results.begin();
+    for (const CTransactionRef& tx : txns) {
+        bool accepted = false;
+        if (fAddToMempool && !tx->IsCoinBase()) {
+            // ignore validation errors in resurrected transactions
+            accepted = (result++)->m_result_type == MempoolAcceptResult::ResultType::VALID;
+        }
+        if (!accepted) {
             // If the transaction doesn't make it in to the mempool, remove any
             // transactions that depend on it (which would now be orphans).
-            m_mempool->removeRecursive(**it, MemPoolRemovalReason::REORG);
-        } else if (m_mempool->exists((*it)->GetHash())) {
-            vHashUpdate.push_back((*it)->GetHash());
+            m_mempool->removeRecursive(*tx, MemPoolRemovalReason::REORG);
+        } else if (m_mempool->exists(tx->GetHash())) {
+            vHashUpdate.push_back(tx->GetHash());
         }
-        ++it;
     }
     disconnectpool.queuedTx.clear();
     // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
@@ -466,7 +487,7 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, TxValidationS
     }
 
     // Call CheckInputScripts() to cache signature and script validity against current tip consensus rules.
-    return CheckInputScripts(tx, state, view, flags, /* cacheSigStore = */ true, /* cacheFullSciptStore = */ true, txdata);
+    return CheckInputScriptsMempool(tx, state, view, flags, /* cacheSigStore = */ true, /* cacheFullScriptStore = */ true, txdata);
 }
 
 namespace {
@@ -849,6 +870,7 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         // this, see https://lists.linuxfoundation.org/pipermail/bitcoin-dev/2018-November/016518.html
         if (nSize >  EXTRA_DESCENDANT_TX_SIZE_LIMIT ||
                 !m_pool.CalculateMemPoolAncestors(*entry, setAncestors, 2, m_limit_ancestor_size, m_limit_descendants + 1, m_limit_descendant_size + EXTRA_DESCENDANT_TX_SIZE_LIMIT, dummy_err_string)) {
+            m_pool.RecordChainLimitRejection();
             return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "too-long-mempool-chain", errString);
         }
     }
@@ -995,7 +1017,7 @@ bool MemPoolAccept::PolicyScriptChecks(const ATMPArgs& args, Workspace& ws, Prec
 
     // Check input scripts and signatures.
     // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-    if (!CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
+    if (!CheckInputScriptsMempool(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
         // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
         // need to turn both off, and compare against just turning off CLEANSTACK
         // to see if the failure is specifically due to witness validation.
@@ -1228,6 +1250,109 @@ MempoolAcceptResult AcceptToMemoryPool(CChainState& active_chainstate, CTxMemPoo
     return AcceptToMemoryPoolWithTime(Params(), pool, active_chainstate, tx, GetTime(), bypass_limits, test_accept);
 }
 
+/**
+ * Verify the signatures of a batch of transactions on the script check
+ * threads, storing them in the signature cache. Results are not reported:
+ * the per-transaction validation that follows repeats the checks and then
+ * mostly hits the cache. As the queue stops at the first failure, a bad
+ * transaction only means that later ones are verified serially instead.
+ *
+ * Only for transactions that are expected to be accepted, such as those of
+ * disconnected blocks or mempool.dat: scripts are run before any of the
+ * cheaper policy checks, and the coins loaded into CoinsTip() along the way
+ * are not uncached again if the transaction is then rejected.
+ */
+static void WarmSignatureCache(CChainState& active_chainstate, const CTxMemPool& pool,
+                               const std::vector<CTransactionRef>& txns)
+                               EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    if (!g_parallel_script_checks) return;
+
+    CCoinsViewMemPool view_mempool(&active_chainstate.CoinsTip(), pool);
+    for (const CTransactionRef& tx : txns) {
+        view_mempool.PackageAddTransaction(tx);
+    }
+    CCoinsViewCache view(&view_mempool);
+
+    // Referenced by the queued checks, so it must outlive control.Wait().
+    std::vector<PrecomputedTransactionData> txdata(txns.size());
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    for (size_t i = 0; i < txns.size(); ++i) {
+        const CTransaction& tx = *txns[i];
+        if (!view.HaveInputs(tx)) continue;
+        std::vector<CScriptCheck> checks;
+        TxValidationState state_dummy;
+        CheckInputScripts(tx, state_dummy, view, STANDARD_SCRIPT_VERIFY_FLAGS, /* cacheSigStore = */ true,
+                          /* cacheFullScriptStore = */ false, txdata[i], &checks);
+        control.Add(checks);
+    }
+    control.Wait();
+}
+
+/**
+ * Add a batch of transactions to the memory pool one after another, with
+ * the given acceptance times. Parents must come before their children.
+ * Equivalent to calling AcceptToMemoryPoolWithTime() for each of them,
+ * except that the coins cache is only flushed once for the whole batch.
+ */
+static std::vector<MempoolAcceptResult> AcceptTransactionBatch(CChainState& active_chainstate, CTxMemPool& pool,
+                                                               const std::vector<CTransactionRef>& txns,
+                                                               const std::vector<int64_t>& accept_times,
+                                                               bool bypass_limits)
+                                                               EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    assert(txns.size() == accept_times.size());
+    std::vector<MempoolAcceptResult> results;
+    if (txns.empty()) return results;
+    results.reserve(txns.size());
+
+    const CChainParams& chainparams = Params();
+    for (size_t i = 0; i < txns.size(); ++i) {
+        std::vector<COutPoint> coins_to_uncache;
+        MemPoolAccept::ATMPArgs args { chainparams, accept_times[i], bypass_limits, coins_to_uncache,
+                                       /* test_accept */ false, /* m_allow_bip125_replacement */ true };
+        results.push_back(MemPoolAccept(pool, active_chainstate).AcceptSingleTransaction(txns[i], args));
+        if (results.back().m_result_type != MempoolAcceptResult::ResultType::VALID) {
+            for (const COutPoint& outpoint : coins_to_uncache) {
+                active_chainstate.CoinsTip().Uncache(outpoint);
+            }
+        }
+    }
+
+    BlockValidationState state_dummy;
+    active_chainstate.FlushStateToDisk(state_dummy, FlushStateMode::PERIODIC);
+    return results;
+}
+
+/**
+ * Re-add transactions that were disconnected by a reorg to the memory pool.
+ * Parents must come before their children. Unlike calling
+ * AcceptToMemoryPool() for each of them, signatures are verified in parallel
+ * up front and the coins cache is only flushed once for the whole batch.
+ */
+static std::vector<MempoolAcceptResult> AcceptReorgTransactions(CChainState& active_chainstate, CTxMemPool& pool,
+                                                                const std::vector<CTransactionRef>& txns)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pool.cs);
+
+    WarmSignatureCache(active_chainstate, pool, txns);
+    return AcceptTransactionBatch(active_chainstate, pool, txns, std::vector<int64_t>(txns.size(), GetTime()),
+                                  /* bypass_limits */ true);
+}
+
+std::vector<MempoolAcceptResult> AcceptToMemoryPoolBatch(CChainState& active_chainstate, CTxMemPool& pool,
+                                                         const std::vector<CTransactionRef>& txns)
+{
+    AssertLockHeld(cs_main);
+    LOCK(pool.cs);
+
+    // The transactions come from peers, so they are not run through WarmSignatureCache(): each is
+    // rejected by the cheap checks first, and has the coins it loaded uncached if it fails.
+    return AcceptTransactionBatch(active_chainstate, pool, txns, std::vector<int64_t>(txns.size(), GetTime()),
+                                  /* bypass_limits */ false);
+}
+
 PackageMempoolAcceptResult ProcessNewPackage(CChainState& active_chainstate, CTxMemPool& pool,
                                                    const Package& package, bool test_accept)
 {
@@ -1345,11 +1470,13 @@ CoinsViews::CoinsViews(
     bool in_memory,
     bool should_wipe) : m_dbview(
                             gArgs.GetDataDirNet() / ldb_name, cache_size_bytes, in_memory, should_wipe),
-                        m_catcherview(&m_dbview) {}
+                        m_catcherview(&m_dbview),
+                        m_writerview(&m_catcherview, m_dbview,
+                            gArgs.GetBoolArg("-asynccoinsflush", DEFAULT_ASYNC_COINS_FLUSH)) {}
 
 void CoinsViews::InitCache()
 {
-    m_cacheview = std::make_unique<CCoinsViewCache>(&m_catcherview);
+    m_cacheview = std::make_unique<CCoinsViewCache>(&m_writerview);
 }
 
 CChainState::CChainState(CTxMemPool* mempool, BlockManager& blockman, std::optional<uint256> from_snapshot_blockhash)
@@ -1642,6 +1769,45 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState& state,
     return true;
 }
 
+/**
+ * CheckInputScripts() for mempool acceptance. Transactions with at least
+ * MEMPOOL_PARALLEL_SCRIPT_CHECK_INPUTS inputs have their inputs verified on
+ * the script-checking threads, so that a single large transaction does not
+ * hold up the calling thread for long. The queue does not report which input
+ * failed or why, so a failing transaction is verified again serially to tell
+ * consensus failures from policy ones.
+ */
+static bool CheckInputScriptsMempool(const CTransaction& tx, TxValidationState& state,
+                                     const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore,
+                                     bool cacheFullScriptStore, PrecomputedTransactionData& txdata)
+{
+    if (!g_parallel_script_checks || tx.vin.size() < MEMPOOL_PARALLEL_SCRIPT_CHECK_INPUTS) {
+        return CheckInputScripts(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata);
+    }
+
+    std::vector<CScriptCheck> checks;
+    if (!CheckInputScripts(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata, &checks)) {
+        return false;
+    }
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(checks);
+    if (!control.Wait()) {
+        if (!CheckInputScripts(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata)) {
+            return false;
+        }
+        // Only reachable if the script checks themselves are inconsistent.
+        return state.Invalid(TxValidationResult::TX_NOT_STANDARD, "script-verify-failed",
+                             "input scripts failed parallel verification only");
+    }
+    if (cacheFullScriptStore) {
+        uint256 hashCacheEntry;
+        CSHA256 hasher = g_scriptExecutionCacheHasher;
+        hasher.Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+        g_scriptExecutionCache.insert(hashCacheEntry);
+    }
+    return true;
+}
+
 bool AbortNode(BlockValidationState& state, const std::string& strMessage, const bilingual_str& userMessage)
 {
     AbortNode(strMessage, userMessage);
@@ -1754,8 +1920,6 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void StartScriptCheckWorkerThreads(int threads_num)
 {
     scriptcheckqueue.StartWorkerThreads(threads_num);
@@ -2297,14 +2461,17 @@ bool CChainState::FlushStateToDisk(
         if (nLastFlush.count() == 0) {
             nLastFlush = nNow;
         }
+        // A background write of the previous flush is still running. Opportunistic flushes would
+        // only block on it, so leave them for a later call.
+        const bool fWriting = CoinsWriter().IsWriting();
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
-        bool fCacheLarge = mode == FlushStateMode::PERIODIC && cache_state >= CoinsCacheSizeState::LARGE;
+        bool fCacheLarge = mode == FlushStateMode::PERIODIC && cache_state >= CoinsCacheSizeState::LARGE && !fWriting;
         // The cache is over the limit, we have to write now.
         bool fCacheCritical = mode == FlushStateMode::IF_NEEDED && cache_state >= CoinsCacheSizeState::CRITICAL;
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
         bool fPeriodicWrite = mode == FlushStateMode::PERIODIC && nNow > nLastWrite + DATABASE_WRITE_INTERVAL;
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
-        bool fPeriodicFlush = mode == FlushStateMode::PERIODIC && nNow > nLastFlush + DATABASE_FLUSH_INTERVAL;
+        bool fPeriodicFlush = mode == FlushStateMode::PERIODIC && nNow > nLastFlush + DATABASE_FLUSH_INTERVAL && !fWriting;
         // Combine all conditions that result in a full cache flush.
         fDoFullFlush = (mode == FlushStateMode::ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
         // Write blocks and block index to disk.
@@ -2344,6 +2511,11 @@ bool CChainState::FlushStateToDisk(
             if (fFlushForPrune) {
                 LOG_TIME_MILLIS_WITH_CATEGORY("unlink pruned files", BCLog::BENCH);
 
+                // An interrupted background coins write is replayed from block files, so
+                // it has to complete before any of them are deleted.
+                if (!CoinsWriter().Sync()) {
+                    return AbortNode(state, "Failed to write to coin database");
+                }
                 UnlinkPrunedFiles(setFilesToPrune);
             }
             nLastWrite = nNow;
@@ -2361,8 +2533,20 @@ bool CChainState::FlushStateToDisk(
             if (!CheckDiskSpace(gArgs.GetDataDirNet(), 48 * 2 * 2 * CoinsTip().GetCacheSize())) {
                 return AbortNode(state, "Disk space is too low!", _("Disk space is too low!"));
             }
-            // Flush the chainstate (which may refer to block index entries).
-            if (!CoinsTip().Flush())
+            // Flush the chainstate (which may refer to block index entries). If we are only
+            // flushing because the cache is full, keep its most recently used part in memory.
+            const int keep_percent = std::clamp<int64_t>(gArgs.GetArg("-dbcachekeep", DEFAULT_DBCACHE_KEEP), 0, MAX_DBCACHE_KEEP);
+            if (mode != FlushStateMode::ALWAYS && (fCacheLarge || fCacheCritical) && keep_percent > 0) {
+                if (!CoinsTip().PartialFlush(m_coinstip_cache_size_bytes / 100 * keep_percent))
+                    return AbortNode(state, "Failed to write to coin database");
+                LogPrint(BCLog::COINDB, "Kept %u coins (%.2fkB) in the coins cache\n",
+                    CoinsTip().GetCacheSize(), CoinsTip().DynamicMemoryUsage() / 1000.0);
+            } else if (!CoinsTip().Flush()) {
+                return AbortNode(state, "Failed to write to coin database");
+            }
+            // With -asynccoinsflush the write above may still be running; callers asking for a
+            // full flush expect it to be on disk when we return.
+            if (mode == FlushStateMode::ALWAYS && !CoinsWriter().Sync())
                 return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
             full_flush_completed = true;
@@ -4719,6 +4903,10 @@ bool CChainState::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
         // Cache sizes are unchanged, no need to continue.
         return true;
     }
+    // Resizing reopens the database, so any background write must be finished first.
+    if (!CoinsWriter().Sync()) {
+        return false;
+    }
     size_t old_coinstip_size = m_coinstip_cache_size_bytes;
     m_coinstip_cache_size_bytes = coinstip_size;
     m_coinsdb_cache_size_bytes = coinsdb_size;
@@ -4744,10 +4932,11 @@ bool CChainState::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
 }
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/** Number of transactions read from mempool.dat and validated under one lock */
+static constexpr size_t MEMPOOL_LOAD_BATCH_SIZE{500};
 
 bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function)
 {
-    const CChainParams& chainparams = Params();
     int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
     FILE* filestr{mockable_fopen_function(gArgs.GetDataDirNet() / "mempool.dat", "rb")};
     CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
@@ -4769,38 +4958,73 @@ bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mocka
         if (version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
+        // Transactions are dumped with parents before children. If the chain
+        // has not moved since the dump, their inputs are still exactly as
+        // they were then, and nearly all of them will be accepted again: it
+        // is worth verifying the signatures of each batch in parallel first.
+        // The tip of the dump is its last field, which older versions neither
+        // write nor read. In their files, these bytes are part of the
+        // unbroadcast set and will not match the tip.
+        bool same_tip = false;
+        const long data_pos{std::ftell(file.Get())};
+        if (data_pos >= 0 && std::fseek(file.Get(), -long{sizeof(uint256)}, SEEK_END) == 0) {
+            uint256 dump_tip;
+            file >> dump_tip;
+            if (std::fseek(file.Get(), data_pos, SEEK_SET) != 0) {
+                throw std::ios_base::failure("Failed to seek in mempool file");
+            }
+            LOCK(cs_main);
+            same_tip = active_chainstate.m_chain.Tip() && active_chainstate.m_chain.Tip()->GetBlockHash() == dump_tip;
+        }
+        if (same_tip) {
+            LogPrint(BCLog::MEMPOOL, "Mempool file was dumped at the current tip, verifying signatures in parallel\n");
+        }
         uint64_t num;
         file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
-            }
-            if (nTime > nNow - nExpiryTimeout) {
-                LOCK(cs_main);
-                if (AcceptToMemoryPoolWithTime(chainparams, pool, active_chainstate, tx, nTime, false /* bypass_limits */,
-                                               false /* test_accept */).m_result_type == MempoolAcceptResult::ResultType::VALID) {
-                    ++count;
+        std::vector<CTransactionRef> batch;
+        std::vector<int64_t> batch_times;
+        while (num) {
+            batch.clear();
+            batch_times.clear();
+            for (; num > 0 && batch.size() < MEMPOOL_LOAD_BATCH_SIZE; --num) {
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+
+                CAmount amountdelta = nFeeDelta;
+                if (amountdelta) {
+                    pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                }
+                if (nTime > nNow - nExpiryTimeout) {
+                    batch.push_back(std::move(tx));
+                    batch_times.push_back(nTime);
                 } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (pool.exists(tx->GetHash())) {
-                        ++already_there;
+                    ++expired;
+                }
+            }
+            {
+                LOCK2(cs_main, pool.cs);
+                if (same_tip) WarmSignatureCache(active_chainstate, pool, batch);
+                const std::vector<MempoolAcceptResult> results = AcceptTransactionBatch(active_chainstate, pool, batch, batch_times,
+                                                                                        /* bypass_limits */ false);
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    if (results[i].m_result_type == MempoolAcceptResult::ResultType::VALID) {
+                        ++count;
                     } else {
-                        ++failed;
+                        // mempool may contain the transaction already, e.g. from
+                        // wallet(s) having loaded it while we were processing
+                        // mempool transactions; consider these as valid, instead of
+                        // failed, but mark them as 'already there'
+                        if (pool.exists(batch[i]->GetHash())) {
+                            ++already_there;
+                        } else {
+                            ++failed;
+                        }
                     }
                 }
-            } else {
-                ++expired;
             }
             if (ShutdownRequested())
                 return false;
@@ -4829,19 +5053,21 @@ bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mocka
     return true;
 }
 
-bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function, bool skip_file_commit)
+bool DumpMempool(const CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function, bool skip_file_commit)
 {
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
     std::set<uint256> unbroadcast_txids;
+    uint256 tip_hash;
 
     static Mutex dump_mutex;
     LOCK(dump_mutex);
 
     {
-        LOCK(pool.cs);
+        LOCK2(cs_main, pool.cs);
+        if (active_chainstate.m_chain.Tip()) tip_hash = active_chainstate.m_chain.Tip()->GetBlockHash();
         for (const auto &i : pool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
@@ -4875,6 +5101,8 @@ bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function, bool s
         LogPrintf("Writing %d unbroadcast transactions to disk.\n", unbroadcast_txids.size());
         file << unbroadcast_txids;
 
+        file << tip_hash;
+
         if (!skip_file_commit && !FileCommit(file.Get()))
             throw std::runtime_error("FileCommit failed");
         file.fclose();
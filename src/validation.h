@@ -76,6 +76,8 @@ static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 336;
 static const int MAX_SCRIPTCHECK_THREADS = 15;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Minimum number of inputs for mempool acceptance to verify a transaction's scripts on the script-checking threads */
+static const unsigned int MEMPOOL_PARALLEL_SCRIPT_CHECK_INPUTS = 16;
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
@@ -85,6 +87,10 @@ static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
+/** Default for -dbcachekeep, percentage of the coins cache kept in memory when it is flushed for being full */
+static const int DEFAULT_DBCACHE_KEEP = 0;
+/** Maximum for -dbcachekeep */
+static const int MAX_DBCACHE_KEEP = 50;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of ::ChainActive().Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 static const signed int DEFAULT_CHECKBLOCKS = 6;
@@ -233,6 +239,17 @@ struct PackageMempoolAcceptResult
 MempoolAcceptResult AcceptToMemoryPool(CChainState& active_chainstate, CTxMemPool& pool, const CTransactionRef& tx,
                                        bool bypass_limits, bool test_accept=false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * (Try to) add several transactions to the memory pool, one after another.
+ * Parents must come before their children. Equivalent to calling
+ * AcceptToMemoryPool() for each of them, except that the coins cache is only
+ * flushed once for the whole batch.
+ * @returns a MempoolAcceptResult for each transaction, in the same order.
+ */
+std::vector<MempoolAcceptResult> AcceptToMemoryPoolBatch(CChainState& active_chainstate, CTxMemPool& pool,
+                                                         const std::vector<CTransactionRef>& txns)
+                                                         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /**
 * Atomically test acceptance of a package. If the package only contains one tx, package rules still
 * apply. Package validation does not allow BIP125 replacements, so the transaction(s) cannot spend
@@ -520,12 +537,16 @@ public:
     //! This view wraps access to the leveldb instance and handles read errors gracefully.
     CCoinsViewErrorCatcher m_catcherview GUARDED_BY(cs_main);
 
+    //! This view hands cache flushes to the database, on a background thread if
+    //! -asynccoinsflush is set.
+    CCoinsViewBackgroundWriter m_writerview GUARDED_BY(cs_main);
+
     //! This is the top layer of the cache hierarchy - it keeps as many coins in memory as
     //! can fit per the dbcache setting.
     std::unique_ptr<CCoinsViewCache> m_cacheview GUARDED_BY(cs_main);
 
-    //! This constructor initializes CCoinsViewDB and CCoinsViewErrorCatcher instances, but it
-    //! *does not* create a CCoinsViewCache instance by default. This is done separately because the
+    //! This constructor initializes CCoinsViewDB, CCoinsViewErrorCatcher and CCoinsViewBackgroundWriter
+    //! instances, but it *does not* create a CCoinsViewCache instance by default. This is done separately because the
     //! presence of the cache has implications on whether or not we're allowed to flush the cache's
     //! state to disk, which should not be done until the health of the database is verified.
     //!
@@ -677,6 +698,12 @@ public:
         return m_coins_views->m_catcherview;
     }
 
+    //! @returns A reference to the view that writes coins cache flushes to disk.
+    CCoinsViewBackgroundWriter& CoinsWriter() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        return m_coins_views->m_writerview;
+    }
+
     //! Destructs all objects related to accessing the UTXO set.
     void ResetCoinsViews() { m_coins_views.reset(); }
 
@@ -1063,8 +1090,8 @@ extern std::unique_ptr<CBlockTreeDB> pblocktree;
 
 using FopenFn = std::function<FILE*(const fs::path&, const char*)>;
 
-/** Dump the mempool to disk. */
-bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function = fsbridge::fopen, bool skip_file_commit = false);
+/** Dump the mempool to disk, along with the chain tip it is valid for. */
+bool DumpMempool(const CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function = fsbridge::fopen, bool skip_file_commit = false);
 
 /** Load the mempool from disk. */
 bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function = fsbridge::fopen);
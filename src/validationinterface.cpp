@@ -254,3 +254,12 @@ void CMainSignals::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared
     LOG_EVENT("%s: block hash=%s", __func__, block->GetHash().ToString());
     m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.NewPoWValidBlock(pindex, block); });
 }
+
+void CMainSignals::NewBlockTemplate(const std::shared_ptr<const CBlock>& block) {
+    auto event = [block, this] {
+        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.NewBlockTemplate(block); });
+    };
+    ENQUEUE_AND_LOG_EVENT(event, "%s: prev block hash=%s txs=%u", __func__,
+                          block->hashPrevBlock.ToString(),
+                          block->vtx.size());
+}
@@ -173,6 +173,14 @@ protected:
      * Notifies listeners that a block which builds directly on our current tip
      * has been received and connected to the headers tree, though not validated yet */
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block) {};
+    /**
+     * Notifies listeners that the block template changed enough to be worth
+     * switching to: it builds on a new tip, or its fees rose past
+     * -blocktemplatefeedelta. The coinbase pays to OP_TRUE.
+     *
+     * Called on a background thread.
+     */
+    virtual void NewBlockTemplate(const std::shared_ptr<const CBlock>& block) {}
     friend class CMainSignals;
 };
 
@@ -205,6 +213,7 @@ public:
     void ChainStateFlushed(const CBlockLocator &);
     void BlockChecked(const CBlock&, const BlockValidationState&);
     void NewPoWValidBlock(const CBlockIndex *, const std::shared_ptr<const CBlock>&);
+    void NewBlockTemplate(const std::shared_ptr<const CBlock>&);
 };
 
 CMainSignals& GetMainSignals();
@@ -31,9 +31,10 @@ class GetBlockTemplateLPTest(BitcoinTestFramework):
     def set_test_params(self):
         self.num_nodes = 2
         self.supports_cli = False
+        # Wake long-polls on any template fee increase
+        self.extra_args = [["-blocktemplatefeedelta=0"]] * self.num_nodes
 
     def run_test(self):
-        self.log.info("Warning: this test will take about 70 seconds in the best case. Be patient.")
         self.log.info("Test that longpollid doesn't change between successive getblocktemplate() invocations if nothing else happens")
         self.nodes[0].generate(10)
         template = self.nodes[0].getblocktemplate({'rules': ['segwit']})
@@ -74,8 +75,8 @@ class GetBlockTemplateLPTest(BitcoinTestFramework):
         fee_rate = min_relay_fee + Decimal('0.00000010') * random.randint(0,20)
         miniwallets[0].send_self_transfer(from_node=random.choice(self.nodes),
                                           fee_rate=fee_rate)
-        # after one minute, every 10 seconds the mempool is probed, so in 80 seconds it should have returned
-        thr.join(60 + 20)
+        # the template is refreshed every second while somebody is long-polling
+        thr.join(10)
         assert not thr.is_alive()
 
 if __name__ == '__main__':